@@ -0,0 +1,132 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#include "Nv12Image.h"
+#include "SyntheticMeshes.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Helpers of the benchmark drivers. Column-major matrices like GLKMatrix4.m.
+
+inline double benchmarkSeconds ()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Best time of a few runs of work, in seconds, the others being disturbed by the rest of the machine.
+inline double measureBestSeconds (int numRuns, const std::function<void ()>& work)
+{
+    double best = 1e30;
+    for (int run = 0; run < numRuns; ++run)
+    {
+        const double start = benchmarkSeconds();
+        work();
+        best = std::min(best, benchmarkSeconds() - start);
+    }
+    return best;
+}
+
+inline void makePerspective (float fovy, float aspect, float nearZ, float farZ, float m[16])
+{
+    const float cotan = 1.f / std::tan(fovy / 2.f);
+    std::fill(m, m + 16, 0.f);
+    m[0] = cotan / aspect;
+    m[5] = cotan;
+    m[10] = (farZ + nearZ) / (nearZ - farZ);
+    m[11] = -1.f;
+    m[14] = 2.f * farZ * nearZ / (nearZ - farZ);
+}
+
+inline void makeLookAt (const float eye[3], const float center[3], float m[16])
+{
+    float forward[3] = { center[0] - eye[0], center[1] - eye[1], center[2] - eye[2] };
+    float length = std::sqrt(forward[0] * forward[0] + forward[1] * forward[1] + forward[2] * forward[2]);
+    for (float& value : forward)
+        value /= length;
+
+    float side[3] = { -forward[2], 0.f, forward[0] }; // forward x (0, 1, 0)
+    length = std::sqrt(side[0] * side[0] + side[2] * side[2]);
+    side[0] /= length;
+    side[2] /= length;
+
+    const float up[3] = { side[1] * forward[2] - side[2] * forward[1],
+                          side[2] * forward[0] - side[0] * forward[2],
+                          side[0] * forward[1] - side[1] * forward[0] };
+
+    const float result[16] = {
+        side[0], up[0], -forward[0], 0.f,
+        side[1], up[1], -forward[1], 0.f,
+        side[2], up[2], -forward[2], 0.f,
+        -(side[0] * eye[0] + side[1] * eye[1] + side[2] * eye[2]),
+        -(up[0] * eye[0] + up[1] * eye[1] + up[2] * eye[2]),
+        forward[0] * eye[0] + forward[1] * eye[1] + forward[2] * eye[2],
+        1.f,
+    };
+    std::copy(result, result + 16, m);
+}
+
+inline void multiplyMatrices (const float a[16], const float b[16], float result[16])
+{
+    for (int column = 0; column < 4; ++column)
+        for (int row = 0; row < 4; ++row)
+        {
+            float sum = 0.f;
+            for (int k = 0; k < 4; ++k)
+                sum += a[k * 4 + row] * b[column * 4 + k];
+            result[column * 4 + row] = sum;
+        }
+}
+
+// A scan of several objects: a grid of spheres on the xz plane, one chunk each, in front of the
+// default camera looking down -z.
+inline std::vector<SyntheticMesh> makeSyntheticScan (int numX, int numZ, int rings, int segments)
+{
+    std::vector<SyntheticMesh> chunks;
+    for (int z = 0; z < numZ; ++z)
+        for (int x = 0; x < numX; ++x)
+            chunks.push_back(makeBumpySphere(rings, segments, 0.45f, x - 0.5f * (numX - 1), 0.f, -2.f - z));
+    return chunks;
+}
+
+// The planes of a camera texture: smooth gradients with some noise and sharp edges.
+struct SyntheticNv12Texture
+{
+    std::vector<uint8_t> luma;
+    std::vector<uint8_t> chroma;
+    Nv12Image image;
+
+    SyntheticNv12Texture (int width, int height)
+    {
+        std::mt19937 random (5);
+        luma.resize(size_t(width) * height);
+        chroma.resize(size_t(width) * ((height + 1) / 2));
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x)
+            {
+                const int edge = ((x / 64) + (y / 48)) % 2 ? 40 : 0;
+                luma[y * width + x] = uint8_t(std::min(255, 60 + (x * 120) / width + (y * 40) / height + edge + int(random() % 12)));
+            }
+        for (int y = 0; y < (height + 1) / 2; ++y)
+            for (int x = 0; x < width / 2; ++x)
+            {
+                chroma[y * width + 2 * x] = uint8_t(100 + (x * 60) / width);
+                chroma[y * width + 2 * x + 1] = uint8_t(150 - (y * 50) / height);
+            }
+
+        image.luma = luma.data();
+        image.chroma = chroma.data();
+        image.lumaBytesPerRow = width;
+        image.chromaBytesPerRow = width;
+        image.width = width;
+        image.height = height;
+    }
+};
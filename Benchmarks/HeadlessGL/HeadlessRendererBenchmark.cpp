@@ -0,0 +1,632 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+// Runs the GL code of MeshRenderer against a software GLES2 context, Mesa llvmpipe on an EGL
+// surfaceless display, to time renderer changes without a device. MeshRenderer itself is tied to
+// STMesh, GCD and CoreVideo, so only its driving code is repeated here, without the threads: the
+// chunks are prepared, uploaded, culled, drawn at their levels of detail and merged by the same
+// MeshChunkTable, over the same MeshBufferArena, RenderCommandLists and MeshShader variants.
+//
+//   HeadlessRendererBenchmark [--frames N] [--quantized]   times the upload and every rendering mode
+//   HeadlessRendererBenchmark --check                      compiles every shader variant, checks that
+//                                                          each mode and every chunk draws, and that the
+//                                                          SoftwareMeshRenderer matches it, for ctest
+
+#include "BenchmarkUtilities.h"
+#include "CustomShaders.h"
+#include "GLExtensions.h"
+#include "MeshChunkTable.h"
+#include "RenderCommandList.h"
+#include "SoftwareMeshRenderer.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+// Local functions
+namespace
+{
+
+    // Same values as MeshRenderer::RenderingMode.
+    enum RenderingMode
+    {
+        RenderingModeXRay = 0,
+        RenderingModePerVertexColor,
+        RenderingModeTextured,
+        RenderingModeLightedGray,
+        RenderingModePoints,
+        RenderingModeNumModes
+    };
+
+    // A software frame matches the GL one if at most this fraction of its pixels differ by more than
+    // this number of levels in a channel.
+    const int kMaxSoftwareColorDifference = 8;
+    const float kMaxSoftwareDifferentPixels = 0.002f;
+
+    const char* const kRenderingModeNames[RenderingModeNumModes] = { "x-ray", "vertex colors", "textured", "lighted gray", "points" };
+
+    // The variants of MeshRenderer, MeshShaderQuantizedPositions is added for quantized positions.
+    const MeshShaderKey kRenderingModeShaderKeys[RenderingModeNumModes] =
+    {
+        MeshShaderXRayLighting | MeshShaderWireframe,
+        MeshShaderVertexColors,
+        MeshShaderYCbCrTexture,
+        MeshShaderHeadlight,
+        MeshShaderHeadlight | MeshShaderPointSplats,
+    };
+
+    // An offscreen framebuffer in a GLES2 context without any window system.
+    class HeadlessContext
+    {
+    public:
+        ~HeadlessContext ()
+        {
+            if (_display == EGL_NO_DISPLAY)
+                return;
+
+            if (_context != EGL_NO_CONTEXT)
+            {
+                glDeleteFramebuffers(1, &_framebuffer);
+                glDeleteRenderbuffers(2, _renderbuffers);
+                eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+                eglDestroyContext(_display, _context);
+            }
+            eglTerminate(_display);
+        }
+
+        bool create (int width, int height)
+        {
+            const PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+                (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+            if (getPlatformDisplay == nullptr)
+                return false;
+
+            _display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            EGLint major, minor;
+            if (_display == EGL_NO_DISPLAY || !eglInitialize(_display, &major, &minor))
+            {
+                _display = EGL_NO_DISPLAY;
+                return false;
+            }
+
+            eglBindAPI(EGL_OPENGL_ES_API);
+            const EGLint contextAttributes[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+            _context = eglCreateContext(_display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttributes);
+            if (_context == EGL_NO_CONTEXT || !eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, _context))
+                return false;
+
+            glGenRenderbuffers(2, _renderbuffers);
+            glBindRenderbuffer(GL_RENDERBUFFER, _renderbuffers[0]);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8_OES, width, height);
+            glBindRenderbuffer(GL_RENDERBUFFER, _renderbuffers[1]);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, width, height);
+
+            glGenFramebuffers(1, &_framebuffer);
+            glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _renderbuffers[0]);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, _renderbuffers[1]);
+            glViewport(0, 0, width, height);
+
+            return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        }
+
+    private:
+        EGLDisplay _display = EGL_NO_DISPLAY;
+        EGLContext _context = EGL_NO_CONTEXT;
+        GLuint _framebuffer = 0;
+        GLuint _renderbuffers[2] = { 0, 0 };
+    };
+
+    // MeshRenderer without the STMesh reading, the worker threads and the texture processing: the
+    // chunks are prepared and their levels of detail built right away.
+    class HeadlessMeshRenderer
+    {
+    public:
+        struct UploadStatistics
+        {
+            double prepareSeconds = 0.0;
+            double uploadSeconds = 0.0;
+            double levelOfDetailSeconds = 0.0;
+            size_t numUploadedBytes = 0;
+        };
+
+    public:
+        explicit HeadlessMeshRenderer (bool quantizedPositions)
+        : _quantizedPositions (quantizedPositions)
+        {
+            _chunkTable.initializeGL();
+            for (int mode = 0; mode < RenderingModeNumModes; ++mode)
+                _shaders.push_back(MeshShader(kRenderingModeShaderKeys[mode] | (quantizedPositions ? MeshShaderKey(MeshShaderQuantizedPositions) : 0)));
+        }
+
+        ~HeadlessMeshRenderer ()
+        {
+            _chunkTable.deleteBuffers();
+            glDeleteTextures(2, _textures);
+        }
+
+        void setLevelOfDetailViewport (float viewportHeightInPixels)
+        {
+            _chunkTable.setLevelOfDetailViewport(viewportHeightInPixels, 1.f);
+        }
+
+        UploadStatistics uploadMesh (const std::vector<SyntheticMesh>& meshes, const Nv12Image& texture)
+        {
+            UploadStatistics statistics;
+            const double startTime = benchmarkSeconds();
+
+            const PackedVertexFormat geometryFormat = makePackedVertexFormat(_quantizedPositions ? PackedVertexFormat::PositionUnorm16 : PackedVertexFormat::PositionFloat32,
+                                                                             true, false, false);
+            const PackedVertexFormat surfaceFormat = makePackedVertexFormat(PackedVertexFormat::PositionNone, false, true, true);
+
+            const int numChunks = int(meshes.size());
+            _chunkTable.setVertexFormats(geometryFormat, surfaceFormat);
+            _chunkTable.resize(numChunks);
+
+            std::vector<MeshChunkUploadData> chunks (numChunks);
+            int numTotalVertices = 0;
+            int numTotalTriangles = 0;
+            for (int meshIndex = 0; meshIndex < numChunks; ++meshIndex)
+            {
+                const SyntheticMesh& mesh = meshes[meshIndex];
+                MeshChunkUploadData& data = chunks[meshIndex];
+                data.numVertices = mesh.numVertices();
+                data.numFaces = mesh.numIndices() / 3;
+                data.positions = mesh.positions.data();
+                data.normals = mesh.normals.data();
+                data.colors = mesh.colors.data();
+                data.texcoords = mesh.texcoords.data();
+                data.faces = mesh.indices.data();
+                _chunkTable.describeUploadedChunk(meshIndex, data);
+
+                numTotalVertices += data.numVertices;
+                numTotalTriangles += data.numFaces;
+            }
+            _chunkTable.setExpectedSize(numTotalVertices, numTotalTriangles);
+
+            // Quantized relative to the whole mesh, like MeshRenderer when it merges the draws.
+            for (MeshChunkUploadData& data : chunks)
+                measureChunk(data, _quantizedPositions);
+            if (_quantizedPositions)
+                shareMeshQuantization(chunks);
+            for (MeshChunkUploadData& data : chunks)
+                prepareChunk(data, geometryFormat, surfaceFormat, true);
+            statistics.prepareSeconds = benchmarkSeconds() - startTime;
+
+            for (int meshIndex = 0; meshIndex < numChunks; ++meshIndex)
+                statistics.numUploadedBytes += _chunkTable.uploadChunk(meshIndex, chunks[meshIndex]);
+
+            // The mipmapped planes of MeshRenderer, without the CVOpenGLESTextureCache. The shaders read the
+            // chroma from .rg, like the GL_RG_EXT textures of the cache.
+            glDeleteTextures(2, _textures);
+            glGenTextures(2, _textures);
+            const bool isOpenGLES3 = isOpenGLES3Context();
+            uploadPlane(_textures[0], isOpenGLES3 ? GL_R8_EXT : GL_RED_EXT, GL_RED_EXT, texture.luma, texture.width, texture.height);
+            uploadPlane(_textures[1], isOpenGLES3 ? GL_RG8_EXT : GL_RG_EXT, GL_RG_EXT, texture.chroma, texture.width / 2, texture.height / 2);
+            statistics.numUploadedBytes += size_t(texture.width) * texture.height * 3 / 2;
+
+            glFinish();
+            statistics.uploadSeconds = benchmarkSeconds() - startTime;
+
+            // In the background after the upload for MeshRenderer.
+            const double levelOfDetailStartTime = benchmarkSeconds();
+            std::vector<MeshChunkSimplification> simplifications (numChunks);
+            for (int meshIndex = 0; meshIndex < numChunks; ++meshIndex)
+            {
+                MeshChunkSimplification& simplification = simplifications[meshIndex];
+                simplification.rebuilt = !chunks[meshIndex].reuseGeometry;
+                simplification.positions.swap(chunks[meshIndex].simplificationPositions);
+                simplification.indices.swap(chunks[meshIndex].simplificationIndices);
+                simplification.bounds = chunks[meshIndex].bounds;
+                buildChunkLevelsOfDetail(simplification, true);
+            }
+            _chunkTable.uploadLevelsOfDetail(simplifications);
+            glFinish();
+            statistics.levelOfDetailSeconds = benchmarkSeconds() - levelOfDetailStartTime;
+
+            for (RenderCommandList& commands : _commandLists)
+                commands.clear();
+
+            return statistics;
+        }
+
+        MeshBufferArena::Statistics bufferStatistics () const { return _chunkTable.bufferArena().statistics(); }
+
+        // Compiles the variant of the mode if needed, and returns the seconds it took.
+        double prepareShader (RenderingMode mode)
+        {
+            if (_shaders[mode].isLoaded())
+                return 0.0;
+
+            const double startTime = benchmarkSeconds();
+            _shaders[mode].load();
+            return benchmarkSeconds() - startTime;
+        }
+
+        void render (RenderingMode mode, const GLKMatrix4& projection, const GLKMatrix4& modelView)
+        {
+            // The occlusion culling runs on a worker thread in MeshRenderer.
+            const GLKMatrix4 viewProjection = GLKMatrix4Multiply(projection, modelView);
+            _chunkTable.cullChunks(viewProjection, _visibleChunks);
+            if (int(_visibleChunks.size()) >= kMinChunksForOcclusionCulling)
+                _chunkTable.removeOccludedChunks(_occlusionCuller, viewProjection, _visibleChunks);
+
+            GLStateCache& cache = _stateCache;
+            cache.beginFrame();
+
+            if (mode == RenderingModeTextured)
+            {
+                cache.bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, _textures[0]);
+                cache.bindTexture(GL_TEXTURE1, GL_TEXTURE_2D, _textures[1]);
+            }
+
+            MeshShader& shader = _shaders[mode];
+            shader.enable(cache);
+            shader.prepareRendering(cache, projection.m, modelView.m, GL_TEXTURE0);
+
+            RenderCommandList& commands = _commandLists[mode];
+            if (commands.empty())
+                _chunkTable.recordCommandList(kRenderingModeShaderKeys[mode], commands);
+
+            cache.setCapability(GL_DEPTH_TEST, true);
+
+            _draws.clear();
+            _numDrawnTriangles = 0;
+            _numDrawnPoints = 0;
+            _chunkTable.buildDraws(kRenderingModeShaderKeys[mode], _visibleChunks, projection, modelView, _draws,
+                                   _numDrawnTriangles, _numDrawnPoints);
+
+            const bool points = (mode == RenderingModePoints);
+            _numChunkDraws = int(_draws.size());
+            if (!points)
+                _chunkTable.mergeDraws(_draws);
+
+            GLint viewport[4];
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            _chunkTable.draw(cache, shader, commands, _draws, points ? pointSplatPixelsPerUnit(projection, modelView, viewport[3]) : 0.f);
+
+            cache.disableAllVertexAttributes();
+            cache.bindElementArrayBuffer(0);
+            cache.bindArrayBuffer(0);
+        }
+
+        const GLStateCache::Statistics& frameStatistics () const { return _stateCache.statistics(); }
+        int numVisibleChunks () const { return int(_visibleChunks.size()); }
+        int numDrawnTriangles () const { return _numDrawnTriangles; }
+        int numChunkDraws () const { return _numChunkDraws; }
+
+    private:
+        // OpenGL ES 3 needs a sized internal format, and Mesa gives an OpenGL ES 3 context for version 2.
+        void uploadPlane (GLuint texture, GLenum internalFormat, GLenum format, const uint8_t* pixels, int width, int height)
+        {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+            glGenerateMipmap(GL_TEXTURE_2D);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+
+    private:
+        bool _quantizedPositions;
+        MeshChunkTable _chunkTable;
+        OcclusionCuller _occlusionCuller;
+        std::vector<int> _visibleChunks;
+        std::vector<ArenaDraw> _draws;
+        int _numChunkDraws = 0;
+        int _numDrawnTriangles = 0;
+        int _numDrawnPoints = 0;
+        GLuint _textures[2] = { 0, 0 };
+        std::vector<MeshShader> _shaders;
+        RenderCommandList _commandLists[RenderingModeNumModes];
+        GLStateCache _stateCache;
+    };
+
+    void makeCamera (int width, int height, GLKMatrix4& projection, GLKMatrix4& modelView)
+    {
+        makePerspective(0.9f, float(width) / height, 0.1f, 50.f, projection.m);
+        const float eye[3] = { 0.f, 1.2f, 0.5f };
+        const float center[3] = { 0.f, 0.f, -3.f };
+        makeLookAt(eye, center, modelView.m);
+    }
+
+    // More chunks than the 30 MeshRenderer used to keep, side by side in front of the camera so that
+    // none is culled: each one is drawn, and covers the pixel at its center.
+    int checkManyChunks (int width, int height, bool quantized)
+    {
+        const int numColumns = 8;
+        const int numRows = 6;
+        std::vector<SyntheticMesh> meshes;
+        std::vector<GLKVector4> centers;
+        for (int row = 0; row < numRows; ++row)
+        {
+            for (int column = 0; column < numColumns; ++column)
+            {
+                const float center[3] = { 0.6f * (column - 0.5f * (numColumns - 1)), -1.f + 0.6f * (row - 0.5f * (numRows - 1)), -6.f };
+                meshes.push_back(makeBumpySphere(8, 12, 0.2f, center[0], center[1], center[2]));
+                centers.push_back(GLKVector4 { { center[0], center[1], center[2], 1.f } });
+            }
+        }
+
+        int numTriangles = 0;
+        for (const SyntheticMesh& mesh : meshes)
+            numTriangles += mesh.numIndices() / 3;
+
+        const SyntheticNv12Texture texture (64, 64);
+        GLKMatrix4 projection, modelView;
+        makeCamera(width, height, projection, modelView);
+
+        HeadlessMeshRenderer renderer (quantized);
+        renderer.uploadMesh(meshes, texture.image);
+
+        glClearColor(0.f, 0.f, 0.f, 0.f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        renderer.render(RenderingModeLightedGray, projection, modelView);
+        std::vector<uint8_t> pixels (width * height * 4);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+        int numFailures = 0;
+        if (renderer.numChunkDraws() != int(meshes.size()) || renderer.numDrawnTriangles() != numTriangles)
+        {
+            fprintf(stderr, "%d chunks%s: %d drawn with %d triangles, instead of all of them with %d.\n", int(meshes.size()),
+                    quantized ? " with quantized positions" : "", renderer.numChunkDraws(), renderer.numDrawnTriangles(), numTriangles);
+            ++numFailures;
+        }
+
+        const GLKMatrix4 viewProjection = GLKMatrix4Multiply(projection, modelView);
+        for (size_t meshIndex = 0; meshIndex < centers.size(); ++meshIndex)
+        {
+            float clip[4] = { 0.f, 0.f, 0.f, 0.f };
+            for (int row = 0; row < 4; ++row)
+                for (int column = 0; column < 4; ++column)
+                    clip[row] += viewProjection.m[column * 4 + row] * centers[meshIndex].v[column];
+
+            const int x = int((clip[0] / clip[3] + 1.f) * 0.5f * width);
+            const int y = int((clip[1] / clip[3] + 1.f) * 0.5f * height);
+            if (x < 0 || x >= width || y < 0 || y >= height || pixels[4 * (y * width + x) + 3] == 0)
+            {
+                fprintf(stderr, "Chunk %d of %d%s is not drawn at (%d, %d).\n", int(meshIndex), int(meshes.size()),
+                        quantized ? " with quantized positions" : "", x, y);
+                ++numFailures;
+            }
+        }
+
+        return numFailures;
+    }
+
+    // The SoftwareMeshRenderer follows the GL conventions of MeshRenderer: with the same camera, each of its
+    // modes matches the GL frame but for a few pixels, on the X-ray wireframe edges and where the texture
+    // filtering differs.
+    int checkSoftwareRenderer (int width, int height)
+    {
+        const SyntheticNv12Texture texture (256, 256);
+        const std::vector<SyntheticMesh> meshes = makeSyntheticScan(3, 2, 30, 40);
+        GLKMatrix4 projection, modelView;
+        makeCamera(width, height, projection, modelView);
+
+        HeadlessMeshRenderer renderer (false);
+        renderer.uploadMesh(meshes, texture.image);
+
+        SoftwareMeshRenderer softwareRenderer (width, height);
+        for (const SyntheticMesh& mesh : meshes)
+        {
+            SoftwareMeshRenderer::MeshChunk chunk;
+            chunk.positions = mesh.positions.data();
+            chunk.normals = mesh.normals.data();
+            chunk.colors = mesh.colors.data();
+            chunk.texcoords = mesh.texcoords.data();
+            chunk.numVertices = mesh.numVertices();
+            chunk.indices = mesh.indices.data();
+            chunk.numIndices = mesh.numIndices();
+            softwareRenderer.addMeshChunk(chunk);
+        }
+        softwareRenderer.setTexture(texture.image);
+
+        std::vector<uint8_t> glPixels (width * height * 4);
+        std::vector<uint8_t> softwarePixels (width * height * 4);
+        int numFailures = 0;
+        for (int mode = 0; mode < SoftwareMeshRenderer::RenderingModeNumModes; ++mode)
+        {
+            softwareRenderer.setRenderingMode(SoftwareMeshRenderer::RenderingMode(mode));
+            softwareRenderer.clear();
+            softwareRenderer.render(projection.m, modelView.m);
+            softwareRenderer.readPixels(softwarePixels.data());
+
+            // The clear color of the software frame, the GL frame is read bottom row first.
+            const float gray = softwarePixels[0] / 255.f;
+            glClearColor(gray, gray, gray, 1.f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            renderer.render(RenderingMode(mode), projection, modelView);
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, glPixels.data());
+
+            int numDifferent = 0;
+            for (int y = 0; y < height; ++y)
+            {
+                const uint8_t* glRow = &glPixels[4 * (height - 1 - y) * width];
+                const uint8_t* softwareRow = &softwarePixels[4 * y * width];
+                for (int x = 0; x < 4 * width; x += 4)
+                {
+                    int difference = 0;
+                    for (int channel = 0; channel < 3; ++channel)
+                        difference = std::max(difference, std::abs(int(glRow[x + channel]) - int(softwareRow[x + channel])));
+                    numDifferent += (difference > kMaxSoftwareColorDifference);
+                }
+            }
+
+            if (numDifferent > kMaxSoftwareDifferentPixels * width * height)
+            {
+                fprintf(stderr, "The software %s mode differs from GL by more than %d levels on %d pixels of %d.\n",
+                        kRenderingModeNames[mode], kMaxSoftwareColorDifference, numDifferent, width * height);
+                ++numFailures;
+            }
+        }
+
+        return numFailures;
+    }
+
+    // Every variant compiles and links with the Mesa compiler, and every mode covers a good part of
+    // the frame without GL errors.
+    int runChecks ()
+    {
+        int numFailures = 0;
+
+        for (MeshShaderKey key = 0; key <= MeshShaderAllFeatures; ++key)
+        {
+            if (!isValidMeshShaderKey(key))
+                continue;
+
+            const MeshShaderSource source = generateMeshShaderSource(key);
+            std::vector<GLuint> attributeIds;
+            std::vector<const char*> attributeNames;
+            for (const MeshShaderSource::Attribute& attribute : source.attributes)
+            {
+                attributeIds.push_back(attribute.index);
+                attributeNames.push_back(attribute.name);
+            }
+
+            const GLuint program = loadOpenGLProgramFromString(source.vertexShader.c_str(), source.fragmentShader.c_str(),
+                                                               int(attributeIds.size()), attributeIds.data(), attributeNames.data());
+            if (program == 0)
+            {
+                fprintf(stderr, "The %s shader does not compile.\n", describeMeshShaderKey(key).c_str());
+                ++numFailures;
+            }
+            glDeleteProgram(program);
+        }
+
+        const int width = 640;
+        const int height = 480;
+        const SyntheticNv12Texture texture (256, 256);
+        const std::vector<SyntheticMesh> meshes = makeSyntheticScan(3, 2, 30, 40);
+        GLKMatrix4 projection, modelView;
+        makeCamera(width, height, projection, modelView);
+        std::vector<uint8_t> pixels (width * height * 4);
+
+        for (bool quantized : { false, true })
+        {
+            HeadlessMeshRenderer renderer (quantized);
+            renderer.uploadMesh(meshes, texture.image);
+
+            for (int mode = 0; mode < RenderingModeNumModes; ++mode)
+            {
+                glClearColor(0.f, 0.f, 0.f, 0.f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                renderer.render(RenderingMode(mode), projection, modelView);
+                glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+                int numCovered = 0;
+                for (int pixel = 0; pixel < width * height; ++pixel)
+                    numCovered += (pixels[4 * pixel + 3] != 0);
+
+                const GLenum error = glGetError();
+                if (error != GL_NO_ERROR || numCovered < width * height / 20)
+                {
+                    fprintf(stderr, "The %s mode%s drew %d pixels, GL error 0x%x.\n", kRenderingModeNames[mode],
+                            quantized ? " with quantized positions" : "", numCovered, error);
+                    ++numFailures;
+                }
+            }
+
+            numFailures += checkManyChunks(width, height, quantized);
+        }
+
+        numFailures += checkSoftwareRenderer(width, height);
+
+        if (numFailures > 0)
+            return 1;
+
+        printf("HeadlessRendererBenchmark: all checks passed\n");
+        return 0;
+    }
+
+    void runBenchmark (int numFrames, bool quantized)
+    {
+        const int width = 640;
+        const int height = 480;
+        const SyntheticNv12Texture texture (2048, 1024);
+        const std::vector<SyntheticMesh> meshes = makeSyntheticScan(4, 4, 100, 150);
+        GLKMatrix4 projection, modelView;
+        makeCamera(width, height, projection, modelView);
+
+        HeadlessMeshRenderer renderer (quantized);
+        renderer.setLevelOfDetailViewport(float(height));
+        const HeadlessMeshRenderer::UploadStatistics upload = renderer.uploadMesh(meshes, texture.image);
+        const MeshBufferArena::Statistics buffers = renderer.bufferStatistics();
+        printf("%s, %s positions\n", reinterpret_cast<const char*>(glGetString(GL_RENDERER)), quantized ? "quantized" : "float");
+        printf("upload %.1f ms (%.1f ms preparing), levels of detail %.1f ms, %.2f MB uploaded, %.2f MB of buffers in %d pages, "
+               "%d buffer objects\n", upload.uploadSeconds * 1e3, upload.prepareSeconds * 1e3, upload.levelOfDetailSeconds * 1e3,
+               upload.numUploadedBytes * 1e-6, buffers.numAllocatedBytes * 1e-6, buffers.numPages, buffers.numBufferObjects);
+
+        for (int mode = 0; mode < RenderingModeNumModes; ++mode)
+        {
+            const double compileSeconds = renderer.prepareShader(RenderingMode(mode));
+
+            // A first frame records the command list.
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            renderer.render(RenderingMode(mode), projection, modelView);
+            glFinish();
+
+            double totalSeconds = 0.0;
+            double worstSeconds = 0.0;
+            double renderSeconds = 0.0;
+            for (int frame = 0; frame < numFrames; ++frame)
+            {
+                const double startTime = benchmarkSeconds();
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                renderer.render(RenderingMode(mode), projection, modelView);
+                renderSeconds += benchmarkSeconds() - startTime;
+                glFinish();
+
+                const double frameSeconds = benchmarkSeconds() - startTime;
+                totalSeconds += frameSeconds;
+                worstSeconds = std::max(worstSeconds, frameSeconds);
+            }
+
+            const GLStateCache::Statistics& statistics = renderer.frameStatistics();
+            printf("    %-13s %7.2f ms per frame (worst %7.2f ms, %.3f ms in render), shader %.1f ms, %d chunks, %d triangles, "
+                   "%d GL calls, %d skipped, %d draws\n", kRenderingModeNames[mode], totalSeconds / numFrames * 1e3, worstSeconds * 1e3,
+                   renderSeconds / numFrames * 1e3, compileSeconds * 1e3, renderer.numVisibleChunks(), renderer.numDrawnTriangles(),
+                   statistics.numGLCalls, statistics.numSkippedGLCalls, statistics.numDrawCalls);
+        }
+    }
+
+} // Anonymous
+
+int main (int argc, char** argv)
+{
+    bool check = false;
+    bool quantized = false;
+    int numFrames = 20;
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        const std::string option = argv[arg];
+        if (option == "--check")
+            check = true;
+        else if (option == "--quantized")
+            quantized = true;
+        else if (option == "--frames" && arg + 1 < argc)
+            numFrames = std::max(1, atoi(argv[++arg]));
+    }
+
+    HeadlessContext context;
+    if (!context.create(640, 480))
+    {
+        fprintf(stderr, "Could not create a surfaceless GLES2 context.\n");
+        return 1;
+    }
+
+    if (check)
+        return runChecks();
+
+    runBenchmark(numFrames, quantized);
+    return 0;
+}
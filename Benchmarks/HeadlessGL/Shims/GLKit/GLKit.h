@@ -0,0 +1,103 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+// The few GLKit types and functions used by the GL code of the renderer shared with the headless
+// benchmark, over the Mesa GLES2 headers. Column-major like GLKit.
+
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include <cmath>
+#include <cstdio>
+
+struct GLKMatrix4
+{
+    float m[16];
+};
+
+struct GLKVector3
+{
+    float v[3];
+};
+
+struct GLKVector4
+{
+    float v[4];
+};
+
+inline GLKVector3 GLKVector3Make (float x, float y, float z)
+{
+    GLKVector3 vector = { { x, y, z } };
+    return vector;
+}
+
+inline GLKVector3 GLKVector3MakeWithArray (float values[3])
+{
+    return GLKVector3Make(values[0], values[1], values[2]);
+}
+
+inline GLKVector3 GLKVector3Subtract (GLKVector3 a, GLKVector3 b)
+{
+    return GLKVector3Make(a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2]);
+}
+
+inline GLKVector3 GLKVector3CrossProduct (GLKVector3 a, GLKVector3 b)
+{
+    return GLKVector3Make(a.v[1] * b.v[2] - a.v[2] * b.v[1], a.v[2] * b.v[0] - a.v[0] * b.v[2], a.v[0] * b.v[1] - a.v[1] * b.v[0]);
+}
+
+inline float GLKVector3Length (GLKVector3 vector)
+{
+    return std::sqrt(vector.v[0] * vector.v[0] + vector.v[1] * vector.v[1] + vector.v[2] * vector.v[2]);
+}
+
+inline GLKVector4 GLKVector4MakeWithArray (float values[4])
+{
+    GLKVector4 vector;
+    for (int i = 0; i < 4; ++i)
+        vector.v[i] = values[i];
+    return vector;
+}
+
+inline bool GLKVector4AllEqualToVector4 (GLKVector4 a, GLKVector4 b)
+{
+    return a.v[0] == b.v[0] && a.v[1] == b.v[1] && a.v[2] == b.v[2] && a.v[3] == b.v[3];
+}
+
+inline GLKMatrix4 GLKMatrix4Multiply (GLKMatrix4 a, GLKMatrix4 b)
+{
+    GLKMatrix4 result;
+    for (int column = 0; column < 4; ++column)
+        for (int row = 0; row < 4; ++row)
+        {
+            float sum = 0.f;
+            for (int k = 0; k < 4; ++k)
+                sum += a.m[k * 4 + row] * b.m[column * 4 + k];
+            result.m[column * 4 + row] = sum;
+        }
+    return result;
+}
+
+inline GLKVector3 GLKMatrix4MultiplyVector3 (GLKMatrix4 matrix, GLKVector3 vector)
+{
+    GLKVector3 result;
+    for (int row = 0; row < 3; ++row)
+        result.v[row] = matrix.m[row] * vector.v[0] + matrix.m[4 + row] * vector.v[1] + matrix.m[8 + row] * vector.v[2];
+    return result;
+}
+
+inline GLKVector3 GLKMatrix4MultiplyVector3WithTranslation (GLKMatrix4 matrix, GLKVector3 vector)
+{
+    GLKVector3 result = GLKMatrix4MultiplyVector3(matrix, vector);
+    for (int row = 0; row < 3; ++row)
+        result.v[row] += matrix.m[12 + row];
+    return result;
+}
+
+// The Objective-C format strings cannot be compiled as C++, the messages are printed as written.
+#define NSLog(...) fprintf(stderr, "NSLog(%s)\n", #__VA_ARGS__)
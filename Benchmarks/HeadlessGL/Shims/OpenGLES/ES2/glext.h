@@ -0,0 +1,26 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+// The libGLESv2 of glvnd only exports the core functions, the extension entry points used by
+// MeshBufferArena are looked up through EGL.
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+inline void* glMapBufferRangeEXT (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+    static const PFNGLMAPBUFFERRANGEEXTPROC mapBufferRange = (PFNGLMAPBUFFERRANGEEXTPROC)eglGetProcAddress("glMapBufferRangeEXT");
+    return mapBufferRange ? mapBufferRange(target, offset, length, access) : nullptr;
+}
+
+inline GLboolean glUnmapBufferOES (GLenum target)
+{
+    static const PFNGLUNMAPBUFFEROESPROC unmapBuffer = (PFNGLUNMAPBUFFEROESPROC)eglGetProcAddress("glUnmapBufferOES");
+    return unmapBuffer ? unmapBuffer(target) : GL_FALSE;
+}
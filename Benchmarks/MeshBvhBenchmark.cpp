@@ -0,0 +1,79 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "BenchmarkUtilities.h"
+#include "MeshBvh.h"
+
+#include <cstdio>
+
+// Build time of the BVH over a whole scan, and the ray throughput of the viewer queries: rays from
+// the camera through every pixel, and occlusion rays between points of the surface.
+int main ()
+{
+    const std::vector<SyntheticMesh> chunks = makeSyntheticScan(4, 4, 150, 200);
+
+    std::vector<MeshBvh::MeshChunk> bvhChunks;
+    for (const SyntheticMesh& mesh : chunks)
+    {
+        MeshBvh::MeshChunk chunk;
+        chunk.positions = mesh.positions.data();
+        chunk.numVertices = mesh.numVertices();
+        chunk.indices = mesh.indices.data();
+        chunk.numIndices = mesh.numIndices();
+        bvhChunks.push_back(chunk);
+    }
+
+    MeshBvh bvh;
+    const double buildSeconds = measureBestSeconds(3, [&] { bvh.build(bvhChunks); });
+    const MeshBvh::BuildStatistics& statistics = bvh.buildStatistics();
+    printf("%d triangles: built in %.1f ms, %d nodes, %d leaves, depth %d, %.1f MB\n", statistics.numTriangles,
+           buildSeconds * 1e3, statistics.numNodes, statistics.numLeaves, statistics.maxDepth, statistics.numBytes * 1e-6);
+
+    const int width = 640;
+    const int height = 480;
+    const float eye[3] = { 0.f, 1.f, 1.f };
+    std::vector<float> directions (3 * width * height);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            float* direction = &directions[3 * (y * width + x)];
+            direction[0] = (x + 0.5f) / width * 1.2f - 0.6f;
+            direction[1] = (y + 0.5f) / height * 0.9f - 0.45f - 0.3f;
+            direction[2] = -1.f;
+        }
+
+    std::vector<MeshBvh::RayHit> hits (width * height);
+    int numHits = 0;
+    const double primarySeconds = measureBestSeconds(3, [&] {
+        numHits = 0;
+        for (int ray = 0; ray < width * height; ++ray)
+            numHits += bvh.intersect(eye, &directions[3 * ray], 1e30f, hits[ray]);
+    });
+    printf("    camera rays:    %5.2f Mrays/s on one thread, %.0f%% hits\n", width * height / primarySeconds * 1e-6,
+           100.0 * numHits / (width * height));
+
+    // From the hit points toward a light, stepping off the surface.
+    const float light[3] = { 2.f, 4.f, 2.f };
+    int numOccluded = 0;
+    int numShadowRays = 0;
+    const double shadowSeconds = measureBestSeconds(3, [&] {
+        numOccluded = 0;
+        numShadowRays = 0;
+        for (int ray = 0; ray < width * height; ++ray)
+        {
+            if (hits[ray].chunk < 0)
+                continue;
+            const float* position = hits[ray].position;
+            const float direction[3] = { light[0] - position[0], light[1] - position[1], light[2] - position[2] };
+            const float origin[3] = { position[0] + 1e-3f * direction[0], position[1] + 1e-3f * direction[1], position[2] + 1e-3f * direction[2] };
+            numOccluded += bvh.isOccluded(origin, direction, 1.f);
+            ++numShadowRays;
+        }
+    });
+    printf("    occlusion rays: %5.2f Mrays/s on one thread, %.0f%% occluded\n", numShadowRays / shadowSeconds * 1e-6,
+           100.0 * numOccluded / std::max(1, numShadowRays));
+    return 0;
+}
@@ -0,0 +1,70 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "BenchmarkUtilities.h"
+#include "MeshOptimizer.h"
+
+#include <cstdio>
+
+// Vertex cache efficiency of the chunks as the mapper emits them, shuffled, and after each step of the
+// upload optimization, with the time each step takes.
+int main ()
+{
+    SyntheticMesh mesh = makeBumpySphere(150, 200);
+    const int numIndices = mesh.numIndices();
+    const int numVertices = mesh.numVertices();
+    printf("%d vertices, %d triangles, cache of %d vertices\n", numVertices, numIndices / 3, kMeshOptimizerCacheSize);
+
+    const auto report = [&](const char* name, const std::vector<uint16_t>& indices, double seconds) {
+        const VertexCacheStatistics statistics = analyzeVertexCache(indices.data(), numIndices, numVertices);
+        printf("    %-22s acmr %.3f  atvr %.3f", name, statistics.acmr, statistics.atvr);
+        if (seconds > 0.0)
+            printf("  %7.2f ms", seconds * 1e3);
+        printf("\n");
+    };
+
+    for (int shuffled = 0; shuffled < 2; ++shuffled)
+    {
+        std::vector<uint16_t> indices = mesh.indices;
+        if (shuffled)
+            shuffleTriangles(indices, 11);
+        printf("%s\n", shuffled ? "shuffled triangles" : "ring order");
+        report("input", indices, 0.0);
+
+        std::vector<uint16_t> cacheOptimized (numIndices);
+        std::vector<int> clusters;
+        double seconds = measureBestSeconds(5, [&] {
+            optimizeVertexCache(indices.data(), numIndices, numVertices, cacheOptimized.data(), clusters);
+        });
+        report("tipsify", cacheOptimized, seconds);
+        printf("    %d clusters\n", int(clusters.size()));
+
+        std::vector<uint16_t> overdrawOptimized (numIndices);
+        seconds = measureBestSeconds(5, [&] {
+            optimizeOverdraw(cacheOptimized.data(), numIndices, mesh.positions.data(), numVertices, clusters, overdrawOptimized.data());
+        });
+        report("+ overdraw", overdrawOptimized, seconds);
+
+        std::vector<uint16_t> remap;
+        std::vector<uint16_t> fetchOptimized;
+        seconds = measureBestSeconds(5, [&] {
+            fetchOptimized = overdrawOptimized;
+            optimizeVertexFetch(fetchOptimized.data(), numIndices, numVertices, remap);
+        });
+        report("+ vertex fetch", fetchOptimized, seconds);
+
+        std::vector<uint8_t> colors;
+        std::vector<uint16_t> duplicateSources;
+        std::vector<uint16_t> colored;
+        seconds = measureBestSeconds(5, [&] {
+            colored = fetchOptimized;
+            assignCornerColors(colored.data(), numIndices, numVertices, colors, duplicateSources);
+        });
+        printf("    %-22s %d duplicated vertices (%.2f%%)  %7.2f ms\n", "corner colors", int(duplicateSources.size()),
+               100.0 * duplicateSources.size() / numVertices, seconds * 1e3);
+    }
+    return 0;
+}
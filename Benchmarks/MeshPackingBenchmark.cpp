@@ -0,0 +1,70 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "BenchmarkUtilities.h"
+#include "MeshVertexPacker.h"
+
+#include <cstdio>
+
+// Vertex sizes and packing throughput of the MeshRenderer vertex formats, against the separate float
+// arrays of the STMesh chunks.
+int main ()
+{
+    const std::vector<SyntheticMesh> chunks = makeSyntheticScan(8, 4, 200, 250);
+    int numVertices = 0;
+    for (const SyntheticMesh& chunk : chunks)
+        numVertices += chunk.numVertices();
+    printf("%d chunks, %d vertices\n", int(chunks.size()), numVertices);
+
+    struct Mode
+    {
+        const char* name;
+        bool normals;
+        bool colors;
+        bool texcoords;
+        int floatBytes;
+    };
+    const Mode modes[] = {
+        { "lighted gray / x-ray", true, false, false, 24 },
+        { "vertex colors", true, true, false, 36 },
+        { "textured", true, false, true, 32 },
+    };
+    const PackedVertexFormat::PositionType positionTypes[] = {
+        PackedVertexFormat::PositionFloat32, PackedVertexFormat::PositionFloat16, PackedVertexFormat::PositionUnorm16,
+    };
+    const char* positionNames[] = { "float32", "float16", "unorm16" };
+
+    std::vector<uint8_t> packed;
+    for (const Mode& mode : modes)
+    {
+        printf("%s, %d bytes per vertex unpacked\n", mode.name, mode.floatBytes);
+        for (int type = 0; type < 3; ++type)
+        {
+            const PackedVertexFormat format = makePackedVertexFormat(positionTypes[type], mode.normals, mode.colors, mode.texcoords);
+            packed.resize(size_t(numVertices) * format.stride);
+
+            float maxError = 0.f;
+            const double seconds = measureBestSeconds(5, [&] {
+                uint8_t* dst = packed.data();
+                for (const SyntheticMesh& chunk : chunks)
+                {
+                    const PositionQuantization quantization = computePositionQuantization(chunk.positions.data(), chunk.numVertices());
+                    maxError = std::max(maxError, positionQuantizationErrorBound(quantization));
+                    packVertices(format, chunk.numVertices(), chunk.positions.data(), chunk.normals.data(), chunk.colors.data(),
+                                 chunk.texcoords.data(), dst, quantization);
+                    dst += size_t(chunk.numVertices()) * format.stride;
+                }
+            });
+
+            printf("    %-8s %2d bytes (%3.0f%%), %6.1f Mvertices/s", positionNames[type], format.stride,
+                   100.0 * format.stride / mode.floatBytes, numVertices / seconds * 1e-6);
+            if (positionTypes[type] == PackedVertexFormat::PositionUnorm16)
+                printf(", position error <= %.2g", maxError);
+            printf("\n");
+        }
+    }
+    return 0;
+}
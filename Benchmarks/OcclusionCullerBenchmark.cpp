@@ -0,0 +1,79 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "BenchmarkUtilities.h"
+#include "OcclusionCuller.h"
+
+#include <cstdio>
+
+// Chunks culled by the frustum and by the occluders on a camera path along rows of objects hiding
+// each other, and the CPU time of the occlusion culling per frame.
+int main ()
+{
+    const std::vector<SyntheticMesh> chunks = makeSyntheticScan(8, 12, 40, 50);
+
+    std::vector<AxisAlignedBox> boxes;
+    std::vector<OccluderProxy> proxies (chunks.size());
+    int numTriangles = 0;
+    int numProxyTriangles = 0;
+    const double buildStart = benchmarkSeconds();
+    for (size_t chunk = 0; chunk < chunks.size(); ++chunk)
+    {
+        const SyntheticMesh& mesh = chunks[chunk];
+        boxes.push_back(computeAxisAlignedBox(mesh.positions.data(), mesh.numVertices()));
+        buildOccluderProxy(mesh.positions.data(), mesh.numVertices(), mesh.indices.data(), mesh.numIndices(), boxes.back(), 8,
+                           proxies[chunk]);
+        numTriangles += mesh.numIndices() / 3;
+        numProxyTriangles += int(proxies[chunk].triangles.size() / 9);
+    }
+    printf("%d chunks, %d triangles, %d proxy triangles built in %.1f ms\n", int(chunks.size()), numTriangles,
+           numProxyTriangles, (benchmarkSeconds() - buildStart) * 1e3);
+
+    OcclusionCuller culler;
+    std::vector<int> visible (chunks.size());
+    const int numFrames = 120;
+    int numInFrustum = 0;
+    int numOccluded = 0;
+    int trianglesDrawn = 0;
+    double seconds = 0.0;
+
+    for (int frame = 0; frame < numFrames; ++frame)
+    {
+        // Low along the rows, panning across them.
+        const float pan = std::sin(frame * 2.f * float(M_PI) / numFrames);
+        const float eye[3] = { 0.5f * pan, 0.1f, 0.f };
+        const float center[3] = { 4.f * pan, 0.f, -8.f };
+
+        float projection[16], modelView[16], viewProjection[16];
+        makePerspective(1.f, 4.f / 3.f, 0.1f, 50.f, projection);
+        makeLookAt(eye, center, modelView);
+        multiplyMatrices(projection, modelView, viewProjection);
+
+        const int numVisible = cullAndSortBoxes(viewProjection, boxes.data(), int(boxes.size()), visible.data());
+        numInFrustum += numVisible;
+
+        // Front to back, like MeshRenderer: the nearest chunks are drawn and occlude the next ones.
+        const double start = benchmarkSeconds();
+        culler.beginFrame(viewProjection);
+        for (int i = 0; i < numVisible; ++i)
+        {
+            const int chunk = visible[i];
+            if (!culler.isBoxVisible(boxes[chunk], proxies[chunk].margin))
+            {
+                ++numOccluded;
+                continue;
+            }
+            culler.renderOccluder(proxies[chunk]);
+            trianglesDrawn += chunks[chunk].numIndices() / 3;
+        }
+        seconds += benchmarkSeconds() - start;
+    }
+
+    printf("per frame: %.1f chunks in the frustum, %.1f occluded (%.0f%%), %.0f triangles drawn, %.3f ms culling\n",
+           double(numInFrustum) / numFrames, double(numOccluded) / numFrames, 100.0 * numOccluded / std::max(1, numInFrustum),
+           double(trianglesDrawn) / numFrames, seconds / numFrames * 1e3);
+    return 0;
+}
@@ -0,0 +1,57 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "BenchmarkUtilities.h"
+#include "ImageResampler.h"
+#include "JpegEncoder.h"
+
+#include <cstdio>
+
+// The CPU side of the mesh previews: downsampling one large screenshot to all the preview sizes and
+// encoding them.
+int main ()
+{
+    const int width = 1280;
+    const int height = 960;
+    std::vector<uint8_t> screenshot (size_t(width) * height * 4);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            uint8_t* pixel = &screenshot[4 * (y * width + x)];
+            const bool inside = (x - width / 2) * (x - width / 2) + (y - height / 2) * (y - height / 2) < height * height / 9;
+            pixel[0] = uint8_t(inside ? 200 - y / 8 : 40);
+            pixel[1] = uint8_t(inside ? 120 + x / 16 : 40);
+            pixel[2] = uint8_t(inside ? 90 : 48);
+            pixel[3] = 255;
+        }
+
+    const std::vector<ImageSize> sizes = { { 640, 480 }, { 320, 240 }, { 160, 120 }, { 80, 60 } };
+    for (ResampleFilter filter : { ResampleFilterBox, ResampleFilterLanczos3 })
+    {
+        std::vector<ColorImage> pyramid;
+        const double resampleSeconds = measureBestSeconds(3, [&] {
+            pyramid = buildImagePyramid(screenshot.data(), width, height, width * 4, true, sizes, filter);
+        });
+
+        size_t numBytes = 0;
+        const double encodeSeconds = measureBestSeconds(3, [&] {
+            numBytes = 0;
+            for (const ColorImage& image : pyramid)
+            {
+                JpegSourceImage source;
+                source.pixels = image.pixels.data();
+                source.width = image.width;
+                source.height = image.height;
+                source.bytesPerRow = image.width * 4;
+                numBytes += encodeJpeg(source).size();
+            }
+        });
+        printf("%-8s pyramid of %d previews: %6.2f ms resampling, %6.2f ms encoding, %.0f kB of JPEG\n",
+               filter == ResampleFilterBox ? "box" : "lanczos3", int(sizes.size()), resampleSeconds * 1e3, encodeSeconds * 1e3,
+               numBytes * 1e-3);
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "BenchmarkUtilities.h"
+#include "SoftwareMeshRenderer.h"
+
+#include <cstdio>
+
+// Frame times of every rendering mode of the SoftwareMeshRenderer, the portable counterpart of the
+// headless GL benchmark for machines without EGL.
+int main ()
+{
+    const int width = 640;
+    const int height = 480;
+    const std::vector<SyntheticMesh> meshes = makeSyntheticScan(4, 4, 100, 150);
+    const SyntheticNv12Texture texture (2048, 1024);
+
+    SoftwareMeshRenderer renderer (width, height);
+    for (const SyntheticMesh& mesh : meshes)
+    {
+        SoftwareMeshRenderer::MeshChunk chunk;
+        chunk.positions = mesh.positions.data();
+        chunk.normals = mesh.normals.data();
+        chunk.colors = mesh.colors.data();
+        chunk.texcoords = mesh.texcoords.data();
+        chunk.numVertices = mesh.numVertices();
+        chunk.indices = mesh.indices.data();
+        chunk.numIndices = mesh.numIndices();
+        renderer.addMeshChunk(chunk);
+    }
+
+    const double textureSeconds = measureBestSeconds(1, [&] { renderer.setTexture(texture.image); });
+    printf("%dx%d, %d chunks, texture and its mip levels set in %.1f ms\n", width, height, int(meshes.size()), textureSeconds * 1e3);
+
+    float projection[16], modelView[16];
+    makePerspective(0.9f, float(width) / height, 0.1f, 50.f, projection);
+    const float eye[3] = { 0.f, 1.2f, 0.5f };
+    const float center[3] = { 0.f, 0.f, -3.f };
+    makeLookAt(eye, center, modelView);
+
+    const char* const modeNames[SoftwareMeshRenderer::RenderingModeNumModes] = { "x-ray", "vertex colors", "textured", "lighted gray" };
+    for (int mode = 0; mode < SoftwareMeshRenderer::RenderingModeNumModes; ++mode)
+    {
+        renderer.setRenderingMode(SoftwareMeshRenderer::RenderingMode(mode));
+        const double seconds = measureBestSeconds(10, [&] {
+            renderer.clear();
+            renderer.render(projection, modelView);
+        });
+
+        const SoftwareMeshRenderer::FrameStatistics& statistics = renderer.lastFrameStatistics();
+        printf("    %-13s %7.2f ms per frame, %d of %d triangles rasterized, %d triangle and tile pairs\n", modeNames[mode],
+               seconds * 1e3, statistics.numRasterizedTriangles, statistics.numTriangles, statistics.numBinnedTriangles);
+    }
+    return 0;
+}
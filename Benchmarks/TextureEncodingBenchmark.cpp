@@ -0,0 +1,53 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "BenchmarkUtilities.h"
+#include "EtcTextureEncoder.h"
+#include "ParallelFor.h"
+#include "TextureMipChain.h"
+
+#include <cstdio>
+
+// The processing of a mesh texture before upload: the mip chains of its planes, and its ETC2 encoding
+// on one thread and spread over block row bands like MeshRenderer, with the quality of the encoding.
+int main ()
+{
+    const int width = 2048;
+    const int height = 1536;
+    const SyntheticNv12Texture texture (width, height);
+    const double megapixels = width * height * 1e-6;
+    printf("%dx%d texture, %.1f MB as NV12\n", width, height, width * height * 1.5e-6);
+
+    for (MipFilter filter : { MipFilterBox, MipFilterKaiser })
+    {
+        const double seconds = measureBestSeconds(3, [&] {
+            buildMipChain(texture.image.luma, width, height, texture.image.lumaBytesPerRow, 1, filter);
+            buildMipChain(texture.image.chroma, width / 2, height / 2, texture.image.chromaBytesPerRow, 2, filter);
+        });
+        printf("    %-6s mip chains %7.1f ms\n", filter == MipFilterBox ? "box" : "kaiser", seconds * 1e3);
+    }
+
+    const int numBlockRows = etcBlockRowCount(height);
+    std::vector<uint8_t> encoded (etcEncodedSize(width, height));
+
+    const double singleSeconds = measureBestSeconds(3, [&] {
+        encodeNv12ToEtc2(texture.image, 0, numBlockRows, encoded.data());
+    });
+
+    const int rowsPerJob = 8;
+    const double parallelSeconds = measureBestSeconds(3, [&] {
+        runOnThreads((numBlockRows + rowsPerJob - 1) / rowsPerJob, [&](int job) {
+            const int firstRow = job * rowsPerJob;
+            encodeNv12ToEtc2(texture.image, firstRow, std::min(rowsPerJob, numBlockRows - firstRow), encoded.data());
+        });
+    });
+
+    printf("    etc2 %.1f MB (%.0f%% of NV12), %.1f dB PSNR\n", encoded.size() * 1e-6, 100.0 * encoded.size() / (width * height * 1.5),
+           computeEtc2Psnr(texture.image, encoded.data()));
+    printf("    etc2 encoding %7.1f ms on one thread (%.1f Mpixels/s), %7.1f ms on %u threads\n", singleSeconds * 1e3,
+           megapixels / singleSeconds, parallelSeconds * 1e3, std::max(1u, std::thread::hardware_concurrency()));
+    return 0;
+}
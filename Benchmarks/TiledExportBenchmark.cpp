@@ -0,0 +1,52 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "BenchmarkUtilities.h"
+#include "TiledImageWriter.h"
+
+#include <cstdio>
+
+// The streaming of a print resolution export through the tiled writer: its time, and how much of the
+// image it buffers compared to the whole of it.
+int main ()
+{
+    // A rendered tile standing in for every tile of the export, flipped like a GL readback.
+    const int tileWidth = 1024;
+    const int tileHeight = 768;
+    std::vector<uint8_t> tile (size_t(tileWidth) * tileHeight * 4);
+    for (int y = 0; y < tileHeight; ++y)
+        for (int x = 0; x < tileWidth; ++x)
+        {
+            uint8_t* pixel = &tile[4 * (y * tileWidth + x)];
+            const bool inside = (x - tileWidth / 2) * (x - tileWidth / 2) + (y - tileHeight / 2) * (y - tileHeight / 2) < tileHeight * tileHeight / 9;
+            pixel[0] = uint8_t(inside ? 200 - y / 8 : 40);
+            pixel[1] = uint8_t(inside ? 120 + x / 16 : 40);
+            pixel[2] = uint8_t(inside ? 90 : 48);
+            pixel[3] = 255;
+        }
+
+    const int width = 6000;
+    const int height = 4500;
+    size_t numBytes = 0;
+    size_t maxBufferedBytes = 0;
+    const double exportSeconds = measureBestSeconds(1, [&] {
+        numBytes = 0;
+        TiledImageWriter writer (width, height, tileWidth, tileHeight, false, 90, [&](const uint8_t*, size_t size) {
+            numBytes += size;
+            return true;
+        });
+        for (int tileIndex = 0; tileIndex < int(writer.tiles().size()); ++tileIndex)
+        {
+            writer.addTile(tileIndex, tile.data(), tileWidth * 4, true);
+            maxBufferedBytes = std::max(maxBufferedBytes, writer.numBufferedBytes());
+        }
+        writer.finish();
+    });
+    printf("%dx%d export from %dx%d tiles: %.0f ms, %.1f MB of JPEG, at most %.1f MB buffered (%.1f MB for the whole image)\n",
+           width, height, tileWidth, tileHeight, exportSeconds * 1e3, numBytes * 1e-6, maxBufferedBytes * 1e-6,
+           size_t(width) * height * 4 * 1e-6);
+    return 0;
+}
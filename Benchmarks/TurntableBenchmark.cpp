@@ -0,0 +1,61 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "BenchmarkUtilities.h"
+#include "TurntableExporter.h"
+
+#include <cstdio>
+#include <string>
+
+// A turntable export through the frame pipeline with one slot, every stage waiting for the previous
+// one like a serial export, and with several slots overlapping the stages.
+int main (int argc, char** argv)
+{
+    const std::string directory = argc > 1 ? argv[1] : ".";
+
+    const std::vector<SyntheticMesh> meshes = makeSyntheticScan(3, 2, 120, 160);
+    std::vector<SoftwareMeshRenderer::MeshChunk> chunks;
+    for (const SyntheticMesh& mesh : meshes)
+    {
+        SoftwareMeshRenderer::MeshChunk chunk;
+        chunk.positions = mesh.positions.data();
+        chunk.normals = mesh.normals.data();
+        chunk.colors = mesh.colors.data();
+        chunk.numVertices = mesh.numVertices();
+        chunk.indices = mesh.indices.data();
+        chunk.numIndices = mesh.numIndices();
+        chunks.push_back(chunk);
+    }
+
+    TurntableSettings settings;
+    settings.numFrames = 60;
+
+    float projection[16];
+    makePerspective(0.8f, float(settings.width) / settings.height, 0.1f, 20.f, projection);
+    const float eye[3] = { 0.f, 1.5f, 1.5f };
+    const float center[3] = { 0.f, 0.f, -2.5f };
+    float modelView[16];
+    makeLookAt(eye, center, modelView);
+
+    for (int numSlots : { 1, 3 })
+    {
+        settings.numSlots = numSlots;
+        SoftwareTurntableExporter exporter (settings);
+        exporter.setMesh(chunks, SoftwareMeshRenderer::RenderingModePerVertexColor);
+        if (!exporter.exportFrames(projection, modelView, center, directory + "/turntable_"))
+        {
+            fprintf(stderr, "Could not write the frames in %s\n", directory.c_str());
+            return 1;
+        }
+
+        printf("%d slots: %d frames at %.1f fps (%.2f s)\n", numSlots, settings.numFrames, exporter.framesPerSecond(),
+               exporter.elapsedSeconds());
+        for (const FramePipeline::StageStatistics& stage : exporter.statistics())
+            printf("    %-10s %6.1f fps alone, busy %.3f s, waiting %.3f s\n", stage.name.c_str(), stage.framesPerSecond(),
+                   stage.busySeconds, stage.waitSeconds);
+    }
+    return 0;
+}
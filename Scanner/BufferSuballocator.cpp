@@ -0,0 +1,142 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "BufferSuballocator.h"
+
+#include <algorithm>
+#include <cassert>
+
+BufferSuballocator::BufferSuballocator (size_t capacity)
+{
+    reset(capacity);
+}
+
+void BufferSuballocator::reset (size_t capacity)
+{
+    _capacity = capacity;
+    _usedSize = 0;
+    _allocations.clear();
+    _freeBlocks.clear();
+
+    if (capacity > 0)
+        _freeBlocks[0] = capacity;
+}
+
+bool BufferSuballocator::allocate (size_t size, size_t& offset)
+{
+    if (size == 0)
+        return false;
+
+    // First fit keeps the allocations in the order they are made, so consecutive ones stay contiguous.
+    for (std::map<size_t, size_t>::iterator block = _freeBlocks.begin(); block != _freeBlocks.end(); ++block)
+    {
+        if (block->second < size)
+            continue;
+
+        offset = block->first;
+        const size_t remainingSize = block->second - size;
+        _freeBlocks.erase(block);
+        if (remainingSize > 0)
+            _freeBlocks[offset + size] = remainingSize;
+
+        _allocations[offset] = size;
+        _usedSize += size;
+        return true;
+    }
+
+    return false;
+}
+
+void BufferSuballocator::free (size_t offset)
+{
+    std::map<size_t, size_t>::iterator allocation = _allocations.find(offset);
+    assert (allocation != _allocations.end());
+    if (allocation == _allocations.end())
+        return;
+
+    size_t size = allocation->second;
+    _usedSize -= size;
+    _allocations.erase(allocation);
+
+    // Merge with the free blocks on both sides.
+    std::map<size_t, size_t>::iterator next = _freeBlocks.lower_bound(offset);
+    if (next != _freeBlocks.end() && next->first == offset + size)
+    {
+        size += next->second;
+        next = _freeBlocks.erase(next);
+    }
+
+    if (next != _freeBlocks.begin())
+    {
+        std::map<size_t, size_t>::iterator previous = next;
+        --previous;
+        if (previous->first + previous->second == offset)
+        {
+            previous->second += size;
+            return;
+        }
+    }
+
+    _freeBlocks[offset] = size;
+}
+
+std::vector<BufferSuballocator::Move> BufferSuballocator::compact ()
+{
+    std::vector<Move> moves;
+    std::map<size_t, size_t> packedAllocations;
+
+    size_t end = 0;
+    for (const std::pair<const size_t, size_t>& allocation : _allocations)
+    {
+        if (allocation.first != end)
+        {
+            Move move;
+            move.from = allocation.first;
+            move.to = end;
+            move.size = allocation.second;
+            moves.push_back(move);
+        }
+
+        packedAllocations[end] = allocation.second;
+        end += allocation.second;
+    }
+
+    _allocations.swap(packedAllocations);
+
+    _freeBlocks.clear();
+    if (end < _capacity)
+        _freeBlocks[end] = _capacity - end;
+
+    return moves;
+}
+
+BufferSuballocator::Statistics BufferSuballocator::statistics () const
+{
+    Statistics statistics;
+    statistics.capacity = _capacity;
+    statistics.usedSize = _usedSize;
+    statistics.numAllocations = (int)_allocations.size();
+    statistics.numFreeBlocks = (int)_freeBlocks.size();
+    for (const std::pair<const size_t, size_t>& block : _freeBlocks)
+        statistics.largestFreeBlock = std::max(statistics.largestFreeBlock, block.second);
+    return statistics;
+}
+
+size_t relocateOffset (const std::vector<BufferSuballocator::Move>& moves, size_t offset)
+{
+    // Last move starting at or before offset.
+    std::vector<BufferSuballocator::Move>::const_iterator move =
+        std::upper_bound(moves.begin(), moves.end(), offset,
+                         [](size_t value, const BufferSuballocator::Move& m) { return value < m.from; });
+
+    if (move == moves.begin())
+        return offset;
+
+    --move;
+    if (offset < move->from + move->size)
+        return offset - move->from + move->to;
+    return offset;
+}
@@ -0,0 +1,69 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+// Ranges of a fixed-size buffer handed out first-fit, in whatever unit the caller counts, e.g.
+// vertices or indices. Freed ranges are merged with their free neighbours, and compact slides the
+// allocations back to the start of the buffer. Does not touch the buffer itself.
+class BufferSuballocator
+{
+public:
+    // An allocation moved by compact, from and to are offsets.
+    struct Move
+    {
+        size_t from;
+        size_t to;
+        size_t size;
+    };
+
+    struct Statistics
+    {
+        size_t capacity = 0;
+        size_t usedSize = 0;
+        size_t largestFreeBlock = 0;
+        int numAllocations = 0;
+        int numFreeBlocks = 0;
+    };
+
+public:
+    explicit BufferSuballocator (size_t capacity = 0);
+
+    // Forgets all the allocations.
+    void reset (size_t capacity);
+
+    // Returns false if no free block can hold size, which may still be less than freeSize.
+    bool allocate (size_t size, size_t& offset);
+
+    // offset must have been returned by allocate.
+    void free (size_t offset);
+
+    // Packs the allocations in their order at the start of the buffer, leaving a single free block.
+    // The moves are sorted by offset and only go backwards, so applying them in order with memmove
+    // never overwrites data still to be moved.
+    std::vector<Move> compact ();
+
+    size_t capacity () const { return _capacity; }
+    size_t usedSize () const { return _usedSize; }
+    size_t freeSize () const { return _capacity - _usedSize; }
+    Statistics statistics () const;
+
+private:
+    size_t _capacity = 0;
+    size_t _usedSize = 0;
+
+    // Offset to size, the free blocks never touch each other.
+    std::map<size_t, size_t> _allocations;
+    std::map<size_t, size_t> _freeBlocks;
+};
+
+// New offset of the data that was at offset before the moves, for offsets inside a moved allocation or
+// not moved at all.
+size_t relocateOffset (const std::vector<BufferSuballocator::Move>& moves, size_t offset);
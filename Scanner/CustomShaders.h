@@ -8,6 +8,9 @@
 
 #include <GLKit/GLKit.h>
 
+#import "RenderCommandList.h"
+#import "MeshShaderGenerator.h"
+
 // Helper functions.
 GLuint loadOpenGLProgramFromString (const char *vertex_shader_src,
                                     const char *fragment_shader_src,
@@ -19,328 +22,73 @@ class CustomShader
 {
 public:
     enum {
-        ATTRIB_VERTEX,
-        ATTRIB_NORMAL,
-        ATTRIB_COLOR,
-        ATTRIB_TEXCOORD,
+        ATTRIB_VERTEX = MeshShaderAttributePosition,
+        ATTRIB_NORMAL = MeshShaderAttributeNormal,
+        ATTRIB_COLOR = MeshShaderAttributeColor,
+        ATTRIB_TEXCOORD = MeshShaderAttributeTexcoord,
+        ATTRIB_CORNER_COLOR = MeshShaderAttributeCornerColor,
     };
     
 public:
     CustomShader ()
-    : _loaded (false)
+    : _glProgram (0)
+    , _loaded (false)
+    , _projectionLocation (-1)
+    , _modelviewLocation (-1)
     {}
     
 public:
     
     virtual void load () = 0;
+    bool isLoaded () const { return _loaded; }
     
-    virtual void enable ()
+    virtual void enable (GLStateCache& cache)
     {
         if (!_loaded)
+        {
             load ();
-        glUseProgram (_glProgram);
+            cache.invalidateProgram ();
+        }
+        cache.useProgram (_glProgram);
     }
     
-protected:
-    virtual const char *vertexShaderSource() = 0;
-    virtual const char *fragmentShaderSource() = 0;
-    
 protected:
     GLuint _glProgram;
     bool _loaded;
-};
-
-
-class LightedGrayShader : public CustomShader
-{
-public:
-    
-    virtual void prepareRendering (const float *projection, const float *modelView)
-    {
-        glUniformMatrix4fv(_modelviewLocation, 1, GL_FALSE, modelView);
-        glUniformMatrix4fv (_projectionLocation, 1, GL_FALSE, projection);
-        
-        glDisable (GL_BLEND);
-    }
-    
-    virtual void load()
-    {
-        const int NUM_ATTRIBS = 2;
-        
-        GLuint attributeIds[NUM_ATTRIBS] = { ATTRIB_VERTEX, ATTRIB_NORMAL };
-        const char *attributeNames[NUM_ATTRIBS] = { "a_position", "a_normal" };
-        
-        _glProgram = loadOpenGLProgramFromString(vertexShaderSource(), fragmentShaderSource(), NUM_ATTRIBS, attributeIds, attributeNames);
-        
-        _projectionLocation = glGetUniformLocation(_glProgram, "u_perspective_projection");
-        _modelviewLocation = glGetUniformLocation(_glProgram, "u_modelview");
-        
-        glUseProgram(0);
-        _loaded = true;
-    }
-    
-protected:
-    
-    const char *vertexShaderSource ()
-    {
-        return R"(
-        attribute vec4 a_position;
-        attribute vec3 a_normal;
-        
-        uniform mat4 u_perspective_projection;
-        uniform mat4 u_modelview;
-        
-        varying float v_luminance;
-        
-        void main()
-        {
-            gl_Position = u_perspective_projection*u_modelview*a_position;
-            
-            //mat3 scaledRotation = mat3(u_modelview);
-            
-            // Directional lighting that moves with the camera
-            vec3 vec = mat3(u_modelview)*a_normal;
-            
-            // Slightly reducing the effect of the lighting
-            v_luminance = 0.5*abs(vec.z) + 0.5;
-        }
-        )";
-    }
     
-    const char *fragmentShaderSource ()
-    {
-        return R"(
-        precision mediump float;
-        
-        varying float v_luminance;
-        
-        void main()
-        {
-            gl_FragColor = vec4(v_luminance, v_luminance, v_luminance, 1.0);
-        }
-        )";
-    }
-    
-private:
-    GLuint _projectionLocation;
-    GLuint _modelviewLocation;
+    GLint _projectionLocation;
+    GLint _modelviewLocation;
 };
 
-
-class PerVertexColorShader : public CustomShader
-{
-public:
-    
-    virtual void load()
-    {
-        const int NUM_ATTRIBS = 3;
-        
-        GLuint attributeIds[NUM_ATTRIBS] = { ATTRIB_VERTEX, ATTRIB_NORMAL, ATTRIB_COLOR };
-        const char *attributeNames[NUM_ATTRIBS] = { "a_position", "a_normal", "a_color" };
-        
-        _glProgram = loadOpenGLProgramFromString(vertexShaderSource(), fragmentShaderSource(), NUM_ATTRIBS, attributeIds, attributeNames);
-        
-        _projectionLocation = glGetUniformLocation(_glProgram, "u_perspective_projection");
-        _modelviewLocation = glGetUniformLocation(_glProgram, "u_modelview");
-        
-        glUseProgram(0);
-        _loaded = true;
-    }
-    
-    virtual void prepareRendering (const float *projection, const float *modelView)
-    {
-        glUniformMatrix4fv(_modelviewLocation, 1, GL_FALSE, modelView);
-        glUniformMatrix4fv (_projectionLocation, 1, GL_FALSE, projection);
-        
-        glDisable (GL_BLEND);
-    }
-    
-protected:
-    
-    const char *vertexShaderSource ()
-    {
-        return R"(
-        attribute vec4 a_position;
-        attribute vec3 a_normal;
-        attribute vec3 a_color;
-        uniform mat4 u_perspective_projection;
-        uniform mat4 u_modelview;
-        
-        varying vec3 v_color;
-        
-        void main()
-        {
-            gl_Position = u_perspective_projection*u_modelview*a_position;
-            v_color = a_color;
-        }
-        )";
-    }
-    
-    const char *fragmentShaderSource ()
-    {
-        return R"(
-        precision mediump float;
-        
-        varying vec3 v_color;
-        void main()
-        {
-            gl_FragColor = vec4(v_color, 1.0);
-        }
-        )";
-    }
-    
-private:
-    GLuint _projectionLocation;
-    GLuint _modelviewLocation;
-};
-
-
-class XrayShader : public CustomShader
+// One variant of the mesh shaders, its GLSL is generated from the features of its key. Replaces
+// the hand-written shader of each rendering mode, which only differed by a few lines.
+class MeshShader : public CustomShader
 {
 public:
+    explicit MeshShader (MeshShaderKey key = 0)
+    : _key (key)
+    {}
     
-    virtual void load()
-    {
-        const int NUM_ATTRIBS = 2;
-        
-        GLuint attributeIds[NUM_ATTRIBS] = { ATTRIB_VERTEX, ATTRIB_NORMAL };
-        const char *attributeNames[NUM_ATTRIBS] = { "a_position", "a_normal" };
-        
-        _glProgram = loadOpenGLProgramFromString(vertexShaderSource(), fragmentShaderSource(), NUM_ATTRIBS, attributeIds, attributeNames);
-        
-        _projectionLocation = glGetUniformLocation(_glProgram, "u_perspective_projection");
-        _modelviewLocation = glGetUniformLocation(_glProgram, "u_modelview");
-        
-        glUseProgram(0);
-        _loaded = true;
-    }
+    MeshShaderKey key () const { return _key; }
     
-    virtual void prepareRendering (const float *projection, const float *modelView)
-    {
-        glUniformMatrix4fv(_modelviewLocation, 1, GL_FALSE, modelView);
-        glUniformMatrix4fv (_projectionLocation, 1, GL_FALSE, projection);
-        
-        glDisable (GL_BLEND);
-    }
+    virtual void load ();
     
-protected:
+    // The luma and chroma planes of a MeshShaderYCbCrTexture variant are read from textureUnit and
+    // the next unit, the texture of a MeshShaderRgbTexture variant from textureUnit.
+    void prepareRendering (GLStateCache& cache, const float *projection, const float *modelView, GLenum textureUnit = GL_TEXTURE0);
     
-    virtual const char *vertexShaderSource ()
-    {
-        return R"(
-        attribute vec4 a_position;
-        attribute vec3 a_normal;
-        uniform mat4 u_perspective_projection;
-        uniform mat4 u_modelview;
-        
-        varying float v_luminance;
-        
-        void main()
-        {
-            gl_Position = u_perspective_projection*u_modelview*a_position;
-            
-            // Directional lighting that moves with the camera
-            vec3 vec = mat3(u_modelview)*a_normal;
-            v_luminance = 1.0 - abs(vec.z);
-        }
-        )";
-    }
+    // Origin and size of the quantization cube, for the MeshShaderQuantizedPositions variants.
+    void setDequantization (GLStateCache& cache, const float dequantization[4]);
     
-    virtual const char *fragmentShaderSource ()
-    {
-        return R"(
-        precision mediump float;
-        
-        varying float v_luminance;
-        
-        void main()
-        {
-            gl_FragColor = vec4(v_luminance, v_luminance, v_luminance, 1.0);
-        }
-        )";
-    }
+    // Diameter at clip w = 1 and its bounds in pixels, for the MeshShaderPointSplats variants.
+    void setPointSplat (GLStateCache& cache, const float pointSplat[4]);
     
 private:
-    GLuint _projectionLocation;
-    GLuint _modelviewLocation;
-};
-
-class YCbCrTextureShader : public CustomShader
-{
-public:
-    virtual void load ()
-    {
-        GLuint attributeIds[2] = { ATTRIB_VERTEX, ATTRIB_TEXCOORD};
-        const char *attributeNames[2] = { "a_position", "a_texCoord" };
-        
-        _glProgram = loadOpenGLProgramFromString(vertexShaderSource(), fragmentShaderSource(), 2, attributeIds, attributeNames);
-        
-        _projectionLocation = glGetUniformLocation(_glProgram, "u_perspective_projection");
-        _modelviewLocation = glGetUniformLocation(_glProgram, "u_modelview");
-        _ySamplerLocation = glGetUniformLocation(_glProgram, "s_texture_y");
-        _cbcrSamplerLocation = glGetUniformLocation(_glProgram, "s_texture_cbcr");
-        
-        glUseProgram(0);
-        _loaded = true;
-    }
-    
-    virtual void prepareRendering (const float *projection, const float *modelView, GLint textureUnit)
-    {
-        glUniformMatrix4fv (_modelviewLocation, 1, GL_FALSE, modelView);
-        glUniformMatrix4fv (_projectionLocation, 1, GL_FALSE, projection);
-        
-        glUniform1i (_ySamplerLocation, textureUnit - GL_TEXTURE0);
-        glUniform1i (_cbcrSamplerLocation, textureUnit + 1 - GL_TEXTURE0);
-    }
+    MeshShaderKey _key;
     
-    virtual const char *vertexShaderSource ()
-    {
-        return R"(
-        attribute vec4 a_position;
-        attribute vec2 a_texCoord;
-        uniform mat4 u_perspective_projection;
-        uniform mat4 u_modelview;
-        
-        varying vec2 v_texCoord;
-        
-        void main()
-        {
-            gl_Position = u_perspective_projection*u_modelview*a_position;
-            
-            v_texCoord = a_texCoord;
-        }
-        )";
-    }
-    
-    virtual const char *fragmentShaderSource ()
-    {
-        return R"(
-        precision mediump float;
-        
-        uniform sampler2D s_texture_y;
-        uniform sampler2D s_texture_cbcr;
-        
-        varying vec2 v_texCoord;
-        void main()
-        {
-            mediump vec3 yuv;
-            lowp vec3 rgb;
-            
-            yuv.x = texture2D(s_texture_y, v_texCoord).r;
-            yuv.yz = texture2D(s_texture_cbcr, v_texCoord).rg - vec2(0.5, 0.5);
-            
-            rgb = mat3(      1,       1,      1,
-                       0, -.18732, 1.8556,
-                       1.57481, -.46813,      0) * yuv;
-            
-            gl_FragColor = vec4(rgb, 1.0);
-        }
-        )";
-    }
-    
-public:
-    GLuint _projectionLocation;
-    GLuint _modelviewLocation;
-    GLuint _ySamplerLocation;
-    GLuint _cbcrSamplerLocation;
+    GLint _dequantizationLocation = -1;
+    GLint _pointSplatLocation = -1;
+    GLint _ySamplerLocation = -1;
+    GLint _cbcrSamplerLocation = -1;
+    GLint _rgbSamplerLocation = -1;
 };
@@ -6,6 +6,8 @@
 
 #include "CustomShaders.h"
 
+#include <vector>
+
 GLuint loadOpenGLShaderFromString(GLenum type, const char *shaderSrc)
 {
     GLuint shader;
@@ -121,3 +123,59 @@ GLuint loadOpenGLProgramFromString (const char *vertex_shader_src,
     
     return program_object;
 }
+
+void MeshShader::load ()
+{
+    const MeshShaderSource source = generateMeshShaderSource(_key);
+    
+    std::vector<GLuint> attributeIds;
+    std::vector<const char*> attributeNames;
+    for (const MeshShaderSource::Attribute& attribute : source.attributes)
+    {
+        attributeIds.push_back(attribute.index);
+        attributeNames.push_back(attribute.name);
+    }
+    
+    _glProgram = loadOpenGLProgramFromString(source.vertexShader.c_str(), source.fragmentShader.c_str(),
+                                             (int)attributeIds.size(), attributeIds.data(), attributeNames.data());
+    
+    _projectionLocation = glGetUniformLocation(_glProgram, "u_perspective_projection");
+    _modelviewLocation = glGetUniformLocation(_glProgram, "u_modelview");
+    _dequantizationLocation = glGetUniformLocation(_glProgram, "u_dequantization");
+    _pointSplatLocation = glGetUniformLocation(_glProgram, "u_pointSplat");
+    _ySamplerLocation = glGetUniformLocation(_glProgram, "s_texture_y");
+    _cbcrSamplerLocation = glGetUniformLocation(_glProgram, "s_texture_cbcr");
+    _rgbSamplerLocation = glGetUniformLocation(_glProgram, "s_texture");
+    
+    glUseProgram(0);
+    _loaded = true;
+}
+
+void MeshShader::prepareRendering (GLStateCache& cache, const float *projection, const float *modelView, GLenum textureUnit)
+{
+    cache.setUniformMatrix4 (_modelviewLocation, modelView);
+    cache.setUniformMatrix4 (_projectionLocation, projection);
+    
+    if (_key & MeshShaderYCbCrTexture)
+    {
+        cache.setUniform1i (_ySamplerLocation, textureUnit - GL_TEXTURE0);
+        cache.setUniform1i (_cbcrSamplerLocation, textureUnit + 1 - GL_TEXTURE0);
+    }
+    
+    if (_key & MeshShaderRgbTexture)
+        cache.setUniform1i (_rgbSamplerLocation, textureUnit - GL_TEXTURE0);
+    
+    cache.setCapability (GL_BLEND, false);
+}
+
+void MeshShader::setDequantization (GLStateCache& cache, const float dequantization[4])
+{
+    if (_dequantizationLocation >= 0)
+        cache.setUniform4 (_dequantizationLocation, dequantization);
+}
+
+void MeshShader::setPointSplat (GLStateCache& cache, const float pointSplat[4])
+{
+    if (_pointSplatLocation >= 0)
+        cache.setUniform4 (_pointSplatLocation, pointSplat);
+}
@@ -0,0 +1,368 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "EtcTextureEncoder.h"
+#include "SimdMath.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// Local functions
+namespace
+{
+
+    // Intensity modifiers, pixel index 0 -> +a, 1 -> +b, 2 -> -a, 3 -> -b.
+    const int kModifierTables[8][2] =
+    {
+        {  2,   8 }, {  5,  17 }, {  9,  29 }, { 13,  42 },
+        { 18,  60 }, { 24,  80 }, { 33, 106 }, { 47, 183 },
+    };
+
+    // Row-major pixels of the two subblocks, for flip 0 (left and right halves) and flip 1
+    // (top and bottom halves).
+    const int kSubblockPixels[2][2][8] =
+    {
+        { { 0, 1, 4, 5, 8, 9, 12, 13 }, { 2, 3, 6, 7, 10, 11, 14, 15 } },
+        { { 0, 1, 2, 3, 4, 5, 6, 7 }, { 8, 9, 10, 11, 12, 13, 14, 15 } },
+    };
+
+    // Pixels of a block in row-major order, edge pixels repeated past the image.
+    struct PixelBlock
+    {
+        float r[16];
+        float g[16];
+        float b[16];
+    };
+
+    void loadBlock (const Nv12Image& image, int blockX, int blockY, PixelBlock& block)
+    {
+        for (int y = 0; y < 4; ++y)
+        {
+            const int imageY = std::min(blockY * 4 + y, image.height - 1);
+            const uint8_t* lumaRow = image.luma + imageY * image.lumaBytesPerRow;
+            const uint8_t* chromaRow = image.chroma + (imageY / 2) * image.chromaBytesPerRow;
+
+            float luma[4], cb[4], cr[4];
+            for (int x = 0; x < 4; ++x)
+            {
+                const int imageX = std::min(blockX * 4 + x, image.width - 1);
+                luma[x] = lumaRow[imageX];
+                cb[x] = chromaRow[(imageX / 2) * 2];
+                cr[x] = chromaRow[(imageX / 2) * 2 + 1];
+            }
+
+            SimdFloat4 r, g, b;
+            simdYCbCrToRgb(simdLoad(luma), simdLoad(cb), simdLoad(cr), r, g, b);
+            simdStore(block.r + 4 * y, simdClamp(r, 0.f, 255.f));
+            simdStore(block.g + 4 * y, simdClamp(g, 0.f, 255.f));
+            simdStore(block.b + 4 * y, simdClamp(b, 0.f, 255.f));
+        }
+    }
+
+    int clampColor (int value)
+    {
+        return std::min(255, std::max(0, value));
+    }
+
+    // Picks the modifier table and the pixel indices of a subblock for an expanded base color,
+    // returns the squared error.
+    float encodeSubblock (const PixelBlock& block, const int pixels[8], const int base[3], int& bestTable, int bestIndices[8])
+    {
+        SimdFloat4 r[2], g[2], b[2];
+        for (int group = 0; group < 2; ++group)
+        {
+            float gr[4], gg[4], gb[4];
+            for (int i = 0; i < 4; ++i)
+            {
+                gr[i] = block.r[pixels[4 * group + i]];
+                gg[i] = block.g[pixels[4 * group + i]];
+                gb[i] = block.b[pixels[4 * group + i]];
+            }
+            r[group] = simdLoad(gr);
+            g[group] = simdLoad(gg);
+            b[group] = simdLoad(gb);
+        }
+
+        float bestError = FLT_MAX;
+        for (int table = 0; table < 8; ++table)
+        {
+            const int modifiers[4] = { kModifierTables[table][0], kModifierTables[table][1], -kModifierTables[table][0], -kModifierTables[table][1] };
+
+            // The 4 candidate colors are shared by the pixels, compare 4 pixels at a time.
+            float tableError = 0.f;
+            int tableIndices[8];
+            for (int group = 0; group < 2; ++group)
+            {
+                SimdFloat4 minError = simdSplat(FLT_MAX);
+                SimdFloat4 minIndex = simdSplat(0.f);
+                for (int index = 0; index < 4; ++index)
+                {
+                    const SimdFloat4 dr = r[group] - simdSplat(float(clampColor(base[0] + modifiers[index])));
+                    const SimdFloat4 dg = g[group] - simdSplat(float(clampColor(base[1] + modifiers[index])));
+                    const SimdFloat4 db = b[group] - simdSplat(float(clampColor(base[2] + modifiers[index])));
+                    const SimdFloat4 error = dr * dr + dg * dg + db * db;
+
+                    const SimdFloat4 better = simdLess(error, minError);
+                    minError = simdSelect(better, error, minError);
+                    minIndex = simdSelect(better, simdSplat(float(index)), minIndex);
+                }
+
+                float errors[4], indices[4];
+                simdStore(errors, minError);
+                simdStore(indices, minIndex);
+                for (int i = 0; i < 4; ++i)
+                {
+                    tableError += errors[i];
+                    tableIndices[4 * group + i] = int(indices[i]);
+                }
+            }
+
+            if (tableError < bestError)
+            {
+                bestError = tableError;
+                bestTable = table;
+                std::copy(tableIndices, tableIndices + 8, bestIndices);
+            }
+        }
+
+        return bestError;
+    }
+
+    struct BlockEncoding
+    {
+        bool differential = false;
+        bool flip = false;
+
+        // Quantized base colors, 4 or 5 bits.
+        int bases[2][3] = {};
+        int tables[2] = {};
+
+        // Per row-major pixel.
+        int indices[16] = {};
+
+        float error = FLT_MAX;
+    };
+
+    void writeBlock (const BlockEncoding& encoding, uint8_t* out)
+    {
+        uint32_t high = 0;
+        if (encoding.differential)
+        {
+            for (int channel = 0; channel < 3; ++channel)
+            {
+                const int delta = encoding.bases[1][channel] - encoding.bases[0][channel];
+                high |= uint32_t((encoding.bases[0][channel] << 3) | (delta & 7)) << (24 - 8 * channel);
+            }
+            high |= 2;
+        }
+        else
+        {
+            for (int channel = 0; channel < 3; ++channel)
+                high |= uint32_t((encoding.bases[0][channel] << 4) | encoding.bases[1][channel]) << (24 - 8 * channel);
+        }
+
+        high |= uint32_t(encoding.tables[0]) << 5 | uint32_t(encoding.tables[1]) << 2 | (encoding.flip ? 1 : 0);
+
+        // Pixel indices are stored column-major, most significant bits in the upper half.
+        uint32_t low = 0;
+        for (int pixel = 0; pixel < 16; ++pixel)
+        {
+            const int x = pixel % 4;
+            const int y = pixel / 4;
+            const int bit = x * 4 + y;
+            low |= uint32_t(encoding.indices[pixel] >> 1) << (16 + bit) | uint32_t(encoding.indices[pixel] & 1) << bit;
+        }
+
+        for (int i = 0; i < 4; ++i)
+        {
+            out[i] = uint8_t(high >> (24 - 8 * i));
+            out[4 + i] = uint8_t(low >> (24 - 8 * i));
+        }
+    }
+
+    // Tries both subblock orientations with 5-bit differential and 4-bit individual base colors, each
+    // subblock based on its average color.
+    void encodeBlock (const PixelBlock& block, uint8_t* out)
+    {
+        BlockEncoding best;
+
+        for (int flip = 0; flip < 2; ++flip)
+        {
+            float averages[2][3];
+            for (int subblock = 0; subblock < 2; ++subblock)
+            {
+                float sums[3] = { 0.f, 0.f, 0.f };
+                for (int pixel : kSubblockPixels[flip][subblock])
+                {
+                    sums[0] += block.r[pixel];
+                    sums[1] += block.g[pixel];
+                    sums[2] += block.b[pixel];
+                }
+                for (int channel = 0; channel < 3; ++channel)
+                    averages[subblock][channel] = sums[channel] / 8.f;
+            }
+
+            for (int differential = 0; differential < 2; ++differential)
+            {
+                BlockEncoding encoding;
+                encoding.differential = (differential == 1);
+                encoding.flip = (flip == 1);
+
+                const int maxBase = encoding.differential ? 31 : 15;
+                for (int subblock = 0; subblock < 2; ++subblock)
+                    for (int channel = 0; channel < 3; ++channel)
+                        encoding.bases[subblock][channel] = std::min(maxBase, std::max(0, int(std::lround(averages[subblock][channel] * maxBase / 255.f))));
+
+                // The second base is stored as a 3-bit difference to the first one.
+                if (encoding.differential)
+                    for (int channel = 0; channel < 3; ++channel)
+                        encoding.bases[1][channel] = std::min(encoding.bases[0][channel] + 3, std::max(encoding.bases[0][channel] - 4, encoding.bases[1][channel]));
+
+                encoding.error = 0.f;
+                for (int subblock = 0; subblock < 2; ++subblock)
+                {
+                    int expanded[3];
+                    for (int channel = 0; channel < 3; ++channel)
+                    {
+                        const int base = encoding.bases[subblock][channel];
+                        expanded[channel] = encoding.differential ? (base << 3) | (base >> 2) : base * 17;
+                    }
+
+                    int indices[8] = {};
+                    encoding.error += encodeSubblock(block, kSubblockPixels[flip][subblock], expanded, encoding.tables[subblock], indices);
+                    for (int i = 0; i < 8; ++i)
+                        encoding.indices[kSubblockPixels[flip][subblock][i]] = indices[i];
+                }
+
+                if (encoding.error < best.error)
+                    best = encoding;
+            }
+        }
+
+        writeBlock(best, out);
+    }
+
+    void convertPixel (const Nv12Image& image, int x, int y, uint8_t rgb[3])
+    {
+        const uint8_t* chroma = image.chroma + (y / 2) * image.chromaBytesPerRow + (x / 2) * 2;
+
+        SimdFloat4 r, g, b;
+        simdYCbCrToRgb(simdSplat(image.luma[y * image.lumaBytesPerRow + x]), simdSplat(chroma[0]), simdSplat(chroma[1]), r, g, b);
+
+        float channels[3][4];
+        simdStore(channels[0], r);
+        simdStore(channels[1], g);
+        simdStore(channels[2], b);
+        for (int channel = 0; channel < 3; ++channel)
+            rgb[channel] = uint8_t(clampColor(int(std::lround(channels[channel][0]))));
+    }
+
+} // Anonymous
+
+int etcBlockRowCount (int height)
+{
+    return (height + 3) / 4;
+}
+
+size_t etcEncodedSize (int width, int height)
+{
+    return size_t((width + 3) / 4) * etcBlockRowCount(height) * 8;
+}
+
+void encodeNv12ToEtc2 (const Nv12Image& image, int firstBlockRow, int numBlockRows, uint8_t* encoded)
+{
+    const int numBlockColumns = (image.width + 3) / 4;
+    const int endBlockRow = std::min(firstBlockRow + numBlockRows, etcBlockRowCount(image.height));
+
+    PixelBlock block;
+    for (int blockY = firstBlockRow; blockY < endBlockRow; ++blockY)
+    {
+        for (int blockX = 0; blockX < numBlockColumns; ++blockX)
+        {
+            loadBlock(image, blockX, blockY, block);
+            encodeBlock(block, encoded + (size_t(blockY) * numBlockColumns + blockX) * 8);
+        }
+    }
+}
+
+void decodeEtc2Block (const uint8_t block[8], uint8_t rgb[16 * 3])
+{
+    const uint32_t high = uint32_t(block[0]) << 24 | uint32_t(block[1]) << 16 | uint32_t(block[2]) << 8 | block[3];
+    const uint32_t low = uint32_t(block[4]) << 24 | uint32_t(block[5]) << 16 | uint32_t(block[6]) << 8 | block[7];
+
+    const bool differential = (high & 2) != 0;
+    const bool flip = (high & 1) != 0;
+    const int tables[2] = { int(high >> 5) & 7, int(high >> 2) & 7 };
+
+    int bases[2][3];
+    for (int channel = 0; channel < 3; ++channel)
+    {
+        const int byte = int(high >> (24 - 8 * channel)) & 0xff;
+        if (differential)
+        {
+            // The T, H and planar modes of ETC2 overflow the difference, encodeNv12ToEtc2 never does.
+            const int base = byte >> 3;
+            const int delta = ((byte & 7) ^ 4) - 4;
+            const int second = std::min(31, std::max(0, base + delta));
+            bases[0][channel] = (base << 3) | (base >> 2);
+            bases[1][channel] = (second << 3) | (second >> 2);
+        }
+        else
+        {
+            bases[0][channel] = (byte >> 4) * 17;
+            bases[1][channel] = (byte & 15) * 17;
+        }
+    }
+
+    for (int pixel = 0; pixel < 16; ++pixel)
+    {
+        const int x = pixel % 4;
+        const int y = pixel / 4;
+        const int bit = x * 4 + y;
+        const int subblock = flip ? (y >= 2) : (x >= 2);
+        const int index = int((low >> (16 + bit)) & 1) << 1 | int((low >> bit) & 1);
+
+        const int* table = kModifierTables[tables[subblock]];
+        const int modifier = (index & 2) ? -table[index & 1] : table[index & 1];
+        for (int channel = 0; channel < 3; ++channel)
+            rgb[pixel * 3 + channel] = uint8_t(clampColor(bases[subblock][channel] + modifier));
+    }
+}
+
+double computeEtc2Psnr (const Nv12Image& image, const uint8_t* encoded)
+{
+    const int numBlockColumns = (image.width + 3) / 4;
+
+    double squaredError = 0.0;
+    uint8_t decoded[16 * 3];
+    for (int blockY = 0; blockY < etcBlockRowCount(image.height); ++blockY)
+    {
+        for (int blockX = 0; blockX < numBlockColumns; ++blockX)
+        {
+            decodeEtc2Block(encoded + (size_t(blockY) * numBlockColumns + blockX) * 8, decoded);
+
+            for (int y = blockY * 4; y < std::min(blockY * 4 + 4, image.height); ++y)
+            {
+                for (int x = blockX * 4; x < std::min(blockX * 4 + 4, image.width); ++x)
+                {
+                    uint8_t reference[3];
+                    convertPixel(image, x, y, reference);
+
+                    const uint8_t* pixel = decoded + ((y - blockY * 4) * 4 + (x - blockX * 4)) * 3;
+                    for (int channel = 0; channel < 3; ++channel)
+                    {
+                        const double difference = double(pixel[channel]) - reference[channel];
+                        squaredError += difference * difference;
+                    }
+                }
+            }
+        }
+    }
+
+    const double meanSquaredError = squaredError / (3.0 * image.width * image.height);
+    return (meanSquaredError > 0.0) ? 10.0 * std::log10(255.0 * 255.0 / meanSquaredError) : INFINITY;
+}
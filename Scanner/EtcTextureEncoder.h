@@ -0,0 +1,28 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#include "Nv12Image.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// ETC2 RGB8 encoding (GL_COMPRESSED_RGB8_ETC2) of the RGB conversion of an NV12 image, 8 bytes per
+// 4x4 block, blocks in row-major order. Only the individual and differential modes are used, which
+// are also valid ETC1. The colors follow simdYCbCrToRgb, like the texture mesh shaders.
+int etcBlockRowCount (int height);
+size_t etcEncodedSize (int width, int height);
+
+// Encodes the block rows [firstBlockRow, firstBlockRow + numBlockRows) into encoded, which holds the
+// whole image. Block rows are independent, so ranges of them can be encoded on several threads.
+void encodeNv12ToEtc2 (const Nv12Image& image, int firstBlockRow, int numBlockRows, uint8_t* encoded);
+
+// Decodes a block written by encodeNv12ToEtc2 to 16 RGB pixels in row-major order.
+void decodeEtc2Block (const uint8_t block[8], uint8_t rgb[16 * 3]);
+
+// Peak signal-to-noise ratio of the decoded image against the RGB conversion of image, in dB.
+double computeEtc2Psnr (const Nv12Image& image, const uint8_t* encoded);
@@ -0,0 +1,211 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "FramePipeline.h"
+
+// Local functions
+namespace
+{
+
+    double secondsBetween (std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+    {
+        return std::chrono::duration<double>(end - start).count();
+    }
+
+} // Anonymous
+
+FramePipeline::FramePipeline (int numSlots, const std::string& firstStageName)
+: _numSlots (numSlots)
+{
+    // Acquired from the back, slot 0 first.
+    for (int slot = numSlots - 1; slot >= 0; --slot)
+        _freeSlots.push_back(slot);
+
+    StageStatistics firstStage;
+    firstStage.name = firstStageName;
+    _statistics.push_back(firstStage);
+}
+
+FramePipeline::~FramePipeline ()
+{
+    finish();
+}
+
+void FramePipeline::addStage (const std::string& name, const Stage& stage)
+{
+    if (_started)
+        return;
+
+    std::unique_ptr<StageThread> stageThread (new StageThread);
+    stageThread->stage = stage;
+    _stages.push_back(std::move(stageThread));
+
+    StageStatistics statistics;
+    statistics.name = name;
+    _statistics.push_back(statistics);
+}
+
+void FramePipeline::start ()
+{
+    if (_started)
+        return;
+
+    _started = true;
+    _startTime = Clock::now();
+    _lastFinishTime = _startTime;
+
+    for (int stage = 0; stage < (int)_stages.size(); ++stage)
+        _stages[stage]->thread = std::thread([this, stage] { runStage(stage); });
+}
+
+int FramePipeline::acquireSlot (bool wait)
+{
+    std::unique_lock<std::mutex> lock (_mutex);
+
+    if (_freeSlots.empty())
+    {
+        // The wait of a caller polling lasts from its first failed attempt.
+        if (!wait || !_started)
+        {
+            if (!_polling)
+            {
+                _polling = true;
+                _pollStart = Clock::now();
+            }
+            return -1;
+        }
+
+        const Clock::time_point waitStart = Clock::now();
+        _slotReleased.wait(lock, [this] { return !_freeSlots.empty(); });
+        _statistics[0].waitSeconds += secondsBetween(waitStart, Clock::now());
+    }
+
+    if (_polling)
+    {
+        _statistics[0].waitSeconds += secondsBetween(_pollStart, Clock::now());
+        _polling = false;
+    }
+
+    const int slot = _freeSlots.back();
+    _freeSlots.pop_back();
+    return slot;
+}
+
+void FramePipeline::submit (int slot, int frame, double busySeconds)
+{
+    std::unique_lock<std::mutex> lock (_mutex);
+
+    StageStatistics& statistics = _statistics[0];
+    ++statistics.numFrames;
+    statistics.busySeconds += busySeconds;
+
+    if (_stages.empty())
+    {
+        ++_numFinishedFrames;
+        _lastFinishTime = Clock::now();
+        _freeSlots.push_back(slot);
+        _slotReleased.notify_all();
+        return;
+    }
+
+    _stages[0]->input.push_back({ slot, frame });
+    _stages[0]->inputChanged.notify_one();
+}
+
+void FramePipeline::finish ()
+{
+    {
+        std::unique_lock<std::mutex> lock (_mutex);
+        if (!_started || _stopping)
+            return;
+
+        // The stages drain their inputs before stopping, from the first one.
+        _stopping = true;
+        if (!_stages.empty())
+            _stages[0]->inputChanged.notify_one();
+    }
+
+    for (std::unique_ptr<StageThread>& stage : _stages)
+        stage->thread.join();
+}
+
+std::vector<FramePipeline::StageStatistics> FramePipeline::statistics () const
+{
+    std::unique_lock<std::mutex> lock (_mutex);
+    return _statistics;
+}
+
+int FramePipeline::numFinishedFrames () const
+{
+    std::unique_lock<std::mutex> lock (_mutex);
+    return _numFinishedFrames;
+}
+
+double FramePipeline::elapsedSeconds () const
+{
+    std::unique_lock<std::mutex> lock (_mutex);
+    return secondsBetween(_startTime, _lastFinishTime);
+}
+
+double FramePipeline::framesPerSecond () const
+{
+    const double seconds = elapsedSeconds();
+    return seconds > 0.0 ? numFinishedFrames() / seconds : 0.0;
+}
+
+void FramePipeline::runStage (int stage)
+{
+    StageThread& thread = *_stages[stage];
+    const bool isLastStage = (stage + 1 == (int)_stages.size());
+
+    for (;;)
+    {
+        Frame frame;
+        {
+            // Once the previous stage is done, the last frames it handed over are in the input.
+            std::unique_lock<std::mutex> lock (_mutex);
+            const Clock::time_point waitStart = Clock::now();
+            thread.inputChanged.wait(lock, [&] {
+                const bool previousStageDone = (stage == 0) ? _stopping : _stages[stage - 1]->done;
+                return !thread.input.empty() || previousStageDone;
+            });
+
+            if (thread.input.empty())
+            {
+                thread.done = true;
+                if (!isLastStage)
+                    _stages[stage + 1]->inputChanged.notify_one();
+                return;
+            }
+
+            _statistics[stage + 1].waitSeconds += secondsBetween(waitStart, Clock::now());
+            frame = thread.input.front();
+            thread.input.pop_front();
+        }
+
+        const Clock::time_point busyStart = Clock::now();
+        thread.stage(frame.slot, frame.frame);
+        const Clock::time_point busyEnd = Clock::now();
+
+        std::unique_lock<std::mutex> lock (_mutex);
+        StageStatistics& statistics = _statistics[stage + 1];
+        ++statistics.numFrames;
+        statistics.busySeconds += secondsBetween(busyStart, busyEnd);
+
+        if (isLastStage)
+        {
+            ++_numFinishedFrames;
+            _lastFinishTime = busyEnd;
+            _freeSlots.push_back(frame.slot);
+            _slotReleased.notify_all();
+        }
+        else
+        {
+            _stages[stage + 1]->input.push_back(frame);
+            _stages[stage + 1]->inputChanged.notify_one();
+        }
+    }
+}
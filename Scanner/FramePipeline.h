@@ -0,0 +1,118 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Frames going through stages in order, e.g. rendering, readback, conversion and encoding of a video,
+// each stage working on its own thread on the next frame while the others work on theirs. Each frame in
+// flight owns one of a fixed number of slots, whose buffers the stages share: once all the slots are in
+// flight the first stage waits for the last one, so no stage gets more than the slots ahead of another
+// one and the memory stays bounded.
+class FramePipeline
+{
+public:
+    // Processes the frame held by the slot, on the thread of the stage.
+    typedef std::function<void (int slot, int frame)> Stage;
+
+    struct StageStatistics
+    {
+        std::string name;
+        int numFrames = 0;
+
+        // Processing the frames, and waiting for the previous stage or for a free slot.
+        double busySeconds = 0.0;
+        double waitSeconds = 0.0;
+
+        // The rate of the stage alone: the slowest stage bounds the rate of the pipeline.
+        double framesPerSecond () const { return busySeconds > 0.0 ? numFrames / busySeconds : 0.0; }
+    };
+
+public:
+    // The first stage is run by the caller, e.g. the rendering on the thread of the GL context, through
+    // acquireSlot and submit.
+    FramePipeline (int numSlots, const std::string& firstStageName);
+
+    // Finishes the frames in flight.
+    ~FramePipeline ();
+
+    int numSlots () const { return _numSlots; }
+
+    // Before start, in the order the frames go through them.
+    void addStage (const std::string& name, const Stage& stage);
+
+    // Starts the thread of each added stage.
+    void start ();
+
+    // A slot free for the next frame of the first stage. Waits for one, or returns -1 if all of them are
+    // in flight and wait is false.
+    int acquireSlot (bool wait);
+
+    // Hands the frame of the slot over to the next stage. busySeconds is the time the first stage spent
+    // on it.
+    void submit (int slot, int frame, double busySeconds);
+
+    // Waits for the submitted frames to go through all the stages, and stops their threads.
+    void finish ();
+
+    // The first stage, then the added ones.
+    std::vector<StageStatistics> statistics () const;
+
+    // From start to the last frame leaving the pipeline, its overall rate.
+    int numFinishedFrames () const;
+    double elapsedSeconds () const;
+    double framesPerSecond () const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Frame
+    {
+        int slot;
+        int frame;
+    };
+
+    struct StageThread
+    {
+        Stage stage;
+        std::deque<Frame> input;
+        std::condition_variable inputChanged;
+        std::thread thread;
+
+        // Stopped, after handing its last frame over.
+        bool done = false;
+    };
+
+    void runStage (int stage);
+
+private:
+    int _numSlots;
+    bool _started = false;
+    bool _stopping = false;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _slotReleased;
+    std::vector<int> _freeSlots;
+    bool _polling = false;
+    Clock::time_point _pollStart;
+
+    // The added stages, the first one having no thread.
+    std::vector<std::unique_ptr<StageThread>> _stages;
+    std::vector<StageStatistics> _statistics;
+
+    int _numFinishedFrames = 0;
+    Clock::time_point _startTime;
+    Clock::time_point _lastFinishTime;
+};
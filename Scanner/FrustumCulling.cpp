@@ -0,0 +1,143 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "FrustumCulling.h"
+#include "SimdMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+AxisAlignedBox computeAxisAlignedBox (const float* positions, int numVertices)
+{
+    AxisAlignedBox box;
+    if (numVertices <= 0)
+        return box;
+
+    box.empty = false;
+    for (int axis = 0; axis < 3; ++axis)
+        box.min[axis] = box.max[axis] = positions[axis];
+
+    const int numFullBlocks = numVertices / 4;
+    if (numFullBlocks > 0)
+    {
+        SimdFloat4 minX = simdSplat(box.min[0]), minY = simdSplat(box.min[1]), minZ = simdSplat(box.min[2]);
+        SimdFloat4 maxX = minX, maxY = minY, maxZ = minZ;
+
+        for (int block = 0; block < numFullBlocks; ++block)
+        {
+            SimdFloat4 x, y, z;
+            simdLoadDeinterleave3(positions + 12*block, x, y, z);
+            minX = simdMin(minX, x); maxX = simdMax(maxX, x);
+            minY = simdMin(minY, y); maxY = simdMax(maxY, y);
+            minZ = simdMin(minZ, z); maxZ = simdMax(maxZ, z);
+        }
+
+        float lanes[6][4];
+        simdStore(lanes[0], minX); simdStore(lanes[1], minY); simdStore(lanes[2], minZ);
+        simdStore(lanes[3], maxX); simdStore(lanes[4], maxY); simdStore(lanes[5], maxZ);
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                box.min[axis] = std::min(box.min[axis], lanes[axis][i]);
+                box.max[axis] = std::max(box.max[axis], lanes[3+axis][i]);
+            }
+        }
+    }
+
+    for (int v = 4*numFullBlocks; v < numVertices; ++v)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            box.min[axis] = std::min(box.min[axis], positions[3*v + axis]);
+            box.max[axis] = std::max(box.max[axis], positions[3*v + axis]);
+        }
+    }
+
+    return box;
+}
+
+Frustum makeFrustum (const float m[16])
+{
+    // Row i of the column-major matrix is m[i], m[4+i], m[8+i], m[12+i].
+    auto row = [m] (int i, int column) { return m[4*column + i]; };
+
+    Frustum frustum;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        for (int column = 0; column < 4; ++column)
+        {
+            frustum.planes[2*axis + 0][column] = row(3, column) + row(axis, column); // left, bottom, near
+            frustum.planes[2*axis + 1][column] = row(3, column) - row(axis, column); // right, top, far
+        }
+    }
+
+    for (float* plane : frustum.planes)
+    {
+        const float length = std::sqrt(plane[0]*plane[0] + plane[1]*plane[1] + plane[2]*plane[2]);
+        if (length > 0.f)
+        {
+            for (int c = 0; c < 4; ++c)
+                plane[c] /= length;
+        }
+    }
+
+    return frustum;
+}
+
+bool isBoxOutsideFrustum (const Frustum& frustum, const AxisAlignedBox& box)
+{
+    if (box.empty)
+        return true;
+
+    for (const float* plane : frustum.planes)
+    {
+        // The box corner furthest along the plane normal.
+        const float x = plane[0] >= 0.f ? box.max[0] : box.min[0];
+        const float y = plane[1] >= 0.f ? box.max[1] : box.min[1];
+        const float z = plane[2] >= 0.f ? box.max[2] : box.min[2];
+
+        if (plane[0]*x + plane[1]*y + plane[2]*z + plane[3] < 0.f)
+            return true;
+    }
+
+    return false;
+}
+
+int cullAndSortBoxes (const float viewProjection[16],
+                      const AxisAlignedBox* boxes,
+                      int numBoxes,
+                      int* visibleBoxes)
+{
+    const Frustum frustum = makeFrustum(viewProjection);
+
+    std::vector<std::pair<float, int> > sortKeys;
+    sortKeys.reserve(numBoxes);
+
+    for (int i = 0; i < numBoxes; ++i)
+    {
+        const AxisAlignedBox& box = boxes[i];
+        if (isBoxOutsideFrustum(frustum, box))
+            continue;
+
+        // The clip-space w of the center is its view depth for a perspective projection.
+        const float center[3] = { 0.5f * (box.min[0] + box.max[0]),
+                                  0.5f * (box.min[1] + box.max[1]),
+                                  0.5f * (box.min[2] + box.max[2]) };
+        const float depth = viewProjection[3]*center[0] + viewProjection[7]*center[1] + viewProjection[11]*center[2] + viewProjection[15];
+
+        sortKeys.push_back(std::make_pair(depth, i));
+    }
+
+    std::sort(sortKeys.begin(), sortKeys.end());
+
+    for (size_t i = 0; i < sortKeys.size(); ++i)
+        visibleBoxes[i] = sortKeys[i].second;
+
+    return (int)sortKeys.size();
+}
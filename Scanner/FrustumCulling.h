@@ -0,0 +1,40 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+// Matrices are 4x4 column-major, like GLKMatrix4 and OpenGL.
+
+struct AxisAlignedBox
+{
+    float min[3] = { 0.f, 0.f, 0.f };
+    float max[3] = { 0.f, 0.f, 0.f };
+
+    // Set by computeAxisAlignedBox, an empty box is never visible.
+    bool empty = true;
+};
+
+// positions are tightly packed xyz floats.
+AxisAlignedBox computeAxisAlignedBox (const float* positions, int numVertices);
+
+// Clip-space planes of a view-projection matrix (Gribb & Hartmann), normalized and pointing inwards:
+// a point p is inside plane i if planes[i][0..2] . p + planes[i][3] >= 0.
+struct Frustum
+{
+    float planes[6][4];
+};
+
+Frustum makeFrustum (const float viewProjection[16]);
+
+// Conservative: boxes crossing a plane corner-wise may be reported as visible.
+bool isBoxOutsideFrustum (const Frustum& frustum, const AxisAlignedBox& box);
+
+// Writes the indices of the boxes intersecting the frustum into visibleBoxes, sorted front to back by
+// the view depth of their center, and returns their number. visibleBoxes must hold numBoxes entries.
+int cullAndSortBoxes (const float viewProjection[16],
+                      const AxisAlignedBox* boxes,
+                      int numBoxes,
+                      int* visibleBoxes);
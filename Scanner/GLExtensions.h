@@ -0,0 +1,15 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+// Whether the current context is OpenGL ES 3 or later, from its version string.
+bool isOpenGLES3Context ();
+
+// Whether the extension string of the current context lists the extension. Extension names are
+// separated by spaces, and some are prefixes of others, so only whole names match. The ES2 extensions
+// promoted to core in OpenGL ES 3 count as present on an ES3 context, which does not list them.
+bool hasGLExtension (const char* name);
@@ -0,0 +1,62 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#import "GLExtensions.h"
+
+#import <GLKit/GLKit.h>
+
+#include <cstdlib>
+#include <cstring>
+
+// Local functions
+namespace
+{
+
+    // The ES2 extensions used by the app that are core in OpenGL ES 3.
+    const char* const kOpenGLES3CoreExtensions[] =
+    {
+        "GL_OES_element_index_uint",
+        "GL_EXT_map_buffer_range",
+        "GL_OES_mapbuffer",
+        "GL_APPLE_sync",
+        "GL_OES_vertex_half_float",
+        "GL_EXT_texture_rg",
+    };
+
+} // Anonymous
+
+bool isOpenGLES3Context ()
+{
+    // "OpenGL ES N.M" followed by vendor information.
+    const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    const char prefix[] = "OpenGL ES ";
+    if (version == NULL || strncmp(version, prefix, sizeof(prefix) - 1) != 0)
+        return false;
+
+    return atoi(version + sizeof(prefix) - 1) >= 3;
+}
+
+bool hasGLExtension (const char* name)
+{
+    const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+    if (extensions == NULL)
+        return false;
+
+    const size_t length = strlen(name);
+    for (const char* found = strstr(extensions, name); found != NULL; found = strstr(found + length, name))
+    {
+        const bool startsName = (found == extensions || found[-1] == ' ');
+        const bool endsName = (found[length] == ' ' || found[length] == '\0');
+        if (startsName && endsName)
+            return true;
+    }
+
+    for (const char* coreExtension : kOpenGLES3CoreExtensions)
+        if (strcmp(name, coreExtension) == 0)
+            return isOpenGLES3Context();
+
+    return false;
+}
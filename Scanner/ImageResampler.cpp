@@ -0,0 +1,171 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "ImageResampler.h"
+#include "SimdMath.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// Local functions
+namespace
+{
+
+    // Destination pixel i reads the source pixels first[i] to first[i] + numTaps[i] - 1, with the weights
+    // from i * maxTaps.
+    struct ResampleTaps
+    {
+        std::vector<int> first;
+        std::vector<int> numTaps;
+        std::vector<float> weights;
+        int maxTaps = 0;
+    };
+
+    double sinc (double x)
+    {
+        if (std::abs(x) < 1e-6)
+            return 1.0;
+        return std::sin(M_PI * x) / (M_PI * x);
+    }
+
+    ResampleTaps makeResampleTaps (int sourceSize, int destinationSize, ResampleFilter filter)
+    {
+        const double scale = double(sourceSize) / destinationSize;
+
+        // When upsampling the filter keeps its width in source pixels.
+        const double filterScale = std::max(1.0, scale);
+        const double support = (filter == ResampleFilterBox ? 0.5 : 3.0) * filterScale;
+
+        ResampleTaps taps;
+        taps.maxTaps = int(std::ceil(2.0 * support)) + 1;
+        taps.first.resize(destinationSize);
+        taps.numTaps.resize(destinationSize);
+        taps.weights.assign(size_t(destinationSize) * taps.maxTaps, 0.f);
+
+        std::vector<double> weights (taps.maxTaps);
+        for (int i = 0; i < destinationSize; ++i)
+        {
+            const double center = (i + 0.5) * scale;
+            const int first = std::max(0, int(std::floor(center - support)));
+            const int last = std::min(sourceSize - 1, int(std::ceil(center + support)));
+
+            double sum = 0.0;
+            int numTaps = 0;
+            for (int source = first; source <= last && numTaps < taps.maxTaps; ++source)
+            {
+                double weight;
+                if (filter == ResampleFilterBox)
+                {
+                    // Coverage of the source pixel by the destination one.
+                    weight = std::max(0.0, std::min(source + 1.0, center + support) - std::max(double(source), center - support));
+                }
+                else
+                {
+                    const double x = (source + 0.5 - center) / filterScale;
+                    weight = (std::abs(x) < 3.0) ? sinc(x) * sinc(x / 3.0) : 0.0;
+                }
+
+                weights[numTaps++] = weight;
+                sum += weight;
+            }
+
+            // The taps past the borders are dropped, the others renormalized.
+            taps.first[i] = first;
+            taps.numTaps[i] = numTaps;
+            for (int tap = 0; tap < numTaps; ++tap)
+                taps.weights[size_t(i) * taps.maxTaps + tap] = float(weights[tap] / sum);
+        }
+
+        return taps;
+    }
+
+    // Destination rows per parallel job.
+    const int kRowsPerJob = 16;
+
+} // Anonymous
+
+void resampleImage (const uint8_t* pixels, int width, int height, size_t bytesPerRow, bool bottomUp,
+                    ImageSize size, ResampleFilter filter, ColorImage& result,
+                    const ParallelFor& parallelFor)
+{
+    assert (width > 0 && height > 0 && size.width > 0 && size.height > 0);
+
+    const ResampleTaps horizontalTaps = makeResampleTaps(width, size.width, filter);
+    const ResampleTaps verticalTaps = makeResampleTaps(height, size.height, filter);
+
+    result.width = size.width;
+    result.height = size.height;
+    result.pixels.resize(size_t(size.width) * size.height * 4);
+
+    // 4 channels, the rows are a whole number of SIMD vectors.
+    const int rowSize = width * 4;
+
+    const int numJobs = (size.height + kRowsPerJob - 1) / kRowsPerJob;
+    parallelFor(numJobs, [&](int job) {
+
+        std::vector<float> filteredRow (rowSize);
+
+        const int lastY = std::min(size.height, (job + 1) * kRowsPerJob);
+        for (int y = job * kRowsPerJob; y < lastY; ++y)
+        {
+            // Vertical pass over whole rows, interleaved channels included.
+            std::fill (filteredRow.begin(), filteredRow.end(), 0.f);
+
+            const float* rowWeights = &verticalTaps.weights[size_t(y) * verticalTaps.maxTaps];
+            for (int tap = 0; tap < verticalTaps.numTaps[y]; ++tap)
+            {
+                const int sourceY = verticalTaps.first[y] + tap;
+                const uint8_t* row = pixels + size_t(bottomUp ? height - 1 - sourceY : sourceY) * bytesPerRow;
+                const SimdFloat4 weight = simdSplat(rowWeights[tap]);
+
+                for (int i = 0; i < rowSize; i += 4)
+                    simdStore(&filteredRow[i], simdLoad(&filteredRow[i]) + weight * simdLoadBytes(row + i));
+            }
+
+            // Horizontal pass, a SIMD vector holds the 4 channels of a pixel.
+            uint8_t* destination = &result.pixels[size_t(y) * size.width * 4];
+            for (int x = 0; x < size.width; ++x)
+            {
+                const float* columnWeights = &horizontalTaps.weights[size_t(x) * horizontalTaps.maxTaps];
+                const float* source = &filteredRow[horizontalTaps.first[x] * 4];
+
+                SimdFloat4 sum = simdSplat(0.f);
+                for (int tap = 0; tap < horizontalTaps.numTaps[x]; ++tap)
+                    sum = sum + simdSplat(columnWeights[tap]) * simdLoad(source + 4 * tap);
+
+                simdStoreBytes(destination + 4 * x, sum);
+            }
+        }
+    });
+}
+
+std::vector<ColorImage> buildImagePyramid (const uint8_t* pixels, int width, int height, size_t bytesPerRow, bool bottomUp,
+                                           const std::vector<ImageSize>& sizes, ResampleFilter filter,
+                                           const ParallelFor& parallelFor)
+{
+    std::vector<ImageSize> sortedSizes = sizes;
+    std::stable_sort (sortedSizes.begin(), sortedSizes.end(), [](ImageSize a, ImageSize b) {
+        return size_t(a.width) * a.height > size_t(b.width) * b.height;
+    });
+
+    std::vector<ColorImage> levels (sortedSizes.size());
+    for (size_t level = 0; level < levels.size(); ++level)
+    {
+        if (level == 0)
+        {
+            resampleImage(pixels, width, height, bytesPerRow, bottomUp, sortedSizes[0], filter, levels[0], parallelFor);
+        }
+        else
+        {
+            const ColorImage& source = levels[level - 1];
+            resampleImage(source.pixels.data(), source.width, source.height, size_t(source.width) * 4, false,
+                          sortedSizes[level], filter, levels[level], parallelFor);
+        }
+    }
+
+    return levels;
+}
@@ -0,0 +1,47 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#include "ParallelFor.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum ResampleFilter
+{
+    ResampleFilterBox = 0,   // average of the covered source pixels
+    ResampleFilterLanczos3,  // 3-lobed windowed sinc, sharper but may ring on hard edges
+};
+
+// An 8-bit image with 4 interleaved channels, RGBA or BGRA alike, rows tightly packed.
+struct ColorImage
+{
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+struct ImageSize
+{
+    int width;
+    int height;
+};
+
+// Resizes to any size with a separable filter stretched over the source pixels a destination pixel
+// covers. The source rows may be padded, and bottom-up as GL renders them: the result is top-down.
+// Bands of destination rows are spread with parallelFor.
+void resampleImage (const uint8_t* pixels, int width, int height, size_t bytesPerRow, bool bottomUp,
+                    ImageSize size, ResampleFilter filter, ColorImage& result,
+                    const ParallelFor& parallelFor = runOnThreads);
+
+// Resamples to each of the sizes, returned from the largest to the smallest. Each one is resampled
+// from the previous one, so that the filters span a few pixels of a near size rather than many of
+// the source.
+std::vector<ColorImage> buildImagePyramid (const uint8_t* pixels, int width, int height, size_t bytesPerRow, bool bottomUp,
+                                           const std::vector<ImageSize>& sizes, ResampleFilter filter,
+                                           const ParallelFor& parallelFor = runOnThreads);
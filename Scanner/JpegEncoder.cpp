@@ -0,0 +1,538 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "JpegEncoder.h"
+#include "SimdMath.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Local functions
+namespace
+{
+
+    // Natural index of the coefficients in the zigzag order.
+    const uint8_t kZigzag[64] = {
+         0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+        12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+        35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+        58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+    };
+
+    // The quantization tables of the JPEG specification, annex K, in the natural order.
+    const uint8_t kLumaQuantization[64] = {
+        16, 11, 10, 16,  24,  40,  51,  61,
+        12, 12, 14, 19,  26,  58,  60,  55,
+        14, 13, 16, 24,  40,  57,  69,  56,
+        14, 17, 22, 29,  51,  87,  80,  62,
+        18, 22, 37, 56,  68, 109, 103,  77,
+        24, 35, 55, 64,  81, 104, 113,  92,
+        49, 64, 78, 87, 103, 121, 120, 101,
+        72, 92, 95, 98, 112, 100, 103,  99,
+    };
+
+    const uint8_t kChromaQuantization[64] = {
+        17, 18, 24, 47, 99, 99, 99, 99,
+        18, 21, 26, 66, 99, 99, 99, 99,
+        24, 26, 56, 99, 99, 99, 99, 99,
+        47, 66, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+    };
+
+    // The Huffman tables of annex K: the number of codes of each length from 1 to 16, then the symbols.
+    const uint8_t kLumaDcBits[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+    const uint8_t kChromaDcBits[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+    const uint8_t kDcSymbols[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+    const uint8_t kLumaAcBits[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+    const uint8_t kLumaAcSymbols[162] = {
+        0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+        0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+        0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+        0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+        0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+        0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+        0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+        0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+        0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+        0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa,
+    };
+
+    const uint8_t kChromaAcBits[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+    const uint8_t kChromaAcSymbols[162] = {
+        0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+        0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+        0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+        0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+        0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+        0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+        0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+        0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+        0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+        0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa,
+    };
+
+    // Output scale of the AAN forward DCT per frequency.
+    const float kDctScales[8] = { 1.f, 1.387039845f, 1.306562965f, 1.175875602f, 1.f, 0.785694958f, 0.541196100f, 0.275899379f };
+
+    const int kBandRows = 16;
+    const size_t kOutputChunkSize = 64 * 1024;
+
+    void makeHuffmanCodes (const uint8_t bits[16], const uint8_t* symbols, uint16_t* codes, uint8_t* lengths)
+    {
+        uint16_t code = 0;
+        int symbol = 0;
+        for (int length = 1; length <= 16; ++length)
+        {
+            for (int i = 0; i < bits[length - 1]; ++i)
+            {
+                codes[symbols[symbol]] = code++;
+                lengths[symbols[symbol]] = uint8_t(length);
+                ++symbol;
+            }
+            code <<= 1;
+        }
+    }
+
+    void makeQuantization (const uint8_t base[64], int quality, uint8_t steps[64], float divisors[64])
+    {
+        const int scale = (quality < 50) ? 5000 / quality : 200 - 2 * quality;
+        for (int i = 0; i < 64; ++i)
+        {
+            steps[i] = uint8_t(std::min(255, std::max(1, (base[i] * scale + 50) / 100)));
+            divisors[i] = 1.f / (steps[i] * kDctScales[i / 8] * kDctScales[i % 8] * 8.f);
+        }
+    }
+
+    // Arai, Agui and Nakajima scaled 1D DCT of 4 columns at once, the scales folded in the divisors.
+    void forwardDct (SimdFloat4 d[8])
+    {
+        const SimdFloat4 tmp0 = d[0] + d[7];
+        const SimdFloat4 tmp7 = d[0] - d[7];
+        const SimdFloat4 tmp1 = d[1] + d[6];
+        const SimdFloat4 tmp6 = d[1] - d[6];
+        const SimdFloat4 tmp2 = d[2] + d[5];
+        const SimdFloat4 tmp5 = d[2] - d[5];
+        const SimdFloat4 tmp3 = d[3] + d[4];
+        const SimdFloat4 tmp4 = d[3] - d[4];
+
+        // Even part.
+        const SimdFloat4 tmp10 = tmp0 + tmp3;
+        const SimdFloat4 tmp13 = tmp0 - tmp3;
+        const SimdFloat4 tmp11 = tmp1 + tmp2;
+        const SimdFloat4 tmp12 = tmp1 - tmp2;
+
+        d[0] = tmp10 + tmp11;
+        d[4] = tmp10 - tmp11;
+
+        const SimdFloat4 z1 = (tmp12 + tmp13) * simdSplat(0.707106781f);
+        d[2] = tmp13 + z1;
+        d[6] = tmp13 - z1;
+
+        // Odd part.
+        const SimdFloat4 odd10 = tmp4 + tmp5;
+        const SimdFloat4 odd11 = tmp5 + tmp6;
+        const SimdFloat4 odd12 = tmp6 + tmp7;
+
+        const SimdFloat4 z5 = (odd10 - odd12) * simdSplat(0.382683433f);
+        const SimdFloat4 z2 = simdSplat(0.541196100f) * odd10 + z5;
+        const SimdFloat4 z4 = simdSplat(1.306562965f) * odd12 + z5;
+        const SimdFloat4 z3 = odd11 * simdSplat(0.707106781f);
+
+        const SimdFloat4 z11 = tmp7 + z3;
+        const SimdFloat4 z13 = tmp7 - z3;
+
+        d[5] = z13 + z2;
+        d[3] = z13 - z2;
+        d[1] = z11 + z4;
+        d[7] = z11 - z4;
+    }
+
+    // Transforms the 8 rows of the block along its columns, and writes the result transposed.
+    void forwardDctColumns (const float* samples, size_t stride, float* transposed)
+    {
+        for (int half = 0; half < 2; ++half)
+        {
+            SimdFloat4 rows[8];
+            for (int row = 0; row < 8; ++row)
+                rows[row] = simdLoad(samples + row * stride + 4 * half);
+
+            forwardDct(rows);
+
+            float lanes[4];
+            for (int row = 0; row < 8; ++row)
+            {
+                simdStore(lanes, rows[row]);
+                for (int lane = 0; lane < 4; ++lane)
+                    transposed[(4 * half + lane) * 8 + row] = lanes[lane];
+            }
+        }
+    }
+
+    // Bits to store the magnitude of value, its JPEG category.
+    int magnitudeCategory (int value)
+    {
+        unsigned magnitude = unsigned(std::abs(value));
+        int category = 0;
+        while (magnitude)
+        {
+            ++category;
+            magnitude >>= 1;
+        }
+        return category;
+    }
+
+    // JFIF conversion of 4 pixels, level shifted to [-128, 128).
+    void storeYCbCr (SimdFloat4 r, SimdFloat4 g, SimdFloat4 b, float* luma, float* blueChroma, float* redChroma)
+    {
+        simdStore(luma, simdSplat(0.299f) * r + simdSplat(0.587f) * g + simdSplat(0.114f) * b - simdSplat(128.f));
+        simdStore(blueChroma, simdSplat(-0.168736f) * r - simdSplat(0.331264f) * g + simdSplat(0.5f) * b);
+        simdStore(redChroma, simdSplat(0.5f) * r - simdSplat(0.418688f) * g - simdSplat(0.081312f) * b);
+    }
+
+} // Anonymous
+
+JpegEncoder::JpegEncoder (int width, int height, int quality, const Output& output)
+: _width (width)
+, _height (height)
+, _output (output)
+{
+    if (width <= 0 || height <= 0 || width > 65535 || height > 65535)
+    {
+        _failed = true;
+        return;
+    }
+
+    _paddedWidth = (width + 15) & ~15;
+    for (int component = 0; component < 3; ++component)
+        _band[component].resize(size_t(kBandRows) * _paddedWidth);
+
+    makeHuffmanCodes(kLumaDcBits, kDcSymbols, _dcCodes[0], _dcLengths[0]);
+    makeHuffmanCodes(kChromaDcBits, kDcSymbols, _dcCodes[1], _dcLengths[1]);
+    makeHuffmanCodes(kLumaAcBits, kLumaAcSymbols, _acCodes[0], _acLengths[0]);
+    makeHuffmanCodes(kChromaAcBits, kChromaAcSymbols, _acCodes[1], _acLengths[1]);
+
+    writeHeaders(std::min(100, std::max(1, quality)));
+}
+
+void JpegEncoder::addRows (const uint8_t* pixels, int numRows, size_t bytesPerRow, bool bgra)
+{
+    if (_failed)
+        return;
+
+    const int redOffset = bgra ? 2 : 0;
+    const int blueOffset = bgra ? 0 : 2;
+
+    for (int y = 0; y < numRows && _numAddedRows < _height; ++y)
+    {
+        const uint8_t* row = pixels + y * bytesPerRow;
+        float* luma = &_band[0][size_t(_numBandRows) * _paddedWidth];
+        float* blueChroma = &_band[1][size_t(_numBandRows) * _paddedWidth];
+        float* redChroma = &_band[2][size_t(_numBandRows) * _paddedWidth];
+
+        // The last pixel repeats up to the padded width.
+        for (int x = 0; x < _paddedWidth; x += 4)
+        {
+            float red[4], green[4], blue[4];
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                const uint8_t* pixel = row + 4 * std::min(x + lane, _width - 1);
+                red[lane] = pixel[redOffset];
+                green[lane] = pixel[1];
+                blue[lane] = pixel[blueOffset];
+            }
+
+            storeYCbCr(simdLoad(red), simdLoad(green), simdLoad(blue), luma + x, blueChroma + x, redChroma + x);
+        }
+
+        ++_numAddedRows;
+        if (++_numBandRows == kBandRows)
+            encodeBand();
+    }
+}
+
+void JpegEncoder::addRows (const Nv12Image& image, int firstRow, int numRows)
+{
+    if (_failed)
+        return;
+
+    for (int y = firstRow; y < firstRow + numRows && _numAddedRows < _height; ++y)
+    {
+        const uint8_t* lumaRow = image.luma + y * image.lumaBytesPerRow;
+        const uint8_t* chromaRow = image.chroma + (y / 2) * image.chromaBytesPerRow;
+        float* luma = &_band[0][size_t(_numBandRows) * _paddedWidth];
+        float* blueChroma = &_band[1][size_t(_numBandRows) * _paddedWidth];
+        float* redChroma = &_band[2][size_t(_numBandRows) * _paddedWidth];
+
+        // Back to RGB first: the BT.709 of the frames is not the BT.601 of JFIF.
+        for (int x = 0; x < _paddedWidth; x += 4)
+        {
+            float lumaSamples[4], blueSamples[4], redSamples[4];
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                const int column = std::min(x + lane, _width - 1);
+                lumaSamples[lane] = lumaRow[column];
+                blueSamples[lane] = chromaRow[2 * (column / 2)];
+                redSamples[lane] = chromaRow[2 * (column / 2) + 1];
+            }
+
+            SimdFloat4 r, g, b;
+            simdYCbCrToRgb(simdLoad(lumaSamples), simdLoad(blueSamples), simdLoad(redSamples), r, g, b);
+            storeYCbCr(simdClamp(r, 0.f, 255.f), simdClamp(g, 0.f, 255.f), simdClamp(b, 0.f, 255.f),
+                       luma + x, blueChroma + x, redChroma + x);
+        }
+
+        ++_numAddedRows;
+        if (++_numBandRows == kBandRows)
+            encodeBand();
+    }
+}
+
+bool JpegEncoder::finish ()
+{
+    if (_failed)
+        return false;
+
+    if (_numBandRows > 0)
+    {
+        // The last row repeats down to the band height.
+        for (int component = 0; component < 3; ++component)
+        {
+            std::vector<float>& band = _band[component];
+            for (int row = _numBandRows; row < kBandRows; ++row)
+                std::copy_n (band.begin() + size_t(_numBandRows - 1) * _paddedWidth, _paddedWidth,
+                             band.begin() + size_t(row) * _paddedWidth);
+        }
+        encodeBand();
+    }
+
+    flushBits();
+
+    const uint8_t endOfImage[2] = { 0xff, 0xd9 };
+    writeBytes(endOfImage, sizeof(endOfImage));
+    flushOutput();
+
+    return !_failed && _numAddedRows == _height;
+}
+
+size_t JpegEncoder::numBufferedBytes () const
+{
+    return (_band[0].capacity() + _band[1].capacity() + _band[2].capacity()) * sizeof(float) + _pending.capacity();
+}
+
+void JpegEncoder::writeHeaders (int quality)
+{
+    uint8_t lumaSteps[64], chromaSteps[64];
+    makeQuantization(kLumaQuantization, quality, lumaSteps, _divisors[0]);
+    makeQuantization(kChromaQuantization, quality, chromaSteps, _divisors[1]);
+
+    std::vector<uint8_t> headers = {
+        0xff, 0xd8,                                            // start of image
+        0xff, 0xe0, 0, 16, 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0, // JFIF 1.1, square pixels
+        0xff, 0xdb, 0, 132,                                    // both quantization tables
+    };
+
+    headers.push_back(0);
+    for (int i = 0; i < 64; ++i)
+        headers.push_back(lumaSteps[kZigzag[i]]);
+    headers.push_back(1);
+    for (int i = 0; i < 64; ++i)
+        headers.push_back(chromaSteps[kZigzag[i]]);
+
+    // Baseline frame, 2x2 luma blocks for each chroma block.
+    const uint8_t frame[] = {
+        0xff, 0xc0, 0, 17, 8,
+        uint8_t(_height >> 8), uint8_t(_height), uint8_t(_width >> 8), uint8_t(_width),
+        3, 1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1,
+    };
+    headers.insert(headers.end(), frame, frame + sizeof(frame));
+
+    struct { uint8_t tableClassAndIndex; const uint8_t* bits; const uint8_t* symbols; } huffmanTables[4] = {
+        { 0x00, kLumaDcBits, kDcSymbols },
+        { 0x10, kLumaAcBits, kLumaAcSymbols },
+        { 0x01, kChromaDcBits, kDcSymbols },
+        { 0x11, kChromaAcBits, kChromaAcSymbols },
+    };
+
+    std::vector<uint8_t> tables;
+    for (const auto& table : huffmanTables)
+    {
+        int numSymbols = 0;
+        for (int length = 0; length < 16; ++length)
+            numSymbols += table.bits[length];
+
+        tables.push_back(table.tableClassAndIndex);
+        tables.insert(tables.end(), table.bits, table.bits + 16);
+        tables.insert(tables.end(), table.symbols, table.symbols + numSymbols);
+    }
+
+    const size_t tablesLength = tables.size() + 2;
+    headers.insert(headers.end(), { 0xff, 0xc4, uint8_t(tablesLength >> 8), uint8_t(tablesLength) });
+    headers.insert(headers.end(), tables.begin(), tables.end());
+
+    // One scan of the 3 components, luma with the tables 0, chroma with the tables 1.
+    const uint8_t scan[] = { 0xff, 0xda, 0, 12, 3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0 };
+    headers.insert(headers.end(), scan, scan + sizeof(scan));
+
+    writeBytes(headers.data(), headers.size());
+}
+
+void JpegEncoder::encodeBand ()
+{
+    const size_t stride = _paddedWidth;
+
+    for (int x = 0; x < _paddedWidth; x += 16)
+    {
+        for (int block = 0; block < 4; ++block)
+        {
+            const float* samples = &_band[0][(block / 2) * 8 * stride + x + (block % 2) * 8];
+            encodeBlock(samples, stride, _divisors[0], _previousDc[0], _dcCodes[0], _dcLengths[0], _acCodes[0], _acLengths[0]);
+        }
+
+        for (int component = 1; component < 3; ++component)
+        {
+            // Average of 2x2 pixels, centered between them like the JFIF chroma.
+            float subsampled[64];
+            const float* band = &_band[component][x];
+            for (int row = 0; row < 8; ++row)
+            {
+                const float* top = band + 2 * row * stride;
+                const float* bottom = top + stride;
+                for (int column = 0; column < 8; ++column)
+                    subsampled[row * 8 + column] = 0.25f * (top[2 * column] + top[2 * column + 1] + bottom[2 * column] + bottom[2 * column + 1]);
+            }
+
+            encodeBlock(subsampled, 8, _divisors[1], _previousDc[component], _dcCodes[1], _dcLengths[1], _acCodes[1], _acLengths[1]);
+        }
+    }
+
+    _numBandRows = 0;
+
+    if (_pending.size() >= kOutputChunkSize)
+        flushOutput();
+}
+
+void JpegEncoder::encodeBlock (const float* samples, size_t stride, const float* divisors, int& previousDc,
+                               const uint16_t* dcCodes, const uint8_t* dcLengths,
+                               const uint16_t* acCodes, const uint8_t* acLengths)
+{
+    // Columns then rows, the two transpositions cancel: the coefficients are in the natural order.
+    float transposed[64];
+    float coefficients[64];
+    forwardDctColumns(samples, stride, transposed);
+    forwardDctColumns(transposed, 8, coefficients);
+
+    int quantized[64];
+    for (int i = 0; i < 64; ++i)
+    {
+        const int natural = kZigzag[i];
+        const float value = coefficients[natural] * divisors[natural];
+        quantized[i] = int(std::lround(value));
+    }
+
+    // The DC difference with the previous block of the component.
+    const int difference = quantized[0] - previousDc;
+    previousDc = quantized[0];
+
+    int category = magnitudeCategory(difference);
+    writeBits(dcCodes[category], dcLengths[category]);
+    writeBits(difference < 0 ? difference - 1 : difference, category);
+
+    // AC coefficients, runs of zeros then a category.
+    int run = 0;
+    for (int i = 1; i < 64; ++i)
+    {
+        const int value = quantized[i];
+        if (value == 0)
+        {
+            ++run;
+            continue;
+        }
+
+        for (; run >= 16; run -= 16)
+            writeBits(acCodes[0xf0], acLengths[0xf0]);
+
+        category = magnitudeCategory(value);
+        const int symbol = (run << 4) | category;
+        writeBits(acCodes[symbol], acLengths[symbol]);
+        writeBits(value < 0 ? value - 1 : value, category);
+        run = 0;
+    }
+
+    // End of block.
+    if (run > 0)
+        writeBits(acCodes[0x00], acLengths[0x00]);
+}
+
+void JpegEncoder::writeBits (uint32_t bits, int numBits)
+{
+    _bitBuffer = (_bitBuffer << numBits) | (bits & ((1u << numBits) - 1));
+    _numBufferedBits += numBits;
+
+    while (_numBufferedBits >= 8)
+    {
+        const uint8_t byte = uint8_t(_bitBuffer >> (_numBufferedBits - 8));
+        _pending.push_back(byte);
+
+        // A 0xff in the entropy coded data is followed by a stuffed zero.
+        if (byte == 0xff)
+            _pending.push_back(0);
+
+        _numBufferedBits -= 8;
+    }
+}
+
+void JpegEncoder::flushBits ()
+{
+    // Padded with ones.
+    if (_numBufferedBits > 0)
+        writeBits(0x7f, 8 - _numBufferedBits);
+}
+
+void JpegEncoder::writeBytes (const uint8_t* bytes, size_t size)
+{
+    _pending.insert(_pending.end(), bytes, bytes + size);
+}
+
+void JpegEncoder::flushOutput ()
+{
+    if (!_failed && !_pending.empty() && !_output(_pending.data(), _pending.size()))
+        _failed = true;
+
+    _pending.clear();
+}
+
+std::vector<uint8_t> encodeJpeg (const JpegSourceImage& image, int quality)
+{
+    std::vector<uint8_t> jpeg;
+    if (image.pixels == nullptr)
+        return jpeg;
+
+    JpegEncoder encoder (image.width, image.height, quality, [&](const uint8_t* data, size_t size) {
+        jpeg.insert(jpeg.end(), data, data + size);
+        return true;
+    });
+
+    if (image.bottomUp)
+    {
+        for (int y = image.height - 1; y >= 0; --y)
+            encoder.addRows(image.pixels + y * image.bytesPerRow, 1, image.bytesPerRow, image.bgra);
+    }
+    else
+    {
+        encoder.addRows(image.pixels, image.height, image.bytesPerRow, image.bgra);
+    }
+
+    if (!encoder.finish())
+        jpeg.clear();
+
+    return jpeg;
+}
@@ -0,0 +1,100 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#include "Nv12Image.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// 8-bit pixels with an ignored alpha, as rendered or read back.
+struct JpegSourceImage
+{
+    const uint8_t* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    size_t bytesPerRow = 0;
+
+    // BGRA like the CVPixelBuffers, instead of RGBA like glReadPixels.
+    bool bgra = false;
+
+    // The first row is the bottom one, as GL renders them.
+    bool bottomUp = false;
+};
+
+// Baseline JPEG encoder, YCbCr with 4:2:0 chroma and the standard Huffman tables, for the previews and
+// exports without ImageIO. The rows are encoded by bands of 16 as they are added, and the bands are the
+// only pixels kept: images of any height stream through a few rows of memory.
+class JpegEncoder
+{
+public:
+    // Receives the encoded bytes in order. Returning false stops the encoding, e.g. on a write error.
+    typedef std::function<bool (const uint8_t* data, size_t size)> Output;
+
+public:
+    // quality from 1 to 100, scaling the standard quantization tables like libjpeg. Writes the headers.
+    JpegEncoder (int width, int height, int quality, const Output& output);
+
+    // Rows top first, 4 bytes per pixel with an ignored alpha.
+    void addRows (const uint8_t* pixels, int numRows, size_t bytesPerRow, bool bgra);
+
+    // Rows of a frame already converted for a video, e.g. by convertToNv12, at the size of the encoder.
+    void addRows (const Nv12Image& image, int firstRow, int numRows);
+
+    // Encodes the last band and writes the end marker. False if the output failed or rows are missing.
+    bool finish ();
+
+    int numAddedRows () const { return _numAddedRows; }
+
+    // The band and the encoded bytes not yet output.
+    size_t numBufferedBytes () const;
+
+private:
+    void writeHeaders (int quality);
+    void encodeBand ();
+    void encodeBlock (const float* samples, size_t stride, const float* divisors, int& previousDc,
+                      const uint16_t* dcCodes, const uint8_t* dcLengths,
+                      const uint16_t* acCodes, const uint8_t* acLengths);
+
+    void writeBits (uint32_t bits, int numBits);
+    void flushBits ();
+    void writeBytes (const uint8_t* bytes, size_t size);
+    void flushOutput ();
+
+private:
+    int _width = 0;
+    int _height = 0;
+    Output _output;
+    bool _failed = false;
+
+    // The width rounded up to the 16 pixels of a block of 4 luma and 2 chroma blocks.
+    int _paddedWidth = 0;
+
+    // Level-shifted Y, Cb and Cr of the band being filled, at full resolution.
+    std::vector<float> _band[3];
+    int _numBandRows = 0;
+    int _numAddedRows = 0;
+
+    // Reciprocals of the quantization steps times the FDCT scale factors, for luma and chroma.
+    float _divisors[2][64];
+
+    // Codes and lengths of the DC categories, and of the AC run and category pairs.
+    uint16_t _dcCodes[2][12];
+    uint8_t _dcLengths[2][12];
+    uint16_t _acCodes[2][256];
+    uint8_t _acLengths[2][256];
+
+    int _previousDc[3] = { 0, 0, 0 };
+    uint32_t _bitBuffer = 0;
+    int _numBufferedBits = 0;
+    std::vector<uint8_t> _pending;
+};
+
+// Encodes a whole image in memory, empty on failure.
+std::vector<uint8_t> encodeJpeg (const JpegSourceImage& image, int quality = 90);
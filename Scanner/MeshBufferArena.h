@@ -0,0 +1,131 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#import <GLKit/GLKit.h>
+
+#include "BufferSuballocator.h"
+
+#include <cstdint>
+#include <vector>
+
+// Vertex and index buffers shared by all the chunks of a mesh, instead of a few buffer objects per chunk.
+// Each page has parallel vertex streams, each one an interleaved buffer, and an index buffer,
+// suballocated in vertices and indices. Indices are stored rebased on the page, so chunks lying
+// next to each other in a page can be drawn by a single glDrawElements. With GL_OES_element_index_uint
+// the indices are 32-bit and a page can hold the whole mesh, otherwise pages stop at 65536 vertices.
+class MeshBufferArena
+{
+public:
+    // The streams are uploaded separately, so the surface attributes can change without the geometry.
+    enum VertexStream
+    {
+        GeometryStream = 0, // positions and normals.
+        SurfaceStream,      // colors and texture coordinates, may be empty.
+        CornerColorStream,  // 4 bytes for the X-ray wireframe.
+
+        NumVertexStreams
+    };
+
+    // A range of a page, in vertices or indices.
+    struct Allocation
+    {
+        int page = -1;
+        int first = 0;
+        int count = 0;
+    };
+
+    struct Statistics
+    {
+        int numPages = 0;
+        int numBufferObjects = 0;
+        size_t numAllocatedBytes = 0;
+        size_t numUsedBytes = 0;
+        int numCompactions = 0;
+    };
+
+public:
+    // Looks for the index and buffer mapping extensions, the GL context must be current.
+    void initializeGL ();
+
+    // Frees all the allocations, the pages are kept for the next mesh.
+    void reset ();
+    void deleteBuffers ();
+
+    // Creates the buffers of the stream again in every page if the stride changes, dropping their data.
+    // 0 for an unused stream.
+    void setVertexStride (VertexStream stream, int stride);
+    int vertexStride (VertexStream stream) const { return _vertexStrides[stream]; }
+
+    // Expected size of the mesh, to size the pages created from now on.
+    void setExpectedSize (int numVertices, int numIndices);
+
+    // Returns an allocation handle. The page is chosen so that numIndices indices can then be allocated
+    // with the vertices, compacting a fragmented page rather than creating a new one when possible.
+    int allocateVertices (int numVertices, int numIndices);
+
+    // Indices for the vertices of vertexAllocation, in the same page. Returns -1 if the page is full.
+    int allocateIndices (int vertexAllocation, int numIndices);
+
+    void free (int allocation);
+
+    // Valid until the next allocation, which may compact the page.
+    const Allocation& allocation (int handle) const { return _allocations[handle]; }
+
+    // vertices holds the stream of the allocated vertices.
+    void uploadVertices (int vertexAllocation, VertexStream stream, const uint8_t* vertices);
+
+    // indices are relative to the vertices of the allocation they were allocated for.
+    void uploadIndices (int indexAllocation, const uint16_t* indices);
+
+    int numPages () const { return (int)_pages.size(); }
+    GLuint vertexBuffer (int page, VertexStream stream) const { return _pages[page].vertexBuffers[stream]; }
+    GLuint indexBuffer (int page) const { return _pages[page].indexBuffer; }
+
+    GLenum indexType () const { return _use32BitIndices ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT; }
+    int indexSize () const { return _use32BitIndices ? 4 : 2; }
+
+    Statistics statistics () const;
+
+private:
+    struct Page
+    {
+        GLuint vertexBuffers[NumVertexStreams] = {};
+        GLuint indexBuffer = 0;
+        BufferSuballocator vertices;
+        BufferSuballocator indices;
+    };
+
+    struct AllocationRecord : Allocation
+    {
+        bool used = false;
+        bool isIndices = false;
+
+        // For indices, the vertices they are rebased on.
+        int vertexAllocation = -1;
+    };
+
+    int createPage (int numVertices, int numIndices);
+    int createAllocation (int page, size_t first, int count, bool isIndices, int vertexAllocation);
+
+    // Packs the allocations of a page with glMapBufferRangeEXT, false if the buffers cannot be mapped.
+    bool compactVertices (int page);
+    bool compactIndices (int page);
+
+private:
+    bool _use32BitIndices = false;
+    bool _canMapBuffers = false;
+    int _vertexStrides[NumVertexStreams] = { 0, 0, 4 };
+
+    int _expectedNumVertices = 0;
+    int _expectedNumIndices = 0;
+
+    std::vector<Page> _pages;
+    std::vector<AllocationRecord> _allocations;
+    std::vector<int> _freeHandles;
+    int _numCompactions = 0;
+};
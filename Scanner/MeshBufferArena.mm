@@ -0,0 +1,407 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#import "MeshBufferArena.h"
+#import "GLExtensions.h"
+
+#import <OpenGLES/ES2/glext.h> // glMapBufferRangeEXT, glUnmapBufferOES
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+// Local functions
+namespace
+{
+
+    // Vertices addressable by 16-bit indices.
+    const int kMaxPageVertices16 = 1 << 16;
+
+    // 32-bit pages are large enough for a whole scan, but not so large that a small one wastes memory.
+    const int kMaxPageVertices32 = 1 << 20;
+    const int kMaxPageIndices = 6 << 20;
+
+    // Below this, a new page is not worth its own draws.
+    const int kMinPageVertices = 1 << 14;
+
+    GLuint createBuffer (GLenum target, GLsizeiptr size)
+    {
+        GLuint buffer = 0;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(target, buffer);
+        glBufferData(target, size, NULL, GL_STATIC_DRAW);
+        glBindBuffer(target, 0);
+        return buffer;
+    }
+
+    // Maps a whole buffer for reading and writing, NULL on failure.
+    uint8_t* mapBuffer (GLenum target, GLuint buffer, GLsizeiptr size)
+    {
+        glBindBuffer(target, buffer);
+        void* data = glMapBufferRangeEXT(target, 0, size, GL_MAP_READ_BIT_EXT | GL_MAP_WRITE_BIT_EXT);
+        if (data == NULL)
+            glBindBuffer(target, 0);
+        return static_cast<uint8_t*>(data);
+    }
+
+    void unmapBuffer (GLenum target)
+    {
+        glUnmapBufferOES(target);
+        glBindBuffer(target, 0);
+    }
+
+    void applyMoves (const std::vector<BufferSuballocator::Move>& moves, size_t elementSize, uint8_t* data)
+    {
+        for (const BufferSuballocator::Move& move : moves)
+            memmove(data + move.to * elementSize, data + move.from * elementSize, move.size * elementSize);
+    }
+
+    template <class Index>
+    void addToIndices (uint8_t* data, int first, int count, int delta)
+    {
+        Index* indices = reinterpret_cast<Index*>(data) + first;
+        for (int i = 0; i < count; ++i)
+            indices[i] = Index(indices[i] + delta);
+    }
+
+} // Anonymous
+
+void MeshBufferArena::initializeGL ()
+{
+    _use32BitIndices = hasGLExtension("GL_OES_element_index_uint");
+    _canMapBuffers = hasGLExtension("GL_EXT_map_buffer_range") && hasGLExtension("GL_OES_mapbuffer");
+}
+
+void MeshBufferArena::reset ()
+{
+    for (Page& page : _pages)
+    {
+        page.vertices.reset(page.vertices.capacity());
+        page.indices.reset(page.indices.capacity());
+    }
+
+    _allocations.clear();
+    _freeHandles.clear();
+}
+
+void MeshBufferArena::deleteBuffers ()
+{
+    for (Page& page : _pages)
+    {
+        glDeleteBuffers(NumVertexStreams, page.vertexBuffers);
+        glDeleteBuffers(1, &page.indexBuffer);
+    }
+
+    _pages.clear();
+    _allocations.clear();
+    _freeHandles.clear();
+}
+
+void MeshBufferArena::setVertexStride (VertexStream stream, int stride)
+{
+    if (stride == _vertexStrides[stream])
+        return;
+
+    _vertexStrides[stream] = stride;
+    for (Page& page : _pages)
+    {
+        // Deleting the name 0 is ignored.
+        glDeleteBuffers(1, &page.vertexBuffers[stream]);
+        page.vertexBuffers[stream] = 0;
+        if (stride > 0)
+            page.vertexBuffers[stream] = createBuffer(GL_ARRAY_BUFFER, (GLsizeiptr)page.vertices.capacity() * stride);
+    }
+}
+
+void MeshBufferArena::setExpectedSize (int numVertices, int numIndices)
+{
+    _expectedNumVertices = numVertices;
+    _expectedNumIndices = numIndices;
+}
+
+int MeshBufferArena::createPage (int numVertices, int numIndices)
+{
+    // Room for what is expected and not covered by the existing pages, without going below the request.
+    size_t existingVertices = 0, existingIndices = 0;
+    for (const Page& page : _pages)
+    {
+        existingVertices += page.vertices.capacity();
+        existingIndices += page.indices.capacity();
+    }
+
+    const int maxPageVertices = _use32BitIndices ? kMaxPageVertices32 : kMaxPageVertices16;
+    const int remainingVertices = std::max(0, _expectedNumVertices - (int)existingVertices);
+    const int remainingIndices = std::max(0, _expectedNumIndices - (int)existingIndices);
+
+    const int pageVertices = std::max(numVertices, std::min(maxPageVertices, std::max(kMinPageVertices, remainingVertices)));
+    const int pageIndices = std::max(numIndices, std::min(kMaxPageIndices, std::max(kMinPageVertices * 6, remainingIndices)));
+
+    Page page;
+    for (int stream = 0; stream < NumVertexStreams; ++stream)
+        if (_vertexStrides[stream] > 0)
+            page.vertexBuffers[stream] = createBuffer(GL_ARRAY_BUFFER, (GLsizeiptr)pageVertices * _vertexStrides[stream]);
+    page.indexBuffer = createBuffer(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)pageIndices * indexSize());
+    page.vertices.reset(pageVertices);
+    page.indices.reset(pageIndices);
+
+    _pages.push_back(page);
+    return (int)_pages.size() - 1;
+}
+
+int MeshBufferArena::createAllocation (int page, size_t first, int count, bool isIndices, int vertexAllocation)
+{
+    int handle;
+    if (!_freeHandles.empty())
+    {
+        handle = _freeHandles.back();
+        _freeHandles.pop_back();
+    }
+    else
+    {
+        handle = (int)_allocations.size();
+        _allocations.push_back(AllocationRecord());
+    }
+
+    AllocationRecord& record = _allocations[handle];
+    record.page = page;
+    record.first = (int)first;
+    record.count = count;
+    record.used = true;
+    record.isIndices = isIndices;
+    record.vertexAllocation = vertexAllocation;
+    return handle;
+}
+
+int MeshBufferArena::allocateVertices (int numVertices, int numIndices)
+{
+    assert (_vertexStrides[GeometryStream] > 0);
+    const int maxPageVertices = _use32BitIndices ? kMaxPageVertices32 : kMaxPageVertices16;
+    if (numVertices <= 0 || numVertices > maxPageVertices)
+        return -1;
+
+    size_t first = 0;
+
+    // First fit, in the first page with room for the indices too.
+    for (int pageIndex = 0; pageIndex < (int)_pages.size(); ++pageIndex)
+    {
+        Page& page = _pages[pageIndex];
+        if (page.indices.statistics().largestFreeBlock < (size_t)numIndices)
+            continue;
+
+        if (page.vertices.allocate(numVertices, first))
+            return createAllocation(pageIndex, first, numVertices, false, -1);
+    }
+
+    // Then a page with enough free space scattered in several blocks.
+    for (int pageIndex = 0; pageIndex < (int)_pages.size(); ++pageIndex)
+    {
+        Page& page = _pages[pageIndex];
+        if (page.vertices.freeSize() < (size_t)numVertices || page.indices.freeSize() < (size_t)numIndices)
+            continue;
+
+        if (page.indices.statistics().largestFreeBlock < (size_t)numIndices && !compactIndices(pageIndex))
+            continue;
+
+        if (page.vertices.allocate(numVertices, first) || (compactVertices(pageIndex) && page.vertices.allocate(numVertices, first)))
+            return createAllocation(pageIndex, first, numVertices, false, -1);
+    }
+
+    const int pageIndex = createPage(numVertices, numIndices);
+    _pages[pageIndex].vertices.allocate(numVertices, first);
+    return createAllocation(pageIndex, first, numVertices, false, -1);
+}
+
+int MeshBufferArena::allocateIndices (int vertexAllocation, int numIndices)
+{
+    assert (_allocations[vertexAllocation].used && !_allocations[vertexAllocation].isIndices);
+    if (numIndices <= 0)
+        return -1;
+
+    const int pageIndex = _allocations[vertexAllocation].page;
+    Page& page = _pages[pageIndex];
+
+    size_t first = 0;
+    if (page.indices.allocate(numIndices, first)
+        || (page.indices.freeSize() >= (size_t)numIndices && compactIndices(pageIndex) && page.indices.allocate(numIndices, first)))
+        return createAllocation(pageIndex, first, numIndices, true, vertexAllocation);
+
+    return -1;
+}
+
+void MeshBufferArena::free (int handle)
+{
+    if (handle < 0)
+        return;
+
+    AllocationRecord& record = _allocations[handle];
+    assert (record.used);
+
+    Page& page = _pages[record.page];
+    if (record.isIndices)
+        page.indices.free(record.first);
+    else
+        page.vertices.free(record.first);
+
+    record = AllocationRecord();
+    _freeHandles.push_back(handle);
+}
+
+void MeshBufferArena::uploadVertices (int vertexAllocation, VertexStream stream, const uint8_t* vertices)
+{
+    const AllocationRecord& record = _allocations[vertexAllocation];
+    const int stride = _vertexStrides[stream];
+    assert (stride > 0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, _pages[record.page].vertexBuffers[stream]);
+    glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)record.first * stride, (GLsizeiptr)record.count * stride, vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MeshBufferArena::uploadIndices (int indexAllocation, const uint16_t* indices)
+{
+    const AllocationRecord& record = _allocations[indexAllocation];
+    const int base = _allocations[record.vertexAllocation].first;
+
+    std::vector<uint8_t> rebasedIndices (record.count * indexSize());
+    if (_use32BitIndices)
+    {
+        uint32_t* rebased = reinterpret_cast<uint32_t*>(rebasedIndices.data());
+        for (int i = 0; i < record.count; ++i)
+            rebased[i] = uint32_t(indices[i]) + base;
+    }
+    else
+    {
+        uint16_t* rebased = reinterpret_cast<uint16_t*>(rebasedIndices.data());
+        for (int i = 0; i < record.count; ++i)
+            rebased[i] = uint16_t(indices[i] + base);
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _pages[record.page].indexBuffer);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (GLintptr)record.first * indexSize(), rebasedIndices.size(), rebasedIndices.data());
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+bool MeshBufferArena::compactVertices (int pageIndex)
+{
+    if (!_canMapBuffers)
+        return false;
+
+    Page& page = _pages[pageIndex];
+    const size_t capacity = page.vertices.capacity();
+
+    uint8_t* vertices = mapBuffer(GL_ARRAY_BUFFER, page.vertexBuffers[GeometryStream], capacity * _vertexStrides[GeometryStream]);
+    if (vertices == NULL)
+    {
+        NSLog(@"MeshBufferArena: could not map a vertex buffer, not compacting.");
+        return false;
+    }
+
+    const std::vector<BufferSuballocator::Move> moves = page.vertices.compact();
+    applyMoves(moves, _vertexStrides[GeometryStream], vertices);
+    unmapBuffer(GL_ARRAY_BUFFER);
+
+    for (int stream = GeometryStream + 1; stream < NumVertexStreams; ++stream)
+    {
+        if (_vertexStrides[stream] == 0)
+            continue;
+
+        uint8_t* attributes = mapBuffer(GL_ARRAY_BUFFER, page.vertexBuffers[stream], capacity * _vertexStrides[stream]);
+        if (attributes)
+        {
+            applyMoves(moves, _vertexStrides[stream], attributes);
+            unmapBuffer(GL_ARRAY_BUFFER);
+        }
+        else
+            NSLog(@"MeshBufferArena: could not map a vertex buffer, some colors may be wrong.");
+    }
+
+    // The indices of the moved vertices follow them.
+    uint8_t* indices = NULL;
+    for (AllocationRecord& record : _allocations)
+    {
+        if (!record.used || !record.isIndices || record.page != pageIndex)
+            continue;
+
+        const int base = _allocations[record.vertexAllocation].first;
+        const int delta = (int)relocateOffset(moves, base) - base;
+        if (delta == 0)
+            continue;
+
+        if (indices == NULL)
+        {
+            indices = mapBuffer(GL_ELEMENT_ARRAY_BUFFER, page.indexBuffer, page.indices.capacity() * indexSize());
+            if (indices == NULL)
+            {
+                NSLog(@"MeshBufferArena: could not map an index buffer, the mesh will be drawn wrong.");
+                break;
+            }
+        }
+
+        if (_use32BitIndices)
+            addToIndices<uint32_t>(indices, record.first, record.count, delta);
+        else
+            addToIndices<uint16_t>(indices, record.first, record.count, delta);
+    }
+
+    if (indices)
+        unmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+
+    for (AllocationRecord& record : _allocations)
+        if (record.used && !record.isIndices && record.page == pageIndex)
+            record.first = (int)relocateOffset(moves, record.first);
+
+    ++_numCompactions;
+    return true;
+}
+
+bool MeshBufferArena::compactIndices (int pageIndex)
+{
+    if (!_canMapBuffers)
+        return false;
+
+    Page& page = _pages[pageIndex];
+
+    uint8_t* indices = mapBuffer(GL_ELEMENT_ARRAY_BUFFER, page.indexBuffer, page.indices.capacity() * indexSize());
+    if (indices == NULL)
+    {
+        NSLog(@"MeshBufferArena: could not map an index buffer, not compacting.");
+        return false;
+    }
+
+    const std::vector<BufferSuballocator::Move> moves = page.indices.compact();
+    applyMoves(moves, indexSize(), indices);
+    unmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+
+    for (AllocationRecord& record : _allocations)
+        if (record.used && record.isIndices && record.page == pageIndex)
+            record.first = (int)relocateOffset(moves, record.first);
+
+    ++_numCompactions;
+    return true;
+}
+
+MeshBufferArena::Statistics MeshBufferArena::statistics () const
+{
+    Statistics statistics;
+    statistics.numPages = (int)_pages.size();
+    statistics.numCompactions = _numCompactions;
+
+    size_t bytesPerVertex = 0;
+    int buffersPerPage = 1;
+    for (int stream = 0; stream < NumVertexStreams; ++stream)
+    {
+        bytesPerVertex += _vertexStrides[stream];
+        buffersPerPage += (_vertexStrides[stream] > 0);
+    }
+    statistics.numBufferObjects = buffersPerPage * statistics.numPages;
+
+    for (const Page& page : _pages)
+    {
+        statistics.numAllocatedBytes += page.vertices.capacity() * bytesPerVertex + page.indices.capacity() * indexSize();
+        statistics.numUsedBytes += page.vertices.usedSize() * bytesPerVertex + page.indices.usedSize() * indexSize();
+    }
+    return statistics;
+}
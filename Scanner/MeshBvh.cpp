@@ -0,0 +1,549 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "MeshBvh.h"
+#include "SimdMath.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+// Local functions
+namespace
+{
+
+    const int kMaxLeafTriangles = 4;
+    const int kNumBins = 16;
+
+    // Subtrees below this depth, or with fewer triangles, are built on the thread of their parent.
+    const int kMaxParallelDepth = 4;
+    const int kMinParallelTriangles = 16384;
+
+    // Past this depth the nodes split at the median, which bounds the depth of the hierarchy, hence
+    // the traversal stack, even when the heuristic keeps peeling off a few triangles.
+    const int kMaxHeuristicDepth = 32;
+    const int kMaxStackSize = 64;
+
+    const int32_t kNoChild = std::numeric_limits<int32_t>::min();
+
+    // Tolerance of the barycentric tests, so that rays hitting a shared edge do not fall between its
+    // triangles.
+    const float kBarycentricEpsilon = 1e-6f;
+
+    // Starts inverted, so that growing needs no test.
+    struct Bounds
+    {
+        float min[3] = { std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity() };
+        float max[3] = { -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity() };
+    };
+
+    void growBounds (Bounds& bounds, const float min[3], const float max[3])
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            bounds.min[axis] = std::min(bounds.min[axis], min[axis]);
+            bounds.max[axis] = std::max(bounds.max[axis], max[axis]);
+        }
+    }
+
+    // Half the surface area, the heuristic only compares ratios.
+    float halfArea (const Bounds& bounds)
+    {
+        if (bounds.min[0] > bounds.max[0])
+            return 0.f;
+
+        const float x = bounds.max[0] - bounds.min[0];
+        const float y = bounds.max[1] - bounds.min[1];
+        const float z = bounds.max[2] - bounds.min[2];
+        return x*y + y*z + z*x;
+    }
+
+    // Leaves are tested a packet at a time.
+    int numPackets (int numTriangles)
+    {
+        return (numTriangles + kMaxLeafTriangles - 1) / kMaxLeafTriangles;
+    }
+
+    // The build helpers below are templates on the build types, which are private to MeshBvh.
+    template <class BuildTriangle>
+    Bounds computeBounds (const BuildTriangle* triangles, int numTriangles)
+    {
+        Bounds bounds;
+        for (int index = 0; index < numTriangles; ++index)
+            growBounds(bounds, triangles[index].min, triangles[index].max);
+        return bounds;
+    }
+
+    // Partitions the triangles at the binned split of lowest surface area heuristic cost, or at the
+    // median of their centers along the longest axis when binning cannot tell them apart. Returns the
+    // number of triangles on the left, and the bounds of both sides.
+    template <class BuildTriangle>
+    int splitTriangles (BuildTriangle* triangles, int numTriangles, bool medianOnly, Bounds& leftBounds, Bounds& rightBounds)
+    {
+        Bounds centers;
+        for (int index = 0; index < numTriangles; ++index)
+            growBounds(centers, triangles[index].center, triangles[index].center);
+
+        struct Bin
+        {
+            Bounds bounds;
+            int numTriangles = 0;
+        };
+
+        float bestCost = std::numeric_limits<float>::max();
+        int bestAxis = -1;
+        int bestBin = 0;
+        float binScales[3];
+
+        for (int axis = 0; axis < 3 && !medianOnly; ++axis)
+        {
+            const float extent = centers.max[axis] - centers.min[axis];
+            binScales[axis] = (extent > 0.f) ? (kNumBins * 0.9999f / extent) : 0.f;
+            if (binScales[axis] == 0.f)
+                continue;
+
+            Bin bins[kNumBins];
+            for (int index = 0; index < numTriangles; ++index)
+            {
+                const BuildTriangle& triangle = triangles[index];
+                const int bin = std::min(kNumBins - 1, int((triangle.center[axis] - centers.min[axis]) * binScales[axis]));
+                growBounds(bins[bin].bounds, triangle.min, triangle.max);
+                ++bins[bin].numTriangles;
+            }
+
+            // Split i puts the bins before i on the left.
+            Bounds rights[kNumBins];
+            int rightCounts[kNumBins];
+            int rightCount = 0;
+            for (int split = kNumBins - 1; split > 0; --split)
+            {
+                rights[split] = (split + 1 < kNumBins) ? rights[split + 1] : Bounds();
+                growBounds(rights[split], bins[split].bounds.min, bins[split].bounds.max);
+                rightCount += bins[split].numTriangles;
+                rightCounts[split] = rightCount;
+            }
+
+            Bounds left;
+            int leftCount = 0;
+            for (int split = 1; split < kNumBins; ++split)
+            {
+                growBounds(left, bins[split - 1].bounds.min, bins[split - 1].bounds.max);
+                leftCount += bins[split - 1].numTriangles;
+                if (leftCount == 0 || rightCounts[split] == 0)
+                    continue;
+
+                const float cost = halfArea(left) * numPackets(leftCount) + halfArea(rights[split]) * numPackets(rightCounts[split]);
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = split;
+                    leftBounds = left;
+                    rightBounds = rights[split];
+                }
+            }
+        }
+
+        if (bestAxis >= 0)
+        {
+            const float minCenter = centers.min[bestAxis];
+            const float binScale = binScales[bestAxis];
+            BuildTriangle* middle = std::partition(triangles, triangles + numTriangles, [&] (const BuildTriangle& triangle) {
+                return std::min(kNumBins - 1, int((triangle.center[bestAxis] - minCenter) * binScale)) < bestBin;
+            });
+            return int(middle - triangles);
+        }
+
+        int longestAxis = 0;
+        for (int axis = 1; axis < 3; ++axis)
+            if (centers.max[axis] - centers.min[axis] > centers.max[longestAxis] - centers.min[longestAxis])
+                longestAxis = axis;
+
+        const int half = numTriangles / 2;
+        std::nth_element(triangles, triangles + half, triangles + numTriangles, [&] (const BuildTriangle& a, const BuildTriangle& b) {
+            return a.center[longestAxis] < b.center[longestAxis];
+        });
+        leftBounds = computeBounds(triangles, half);
+        rightBounds = computeBounds(triangles + half, numTriangles - half);
+        return half;
+    }
+
+    template <class Node>
+    void setChild (Node& node, int child, const Bounds& bounds, int32_t reference)
+    {
+        // Empty bounds have min > max, no ray enters them.
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            node.bounds[axis][child] = bounds.min[axis];
+            node.bounds[axis][2 + child] = bounds.max[axis];
+            node.bounds[axis][4 + child] = bounds.min[axis];
+        }
+        node.children[child] = reference;
+    }
+
+    // Appends a subtree built separately, and returns the new reference of its root.
+    template <class BuildOutput>
+    int32_t appendOutput (const BuildOutput& part, int32_t root, BuildOutput& output)
+    {
+        const int32_t nodeOffset = int32_t(output.nodes.size());
+        const int32_t packetOffset = int32_t(output.packets.size());
+
+        for (auto node : part.nodes)
+        {
+            for (int32_t& child : node.children)
+                child = (child >= 0) ? child + nodeOffset : ~(~child + packetOffset);
+            output.nodes.push_back(node);
+        }
+        output.packets.insert(output.packets.end(), part.packets.begin(), part.packets.end());
+        output.maxDepth = std::max(output.maxDepth, part.maxDepth);
+
+        return (root >= 0) ? root + nodeOffset : ~(~root + packetOffset);
+    }
+
+} // Anonymous
+
+struct MeshBvh::BuildTriangle
+{
+    float min[3];
+    float max[3];
+    float center[3];
+    int32_t chunk;
+    int32_t triangle;
+};
+
+// Nodes and packets of a subtree, in depth-first order from its root.
+struct MeshBvh::BuildOutput
+{
+    const MeshChunk* chunks = nullptr;
+    std::vector<Node> nodes;
+    std::vector<TrianglePacket> packets;
+    int maxDepth = 0;
+};
+
+MeshBvh::MeshBvh ()
+: _parallelFor (runOnThreads)
+{
+}
+
+void MeshBvh::setParallelFor (const ParallelFor& parallelFor)
+{
+    _parallelFor = parallelFor;
+}
+
+void MeshBvh::clear ()
+{
+    _nodes.clear();
+    _packets.clear();
+    _statistics = BuildStatistics();
+}
+
+void MeshBvh::build (const std::vector<MeshChunk>& chunks)
+{
+    clear();
+
+    std::vector<int> firstTriangles (chunks.size() + 1, 0);
+    for (size_t chunk = 0; chunk < chunks.size(); ++chunk)
+        firstTriangles[chunk + 1] = firstTriangles[chunk] + chunks[chunk].numIndices / 3;
+
+    const int numTriangles = firstTriangles.back();
+    if (numTriangles == 0)
+        return;
+
+    std::vector<BuildTriangle> triangles (numTriangles);
+    _parallelFor(int(chunks.size()), [&] (int chunkIndex) {
+        const MeshChunk& chunk = chunks[chunkIndex];
+        for (int triangle = 0; triangle < chunk.numIndices / 3; ++triangle)
+        {
+            BuildTriangle& buildTriangle = triangles[firstTriangles[chunkIndex] + triangle];
+            const float* a = chunk.positions + 3 * chunk.indices[3 * triangle];
+            const float* b = chunk.positions + 3 * chunk.indices[3 * triangle + 1];
+            const float* c = chunk.positions + 3 * chunk.indices[3 * triangle + 2];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                buildTriangle.min[axis] = std::min(a[axis], std::min(b[axis], c[axis]));
+                buildTriangle.max[axis] = std::max(a[axis], std::max(b[axis], c[axis]));
+                buildTriangle.center[axis] = 0.5f * (buildTriangle.min[axis] + buildTriangle.max[axis]);
+            }
+            buildTriangle.chunk = chunkIndex;
+            buildTriangle.triangle = triangle;
+        }
+    });
+
+    BuildOutput output;
+    output.chunks = chunks.data();
+    output.nodes.reserve (2 * numPackets(numTriangles));
+    output.packets.reserve (2 * numPackets(numTriangles));
+
+    const int32_t root = buildSubtree(triangles.data(), numTriangles, 1, output);
+
+    // Traversal starts from a node, a single leaf gets one with an empty sibling.
+    if (root < 0)
+    {
+        Node node;
+        setChild(node, 0, computeBounds(triangles.data(), numTriangles), root);
+        setChild(node, 1, Bounds(), kNoChild);
+        output.nodes.push_back(node);
+    }
+
+    _nodes.swap (output.nodes);
+    _packets.swap (output.packets);
+
+    _statistics.numTriangles = numTriangles;
+    _statistics.numNodes = int(_nodes.size());
+    _statistics.numLeaves = int(_packets.size());
+    _statistics.maxDepth = output.maxDepth;
+    _statistics.numBytes = _nodes.size() * sizeof(Node) + _packets.size() * sizeof(TrianglePacket);
+}
+
+int32_t MeshBvh::buildSubtree (BuildTriangle* triangles, int numTriangles, int depth, BuildOutput& output)
+{
+    output.maxDepth = std::max(output.maxDepth, depth);
+
+    if (numTriangles <= kMaxLeafTriangles)
+    {
+        TrianglePacket packet;
+        for (int lane = 0; lane < kMaxLeafTriangles; ++lane)
+        {
+            float vertices[3][3] = {};
+            packet.chunks[lane] = -1;
+            packet.triangles[lane] = -1;
+
+            if (lane < numTriangles)
+            {
+                const MeshChunk& chunk = output.chunks[triangles[lane].chunk];
+                const uint16_t* indices = chunk.indices + 3 * triangles[lane].triangle;
+                for (int vertex = 0; vertex < 3; ++vertex)
+                    std::copy (chunk.positions + 3 * indices[vertex], chunk.positions + 3 * indices[vertex] + 3, vertices[vertex]);
+
+                packet.chunks[lane] = triangles[lane].chunk;
+                packet.triangles[lane] = triangles[lane].triangle;
+            }
+
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                packet.v0[axis][lane] = vertices[0][axis];
+                packet.edge1[axis][lane] = vertices[1][axis] - vertices[0][axis];
+                packet.edge2[axis][lane] = vertices[2][axis] - vertices[0][axis];
+            }
+        }
+
+        output.packets.push_back(packet);
+        return ~int32_t(output.packets.size() - 1);
+    }
+
+    Bounds leftBounds, rightBounds;
+    const int numLeft = splitTriangles(triangles, numTriangles, depth > kMaxHeuristicDepth, leftBounds, rightBounds);
+
+    const int32_t nodeIndex = int32_t(output.nodes.size());
+    output.nodes.emplace_back();
+
+    int32_t left, right;
+    if (depth < kMaxParallelDepth && numTriangles >= kMinParallelTriangles)
+    {
+        BuildOutput parts[2];
+        int32_t roots[2];
+        _parallelFor(2, [&] (int part) {
+            parts[part].chunks = output.chunks;
+            roots[part] = (part == 0) ? buildSubtree(triangles, numLeft, depth + 1, parts[0])
+                                      : buildSubtree(triangles + numLeft, numTriangles - numLeft, depth + 1, parts[1]);
+        });
+        left = appendOutput(parts[0], roots[0], output);
+        right = appendOutput(parts[1], roots[1], output);
+    }
+    else
+    {
+        left = buildSubtree(triangles, numLeft, depth + 1, output);
+        right = buildSubtree(triangles + numLeft, numTriangles - numLeft, depth + 1, output);
+    }
+
+    Node& node = output.nodes[nodeIndex];
+    setChild(node, 0, leftBounds, left);
+    setChild(node, 1, rightBounds, right);
+    return nodeIndex;
+}
+
+bool MeshBvh::intersect (const float origin[3], const float direction[3], float maxDistance, RayHit& hit) const
+{
+    return traverse<false>(origin, direction, maxDistance, &hit);
+}
+
+bool MeshBvh::isOccluded (const float origin[3], const float direction[3], float maxDistance) const
+{
+    return traverse<true>(origin, direction, maxDistance, nullptr);
+}
+
+template <bool AnyHit>
+bool MeshBvh::traverse (const float origin[3], const float direction[3], float maxDistance, RayHit* hit) const
+{
+    if (_nodes.empty())
+        return false;
+
+    // Slabs of both children at once: lanes 0 and 1 get the entry distances, lanes 2 and 3 the
+    // negated exit distances, so a single max accumulates both over the axes.
+    SimdFloat4 origins[3];
+    SimdFloat4 slabScales[3];
+    SimdFloat4 directions[3];
+    int nearOffsets[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        // Avoids the infinities, and the NaNs of 0 * infinity on the slab planes.
+        const float component = (std::abs(direction[axis]) > 1e-20f) ? direction[axis] : std::copysign(1e-20f, direction[axis]);
+        const float inverse = 1.f / component;
+        const float scales[4] = { inverse, inverse, -inverse, -inverse };
+
+        origins[axis] = simdSplat(origin[axis]);
+        slabScales[axis] = simdLoad(scales);
+        directions[axis] = simdSplat(direction[axis]);
+        nearOffsets[axis] = (component < 0.f) ? 2 : 0;
+    }
+
+    struct StackEntry
+    {
+        int32_t reference;
+        float distance;
+    };
+
+    StackEntry stack[kMaxStackSize];
+    int stackSize = 0;
+
+    float closest = maxDistance;
+    int closestPacket = -1;
+    int closestLane = 0;
+    float closestU = 0.f;
+    float closestV = 0.f;
+
+    int32_t reference = 0;
+    while (reference != kNoChild)
+    {
+        if (reference >= 0)
+        {
+            const Node& node = _nodes[reference];
+
+            const float limits[4] = { 0.f, 0.f, -closest, -closest };
+            SimdFloat4 distances = simdLoad(limits);
+            for (int axis = 0; axis < 3; ++axis)
+                distances = simdMax(distances, (simdLoad(node.bounds[axis] + nearOffsets[axis]) - origins[axis]) * slabScales[axis]);
+
+            float lanes[4];
+            simdStore(lanes, distances);
+            const bool hits[2] = {
+                lanes[0] <= -lanes[2] && node.children[0] != kNoChild,
+                lanes[1] <= -lanes[3] && node.children[1] != kNoChild
+            };
+
+            if (hits[0] && hits[1])
+            {
+                // The nearest child first, the other one waits on the stack.
+                const int first = (lanes[0] <= lanes[1]) ? 0 : 1;
+                assert (stackSize < kMaxStackSize);
+                stack[stackSize].reference = node.children[1 - first];
+                stack[stackSize].distance = lanes[1 - first];
+                ++stackSize;
+                reference = node.children[first];
+                continue;
+            }
+
+            if (hits[0] || hits[1])
+            {
+                reference = node.children[hits[0] ? 0 : 1];
+                continue;
+            }
+        }
+        else
+        {
+            // Möller-Trumbore on the 4 triangles of the leaf.
+            const TrianglePacket& packet = _packets[~reference];
+            SimdFloat4 v0[3], edge1[3], edge2[3];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                v0[axis] = simdLoad(packet.v0[axis]);
+                edge1[axis] = simdLoad(packet.edge1[axis]);
+                edge2[axis] = simdLoad(packet.edge2[axis]);
+            }
+
+            const SimdFloat4 p[3] = {
+                directions[1] * edge2[2] - directions[2] * edge2[1],
+                directions[2] * edge2[0] - directions[0] * edge2[2],
+                directions[0] * edge2[1] - directions[1] * edge2[0]
+            };
+            const SimdFloat4 determinant = edge1[0] * p[0] + edge1[1] * p[1] + edge1[2] * p[2];
+            const SimdFloat4 inverseDeterminant = simdReciprocal(determinant);
+
+            const SimdFloat4 s[3] = { origins[0] - v0[0], origins[1] - v0[1], origins[2] - v0[2] };
+            const SimdFloat4 u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inverseDeterminant;
+
+            const SimdFloat4 q[3] = {
+                s[1] * edge1[2] - s[2] * edge1[1],
+                s[2] * edge1[0] - s[0] * edge1[2],
+                s[0] * edge1[1] - s[1] * edge1[0]
+            };
+            const SimdFloat4 v = (directions[0] * q[0] + directions[1] * q[1] + directions[2] * q[2]) * inverseDeterminant;
+            const SimdFloat4 t = (edge2[0] * q[0] + edge2[1] * q[1] + edge2[2] * q[2]) * inverseDeterminant;
+
+            // The degenerate lanes have a zero determinant, or NaNs which fail every comparison.
+            const SimdFloat4 minBarycentric = simdSplat(-kBarycentricEpsilon);
+            SimdFloat4 valid = simdLess(simdSplat(0.f), simdAbs(determinant));
+            valid = simdAndMask(valid, simdLess(minBarycentric, u));
+            valid = simdAndMask(valid, simdLess(minBarycentric, v));
+            valid = simdAndMask(valid, simdLess(u + v, simdSplat(1.f + kBarycentricEpsilon)));
+            valid = simdAndMask(valid, simdLess(simdSplat(0.f), t));
+            valid = simdAndMask(valid, simdLess(t, simdSplat(closest)));
+
+            float distances[4];
+            simdStore(distances, simdSelect(valid, t, simdSplat(std::numeric_limits<float>::infinity())));
+
+            int lane = -1;
+            for (int index = 0; index < 4; ++index)
+                if (distances[index] < closest)
+                {
+                    closest = distances[index];
+                    lane = index;
+                }
+
+            if (lane >= 0)
+            {
+                if (AnyHit)
+                    return true;
+
+                float us[4], vs[4];
+                simdStore(us, u);
+                simdStore(vs, v);
+                closestPacket = ~reference;
+                closestLane = lane;
+                closestU = us[lane];
+                closestV = vs[lane];
+            }
+        }
+
+        // Next subtree from the stack, skipping those behind the closest hit.
+        reference = kNoChild;
+        while (stackSize > 0)
+        {
+            const StackEntry& entry = stack[--stackSize];
+            if (entry.distance <= closest)
+            {
+                reference = entry.reference;
+                break;
+            }
+        }
+    }
+
+    if (closestPacket < 0)
+        return false;
+
+    if (hit)
+    {
+        hit->distance = closest;
+        for (int axis = 0; axis < 3; ++axis)
+            hit->position[axis] = origin[axis] + closest * direction[axis];
+        hit->u = closestU;
+        hit->v = closestV;
+        hit->chunk = _packets[closestPacket].chunks[closestLane];
+        hit->triangle = _packets[closestPacket].triangles[closestLane];
+    }
+    return true;
+}
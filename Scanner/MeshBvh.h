@@ -0,0 +1,109 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#include "ParallelFor.h"
+
+#include <cstdint>
+#include <vector>
+
+// Bounding volume hierarchy over the triangles of all the mesh chunks, for the ray queries of the
+// viewer: picking the orbit center, measurements, visibility. Binned surface area heuristic build,
+// the top levels split in parallel. The nodes are flattened depth-first and hold the boxes of both
+// their children, so one node fetch tests both boxes in SIMD lanes. Leaves are packets of up to 4
+// triangles, tested at once.
+class MeshBvh
+{
+public:
+    // A chunk of the mesh, like those of STMesh. Only read by build, the triangles are copied.
+    struct MeshChunk
+    {
+        const float* positions = nullptr; // xyz
+        int numVertices = 0;
+
+        const uint16_t* indices = nullptr; // triangles
+        int numIndices = 0;
+    };
+
+    struct RayHit
+    {
+        // Along the ray direction, a distance if it is normalized.
+        float distance = 0.f;
+        float position[3] = { 0.f, 0.f, 0.f };
+
+        // Barycentric coordinates of the second and third vertices.
+        float u = 0.f;
+        float v = 0.f;
+
+        int chunk = -1;
+        int triangle = -1;
+    };
+
+    struct BuildStatistics
+    {
+        int numTriangles = 0;
+        int numNodes = 0;
+        int numLeaves = 0;
+        int maxDepth = 0;
+        size_t numBytes = 0;
+    };
+
+public:
+    MeshBvh ();
+
+    // Spreads the build of the top subtrees, std::thread workers by default.
+    void setParallelFor (const ParallelFor& parallelFor);
+
+    void build (const std::vector<MeshChunk>& chunks);
+    void clear ();
+    bool empty () const { return _nodes.empty(); }
+
+    // Closest hit with a distance in (0, maxDistance]. The direction does not need to be normalized.
+    bool intersect (const float origin[3], const float direction[3], float maxDistance, RayHit& hit) const;
+
+    // Any hit with a distance in (0, maxDistance], cheaper than intersect for visibility tests.
+    bool isOccluded (const float origin[3], const float direction[3], float maxDistance) const;
+
+    const BuildStatistics& buildStatistics () const { return _statistics; }
+
+private:
+    // Per axis the boxes of both children: min0, min1, max0, max1, min0, min1. A ray loads 4 lanes
+    // from 0 or 2 depending on its direction sign, so the near planes come first.
+    struct Node
+    {
+        float bounds[3][6];
+
+        // >= 0 for an inner node, ~packet for a leaf, kNoChild for the empty sibling of a root leaf.
+        int32_t children[2];
+    };
+
+    // Up to 4 triangles in SIMD lanes, the unused lanes degenerate.
+    struct TrianglePacket
+    {
+        float v0[3][4];
+        float edge1[3][4];
+        float edge2[3][4];
+        int32_t chunks[4];
+        int32_t triangles[4];
+    };
+
+    struct BuildTriangle;
+    struct BuildOutput;
+
+    int32_t buildSubtree (BuildTriangle* triangles, int numTriangles, int depth, BuildOutput& output);
+
+    template <bool AnyHit>
+    bool traverse (const float origin[3], const float direction[3], float maxDistance, RayHit* hit) const;
+
+private:
+    ParallelFor _parallelFor;
+
+    std::vector<Node> _nodes;
+    std::vector<TrianglePacket> _packets;
+
+    BuildStatistics _statistics;
+};
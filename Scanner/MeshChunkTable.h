@@ -0,0 +1,277 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#import <GLKit/GLKit.h>
+
+#include "FrustumCulling.h"
+#include "MeshBufferArena.h"
+#include "MeshOptimizer.h"
+#include "MeshShaderGenerator.h"
+#include "MeshSimplifier.h"
+#include "MeshVertexPacker.h"
+#include "OcclusionCuller.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class GLStateCache;
+class MeshShader;
+class RenderCommandList;
+
+// Full resolution level included.
+const int kMaxChunkLevelsOfDetail = 4;
+
+// Below this number of chunks in the frustum, occlusion culling costs more than it saves.
+const int kMinChunksForOcclusionCulling = 4;
+
+// Sizes and content hashes of the STMesh arrays of a chunk.
+struct MeshGeometryKey
+{
+    int numVertices = 0;
+    int numFaces = 0;
+    int numLines = 0;
+    uint64_t vertexHash = 0;
+    uint64_t indexHash = 0;
+};
+
+struct MeshChunk
+{
+    // The vertex allocation covers the geometry, surface and one-hot corner color streams, the latter
+    // for the X-ray wireframe, see assignCornerColors. -1 when nothing is uploaded.
+    int vertexAllocation = -1;
+
+    // Only allocated for the chunks whose corner coloring failed.
+    int linesAllocation = -1;
+
+    int numTriangleIndices = 0;
+    int numLinesIndices = 0;
+    bool hasCornerColors = false;
+
+    // Square root of the surface area per vertex, in mesh units, the diameter of the point splats.
+    float vertexSpacing = 0.f;
+
+    // Triangles of each level of detail in the page of the vertices, level 0 is the full resolution.
+    int levelIndexAllocations[kMaxChunkLevelsOfDetail] = { -1, -1, -1, -1 };
+    int numLevelsOfDetail = 1;
+    int levelNumIndices[kMaxChunkLevelsOfDetail] = {};
+    float levelErrors[kMaxChunkLevelsOfDetail] = {};
+
+    // Origin and size of the quantization cube, mapping quantized positions back to mesh space in the
+    // vertex shader. Unused for float positions.
+    GLfloat dequantization[4] = { 0.f, 0.f, 0.f, 1.f };
+    float quantizationErrorBound = 0.f;
+
+    // What the streams were filled from, so that the next upload skips those that did not change.
+    // STMesh has no change counters, the arrays are hashed instead.
+    MeshGeometryKey geometryKey;
+    uint64_t surfaceHash = 0;
+    PositionQuantization quantization;
+
+    // Uploaded vertex i is STMesh vertex (*vertexOrder)[i], corner color duplicates included.
+    std::shared_ptr<const std::vector<uint16_t>> vertexOrder;
+
+    // The surface stream holds the colors and texture coordinates of the current surface format.
+    bool hasSurface = false;
+
+    // The geometry is only reused once its levels of detail are built.
+    bool levelsOfDetailBuilt = false;
+};
+
+// CPU side of a chunk upload, prepared in parallel before the buffers are filled on the GL thread.
+struct MeshChunkUploadData
+{
+    // STMesh arrays, read-only.
+    int numVertices = 0;
+    int numFaces = 0;
+    int numLines = 0;
+    const float* positions = NULL;
+    const float* normals = NULL;
+    const float* colors = NULL;
+    const float* texcoords = NULL;
+    const unsigned short* faces = NULL;
+    const unsigned short* lines = NULL;
+
+    // The chunk already uploaded, see MeshChunkTable::describeUploadedChunk.
+    bool canReuseGeometry = false;
+    bool hadSurface = false;
+    MeshGeometryKey previousGeometryKey;
+    uint64_t previousSurfaceHash = 0;
+    PositionQuantization previousQuantization;
+
+    // The geometry is reused if its arrays and quantization did not change, and the surface stream is
+    // uploaded again only if it changed too. vertexOrder then comes from the uploaded chunk.
+    MeshGeometryKey geometryKey;
+    uint64_t surfaceHash = 0;
+    bool reuseGeometry = false;
+    bool uploadSurface = false;
+    std::shared_ptr<const std::vector<uint16_t>> vertexOrder;
+
+    // Data to upload, lineIndices is only filled if cornerColors is empty.
+    std::vector<uint8_t> packedVertices;
+    std::vector<uint8_t> packedSurface;
+    std::vector<uint16_t> faceIndices;
+    std::vector<uint16_t> lineIndices;
+    std::vector<uint8_t> cornerColors;
+    PositionQuantization quantization;
+    AxisAlignedBox bounds;
+    OccluderProxy occluder;
+    float vertexSpacing = 0.f;
+    int numDuplicatedVertices = 0;
+    size_t numWireframeBytes = 0;
+
+    // Positions in the uploaded vertex order and triangles without the corner color duplicates,
+    // kept for the build of the levels of detail.
+    std::vector<float> simplificationPositions;
+    std::vector<uint16_t> simplificationIndices;
+
+    VertexCacheStatistics statisticsBefore;
+    VertexCacheStatistics statisticsAfter;
+};
+
+// Levels of detail of a chunk, built on a worker thread from its simplification arrays.
+struct MeshChunkSimplification
+{
+    std::vector<float> positions;
+    std::vector<uint16_t> indices;
+    AxisAlignedBox bounds;
+    std::vector<LevelOfDetail> levels;
+
+    // False for the chunks whose geometry was reused, their levels are already uploaded.
+    bool rebuilt = false;
+};
+
+// Consecutive indices of a page of the buffer arena, drawn after replaying the setup segment of the page.
+struct ArenaDraw
+{
+    int segment = 0;
+    GLenum primitive = GL_TRIANGLES;
+    int firstIndex = 0;
+    int numIndices = 0;
+
+    // Chunk of the first index, for the dequantization.
+    int meshIndex = 0;
+};
+
+// The worker side of a chunk upload, without GL. measureChunk runs first on every chunk, then
+// shareMeshQuantization if the draws are merged, then prepareChunk, each call independent of the others.
+
+// Bounds, quantization and content hashes.
+void measureChunk (MeshChunkUploadData& chunkData, bool quantizedPositions);
+
+// Quantizes all the chunks relative to the whole mesh, so that their draws can be merged.
+void shareMeshQuantization (std::vector<MeshChunkUploadData>& chunks);
+
+// Decides what is reused from the uploaded chunk, then packs, optimizes and colors the geometry that
+// changed, and packs the surface in its vertex order.
+void prepareChunk (MeshChunkUploadData& chunkData, const PackedVertexFormat& geometryFormat,
+                   const PackedVertexFormat& surfaceFormat, bool optimize);
+
+void buildChunkLevelsOfDetail (MeshChunkSimplification& chunk, bool optimize);
+
+// Point splat diameter in pixels at clip w = 1 of a mesh unit, for a viewport of viewportHeight pixels.
+float pointSplatPixelsPerUnit (const GLKMatrix4& projectionMatrix, const GLKMatrix4& modelViewMatrix, int viewportHeight);
+
+// The uploaded chunks of a mesh in a MeshBufferArena, and the GL side of drawing them: the chunks are
+// culled, their levels of detail selected, and their draws merged and issued over the recorded setup
+// of each page. The culling and the choice of the levels of detail do not use GL, and can run on any
+// thread, the rest needs the GL context current.
+class MeshChunkTable
+{
+public:
+    void initializeGL ();
+    void deleteBuffers ();
+
+    // Keeps the chunks uploaded unless the geometry layout changes. Chunks without the new surface
+    // layout are not drawn by the modes needing it until their surface is uploaded again.
+    void setVertexFormats (const PackedVertexFormat& geometryFormat, const PackedVertexFormat& surfaceFormat);
+    const PackedVertexFormat& geometryFormat () const { return _geometryFormat; }
+    const PackedVertexFormat& surfaceFormat () const { return _surfaceFormat; }
+    bool hasQuantizedPositions () const { return _geometryFormat.positionType == PackedVertexFormat::PositionUnorm16; }
+
+    // Frees the chunks from numChunks on.
+    void resize (int numChunks);
+    int numChunks () const { return _numChunks; }
+    const MeshChunk& chunk (int meshIndex) const { return _chunks[meshIndex]; }
+
+    // Sizes the pages for the corner color duplicates, the levels of detail and some line fallbacks.
+    void setExpectedSize (int numVertices, int numTriangles);
+
+    // What prepareChunk reuses from the chunk already uploaded at meshIndex.
+    void describeUploadedChunk (int meshIndex, MeshChunkUploadData& data) const;
+
+    // Returns the number of bytes uploaded. Only keeps in data what the reports and the levels of detail need.
+    size_t uploadChunk (int meshIndex, MeshChunkUploadData& data);
+
+    // Level by level, so that the same level of neighbouring chunks is contiguous. False if the chunks
+    // changed since the build.
+    bool uploadLevelsOfDetail (const std::vector<MeshChunkSimplification>& simplifications);
+
+    // Chunks are drawn with the coarsest level whose error projects to at most maxPixelError pixels,
+    // at full resolution while viewportHeightInPixels is 0.
+    void setLevelOfDetailViewport (float viewportHeightInPixels, float maxPixelError);
+    int selectLevelOfDetail (int meshIndex, const GLKMatrix4& projectionMatrix, const GLKMatrix4& modelViewMatrix) const;
+
+    // Fills visibleChunks with the chunks in the frustum, front to back, and returns the number of
+    // non-empty chunks outside of it.
+    int cullChunks (const GLKMatrix4& viewProjection, std::vector<int>& visibleChunks) const;
+
+    // Drops the chunks hidden by the proxies of the chunks in front of them, returns their number.
+    int removeOccludedChunks (OcclusionCuller& culler, const GLKMatrix4& viewProjection, std::vector<int>& visibleChunks) const;
+
+    // One draw per visible chunk, front to back, for the attributes read by the shader variant. Adds
+    // the triangles or points drawn to the counters.
+    void buildDraws (MeshShaderKey shaderKey, const std::vector<int>& visibleChunks, const GLKMatrix4& projectionMatrix,
+                     const GLKMatrix4& modelViewMatrix, std::vector<ArenaDraw>& draws, int& numTriangles, int& numPoints) const;
+
+    // Merges the draws following each other that are contiguous in the buffers and share their
+    // dequantization, either way round, so that the draws stay front to back.
+    void mergeDraws (std::vector<ArenaDraw>& draws) const;
+
+    // Two segments per page, setting up its attributes and index buffer for the shader variant:
+    // segment 2 * page for the triangles, 2 * page + 1 for the X-ray lines fallback.
+    void recordCommandList (MeshShaderKey shaderKey, RenderCommandList& commands) const;
+
+    // With the shader enabled and the recorded commands of its variant.
+    void draw (GLStateCache& cache, MeshShader& shader, const RenderCommandList& commands,
+               const std::vector<ArenaDraw>& draws, float pointSplatPixelsPerUnit) const;
+
+    const MeshBufferArena& bufferArena () const { return _arena; }
+
+private:
+    void releaseChunk (MeshChunk& chunk);
+    void recordVertexAttributes (RenderCommandList& commands, int page, bool withNormals, bool withColors, bool withTexcoords) const;
+    void recordCornerColors (RenderCommandList& commands, int page, bool fromBuffer) const;
+
+private:
+    // Grows on demand, chunks beyond _numChunks are left empty.
+    std::vector<MeshChunk> _chunks;
+    int _numChunks = 0;
+
+    // Vertex and index buffers of all the chunks.
+    MeshBufferArena _arena;
+
+    // Layouts of the geometry and surface streams, identical for all the chunks.
+    PackedVertexFormat _geometryFormat;
+    PackedVertexFormat _surfaceFormat;
+
+    // Mesh-space bounds of the uploaded chunks, empty for chunks without triangles.
+    std::vector<AxisAlignedBox> _chunkBounds;
+
+    // Coarse stand-ins of the uploaded chunks, rasterized by the occlusion culler.
+    std::vector<OccluderProxy> _occluderProxies;
+
+    float _levelOfDetailViewportHeight = 0.f;
+    float _levelOfDetailMaxPixelError = 1.f;
+
+    // GL_ALIASED_POINT_SIZE_RANGE upper bound.
+    float _maxPointSize = 1.f;
+
+    // Some ES2 extension enums, like GL_HALF_FLOAT_OES, are invalid on an OpenGL ES 3 context.
+    bool _isOpenGLES3 = false;
+};
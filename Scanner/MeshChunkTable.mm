@@ -0,0 +1,818 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#import "MeshChunkTable.h"
+#import "CustomShaders.h"
+#import "GLExtensions.h"
+#import "RenderCommandList.h"
+
+#import <OpenGLES/ES2/glext.h> // GL_HALF_FLOAT_OES
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+// From OpenGL ES 3, the ES2 headers do not have it.
+#ifndef GL_HALF_FLOAT
+#define GL_HALF_FLOAT 0x140B
+#endif
+
+// Local functions
+namespace
+{
+
+    // Simplification grid of the occluder proxies, relative to the chunk bounds.
+    const int kOccluderGridResolution = 8;
+
+    // Point splat diameter relative to the vertex spacing, discs of the spacing leave gaps between them.
+    const float kPointSplatScale = 1.5f;
+
+    uint64_t rotateLeft (uint64_t value, int bits)
+    {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    const uint64_t kHashPrime1 = 0x9e3779b185ebca87ULL;
+    const uint64_t kHashPrime2 = 0xc2b2ae3d27d4eb4fULL;
+    const uint64_t kHashPrime3 = 0x165667b19e3779f9ULL;
+    const uint64_t kHashPrime4 = 0x85ebca77c2b2ae63ULL;
+
+    // Content hash of an array, chained from the hash of the previous one. Each word is mixed xxHash64
+    // style so that all its bits reach the whole hash, and the size is folded in before the final
+    // avalanche so that arrays differing only by trailing zeros do not collide.
+    uint64_t hashBytes (const void* data, size_t size, uint64_t hash)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            memcpy(&word, bytes + i, sizeof(word));
+            hash ^= rotateLeft(word * kHashPrime2, 31) * kHashPrime1;
+            hash = rotateLeft(hash, 27) * kHashPrime1 + kHashPrime4;
+        }
+
+        for (; i < size; ++i)
+        {
+            hash ^= bytes[i] * kHashPrime3;
+            hash = rotateLeft(hash, 11) * kHashPrime1;
+        }
+
+        hash ^= size * kHashPrime3;
+        hash ^= hash >> 33;
+        hash *= kHashPrime2;
+        hash ^= hash >> 29;
+        hash *= kHashPrime3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+    const uint64_t kHashSeed = 0x27d4eb2f165667c5ULL;
+
+    // The vertex and index arrays are hashed apart and their sizes kept, a reused chunk has to match all.
+    MeshGeometryKey computeGeometryKey (const MeshChunkUploadData& chunkData)
+    {
+        MeshGeometryKey key;
+        key.numVertices = chunkData.numVertices;
+        key.numFaces = chunkData.numFaces;
+        key.numLines = chunkData.numLines;
+
+        key.vertexHash = hashBytes(chunkData.positions, chunkData.numVertices * 3 * sizeof(float), kHashSeed);
+        if (chunkData.normals)
+            key.vertexHash = hashBytes(chunkData.normals, chunkData.numVertices * 3 * sizeof(float), key.vertexHash);
+
+        key.indexHash = hashBytes(chunkData.faces, chunkData.numFaces * 3 * sizeof(unsigned short), kHashSeed);
+        key.indexHash = hashBytes(chunkData.lines, chunkData.numLines * 2 * sizeof(unsigned short), key.indexHash);
+        return key;
+    }
+
+    bool isSameGeometry (const MeshGeometryKey& a, const MeshGeometryKey& b)
+    {
+        return a.numVertices == b.numVertices && a.numFaces == b.numFaces && a.numLines == b.numLines
+            && a.vertexHash == b.vertexHash && a.indexHash == b.indexHash;
+    }
+
+    uint64_t hashChunkSurface (const MeshChunkUploadData& chunkData)
+    {
+        uint64_t hash = kHashSeed;
+        if (chunkData.colors)
+            hash = hashBytes(chunkData.colors, chunkData.numVertices * 3 * sizeof(float), hash);
+        if (chunkData.texcoords)
+            hash = hashBytes(chunkData.texcoords, chunkData.numVertices * 2 * sizeof(float), hash);
+        return hash;
+    }
+
+    bool isSameQuantization (const PositionQuantization& a, const PositionQuantization& b)
+    {
+        return a.origin[0] == b.origin[0] && a.origin[1] == b.origin[1] && a.origin[2] == b.origin[2] && a.scale == b.scale;
+    }
+
+    bool isSameVertexFormat (const PackedVertexFormat& a, const PackedVertexFormat& b)
+    {
+        return a.positionType == b.positionType && a.hasNormals == b.hasNormals && a.hasColors == b.hasColors
+            && a.hasTexcoords == b.hasTexcoords && a.stride == b.stride;
+    }
+
+    // Square root of the surface area per vertex: the spacing of a regular grid with the same density.
+    float computeVertexSpacing (const float* positions, int numVertices, const unsigned short* faces, int numFaces)
+    {
+        if (numVertices == 0)
+            return 0.f;
+
+        double area = 0.0;
+        for (int face = 0; face < numFaces; ++face)
+        {
+            const GLKVector3 a = GLKVector3MakeWithArray(const_cast<float*>(positions + 3 * faces[3 * face]));
+            const GLKVector3 b = GLKVector3MakeWithArray(const_cast<float*>(positions + 3 * faces[3 * face + 1]));
+            const GLKVector3 c = GLKVector3MakeWithArray(const_cast<float*>(positions + 3 * faces[3 * face + 2]));
+            area += 0.5 * GLKVector3Length(GLKVector3CrossProduct(GLKVector3Subtract(b, a), GLKVector3Subtract(c, a)));
+        }
+
+        return float(std::sqrt(area / numVertices));
+    }
+
+    // Reorders the triangles for the post-transform vertex cache and overdraw, then renumbers
+    // the vertices in fetch order, and colors their corners for the wireframe. Uses the bounds and the
+    // quantization already computed, and records the vertex order for the surface stream.
+    void prepareChunkGeometry (MeshChunkUploadData& chunkData, const PackedVertexFormat& geometryFormat, bool optimize)
+    {
+        const int numIndices = chunkData.numFaces * 3;
+        const int stride = geometryFormat.stride;
+
+        chunkData.vertexSpacing = computeVertexSpacing(chunkData.positions, chunkData.numVertices, chunkData.faces, chunkData.numFaces);
+
+        buildOccluderProxy(chunkData.positions, chunkData.numVertices, chunkData.faces, numIndices,
+                           chunkData.bounds, kOccluderGridResolution, chunkData.occluder);
+
+        std::vector<uint8_t> packedVertices (chunkData.numVertices * stride);
+        packVertices(geometryFormat,
+                     chunkData.numVertices,
+                     chunkData.positions,
+                     chunkData.normals,
+                     NULL,
+                     NULL,
+                     packedVertices.data(),
+                     chunkData.quantization);
+
+        std::vector<uint16_t> remap;
+        std::shared_ptr<std::vector<uint16_t>> vertexOrder = std::make_shared<std::vector<uint16_t>>(chunkData.numVertices);
+
+        if (optimize)
+        {
+            chunkData.statisticsBefore = analyzeVertexCache(chunkData.faces, numIndices, chunkData.numVertices);
+
+            std::vector<uint16_t> cacheOrderedFaces (numIndices);
+            std::vector<int> clusters;
+            chunkData.faceIndices.resize (numIndices);
+            optimizeVertexCache(chunkData.faces, numIndices, chunkData.numVertices, cacheOrderedFaces.data(), clusters);
+            optimizeOverdraw(cacheOrderedFaces.data(), numIndices, chunkData.positions, chunkData.numVertices, clusters, chunkData.faceIndices.data());
+
+            optimizeVertexFetch(chunkData.faceIndices.data(), numIndices, chunkData.numVertices, remap);
+
+            chunkData.statisticsAfter = analyzeVertexCache(chunkData.faceIndices.data(), numIndices, chunkData.numVertices);
+
+            for (int vertex = 0; vertex < chunkData.numVertices; ++vertex)
+                (*vertexOrder)[remap[vertex]] = uint16_t(vertex);
+        }
+        else
+        {
+            chunkData.faceIndices.assign (chunkData.faces, chunkData.faces + numIndices);
+
+            for (int vertex = 0; vertex < chunkData.numVertices; ++vertex)
+                (*vertexOrder)[vertex] = uint16_t(vertex);
+        }
+
+        chunkData.simplificationIndices = chunkData.faceIndices;
+        chunkData.simplificationPositions.resize (chunkData.numVertices * 3);
+        gatherVertices(reinterpret_cast<const uint8_t*>(chunkData.positions), 3 * sizeof(float), vertexOrder->data(), chunkData.numVertices,
+                       reinterpret_cast<uint8_t*>(chunkData.simplificationPositions.data()));
+
+        // The wireframe is drawn from the triangles, the line indices are only kept as a fallback.
+        std::vector<uint8_t> colors;
+        std::vector<uint16_t> duplicateSources;
+        if (assignCornerColors(chunkData.faceIndices.data(), numIndices, chunkData.numVertices, colors, duplicateSources))
+        {
+            chunkData.numDuplicatedVertices = (int)duplicateSources.size();
+            for (uint16_t source : duplicateSources)
+                vertexOrder->push_back((*vertexOrder)[source]);
+
+            chunkData.cornerColors.assign (colors.size() * 4, 0);
+            for (size_t vertex = 0; vertex < colors.size(); ++vertex)
+                chunkData.cornerColors[vertex * 4 + colors[vertex]] = 0xff;
+        }
+        else
+        {
+            chunkData.lineIndices.assign (chunkData.lines, chunkData.lines + chunkData.numLines * 2);
+            if (!remap.empty())
+                remapIndices(chunkData.lineIndices.data(), (int)chunkData.lineIndices.size(), remap);
+        }
+
+        chunkData.packedVertices.resize (vertexOrder->size() * stride);
+        gatherVertices(packedVertices.data(), stride, vertexOrder->data(), (int)vertexOrder->size(), chunkData.packedVertices.data());
+
+        chunkData.vertexOrder = vertexOrder;
+    }
+
+    // Colors and texture coordinates in the vertex order of the geometry.
+    void prepareChunkSurface (MeshChunkUploadData& chunkData, const PackedVertexFormat& surfaceFormat)
+    {
+        const std::vector<uint16_t>& vertexOrder = *chunkData.vertexOrder;
+        const int stride = surfaceFormat.stride;
+
+        std::vector<uint8_t> packedSurface (chunkData.numVertices * stride);
+        packVertices(surfaceFormat,
+                     chunkData.numVertices,
+                     NULL,
+                     NULL,
+                     chunkData.colors,
+                     chunkData.texcoords,
+                     packedSurface.data());
+
+        chunkData.packedSurface.resize (vertexOrder.size() * stride);
+        gatherVertices(packedSurface.data(), stride, vertexOrder.data(), (int)vertexOrder.size(), chunkData.packedSurface.data());
+    }
+
+} // Anonymous
+
+void measureChunk (MeshChunkUploadData& chunkData, bool quantizedPositions)
+{
+    chunkData.bounds = computeAxisAlignedBox(chunkData.positions, chunkData.numVertices);
+    if (quantizedPositions)
+        chunkData.quantization = computePositionQuantization(chunkData.bounds);
+
+    chunkData.geometryKey = computeGeometryKey(chunkData);
+    chunkData.surfaceHash = hashChunkSurface(chunkData);
+}
+
+void shareMeshQuantization (std::vector<MeshChunkUploadData>& chunks)
+{
+    AxisAlignedBox meshBounds;
+    for (const MeshChunkUploadData& data : chunks)
+    {
+        if (data.bounds.empty)
+            continue;
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            meshBounds.min[axis] = meshBounds.empty ? data.bounds.min[axis] : std::min(meshBounds.min[axis], data.bounds.min[axis]);
+            meshBounds.max[axis] = meshBounds.empty ? data.bounds.max[axis] : std::max(meshBounds.max[axis], data.bounds.max[axis]);
+        }
+        meshBounds.empty = false;
+    }
+
+    const PositionQuantization meshQuantization = computePositionQuantization(meshBounds);
+    for (MeshChunkUploadData& data : chunks)
+        data.quantization = meshQuantization;
+}
+
+void prepareChunk (MeshChunkUploadData& chunkData, const PackedVertexFormat& geometryFormat,
+                   const PackedVertexFormat& surfaceFormat, bool optimize)
+{
+    chunkData.reuseGeometry = chunkData.canReuseGeometry
+                           && isSameGeometry(chunkData.geometryKey, chunkData.previousGeometryKey)
+                           && isSameQuantization(chunkData.quantization, chunkData.previousQuantization);
+    chunkData.uploadSurface = (surfaceFormat.stride > 0)
+                           && (!chunkData.reuseGeometry || !chunkData.hadSurface || chunkData.surfaceHash != chunkData.previousSurfaceHash);
+
+    if (!chunkData.reuseGeometry)
+        prepareChunkGeometry(chunkData, geometryFormat, optimize);
+
+    if (chunkData.uploadSurface)
+        prepareChunkSurface(chunkData, surfaceFormat);
+}
+
+void buildChunkLevelsOfDetail (MeshChunkSimplification& chunk, bool optimize)
+{
+    if (!chunk.rebuilt)
+        return;
+
+    const int numVertices = (int)chunk.positions.size() / 3;
+    buildLevelsOfDetail(chunk.indices.data(), (int)chunk.indices.size(), chunk.positions.data(), numVertices,
+                        chunk.bounds, kMaxChunkLevelsOfDetail - 1, chunk.levels);
+
+    if (optimize)
+    {
+        std::vector<uint16_t> optimizedIndices;
+        std::vector<int> clusters;
+        for (LevelOfDetail& level : chunk.levels)
+        {
+            optimizedIndices.resize (level.indices.size());
+            optimizeVertexCache(level.indices.data(), (int)level.indices.size(), numVertices, optimizedIndices.data(), clusters);
+            level.indices.swap (optimizedIndices);
+        }
+    }
+
+    // Only the levels are needed from now on.
+    std::vector<float>().swap (chunk.positions);
+    std::vector<uint16_t>().swap (chunk.indices);
+}
+
+float pointSplatPixelsPerUnit (const GLKMatrix4& projectionMatrix, const GLKMatrix4& modelViewMatrix, int viewportHeight)
+{
+    // From the vertical scale of the projection and the viewport, times the scale of the mesh in the view.
+    const float modelViewScale = GLKVector3Length(GLKMatrix4MultiplyVector3(modelViewMatrix, GLKVector3Make(1.f, 0.f, 0.f)));
+    return kPointSplatScale * modelViewScale * projectionMatrix.m[5] * 0.5f * viewportHeight;
+}
+
+void MeshChunkTable::initializeGL ()
+{
+    _isOpenGLES3 = isOpenGLES3Context();
+
+    // Buffer pages are created on demand, sized after the mesh.
+    _arena.initializeGL();
+
+    GLfloat pointSizeRange[2] = { 1.f, 1.f };
+    glGetFloatv(GL_ALIASED_POINT_SIZE_RANGE, pointSizeRange);
+    _maxPointSize = pointSizeRange[1];
+}
+
+void MeshChunkTable::deleteBuffers ()
+{
+    for (MeshChunk& chunk : _chunks)
+        chunk = MeshChunk();
+
+    _arena.deleteBuffers();
+
+    _numChunks = 0;
+    _chunkBounds.clear();
+    _occluderProxies.clear();
+}
+
+void MeshChunkTable::setVertexFormats (const PackedVertexFormat& geometryFormat, const PackedVertexFormat& surfaceFormat)
+{
+    if (!isSameVertexFormat(geometryFormat, _geometryFormat))
+    {
+        for (MeshChunk& chunk : _chunks)
+            chunk = MeshChunk();
+        _chunkBounds.clear();
+        _occluderProxies.clear();
+
+        _arena.reset();
+        _arena.setVertexStride(MeshBufferArena::GeometryStream, geometryFormat.stride);
+        _geometryFormat = geometryFormat;
+    }
+
+    if (!isSameVertexFormat(surfaceFormat, _surfaceFormat))
+    {
+        for (MeshChunk& chunk : _chunks)
+            chunk.hasSurface = false;
+
+        _arena.setVertexStride(MeshBufferArena::SurfaceStream, surfaceFormat.stride);
+        _surfaceFormat = surfaceFormat;
+    }
+}
+
+void MeshChunkTable::resize (int numChunks)
+{
+    for (int meshIndex = numChunks; meshIndex < (int)_chunks.size(); ++meshIndex)
+        releaseChunk(_chunks[meshIndex]);
+    if ((int)_chunks.size() < numChunks)
+        _chunks.resize (numChunks);
+
+    _numChunks = numChunks;
+    _chunkBounds.resize (numChunks);
+    _occluderProxies.resize (numChunks);
+}
+
+void MeshChunkTable::setExpectedSize (int numVertices, int numTriangles)
+{
+    _arena.setExpectedSize(numVertices + numVertices / 4, numTriangles * 3 * 3 / 2);
+}
+
+void MeshChunkTable::describeUploadedChunk (int meshIndex, MeshChunkUploadData& data) const
+{
+    const MeshChunk& chunk = _chunks[meshIndex];
+    data.canReuseGeometry = (chunk.vertexAllocation >= 0 && chunk.levelsOfDetailBuilt);
+    data.hadSurface = chunk.hasSurface;
+    data.previousGeometryKey = chunk.geometryKey;
+    data.previousSurfaceHash = chunk.surfaceHash;
+    data.previousQuantization = chunk.quantization;
+    data.vertexOrder = chunk.vertexOrder;
+}
+
+size_t MeshChunkTable::uploadChunk (int meshIndex, MeshChunkUploadData& data)
+{
+    MeshChunk& chunk = _chunks[meshIndex];
+    const size_t indexSize = _arena.indexSize();
+    size_t numBytes = 0;
+
+    if (!data.reuseGeometry)
+    {
+        // The previous levels of detail go too, until those of the new geometry are built.
+        releaseChunk(chunk);
+
+        if (hasQuantizedPositions())
+        {
+            const PositionQuantization& quantization = data.quantization;
+            const GLfloat dequantization[4] = { quantization.origin[0], quantization.origin[1], quantization.origin[2], quantization.scale };
+            memcpy(chunk.dequantization, dequantization, sizeof(dequantization));
+            chunk.quantizationErrorBound = positionQuantizationErrorBound(quantization);
+        }
+
+        const int numVertices = (int)data.vertexOrder->size();
+        const int numTriangleIndices = (int)data.faceIndices.size();
+        const int numLinesIndices = (int)data.lineIndices.size();
+
+        chunk.hasCornerColors = !data.cornerColors.empty();
+        chunk.vertexSpacing = data.vertexSpacing;
+
+        if (numTriangleIndices > 0)
+        {
+            // The page is picked with room for the line indices too.
+            chunk.vertexAllocation = _arena.allocateVertices(numVertices, numTriangleIndices + numLinesIndices);
+            if (chunk.vertexAllocation < 0)
+                NSLog(@"MeshRenderer: no room for the %d vertices of chunk %d, skipping it.", numVertices, meshIndex);
+        }
+
+        if (chunk.vertexAllocation >= 0)
+        {
+            _arena.uploadVertices(chunk.vertexAllocation, MeshBufferArena::GeometryStream, data.packedVertices.data());
+            if (chunk.hasCornerColors)
+                _arena.uploadVertices(chunk.vertexAllocation, MeshBufferArena::CornerColorStream, data.cornerColors.data());
+
+            chunk.levelIndexAllocations[0] = _arena.allocateIndices(chunk.vertexAllocation, numTriangleIndices);
+            _arena.uploadIndices(chunk.levelIndexAllocations[0], data.faceIndices.data());
+
+            if (!chunk.hasCornerColors && numLinesIndices > 0)
+            {
+                chunk.linesAllocation = _arena.allocateIndices(chunk.vertexAllocation, numLinesIndices);
+                _arena.uploadIndices(chunk.linesAllocation, data.lineIndices.data());
+            }
+
+            chunk.numTriangleIndices = numTriangleIndices;
+            chunk.numLinesIndices = numLinesIndices;
+
+            numBytes += data.packedVertices.size() + data.faceIndices.size() * indexSize
+                      + data.cornerColors.size() + data.lineIndices.size() * indexSize;
+        }
+
+        chunk.numLevelsOfDetail = 1;
+        chunk.levelNumIndices[0] = chunk.numTriangleIndices;
+
+        chunk.geometryKey = data.geometryKey;
+        chunk.quantization = data.quantization;
+        chunk.vertexOrder = data.vertexOrder;
+
+        _chunkBounds[meshIndex] = (chunk.vertexAllocation >= 0) ? data.bounds : AxisAlignedBox();
+        _occluderProxies[meshIndex].triangles.swap (data.occluder.triangles);
+        _occluderProxies[meshIndex].margin = data.occluder.margin;
+
+        data.numWireframeBytes = data.cornerColors.size()
+                               + data.numDuplicatedVertices * (_geometryFormat.stride + _surfaceFormat.stride)
+                               + data.lineIndices.size() * indexSize;
+    }
+
+    if (data.uploadSurface && chunk.vertexAllocation >= 0)
+    {
+        assert (data.packedSurface.size() == data.vertexOrder->size() * _surfaceFormat.stride);
+        _arena.uploadVertices(chunk.vertexAllocation, MeshBufferArena::SurfaceStream, data.packedSurface.data());
+        numBytes += data.packedSurface.size();
+    }
+
+    // Either uploaded now, unchanged, or not needed by the format.
+    chunk.surfaceHash = data.surfaceHash;
+    chunk.hasSurface = true;
+
+    // The GPU has its copy.
+    std::vector<uint8_t>().swap (data.packedVertices);
+    std::vector<uint8_t>().swap (data.packedSurface);
+    std::vector<uint16_t>().swap (data.faceIndices);
+    std::vector<uint16_t>().swap (data.lineIndices);
+    std::vector<uint8_t>().swap (data.cornerColors);
+
+    return numBytes;
+}
+
+bool MeshChunkTable::uploadLevelsOfDetail (const std::vector<MeshChunkSimplification>& simplifications)
+{
+    if ((int)simplifications.size() != _numChunks)
+        return false;
+
+    // A chunk whose page is full keeps the levels it got.
+    for (int level = 1; level < kMaxChunkLevelsOfDetail; ++level)
+    {
+        for (int meshIndex = 0; meshIndex < _numChunks; ++meshIndex)
+        {
+            MeshChunk& chunk = _chunks[meshIndex];
+            const std::vector<LevelOfDetail>& levels = simplifications[meshIndex].levels;
+            if (!simplifications[meshIndex].rebuilt || chunk.vertexAllocation < 0
+                || chunk.numLevelsOfDetail != level || level > (int)levels.size())
+                continue;
+
+            const LevelOfDetail& levelOfDetail = levels[level - 1];
+            const int allocation = _arena.allocateIndices(chunk.vertexAllocation, (int)levelOfDetail.indices.size());
+            if (allocation < 0)
+                continue;
+
+            _arena.uploadIndices(allocation, levelOfDetail.indices.data());
+            chunk.levelIndexAllocations[level] = allocation;
+            chunk.levelNumIndices[level] = (int)levelOfDetail.indices.size();
+            chunk.levelErrors[level] = levelOfDetail.error;
+            chunk.numLevelsOfDetail = level + 1;
+        }
+    }
+
+    for (int meshIndex = 0; meshIndex < _numChunks; ++meshIndex)
+        _chunks[meshIndex].levelsOfDetailBuilt = true;
+
+    return true;
+}
+
+void MeshChunkTable::setLevelOfDetailViewport (float viewportHeightInPixels, float maxPixelError)
+{
+    _levelOfDetailViewportHeight = viewportHeightInPixels;
+    _levelOfDetailMaxPixelError = maxPixelError;
+}
+
+int MeshChunkTable::selectLevelOfDetail (int meshIndex, const GLKMatrix4& projectionMatrix, const GLKMatrix4& modelViewMatrix) const
+{
+    const MeshChunk& chunk = _chunks[meshIndex];
+    return ::selectLevelOfDetail(chunk.levelErrors, chunk.numLevelsOfDetail, _chunkBounds[meshIndex], projectionMatrix.m,
+                                 modelViewMatrix.m, _levelOfDetailViewportHeight, _levelOfDetailMaxPixelError);
+}
+
+int MeshChunkTable::cullChunks (const GLKMatrix4& viewProjection, std::vector<int>& visibleChunks) const
+{
+    visibleChunks.resize (_numChunks);
+    const int numVisibleChunks = cullAndSortBoxes(viewProjection.m, _chunkBounds.data(), _numChunks, visibleChunks.data());
+    visibleChunks.resize (numVisibleChunks);
+
+    int numCulledChunks = -numVisibleChunks;
+    for (int meshIndex = 0; meshIndex < _numChunks; ++meshIndex)
+        if (!_chunkBounds[meshIndex].empty)
+            ++numCulledChunks;
+    return numCulledChunks;
+}
+
+int MeshChunkTable::removeOccludedChunks (OcclusionCuller& culler, const GLKMatrix4& viewProjection, std::vector<int>& visibleChunks) const
+{
+    culler.beginFrame(viewProjection.m);
+
+    // Front to back, each chunk is tested against the proxies of those in front of it.
+    size_t numKept = 0;
+    for (size_t i = 0; i < visibleChunks.size(); ++i)
+    {
+        const int meshIndex = visibleChunks[i];
+        const OccluderProxy& occluder = _occluderProxies[meshIndex];
+
+        if (!culler.isBoxVisible(_chunkBounds[meshIndex], occluder.margin))
+            continue;
+
+        culler.renderOccluder(occluder);
+        visibleChunks[numKept++] = meshIndex;
+    }
+
+    const int numOccluded = (int)(visibleChunks.size() - numKept);
+    visibleChunks.resize (numKept);
+    return numOccluded;
+}
+
+void MeshChunkTable::buildDraws (MeshShaderKey shaderKey, const std::vector<int>& visibleChunks, const GLKMatrix4& projectionMatrix,
+                                 const GLKMatrix4& modelViewMatrix, std::vector<ArenaDraw>& draws, int& numTriangles, int& numPoints) const
+{
+    const bool wireframe = (shaderKey & MeshShaderWireframe) != 0;
+    const bool points = (shaderKey & MeshShaderPointSplats) != 0;
+
+    // Chunks whose surface stream is not uploaded yet in the current format would show garbage colors.
+    const bool needsSurface = (shaderKey & MeshShaderColorMask) != 0;
+
+    for (int meshIndex : visibleChunks)
+    {
+        const MeshChunk& chunk = _chunks[meshIndex];
+        if (chunk.vertexAllocation < 0 || (needsSurface && !chunk.hasSurface))
+            continue;
+
+        // The points are the vertices of the chunk, its wireframe duplicates included.
+        if (points)
+        {
+            const MeshBufferArena::Allocation& vertices = _arena.allocation(chunk.vertexAllocation);
+
+            ArenaDraw draw;
+            draw.segment = 2 * vertices.page;
+            draw.primitive = GL_POINTS;
+            draw.firstIndex = vertices.first;
+            draw.numIndices = vertices.count;
+            draw.meshIndex = meshIndex;
+            draws.push_back(draw);
+
+            numPoints += vertices.count;
+            continue;
+        }
+
+        // The wireframe is always drawn at full resolution.
+        const int level = wireframe ? 0 : selectLevelOfDetail(meshIndex, projectionMatrix, modelViewMatrix);
+        const int page = _arena.allocation(chunk.vertexAllocation).page;
+
+        const bool lines = wireframe && !chunk.hasCornerColors;
+        const int indexAllocation = lines ? chunk.linesAllocation : chunk.levelIndexAllocations[level];
+        if (indexAllocation < 0)
+            continue;
+
+        ArenaDraw draw;
+        draw.segment = 2 * page + (lines ? 1 : 0);
+        draw.primitive = lines ? GL_LINES : GL_TRIANGLES;
+        draw.firstIndex = _arena.allocation(indexAllocation).first;
+        draw.numIndices = _arena.allocation(indexAllocation).count;
+        draw.meshIndex = meshIndex;
+        draws.push_back(draw);
+
+        numTriangles += chunk.levelNumIndices[level] / 3;
+    }
+}
+
+void MeshChunkTable::mergeDraws (std::vector<ArenaDraw>& draws) const
+{
+    size_t numMerged = 0;
+    for (size_t i = 0; i < draws.size(); ++i)
+    {
+        if (numMerged > 0)
+        {
+            ArenaDraw& previous = draws[numMerged - 1];
+            const ArenaDraw& draw = draws[i];
+            const GLfloat* previousDequantization = _chunks[previous.meshIndex].dequantization;
+            const GLfloat* dequantization = _chunks[draw.meshIndex].dequantization;
+
+            if (draw.segment == previous.segment && draw.primitive == previous.primitive
+                && memcmp(dequantization, previousDequantization, 4 * sizeof(GLfloat)) == 0)
+            {
+                if (draw.firstIndex == previous.firstIndex + previous.numIndices)
+                {
+                    previous.numIndices += draw.numIndices;
+                    continue;
+                }
+
+                if (draw.firstIndex + draw.numIndices == previous.firstIndex)
+                {
+                    previous.firstIndex = draw.firstIndex;
+                    previous.numIndices += draw.numIndices;
+                    continue;
+                }
+            }
+        }
+
+        draws[numMerged++] = draws[i];
+    }
+
+    draws.resize (numMerged);
+}
+
+void MeshChunkTable::recordVertexAttributes (RenderCommandList& commands, int page, bool withNormals, bool withColors, bool withTexcoords) const
+{
+    const PackedVertexFormat& format = _geometryFormat;
+    const GLenum halfFloatType = _isOpenGLES3 ? GL_HALF_FLOAT : GL_HALF_FLOAT_OES;
+
+    // The indices are rebased on the page, the attributes start at its first vertex.
+    VertexAttributeBinding binding;
+    binding.buffer = _arena.vertexBuffer(page, MeshBufferArena::GeometryStream);
+    binding.stride = format.stride;
+
+    binding.index = CustomShader::ATTRIB_VERTEX;
+    binding.offset = format.positionOffset;
+    switch (format.positionType)
+    {
+        case PackedVertexFormat::PositionFloat32:
+            binding.size = 3; binding.type = GL_FLOAT; binding.normalized = GL_FALSE;
+            break;
+
+        case PackedVertexFormat::PositionFloat16:
+            binding.size = 4; binding.type = halfFloatType; binding.normalized = GL_FALSE;
+            break;
+
+        case PackedVertexFormat::PositionUnorm16:
+            binding.size = 3; binding.type = GL_UNSIGNED_SHORT; binding.normalized = GL_TRUE;
+            break;
+
+        case PackedVertexFormat::PositionNone:
+            assert (false);
+            break;
+    }
+    commands.setVertexAttribute(binding);
+
+    if (withNormals && format.hasNormals)
+    {
+        binding.index = CustomShader::ATTRIB_NORMAL;
+        binding.size = 2; binding.type = GL_SHORT; binding.normalized = GL_TRUE;
+        binding.offset = format.normalOffset;
+        commands.setVertexAttribute(binding);
+    }
+
+    // Colors and texture coordinates come from the surface stream.
+    const PackedVertexFormat& surfaceFormat = _surfaceFormat;
+    binding.buffer = _arena.vertexBuffer(page, MeshBufferArena::SurfaceStream);
+    binding.stride = surfaceFormat.stride;
+
+    if (withColors && surfaceFormat.hasColors)
+    {
+        binding.index = CustomShader::ATTRIB_COLOR;
+        binding.size = 4; binding.type = GL_UNSIGNED_BYTE; binding.normalized = GL_TRUE;
+        binding.offset = surfaceFormat.colorOffset;
+        commands.setVertexAttribute(binding);
+    }
+
+    if (withTexcoords && surfaceFormat.hasTexcoords)
+    {
+        binding.index = CustomShader::ATTRIB_TEXCOORD;
+        binding.size = 2; binding.type = halfFloatType; binding.normalized = GL_FALSE;
+        binding.offset = surfaceFormat.texcoordOffset;
+        commands.setVertexAttribute(binding);
+    }
+}
+
+void MeshChunkTable::recordCornerColors (RenderCommandList& commands, int page, bool fromBuffer) const
+{
+    if (fromBuffer)
+    {
+        VertexAttributeBinding binding;
+        binding.index = CustomShader::ATTRIB_CORNER_COLOR;
+        binding.buffer = _arena.vertexBuffer(page, MeshBufferArena::CornerColorStream);
+        binding.size = 4;
+        binding.type = GL_UNSIGNED_BYTE;
+        binding.normalized = GL_TRUE;
+        binding.stride = 4;
+        commands.setVertexAttribute(binding);
+    }
+    else
+    {
+        // Lines fallback: a constant zero color marks every fragment as an edge.
+        const GLfloat zero[4] = { 0.f, 0.f, 0.f, 0.f };
+        commands.setConstantVertexAttribute(CustomShader::ATTRIB_CORNER_COLOR, zero);
+    }
+}
+
+void MeshChunkTable::recordCommandList (MeshShaderKey shaderKey, RenderCommandList& commands) const
+{
+    commands.clear();
+
+    const bool withNormals = (shaderKey & MeshShaderLightingMask) != 0;
+    const bool withColors = (shaderKey & MeshShaderVertexColors) != 0;
+    const bool withTexcoords = (shaderKey & (MeshShaderYCbCrTexture | MeshShaderRgbTexture)) != 0;
+    const bool wireframe = (shaderKey & MeshShaderWireframe) != 0;
+    const bool points = (shaderKey & MeshShaderPointSplats) != 0;
+
+    // draw issues the draws, merging the chunks next to each other in the page.
+    for (int segment = 0; segment < 2 * _arena.numPages(); ++segment)
+    {
+        commands.beginSegment();
+
+        const int page = segment / 2;
+        const bool lines = (segment % 2 == 1);
+
+        if (wireframe)
+            recordCornerColors(commands, page, !lines);
+
+        recordVertexAttributes(commands, page, withNormals, withColors, withTexcoords);
+
+        if (!points)
+            commands.bindElementArrayBuffer(_arena.indexBuffer(page));
+
+        if (wireframe && lines)
+            commands.setLineWidth(1.0);
+    }
+}
+
+void MeshChunkTable::draw (GLStateCache& cache, MeshShader& shader, const RenderCommandList& commands,
+                           const std::vector<ArenaDraw>& draws, float pointSplatPixelsPerUnit) const
+{
+    const bool quantizedPositions = hasQuantizedPositions();
+    float pointSplat[4] = { 0.f, 1.f, _maxPointSize, 0.f };
+
+    int currentSegment = -1;
+    for (const ArenaDraw& draw : draws)
+    {
+        if (draw.segment != currentSegment)
+        {
+            commands.replaySegments(cache, &draw.segment, 1);
+            currentSegment = draw.segment;
+        }
+
+        // The cache skips the uniform when the chunks share their quantization.
+        if (quantizedPositions)
+            shader.setDequantization(cache, _chunks[draw.meshIndex].dequantization);
+
+        // The point splats of each chunk have their own size.
+        if (draw.primitive == GL_POINTS)
+        {
+            pointSplat[0] = pointSplatPixelsPerUnit * _chunks[draw.meshIndex].vertexSpacing;
+            shader.setPointSplat(cache, pointSplat);
+            cache.drawArrays(GL_POINTS, draw.firstIndex, draw.numIndices);
+            continue;
+        }
+
+        cache.drawElements(draw.primitive, draw.numIndices, _arena.indexType(), (GLsizeiptr)draw.firstIndex * _arena.indexSize());
+    }
+}
+
+void MeshChunkTable::releaseChunk (MeshChunk& chunk)
+{
+    _arena.free(chunk.vertexAllocation);
+    _arena.free(chunk.linesAllocation);
+    for (int allocation : chunk.levelIndexAllocations)
+        _arena.free(allocation);
+
+    chunk = MeshChunk();
+}
@@ -0,0 +1,592 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+// Local functions
+namespace
+{
+
+    // Triangles using each vertex, as offsets into a flat triangle list.
+    struct VertexTriangleAdjacency
+    {
+        std::vector<int> offsets; // numVertices + 1 entries.
+        std::vector<int> triangles;
+
+        VertexTriangleAdjacency (const uint16_t* indices, int numIndices, int numVertices)
+        : offsets (numVertices + 1, 0)
+        , triangles (numIndices)
+        {
+            for (int i = 0; i < numIndices; ++i)
+                ++offsets[indices[i] + 1];
+
+            for (int v = 0; v < numVertices; ++v)
+                offsets[v + 1] += offsets[v];
+
+            std::vector<int> fill (offsets.begin(), offsets.end() - 1);
+            for (int i = 0; i < numIndices; ++i)
+                triangles[fill[indices[i]]++] = i / 3;
+        }
+
+        int valence (int vertex) const { return offsets[vertex + 1] - offsets[vertex]; }
+    };
+
+    // FIFO cache simulation, returns true on a miss.
+    struct FifoCache
+    {
+        std::vector<unsigned> timestamps;
+        unsigned now;
+        int size;
+
+        FifoCache (int numVertices, int cacheSize)
+        : timestamps (numVertices, 0)
+        , now (cacheSize + 1)
+        , size (cacheSize)
+        {}
+
+        void flush () { now += size + 1; }
+
+        bool access (int vertex)
+        {
+            if (now - timestamps[vertex] > unsigned(size))
+            {
+                timestamps[vertex] = now++;
+                return true;
+            }
+            return false;
+        }
+    };
+
+    // Tipsify fanning vertex selection: the candidate that will still be in the cache after its
+    // remaining triangles are emitted, and that entered the cache first. Falls back to the dead-end
+    // stack, then to the input order. Returns -1 when all the triangles were emitted.
+    int nextFanningVertex (const std::vector<int>& candidates,
+                           const std::vector<int>& liveTriangles,
+                           const std::vector<unsigned>& cacheTimestamps,
+                           unsigned timestamp,
+                           int cacheSize,
+                           std::vector<int>& deadEndStack,
+                           int& inputCursor,
+                           int numVertices,
+                           bool& cacheFlushed)
+    {
+        int bestVertex = -1;
+        int bestPriority = -1;
+
+        for (int vertex : candidates)
+        {
+            if (liveTriangles[vertex] <= 0)
+                continue;
+
+            int priority = 0;
+            const int age = int(timestamp - cacheTimestamps[vertex]);
+            if (age + 2 * liveTriangles[vertex] <= cacheSize)
+                priority = age;
+
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                bestVertex = vertex;
+            }
+        }
+
+        cacheFlushed = false;
+        if (bestVertex >= 0)
+            return bestVertex;
+
+        cacheFlushed = true;
+
+        while (!deadEndStack.empty())
+        {
+            const int vertex = deadEndStack.back();
+            deadEndStack.pop_back();
+            if (liveTriangles[vertex] > 0)
+                return vertex;
+        }
+
+        while (inputCursor < numVertices)
+        {
+            const int vertex = inputCursor++;
+            if (liveTriangles[vertex] > 0)
+                return vertex;
+        }
+
+        return -1;
+    }
+
+    // Splits [begin, end) triangle ranges wherever the running cluster ACMR is close to the ACMR
+    // of the whole range (Sander et al. 2007, section 4.2).
+    void addSoftBoundaries (const uint16_t* indices,
+                            int beginTriangle,
+                            int endTriangle,
+                            FifoCache& cache,
+                            std::vector<int>& clusters)
+    {
+        const float threshold = 1.05f;
+
+        cache.flush();
+        int rangeMisses = 0;
+        for (int t = beginTriangle; t < endTriangle; ++t)
+            for (int k = 0; k < 3; ++k)
+                rangeMisses += cache.access(indices[3*t + k]);
+
+        const float rangeAcmr = float(rangeMisses) / float(endTriangle - beginTriangle);
+
+        cache.flush();
+        int clusterStart = beginTriangle;
+        int clusterMisses = 0;
+
+        clusters.push_back(beginTriangle);
+
+        for (int t = beginTriangle; t < endTriangle; ++t)
+        {
+            for (int k = 0; k < 3; ++k)
+                clusterMisses += cache.access(indices[3*t + k]);
+
+            const int clusterTriangles = t + 1 - clusterStart;
+            if (t + 1 < endTriangle && float(clusterMisses) <= threshold * rangeAcmr * float(clusterTriangles))
+            {
+                // New cluster, with a cold cache.
+                clusters.push_back(t + 1);
+                clusterStart = t + 1;
+                clusterMisses = 0;
+                cache.flush();
+            }
+        }
+    }
+
+    // Colors used by the vertices sharing a triangle with vertex, except ignoredVertex.
+    int neighborColorMask (int vertex, int ignoredVertex, const uint16_t* indices,
+                           const VertexTriangleAdjacency& adjacency, const std::vector<uint8_t>& colors)
+    {
+        int mask = 0;
+        for (int a = adjacency.offsets[vertex]; a < adjacency.offsets[vertex + 1]; ++a)
+        {
+            const int triangle = adjacency.triangles[a];
+            for (int k = 0; k < 3; ++k)
+            {
+                const int neighbor = indices[3*triangle + k];
+                if (neighbor != vertex && neighbor != ignoredVertex && colors[neighbor] != 0xff)
+                    mask |= 1 << colors[neighbor];
+            }
+        }
+        return mask;
+    }
+
+    // All 4 colors are used around vertex: tries to free one by recoloring a neighbor that is the only
+    // one with its color. Returns the freed color, or 4 on failure.
+    int freeColorByRecoloringNeighbor (int vertex, const uint16_t* indices,
+                                       const VertexTriangleAdjacency& adjacency, std::vector<uint8_t>& colors)
+    {
+        for (int a = adjacency.offsets[vertex]; a < adjacency.offsets[vertex + 1]; ++a)
+        {
+            const int triangle = adjacency.triangles[a];
+            for (int k = 0; k < 3; ++k)
+            {
+                const int neighbor = indices[3*triangle + k];
+                if (neighbor == vertex || colors[neighbor] == 0xff)
+                    continue;
+
+                const int color = colors[neighbor];
+
+                // Other neighbors of vertex with the same color would keep it taken.
+                colors[neighbor] = 0xff;
+                const bool colorIsUnique = !(neighborColorMask(vertex, -1, indices, adjacency, colors) & (1 << color));
+                colors[neighbor] = uint8_t(color);
+                if (!colorIsUnique)
+                    continue;
+
+                const int usedAroundNeighbor = neighborColorMask(neighbor, vertex, indices, adjacency, colors) | (1 << color);
+                for (int newColor = 0; newColor < 4; ++newColor)
+                {
+                    if (!(usedAroundNeighbor & (1 << newColor)))
+                    {
+                        colors[neighbor] = uint8_t(newColor);
+                        return color;
+                    }
+                }
+            }
+        }
+        return 4;
+    }
+
+} // Anonymous
+
+VertexCacheStatistics analyzeVertexCache (const uint16_t* indices,
+                                          int numIndices,
+                                          int numVertices,
+                                          int cacheSize)
+{
+    VertexCacheStatistics statistics;
+    if (numIndices < 3 || numVertices <= 0)
+        return statistics;
+
+    FifoCache cache (numVertices, cacheSize);
+    std::vector<bool> referenced (numVertices, false);
+
+    int misses = 0;
+    int numReferencedVertices = 0;
+    for (int i = 0; i < numIndices; ++i)
+    {
+        const int vertex = indices[i];
+        misses += cache.access(vertex);
+        if (!referenced[vertex])
+        {
+            referenced[vertex] = true;
+            ++numReferencedVertices;
+        }
+    }
+
+    statistics.acmr = float(misses) / float(numIndices / 3);
+    statistics.atvr = float(misses) / float(numReferencedVertices);
+    return statistics;
+}
+
+void optimizeVertexCache (const uint16_t* indices,
+                          int numIndices,
+                          int numVertices,
+                          uint16_t* dst,
+                          std::vector<int>& clusters,
+                          int cacheSize)
+{
+    assert (indices != dst);
+
+    clusters.clear();
+
+    const int numTriangles = numIndices / 3;
+    if (numTriangles == 0)
+        return;
+
+    VertexTriangleAdjacency adjacency (indices, numTriangles * 3, numVertices);
+
+    std::vector<int> liveTriangles (numVertices);
+    for (int v = 0; v < numVertices; ++v)
+        liveTriangles[v] = adjacency.valence(v);
+
+    std::vector<unsigned> cacheTimestamps (numVertices, 0);
+    unsigned timestamp = cacheSize + 1;
+
+    std::vector<bool> emitted (numTriangles, false);
+    std::vector<int> deadEndStack;
+    std::vector<int> candidates;
+
+    // Triangle ranges between cache flushes, split further by addSoftBoundaries.
+    std::vector<int> hardBoundaries;
+
+    int inputCursor = 1;
+    int numEmitted = 0;
+    int fanningVertex = 0;
+    bool cacheFlushed = true;
+
+    // The first vertex may not be referenced at all.
+    if (liveTriangles[fanningVertex] == 0)
+        fanningVertex = nextFanningVertex(candidates, liveTriangles, cacheTimestamps, timestamp, cacheSize,
+                                          deadEndStack, inputCursor, numVertices, cacheFlushed);
+
+    while (fanningVertex >= 0)
+    {
+        if (cacheFlushed)
+            hardBoundaries.push_back(numEmitted);
+
+        candidates.clear();
+
+        for (int a = adjacency.offsets[fanningVertex]; a < adjacency.offsets[fanningVertex + 1]; ++a)
+        {
+            const int triangle = adjacency.triangles[a];
+            if (emitted[triangle])
+                continue;
+
+            for (int k = 0; k < 3; ++k)
+            {
+                const int vertex = indices[3*triangle + k];
+                dst[3*numEmitted + k] = uint16_t(vertex);
+
+                deadEndStack.push_back(vertex);
+                candidates.push_back(vertex);
+                --liveTriangles[vertex];
+
+                if (timestamp - cacheTimestamps[vertex] > unsigned(cacheSize))
+                    cacheTimestamps[vertex] = timestamp++;
+            }
+
+            emitted[triangle] = true;
+            ++numEmitted;
+        }
+
+        fanningVertex = nextFanningVertex(candidates, liveTriangles, cacheTimestamps, timestamp, cacheSize,
+                                          deadEndStack, inputCursor, numVertices, cacheFlushed);
+    }
+
+    assert (numEmitted == numTriangles);
+    hardBoundaries.push_back(numEmitted);
+
+    FifoCache cache (numVertices, cacheSize);
+
+    for (size_t range = 0; range + 1 < hardBoundaries.size(); ++range)
+    {
+        if (hardBoundaries[range] < hardBoundaries[range + 1])
+            addSoftBoundaries(dst, hardBoundaries[range], hardBoundaries[range + 1], cache, clusters);
+    }
+}
+
+void optimizeOverdraw (const uint16_t* indices,
+                       int numIndices,
+                       const float* positions,
+                       int numVertices,
+                       const std::vector<int>& clusters,
+                       uint16_t* dst)
+{
+    assert (indices != dst);
+
+    const int numTriangles = numIndices / 3;
+    const int numClusters = (int)clusters.size();
+    if (numClusters <= 1)
+    {
+        std::copy(indices, indices + numTriangles * 3, dst);
+        return;
+    }
+
+    // Area-weighted centroid of the chunk, a cheap stand-in for its center of mass.
+    double meshCentroid[3] = { 0.0, 0.0, 0.0 };
+    double meshArea = 0.0;
+
+    std::vector<float> clusterCentroids (numClusters * 3, 0.f);
+    std::vector<float> clusterNormals (numClusters * 3, 0.f);
+    std::vector<float> clusterAreas (numClusters, 0.f);
+
+    for (int cluster = 0; cluster < numClusters; ++cluster)
+    {
+        const int end = (cluster + 1 < numClusters) ? clusters[cluster + 1] : numTriangles;
+        float* centroid = &clusterCentroids[3*cluster];
+        float* normal = &clusterNormals[3*cluster];
+
+        for (int t = clusters[cluster]; t < end; ++t)
+        {
+            const float* p0 = positions + 3*indices[3*t + 0];
+            const float* p1 = positions + 3*indices[3*t + 1];
+            const float* p2 = positions + 3*indices[3*t + 2];
+
+            const float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            const float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            const float n[3] = { e1[1]*e2[2] - e1[2]*e2[1], e1[2]*e2[0] - e1[0]*e2[2], e1[0]*e2[1] - e1[1]*e2[0] };
+            const float area = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+
+            for (int c = 0; c < 3; ++c)
+            {
+                centroid[c] += area * (p0[c] + p1[c] + p2[c]) / 3.f;
+                normal[c] += n[c];
+            }
+            clusterAreas[cluster] += area;
+        }
+
+        for (int c = 0; c < 3; ++c)
+            meshCentroid[c] += centroid[c];
+        meshArea += clusterAreas[cluster];
+
+        if (clusterAreas[cluster] > 0.f)
+            for (int c = 0; c < 3; ++c)
+                centroid[c] /= clusterAreas[cluster];
+    }
+
+    if (meshArea > 0.0)
+        for (int c = 0; c < 3; ++c)
+            meshCentroid[c] /= meshArea;
+
+    // Clusters whose normal points away from the chunk center occlude the others from most viewpoints.
+    std::vector<std::pair<float, int> > sortKeys (numClusters);
+    for (int cluster = 0; cluster < numClusters; ++cluster)
+    {
+        const float* centroid = &clusterCentroids[3*cluster];
+        const float* normal = &clusterNormals[3*cluster];
+        const float normalLength = std::sqrt(normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2]);
+
+        float key = 0.f;
+        if (normalLength > 0.f)
+        {
+            for (int c = 0; c < 3; ++c)
+                key += (centroid[c] - float(meshCentroid[c])) * normal[c];
+            key /= normalLength;
+        }
+
+        sortKeys[cluster] = std::make_pair(-key, cluster);
+    }
+
+    std::stable_sort(sortKeys.begin(), sortKeys.end());
+
+    uint16_t* out = dst;
+    for (const std::pair<float, int>& sortKey : sortKeys)
+    {
+        const int cluster = sortKey.second;
+        const int end = (cluster + 1 < numClusters) ? clusters[cluster + 1] : numTriangles;
+        out = std::copy(indices + 3*clusters[cluster], indices + 3*end, out);
+    }
+
+    (void)numVertices;
+}
+
+void optimizeVertexFetch (uint16_t* indices,
+                          int numIndices,
+                          int numVertices,
+                          std::vector<uint16_t>& remap)
+{
+    const uint16_t unassigned = 0xffff;
+    remap.assign(numVertices, unassigned);
+
+    // STMesh chunks have fewer than 65535 vertices, so 0xffff never is a valid new index.
+    assert (numVertices < 0xffff);
+
+    int nextVertex = 0;
+    for (int i = 0; i < numIndices; ++i)
+    {
+        uint16_t& newIndex = remap[indices[i]];
+        if (newIndex == unassigned)
+            newIndex = uint16_t(nextVertex++);
+        indices[i] = newIndex;
+    }
+
+    for (int v = 0; v < numVertices; ++v)
+        if (remap[v] == unassigned)
+            remap[v] = uint16_t(nextVertex++);
+}
+
+void remapIndices (uint16_t* indices, int numIndices, const std::vector<uint16_t>& remap)
+{
+    for (int i = 0; i < numIndices; ++i)
+        indices[i] = remap[indices[i]];
+}
+
+void remapVertices (const uint8_t* src, int numVertices, int vertexSize, const std::vector<uint16_t>& remap, uint8_t* dst)
+{
+    assert (src != dst);
+
+    for (int v = 0; v < numVertices; ++v)
+        memcpy(dst + remap[v] * vertexSize, src + v * vertexSize, vertexSize);
+}
+
+void gatherVertices (const uint8_t* src, int vertexSize, const uint16_t* order, int numVertices, uint8_t* dst)
+{
+    assert (src != dst);
+
+    for (int v = 0; v < numVertices; ++v)
+        memcpy(dst + v * vertexSize, src + order[v] * vertexSize, vertexSize);
+}
+
+bool assignCornerColors (uint16_t* indices,
+                         int numIndices,
+                         int numVertices,
+                         std::vector<uint8_t>& colors,
+                         std::vector<uint16_t>& duplicateSources)
+{
+    const uint8_t uncolored = 0xff;
+    const int maxVertices = 0xffff;
+
+    colors.assign(numVertices, uncolored);
+    duplicateSources.clear();
+
+    const int numTriangles = numIndices / 3;
+    VertexTriangleAdjacency adjacency (indices, numTriangles * 3, numVertices);
+
+    // Greedy coloring in breadth-first order. Mesh graphs are planar so 4 colors are enough in theory,
+    // the greedy order occasionally needs a 5th one which is resolved below with duplicates.
+    std::vector<bool> queued (numVertices, false);
+    std::vector<int> queue;
+    queue.reserve(numVertices);
+
+    for (int seed = 0; seed < numVertices; ++seed)
+    {
+        if (queued[seed] || adjacency.valence(seed) == 0)
+            continue;
+
+        queued[seed] = true;
+        queue.push_back(seed);
+
+        for (size_t next = queue.size() - 1; next < queue.size(); ++next)
+        {
+            const int vertex = queue[next];
+
+            int neighborColors = 0;
+            for (int a = adjacency.offsets[vertex]; a < adjacency.offsets[vertex + 1]; ++a)
+            {
+                const int triangle = adjacency.triangles[a];
+                for (int k = 0; k < 3; ++k)
+                {
+                    const int neighbor = indices[3*triangle + k];
+                    if (colors[neighbor] != uncolored)
+                        neighborColors |= 1 << colors[neighbor];
+
+                    if (!queued[neighbor])
+                    {
+                        queued[neighbor] = true;
+                        queue.push_back(neighbor);
+                    }
+                }
+            }
+
+            int color = 0;
+            while (color < 4 && (neighborColors & (1 << color)))
+                ++color;
+
+            if (color == 4)
+                color = freeColorByRecoloringNeighbor(vertex, indices, adjacency, colors);
+
+            colors[vertex] = uint8_t(color < 4 ? color : 0);
+        }
+    }
+
+    // Duplicate the vertices whose color collides inside a triangle.
+    std::vector<int> colorVertices (numVertices * 4, -1); // vertex holding each color of an original vertex.
+    std::vector<uint16_t> remappedIndices (indices, indices + numIndices);
+
+    for (int t = 0; t < numTriangles; ++t)
+    {
+        uint16_t* triangle = &remappedIndices[3*t];
+        const int triangleColors = (1 << colors[triangle[0]]) | (1 << colors[triangle[1]]) | (1 << colors[triangle[2]]);
+        int takenColors = 0;
+
+        for (int k = 0; k < 3; ++k)
+        {
+            const int vertex = triangle[k];
+            const int color = colors[vertex];
+
+            if (takenColors & (1 << color))
+            {
+                int newColor = 0;
+                while ((triangleColors | takenColors) & (1 << newColor))
+                    ++newColor;
+
+                int& duplicate = colorVertices[vertex * 4 + newColor];
+                if (duplicate < 0)
+                {
+                    duplicate = numVertices + (int)duplicateSources.size();
+                    if (duplicate >= maxVertices)
+                    {
+                        colors.clear();
+                        duplicateSources.clear();
+                        return false;
+                    }
+
+                    duplicateSources.push_back(uint16_t(vertex));
+                    colors.push_back(uint8_t(newColor));
+                }
+
+                triangle[k] = uint16_t(duplicate);
+                takenColors |= 1 << newColor;
+            }
+            else
+            {
+                takenColors |= 1 << color;
+            }
+        }
+    }
+
+    std::copy(remappedIndices.begin(), remappedIndices.end(), indices);
+    return true;
+}
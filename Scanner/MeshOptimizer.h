@@ -0,0 +1,82 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Triangle and vertex reordering of one mesh chunk before upload. All the functions work on
+// 16-bit triangle lists, like the STMesh faces, and are independent so they can be run on
+// several chunks in parallel.
+
+// Post-transform vertex cache statistics for a FIFO cache.
+struct VertexCacheStatistics
+{
+    // Average cache miss ratio: transformed vertices per triangle, 0.5 is ideal on large meshes.
+    float acmr = 0.f;
+
+    // Average transformed to vertex ratio: transformed vertices per referenced vertex, 1 is ideal.
+    float atvr = 0.f;
+};
+
+// Cache size used by the reordering and statistics, a conservative estimate for mobile GPUs.
+const int kMeshOptimizerCacheSize = 16;
+
+VertexCacheStatistics analyzeVertexCache (const uint16_t* indices,
+                                          int numIndices,
+                                          int numVertices,
+                                          int cacheSize = kMeshOptimizerCacheSize);
+
+// Tipsify reordering (Sander et al. 2007). Writes the reordered triangles into dst, which must not
+// alias indices, and the index of the first triangle of every cluster into clusters. Clusters start
+// where the cache is flushed, or where the cache efficiency of the running cluster would not degrade
+// much, so that they can be reordered freely by optimizeOverdraw.
+void optimizeVertexCache (const uint16_t* indices,
+                          int numIndices,
+                          int numVertices,
+                          uint16_t* dst,
+                          std::vector<int>& clusters,
+                          int cacheSize = kMeshOptimizerCacheSize);
+
+// Sorts the clusters so that the outward-facing ones are drawn first, which lets early depth
+// testing reject more fragments from any viewpoint. positions are tightly packed xyz floats.
+// dst must not alias indices.
+void optimizeOverdraw (const uint16_t* indices,
+                       int numIndices,
+                       const float* positions,
+                       int numVertices,
+                       const std::vector<int>& clusters,
+                       uint16_t* dst);
+
+// Renumbers the vertices in order of first use, so that vertex fetches are sequential. Applies the
+// remapping to indices in place and writes remap[oldIndex] = newIndex. Unreferenced vertices are moved
+// to the end, so that other index buffers sharing the vertices can be remapped with remapIndices.
+void optimizeVertexFetch (uint16_t* indices,
+                          int numIndices,
+                          int numVertices,
+                          std::vector<uint16_t>& remap);
+
+void remapIndices (uint16_t* indices, int numIndices, const std::vector<uint16_t>& remap);
+
+// dst[remap[i]] = src[i] for vertices of vertexSize bytes. dst must not alias src.
+void remapVertices (const uint8_t* src, int numVertices, int vertexSize, const std::vector<uint16_t>& remap, uint8_t* dst);
+
+// dst[i] = src[order[i]] for numVertices vertices of vertexSize bytes, e.g. to lay out other attributes
+// like vertices already remapped and duplicated. dst must not alias src.
+void gatherVertices (const uint8_t* src, int vertexSize, const uint16_t* order, int numVertices, uint8_t* dst);
+
+// Colors the vertices with 4 colors so that the corners of each triangle have distinct colors, which
+// lets a shader find the triangle edges without a line index buffer: interpolating one-hot colors, the
+// color missing from the triangle stays at 0 and the three others are barycentric coordinates. Where the
+// coloring conflicts, the vertex is duplicated: the triangles are updated to reference the duplicates,
+// appended after the existing vertices, and duplicateSources[i] is the original of vertex numVertices + i.
+// Returns false, leaving indices unchanged, if the duplicates would not fit in 16-bit indices.
+bool assignCornerColors (uint16_t* indices,
+                         int numIndices,
+                         int numVertices,
+                         std::vector<uint8_t>& colors,
+                         std::vector<uint16_t>& duplicateSources);
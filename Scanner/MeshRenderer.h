@@ -9,6 +9,8 @@
 #import <GLKit/GLKit.h>
 #import <CoreVideo/CVImageBuffer.h>
 
+#include "TextureMipChain.h"
+
 @class STMesh;
 
 class MeshRenderer
@@ -21,13 +23,22 @@ public:
         RenderingModeTextured,
         RenderingModeLightedGray,
         
+        // Lighted gray discs at the vertices, sized after the vertex spacing of each chunk. Only needs the
+        // vertex positions and normals, e.g. to preview huge meshes while their triangles are uploaded.
+        RenderingModePoints,
+        
         RenderingModeNumModes
     };
     
+    // Full resolution level included.
+    enum { MaxLevelsOfDetail = 4 };
+    
     MeshRenderer();
     ~MeshRenderer();
     
-    void initializeGL (GLenum defaultTextureUnit = GL_TEXTURE3);
+    // Compiles the shader variants of all the rendering modes unless prewarmShaders is false, in which
+    // case each one is compiled by the first render needing it.
+    void initializeGL (GLenum defaultTextureUnit = GL_TEXTURE3, bool prewarmShaders = true);
     void releaseGLBuffers (); // release the data uploaded to the GPU.
     void releaseGLTextures (); // release the data uploaded to the GPU.
     
@@ -36,29 +47,199 @@ public:
     
     void clear();
     
+    // Store vertex positions as 16-bit integers relative to each chunk bounding cube, or to the mesh
+    // one when draw calls are merged. Takes effect on the next uploadMesh.
+    void setPositionQuantizationEnabled (bool enabled);
+    
+    // Reorder triangles and vertices of each chunk for the post-transform vertex cache, overdraw
+    // and vertex fetches. Enabled by default, takes effect on the next uploadMesh.
+    void setMeshOptimizationEnabled (bool enabled);
+    
+    // Skip the chunks hidden behind others, tested against a low resolution depth buffer where coarse
+    // proxies of the chunks in front are rasterized on the CPU. Enabled by default.
+    void setOcclusionCullingEnabled (bool enabled);
+    
+    // Merge the draws of the visible chunks that follow each other front to back and lie next to each other
+    // in the shared buffers, keeping the front to back order. Quantized positions then share one transform
+    // for the whole mesh, from the next uploadMesh. Enabled by default.
+    void setDrawCallMergingEnabled (bool enabled);
+    
+    // Draw each chunk with the coarsest level of detail whose simplification error projects to at most
+    // maxPixelError pixels. The levels are built in the background after each upload, and are not used
+    // until the viewport height is known. The X-ray wireframe is always drawn at full resolution.
+    void setLevelOfDetailViewport (float viewportHeightInPixels, float maxPixelError = 1.f);
+    
+    // Build the mip levels of the mesh texture on worker threads and sample it trilinearly once they are
+    // uploaded, rather than aliasing when zoomed out. OpenGL ES 2 only mipmaps power of two textures.
+    // Enabled with the Kaiser filter by default, takes effect on the next texture upload.
+    void setTextureMipmapping (bool enabled, MipFilter filter = MipFilterKaiser);
+    
+    // Encode the mesh texture to ETC2 on worker threads and draw with it once ready, 4 bits per pixel
+    // instead of 12 for the luma and chroma planes. Needs an OpenGL ES 3 context, the planes are kept
+    // otherwise. Enabled by default, takes effect on the next texture upload.
+    void setTextureCompressionEnabled (bool enabled);
+    
+    // Upper bound of the position error introduced by quantization for the uploaded mesh, in meters.
+    float maxPositionQuantizationError () const;
+    
+    // Returns right away: the chunks are prepared on worker threads, then pushed to the GPU by render
+    // under a per-frame budget. The chunks already uploaded are drawn in the meantime. The mesh is
+    // retained until its upload is done. Only what changed since the previous mesh is uploaded again,
+    // e.g. the colors, texture coordinates and texture of a colorized mesh but not its geometry.
     void uploadMesh (STMesh* mesh);
     
+    bool isUploadInProgress () const;
+    
+    // The levels of detail or the processed texture are still built in the background, or ready but
+    // not picked up yet. Only render picks them up.
+    bool hasPendingBackgroundWork () const;
+    
+    // Blocks until the whole mesh is uploaded, e.g. before rendering a screenshot.
+    void finishUpload ();
+    
+    // At least one chunk is uploaded per frame, whatever the budget. Defaults to 2 MB and 4 ms.
+    void setUploadBudgetPerFrame (size_t maxBytes, double maxSeconds);
+    
+    // Progress of the upload in progress, or the metrics of the last finished one.
+    struct UploadStatistics
+    {
+        int numChunks = 0;
+        int numUploadedChunks = 0;
+        
+        // Fraction of the triangles uploaded.
+        float progress = 0.f;
+        
+        // Renders during the upload, the longest interval between two of them, and the longest time
+        // one of them spent uploading.
+        int numFrames = 0;
+        double worstFrameSeconds = 0.0;
+        double worstUploadSliceSeconds = 0.0;
+        
+        // From uploadMesh to the last chunk, set when the upload is finished.
+        double totalSeconds = 0.0;
+        
+        // Vertices, indices and texture sent to the GPU, and the chunks that kept their uploaded
+        // positions, normals and triangles.
+        size_t numUploadedBytes = 0;
+        int numReusedGeometryChunks = 0;
+    };
+    
+    UploadStatistics lastUploadStatistics () const;
+    
     void render(const GLKMatrix4& projectionMatrix, const GLKMatrix4& modelViewMatrix);
+    
+    // GL calls issued by the last render, and the redundant ones skipped by the state cache.
+    struct FrameStatistics
+    {
+        int numGLCalls = 0;
+        int numSkippedGLCalls = 0;
+        int numDrawCalls = 0;
+        
+        // Draws of the visible chunks before merging, one per chunk.
+        int numChunkDraws = 0;
+        
+        // Non-empty chunks drawn, rejected by frustum culling and by occlusion culling.
+        int numDrawnChunks = 0;
+        int numCulledChunks = 0;
+        int numOccludedChunks = 0;
+        
+        // Triangles drawn, after the choice of the levels of detail, or points in RenderingModePoints.
+        int numDrawnTriangles = 0;
+        int numDrawnPoints = 0;
+        
+        // Stall compiling a shader variant on its first use, 0 once they are prewarmed.
+        double shaderCompileSeconds = 0.0;
+        
+        // Spent in render on the CPU, the GPU work is not waited for.
+        double renderSeconds = 0.0;
+    };
+    
+    FrameStatistics lastFrameStatistics () const;
+    
+    // GPU memory of the mesh, suballocated from a few large buffer objects.
+    struct BufferStatistics
+    {
+        int numBufferObjects = 0;
+        int numPages = 0;
+        size_t numAllocatedBytes = 0;
+        size_t numUsedBytes = 0;
+        int numCompactions = 0;
+        int indexBits = 16;
+        
+        // Vertex streams, indices and texture each rendering mode draws from, all levels of detail included.
+        size_t numModeBytes[RenderingModeNumModes] = {};
+    };
+    
+    BufferStatistics bufferStatistics () const;
+    
+    // The texture drawn by RenderingModeTextured, and the background work on it, set once that is done.
+    struct TextureStatistics
+    {
+        int width = 0;
+        int height = 0;
+        int numMipLevels = 1;
+        double mipmapSeconds = 0.0;
+        
+        bool compressed = false;
+        double compressionSeconds = 0.0;
+        double compressionPsnr = 0.0;
+        
+        // GPU memory of all the levels.
+        size_t numBytes = 0;
+    };
+    
+    TextureStatistics textureStatistics () const;
+    
+    // Timings of runBenchmark, a regression signal for renderer changes on a device or the simulator.
+    struct BenchmarkStatistics
+    {
+        // Full upload of the mesh, without reusing the previous one, and the background work after it.
+        double uploadSeconds = 0.0;
+        double backgroundSeconds = 0.0;
+        size_t numUploadedBytes = 0;
+        BufferStatistics buffers;
+        TextureStatistics texture;
+        
+        struct ModeStatistics
+        {
+            // False for the modes the mesh has no data for.
+            bool rendered = false;
+            int numFrames = 0;
+            
+            // Render and glFinish, for the CPU and GPU work of a frame.
+            double averageFrameSeconds = 0.0;
+            double worstFrameSeconds = 0.0;
+            double averageRenderSeconds = 0.0;
+            
+            FrameStatistics lastFrame;
+        };
+        
+        ModeStatistics modes[RenderingModeNumModes];
+    };
+    
+    // Uploads the mesh from scratch, waits for its levels of detail and texture, then renders it numFrames
+    // times in each rendering mode into the current framebuffer. The rendering mode is restored. Blocks
+    // until done, and logs the results.
+    BenchmarkStatistics runBenchmark (STMesh* mesh, const GLKMatrix4& projectionMatrix, const GLKMatrix4& modelViewMatrix,
+                                      int numFrames = 60);
 
 private:
-    void renderPartialMesh(int meshIndex);
-
-    void enableVertexBuffer (int meshIndex);
-    void disableVertexBuffer (int meshIndex);
-    
-    void enableNormalBuffer (int meshIndex);
-    void disableNormalBuffer (int meshIndex);
+    // The state setup of each buffer page is recorded for a mode, and replayed by render until the next upload.
+    void invalidateCommandLists ();
     
-    void enableVertexColorBuffer (int meshIndex);
-    void disableVertexColorBuffer (int meshIndex);
+    // Uploads the prepared chunks in order, within the per-frame budget or all of them.
+    void uploadPendingChunks (bool withinBudget);
+    void finishMeshUpload ();
     
-    void enableVertexTexcoordsBuffer (int meshIndex);
-    void disableVertexTexcoordBuffer (int meshIndex);
+    // Uploads the levels of detail once their background build is done.
+    void uploadLevelsOfDetail ();
     
-    void enableLinesElementBuffer (int meshIndex);
-    void enableTrianglesElementBuffer (int meshIndex);
+    // Returns the number of bytes of the texture planes.
+    size_t uploadTexture (CVImageBufferRef pixelBuffer);
     
-    void uploadTexture (CVImageBufferRef pixelBuffer);
+    // Starts building the mip levels and the ETC2 encoding of the texture, and uploads them once done.
+    void processTexture (CVImageBufferRef pixelBuffer, bool mipmap, bool compress);
+    void uploadProcessedTexture ();
     
 private:
     class PrivateData;
@@ -5,40 +5,259 @@
 */
 
 #import <GLKit/GLKit.h>
+#import <QuartzCore/QuartzCore.h>
 #import <OpenGLES/ES2/glext.h> // GL_RED_EXT
 
+// From OpenGL ES 3, the ES2 headers do not have them.
+#ifndef GL_COMPRESSED_RGB8_ETC2
+#define GL_COMPRESSED_RGB8_ETC2 0x9274
+#endif
+
+#ifndef GL_R8
+#define GL_R8 0x8229
+#define GL_RG8 0x822B
+#endif
+
 #import "MeshRenderer.h"
+#import "MeshChunkTable.h"
 #import "CustomShaders.h"
+#import "RenderCommandList.h"
+#import "EtcTextureEncoder.h"
+#import "GLExtensions.h"
+#import "SoftwareMeshRenderer.h"
 
 #import <Structure/StructureSLAM.h>
 
-#define MAX_MESHES 30
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <vector>
 
 // Local functions
 
+// Levels of detail of all the chunks of an upload, built on a worker thread and picked up by render.
+struct LevelOfDetailBuild
+{
+    std::vector<MeshChunkSimplification> chunks;
+    bool optimize = true;
+    double seconds = 0.0;
+    std::atomic<bool> finished { false };
+};
+
+// Mip levels and ETC2 encoding of the mesh texture, done on worker threads and picked up by render.
+struct TextureProcessing
+{
+    // Retained and locked read-only while it is processed.
+    CVPixelBufferRef pixelBuffer = NULL;
+    int width = 0;
+    int height = 0;
+    
+    bool mipmap = false;
+    MipFilter mipFilter = MipFilterKaiser;
+    bool compress = false;
+    
+    // Levels from 1 of the luma and chroma planes, and copies of the planes when they are uploaded
+    // uncompressed.
+    std::vector<MipLevel> lumaLevels;
+    std::vector<MipLevel> chromaLevels;
+    MipLevel lumaBase;
+    MipLevel chromaBase;
+    double mipmapSeconds = 0.0;
+    
+    // ETC2 blocks of each level from 0.
+    std::vector<std::vector<uint8_t>> compressedLevels;
+    double compressionSeconds = 0.0;
+    double psnr = 0.0;
+    
+    std::atomic<bool> cancelled { false };
+    std::atomic<bool> finished { false };
+};
+
+// A mesh upload in progress: the chunks are prepared on worker threads, and render uploads the
+// prepared ones in order, a few per frame.
+struct MeshUpload
+{
+    MeshUpload () : preparation (dispatch_group_create()) {}
+    
+    // Keeps the arrays read by the workers alive.
+    STMesh* mesh = nil;
+    
+    std::vector<MeshChunkUploadData> chunks;
+    std::unique_ptr<std::atomic<bool>[]> prepared;
+    std::atomic<bool> cancelled { false };
+    dispatch_group_t preparation;
+    double prepareSeconds = 0.0;
+    
+    PackedVertexFormat geometryFormat;
+    PackedVertexFormat surfaceFormat;
+    bool optimize = true;
+    
+    // Quantize all the chunks relative to the whole mesh, so that their draws can be merged.
+    bool sharedQuantization = false;
+    
+    int numUploadedChunks = 0;
+    int numTotalTriangles = 0;
+    int numUploadedTriangles = 0;
+    double startTime = 0.0;
+    double lastRenderTime = 0.0;
+};
+
+namespace
+{
+    // Shader variant of each rendering mode, MeshShaderQuantizedPositions is added for quantized positions.
+    constexpr MeshShaderKey kRenderingModeShaderKeys[MeshRenderer::RenderingModeNumModes] =
+    {
+        MeshShaderXRayLighting | MeshShaderWireframe,  // RenderingModeXRay
+        MeshShaderVertexColors,                        // RenderingModePerVertexColor
+        MeshShaderYCbCrTexture,                        // RenderingModeTextured
+        MeshShaderHeadlight,                           // RenderingModeLightedGray
+        MeshShaderHeadlight | MeshShaderPointSplats,   // RenderingModePoints
+    };
+    
+    static_assert(isValidMeshShaderKey(kRenderingModeShaderKeys[0] | MeshShaderQuantizedPositions)
+                  && isValidMeshShaderKey(kRenderingModeShaderKeys[1] | MeshShaderQuantizedPositions)
+                  && isValidMeshShaderKey(kRenderingModeShaderKeys[2] | MeshShaderQuantizedPositions)
+                  && isValidMeshShaderKey(kRenderingModeShaderKeys[3] | MeshShaderQuantizedPositions)
+                  && isValidMeshShaderKey(kRenderingModeShaderKeys[4] | MeshShaderQuantizedPositions),
+                  "Invalid shader variant");
+    
+    static_assert(int(MeshRenderer::MaxLevelsOfDetail) == kMaxChunkLevelsOfDetail, "MeshChunkTable uploads the levels of detail");
+    
+    static_assert(int(SoftwareMeshRenderer::RenderingModeXRay) == int(MeshRenderer::RenderingModeXRay)
+                  && int(SoftwareMeshRenderer::RenderingModePerVertexColor) == int(MeshRenderer::RenderingModePerVertexColor)
+                  && int(SoftwareMeshRenderer::RenderingModeTextured) == int(MeshRenderer::RenderingModeTextured)
+                  && int(SoftwareMeshRenderer::RenderingModeLightedGray) == int(MeshRenderer::RenderingModeLightedGray),
+                  "SoftwareMeshRenderer renders the MeshRenderer modes");
+    
+    int shaderVariantIndex (MeshRenderer::RenderingMode mode, bool quantizedPositions)
+    {
+        return 2 * mode + (quantizedPositions ? 1 : 0);
+    }
+    
+    // RenderingModeTextured once the ETC2 texture replaces the planes, these variants follow those of the modes.
+    constexpr MeshShaderKey kCompressedTextureShaderKey = MeshShaderRgbTexture;
+    
+    static_assert(isValidMeshShaderKey(kCompressedTextureShaderKey | MeshShaderQuantizedPositions), "Invalid shader variant");
+    
+    int compressedTextureShaderIndex (bool quantizedPositions)
+    {
+        return 2 * MeshRenderer::RenderingModeNumModes + (quantizedPositions ? 1 : 0);
+    }
+    
+    // Block rows encoded by each job of the texture compression.
+    const int kBlockRowsPerCompressionJob = 8;
+    
+    bool isPowerOfTwo (int x)
+    {
+        return x > 0 && (x & (x - 1)) == 0;
+    }
+    
+    void copyPlane (const uint8_t* pixels, int width, int height, size_t bytesPerRow, int channels, MipLevel& result)
+    {
+        result.width = width;
+        result.height = height;
+        result.channels = channels;
+        result.pixels.resize (size_t(width) * height * channels);
+        for (int y = 0; y < height; ++y)
+            memcpy(&result.pixels[size_t(y) * width * channels], pixels + y * bytesPerRow, size_t(width) * channels);
+    }
+    
+    // Trilinear with mip levels, on the texture bound to GL_TEXTURE_2D.
+    void setTextureSampling (bool mipmapped)
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    
+    // A GL_RED_EXT or GL_RG_EXT texture with all its levels, adds their size to numBytes. OpenGL ES 3 needs
+    // a sized internal format for them.
+    GLuint createMipmappedTexture (GLenum internalFormat, GLenum format, const MipLevel& base, const std::vector<MipLevel>& levels, size_t& numBytes)
+    {
+        GLuint texture = 0;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        
+        for (size_t level = 0; level <= levels.size(); ++level)
+        {
+            const MipLevel& image = (level == 0) ? base : levels[level - 1];
+            glTexImage2D(GL_TEXTURE_2D, (GLint)level, internalFormat, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels.data());
+            numBytes += image.pixels.size();
+        }
+        
+        setTextureSampling(true);
+        return texture;
+    }
+} // Anonymous
+
 struct MeshRenderer::PrivateData
 {
-    LightedGrayShader lightedGrayShader;
-    PerVertexColorShader perVertexColorShader;
-    XrayShader xRayShader;
-    YCbCrTextureShader yCbCrTextureShader;
+    // Variants of each rendering mode for float and quantized positions, see shaderVariantIndex, then
+    // those of the compressed texture.
+    std::vector<MeshShader> shaders;
+    
+    // Spent compiling shaders on first use by the last render, and in the whole render.
+    double shaderCompileSeconds = 0.0;
+    double renderSeconds = 0.0;
+    
+    // Uploaded chunks in a buffer arena, with their levels of detail.
+    MeshChunkTable chunkTable;
+    
+    // Chunks to draw, front to back, refreshed every frame.
+    std::vector<int> visibleChunks;
+    int numCulledChunks = 0;
+    int numOccludedChunks = 0;
     
-    int numUploadedMeshes = 0;
-    int numTriangleIndices[MAX_MESHES];
-    int numLinesIndices[MAX_MESHES];
+    bool occlusionCullingEnabled = true;
+    OcclusionCuller occlusionCuller;
+    
+    // Draws of the visible chunks, merged when they are next to each other in the buffer arena.
+    bool drawCallMergingEnabled = true;
+    std::vector<ArenaDraw> draws;
+    int numChunkDraws = 0;
+    
+    // Upload in progress, and the budget render gives it every frame.
+    std::shared_ptr<MeshUpload> upload;
+    size_t uploadBudgetBytes = 2 << 20;
+    double uploadBudgetSeconds = 0.004;
+    UploadStatistics uploadStatistics;
+    
+    // Build of the levels of detail of the last upload, until render uploads it.
+    std::shared_ptr<LevelOfDetailBuild> levelOfDetailBuild;
+    
+    // Triangles drawn at the levels of detail of the visible chunks, or their vertices as points.
+    int numDrawnTriangles = 0;
+    int numDrawnPoints = 0;
+    
+    // The ES2 texture formats are invalid on an OpenGL ES 3 context.
+    bool isOpenGLES3 = false;
 
     bool hasPerVertexColor = false;
     bool hasPerVertexNormals = false;
     bool hasPerVertexUV = false;
     bool hasTexture = false;
     
-    // Vertex buffer objects.
-    GLuint vertexVbo[MAX_MESHES];
-    GLuint normalsVbo[MAX_MESHES];
-    GLuint colorsVbo[MAX_MESHES];
-    GLuint texcoordsVbo[MAX_MESHES];
-    GLuint facesVbo[MAX_MESHES];
-    GLuint linesVbo[MAX_MESHES];
+    // Pixel buffer of the textures, retained so that the same texture is not uploaded twice.
+    CVImageBufferRef uploadedTextureBuffer = NULL;
+    
+    // Processing of the texture in progress. Once done, the planes are replaced by mipmapped copies,
+    // or by a single ETC2 texture when compressing.
+    bool textureMipmappingEnabled = true;
+    MipFilter textureMipFilter = MipFilterKaiser;
+    bool textureCompressionEnabled = true;
+    std::shared_ptr<TextureProcessing> textureProcessing;
+    GLuint compressedTexture = 0;
+    GLuint mipmappedLumaTexture = 0;
+    GLuint mipmappedChromaTexture = 0;
+    TextureStatistics textureStatistics;
+    
+    // Store positions as 16-bit integers relative to each chunk bounding cube on the next upload.
+    bool positionQuantizationEnabled = false;
+    
+    // Reorder triangles and vertices for the GPU caches on the next upload.
+    bool meshOptimizationEnabled = true;
 
     // OpenGL Texture reference for y and chroma images.
     CVOpenGLESTextureRef lumaTexture = NULL;
@@ -52,26 +271,63 @@ struct MeshRenderer::PrivateData
     
     // Current render mode.
     RenderingMode currentRenderingMode = RenderingModeLightedGray;
+    
+    // Recorded lazily for each mode, cleared when the buffers change.
+    RenderCommandList commandLists[RenderingModeNumModes];
+    
+    GLStateCache stateCache;
 };
 
 MeshRenderer::MeshRenderer()
 : d (new PrivateData)
 {
+    for (int mode = 0; mode < RenderingModeNumModes; ++mode)
+    {
+        d->shaders.push_back(MeshShader(kRenderingModeShaderKeys[mode]));
+        d->shaders.push_back(MeshShader(kRenderingModeShaderKeys[mode] | MeshShaderQuantizedPositions));
+    }
+    
+    d->shaders.push_back(MeshShader(kCompressedTextureShaderKey));
+    d->shaders.push_back(MeshShader(kCompressedTextureShaderKey | MeshShaderQuantizedPositions));
 }
 
-void MeshRenderer::initializeGL (GLenum defaultTextureUnit)
+void MeshRenderer::initializeGL (GLenum defaultTextureUnit, bool prewarmShaders)
 {
     d->textureUnit = defaultTextureUnit;
-    glGenBuffers (MAX_MESHES, d->vertexVbo);
-    glGenBuffers (MAX_MESHES, d->normalsVbo);
-    glGenBuffers (MAX_MESHES, d->colorsVbo);
-    glGenBuffers (MAX_MESHES, d->texcoordsVbo);
-    glGenBuffers (MAX_MESHES, d->facesVbo);
-    glGenBuffers (MAX_MESHES, d->linesVbo);    
+    d->isOpenGLES3 = isOpenGLES3Context();
+    
+    d->chunkTable.initializeGL();
+    
+    // Compiling a variant on its first use stalls that frame, compile them all now instead.
+    if (prewarmShaders)
+    {
+        const double startTime = CACurrentMediaTime();
+        for (MeshShader& shader : d->shaders)
+            if (!shader.isLoaded())
+                shader.load();
+        
+        NSLog(@"MeshRenderer: prewarmed %d shader variants in %.1f ms.",
+              (int)d->shaders.size(), (CACurrentMediaTime() - startTime) * 1e3);
+    }
 }
 
 void MeshRenderer::releaseGLTextures ()
 {
+    if (d->textureProcessing)
+    {
+        d->textureProcessing->cancelled = true;
+        d->textureProcessing.reset();
+    }
+    
+    for (GLuint* texture : { &d->compressedTexture, &d->mipmappedLumaTexture, &d->mipmappedChromaTexture })
+    {
+        if (*texture)
+        {
+            glDeleteTextures(1, texture);
+            *texture = 0;
+        }
+    }
+    
     if (d->lumaTexture)
     {
         CFRelease (d->lumaTexture);
@@ -89,51 +345,32 @@ void MeshRenderer::releaseGLTextures ()
         CFRelease(d->textureCache);
         d->textureCache = NULL;
     }
+    
+    if (d->uploadedTextureBuffer)
+    {
+        CFRelease(d->uploadedTextureBuffer);
+        d->uploadedTextureBuffer = NULL;
+    }
 }
 
 void MeshRenderer::releaseGLBuffers ()
 {
-    for (int meshIndex = 0; meshIndex < d->numUploadedMeshes; ++meshIndex)
+    d->chunkTable.deleteBuffers();
+    
+    if (d->upload)
     {
-        glBindBuffer(GL_ARRAY_BUFFER, d->vertexVbo[meshIndex]);
-        glBufferData(GL_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW);
-        
-        glBindBuffer(GL_ARRAY_BUFFER, d->normalsVbo[meshIndex]);
-        glBufferData(GL_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW);
-        
-        glBindBuffer(GL_ARRAY_BUFFER, d->colorsVbo[meshIndex]);
-        glBufferData(GL_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW);
-        
-        glBindBuffer(GL_ARRAY_BUFFER, d->texcoordsVbo[meshIndex]);
-        glBufferData(GL_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW);
-        
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, d->facesVbo[meshIndex]);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW);
-        
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, d->linesVbo[meshIndex]);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW);
+        d->upload->cancelled = true;
+        d->upload.reset();
     }
+    
+    d->levelOfDetailBuild.reset();
+    
+    invalidateCommandLists();
 }
 
 MeshRenderer::~MeshRenderer()
 {
-    if(d->vertexVbo[0])
-        glDeleteBuffers(MAX_MESHES, d->vertexVbo);
-    
-    if(d->normalsVbo[0])
-        glDeleteBuffers(MAX_MESHES, d->normalsVbo);
-    
-    if(d->colorsVbo[0])
-        glDeleteBuffers(MAX_MESHES, d->colorsVbo);
-    
-    if(d->texcoordsVbo[0])
-        glDeleteBuffers(MAX_MESHES, d->texcoordsVbo);
-    
-    if(d->facesVbo[0])
-        glDeleteBuffers(MAX_MESHES, d->facesVbo);
-    
-    if(d->linesVbo[0])
-        glDeleteBuffers(MAX_MESHES, d->linesVbo);
+    d->chunkTable.deleteBuffers();
     
     releaseGLTextures ();
 
@@ -162,61 +399,366 @@ MeshRenderer::RenderingMode MeshRenderer::getRenderingMode() const
     return d->currentRenderingMode;
 }
 
+void MeshRenderer::setPositionQuantizationEnabled (bool enabled)
+{
+    d->positionQuantizationEnabled = enabled;
+}
+
+void MeshRenderer::setMeshOptimizationEnabled (bool enabled)
+{
+    d->meshOptimizationEnabled = enabled;
+}
+
+void MeshRenderer::setOcclusionCullingEnabled (bool enabled)
+{
+    d->occlusionCullingEnabled = enabled;
+}
+
+void MeshRenderer::setDrawCallMergingEnabled (bool enabled)
+{
+    d->drawCallMergingEnabled = enabled;
+}
+
+void MeshRenderer::setLevelOfDetailViewport (float viewportHeightInPixels, float maxPixelError)
+{
+    d->chunkTable.setLevelOfDetailViewport(viewportHeightInPixels, maxPixelError);
+}
+
+void MeshRenderer::setTextureMipmapping (bool enabled, MipFilter filter)
+{
+    d->textureMipmappingEnabled = enabled;
+    d->textureMipFilter = filter;
+}
+
+void MeshRenderer::setTextureCompressionEnabled (bool enabled)
+{
+    d->textureCompressionEnabled = enabled;
+}
+
+MeshRenderer::TextureStatistics MeshRenderer::textureStatistics () const
+{
+    return d->textureStatistics;
+}
+
+float MeshRenderer::maxPositionQuantizationError () const
+{
+    float maxError = 0.f;
+    for (int meshIndex = 0; meshIndex < d->chunkTable.numChunks(); ++meshIndex)
+        maxError = std::max(maxError, d->chunkTable.chunk(meshIndex).quantizationErrorBound);
+    return maxError;
+}
+
 void MeshRenderer::uploadMesh (STMesh* mesh)
 {
-    int numUploads = fmin((int)[mesh numberOfMeshes], MAX_MESHES);
-    d->numUploadedMeshes = fmin((int)[mesh numberOfMeshes], MAX_MESHES);
+    const int numUploads = (int)[mesh numberOfMeshes];
+    
+    // Drop the upload in progress, its workers stop at the next chunk.
+    if (d->upload)
+    {
+        d->upload->cancelled = true;
+        d->upload.reset();
+    }
+    
+    d->uploadStatistics = UploadStatistics();
+    d->uploadStatistics.numChunks = numUploads;
     
     d->hasPerVertexColor = [mesh hasPerVertexColors];
     d->hasPerVertexNormals = [mesh hasPerVertexNormals];
     d->hasPerVertexUV = [mesh hasPerVertexUVTextureCoords];
     d->hasTexture = ([mesh meshYCbCrTexture] != NULL);
 
-    if (d->hasTexture)
-        uploadTexture ([mesh meshYCbCrTexture]);
+    // A colorized mesh usually comes with the texture of the previous one.
+    if (d->hasTexture && [mesh meshYCbCrTexture] != d->uploadedTextureBuffer)
+        d->uploadStatistics.numUploadedBytes += uploadTexture ([mesh meshYCbCrTexture]);
+    
+    const PackedVertexFormat geometryFormat = makePackedVertexFormat(d->positionQuantizationEnabled ? PackedVertexFormat::PositionUnorm16 : PackedVertexFormat::PositionFloat32,
+                                                                     d->hasPerVertexNormals,
+                                                                     false,
+                                                                     false);
+    
+    const PackedVertexFormat surfaceFormat = makePackedVertexFormat(PackedVertexFormat::PositionNone,
+                                                                    false,
+                                                                    d->hasPerVertexColor,
+                                                                    d->hasPerVertexUV);
+    
+    // The chunks are drawn with their previous data until it gets replaced, unless the layout of
+    // their geometry changes.
+    MeshChunkTable& chunkTable = d->chunkTable;
+    chunkTable.setVertexFormats(geometryFormat, surfaceFormat);
+    chunkTable.resize(numUploads);
+    d->levelOfDetailBuild.reset();
+    
+    invalidateCommandLists();
     
+    std::shared_ptr<MeshUpload> upload = std::make_shared<MeshUpload>();
+    upload->mesh = mesh;
+    upload->geometryFormat = geometryFormat;
+    upload->surfaceFormat = surfaceFormat;
+    upload->optimize = d->meshOptimizationEnabled;
+    upload->sharedQuantization = d->drawCallMergingEnabled;
+    upload->startTime = CACurrentMediaTime();
+    upload->chunks.resize (numUploads);
+    upload->prepared.reset (new std::atomic<bool>[numUploads]);
+    
+    // Gather the chunk arrays on this thread, STMesh is not accessed by the workers.
+    int numTotalVertices = 0;
     for (int meshIndex = 0; meshIndex < numUploads; ++meshIndex)
     {
-        const int numVertices = [mesh numberOfMeshVertices:meshIndex];
+        MeshChunkUploadData& data = upload->chunks[meshIndex];
+        data.numVertices = [mesh numberOfMeshVertices:meshIndex];
+        data.numFaces = [mesh numberOfMeshFaces:meshIndex];
+        data.numLines = [mesh numberOfMeshLines:meshIndex];
+        data.positions = reinterpret_cast<const float*>([mesh meshVertices:meshIndex]);
+        data.normals = d->hasPerVertexNormals ? reinterpret_cast<const float*>([mesh meshPerVertexNormals:meshIndex]) : NULL;
+        data.colors = d->hasPerVertexColor ? reinterpret_cast<const float*>([mesh meshPerVertexColors:meshIndex]) : NULL;
+        data.texcoords = d->hasPerVertexUV ? reinterpret_cast<const float*>([mesh meshPerVertexUVTextureCoords:meshIndex]) : NULL;
+        data.faces = [mesh meshFaces:meshIndex];
+        data.lines = [mesh meshLines:meshIndex];
         
-        glBindBuffer(GL_ARRAY_BUFFER, d->vertexVbo[meshIndex]);
-        glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof (GLKVector3), [mesh meshVertices:meshIndex], GL_STATIC_DRAW);
+        chunkTable.describeUploadedChunk(meshIndex, data);
         
-        if (d->hasPerVertexNormals)
-        {
-            glBindBuffer(GL_ARRAY_BUFFER, d->normalsVbo[meshIndex]);
-            glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof (GLKVector3), [mesh meshPerVertexNormals:meshIndex], GL_STATIC_DRAW);
-        }
+        upload->prepared[meshIndex] = false;
+        upload->numTotalTriangles += data.numFaces;
+        numTotalVertices += data.numVertices;
+    }
+    
+    chunkTable.setExpectedSize(numTotalVertices, upload->numTotalTriangles);
+    
+    d->upload = upload;
+    
+    // Chunks are independent, pack and optimize them on all the cores. render uploads them as they
+    // get ready, roughly in order.
+    dispatch_group_async(upload->preparation, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
+        const double prepareStartTime = CACurrentMediaTime();
+        const bool quantizedPositions = (upload->geometryFormat.positionType == PackedVertexFormat::PositionUnorm16);
+        
+        // The bounds first, a shared quantization needs those of the whole mesh.
+        dispatch_apply(upload->chunks.size(), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^(size_t meshIndex) {
+            measureChunk(upload->chunks[meshIndex], quantizedPositions);
+        });
+        
+        if (quantizedPositions && upload->sharedQuantization)
+            shareMeshQuantization(upload->chunks);
+        
+        dispatch_apply(upload->chunks.size(), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^(size_t meshIndex) {
+            if (upload->cancelled)
+                return;
+            
+            prepareChunk(upload->chunks[meshIndex], upload->geometryFormat, upload->surfaceFormat, upload->optimize);
+            upload->prepared[meshIndex] = true;
+        });
         
-        if (d->hasPerVertexColor)
+        upload->prepareSeconds = CACurrentMediaTime() - prepareStartTime;
+    });
+}
+
+void MeshRenderer::uploadPendingChunks (bool withinBudget)
+{
+    MeshUpload& upload = *d->upload;
+    UploadStatistics& statistics = d->uploadStatistics;
+    
+    const double startTime = CACurrentMediaTime();
+    if (upload.lastRenderTime > 0.0)
+        statistics.worstFrameSeconds = std::max(statistics.worstFrameSeconds, startTime - upload.lastRenderTime);
+    upload.lastRenderTime = startTime;
+    ++statistics.numFrames;
+    
+    // At least one chunk per frame, so that the upload always progresses.
+    size_t numBytes = 0;
+    const int numChunks = (int)upload.chunks.size();
+    while (upload.numUploadedChunks < numChunks && upload.prepared[upload.numUploadedChunks])
+    {
+        if (withinBudget && numBytes > 0
+            && (numBytes >= d->uploadBudgetBytes || CACurrentMediaTime() - startTime >= d->uploadBudgetSeconds))
+            break;
+        
+        const int meshIndex = upload.numUploadedChunks++;
+        numBytes += d->chunkTable.uploadChunk(meshIndex, upload.chunks[meshIndex]);
+        upload.numUploadedTriangles += upload.chunks[meshIndex].numFaces;
+        if (upload.chunks[meshIndex].reuseGeometry)
+            ++statistics.numReusedGeometryChunks;
+    }
+    
+    statistics.numUploadedBytes += numBytes;
+    
+    if (numBytes > 0)
+        invalidateCommandLists();
+    
+    statistics.numUploadedChunks = upload.numUploadedChunks;
+    statistics.progress = (upload.numTotalTriangles > 0) ? float(upload.numUploadedTriangles) / upload.numTotalTriangles : 1.f;
+    statistics.worstUploadSliceSeconds = std::max(statistics.worstUploadSliceSeconds, CACurrentMediaTime() - startTime);
+    
+    const bool preparationFinished = (dispatch_group_wait(upload.preparation, DISPATCH_TIME_NOW) == 0);
+    if (upload.numUploadedChunks == numChunks && preparationFinished)
+        finishMeshUpload();
+}
+
+void MeshRenderer::finishUpload ()
+{
+    if (!d->upload)
+        return;
+    
+    dispatch_group_wait(d->upload->preparation, DISPATCH_TIME_FOREVER);
+    uploadPendingChunks(false);
+}
+
+void MeshRenderer::finishMeshUpload ()
+{
+    std::shared_ptr<MeshUpload> upload;
+    upload.swap (d->upload);
+    
+    const int numUploads = (int)upload->chunks.size();
+    d->uploadStatistics.totalSeconds = CACurrentMediaTime() - upload->startTime;
+    
+    int numTotalVertices = 0;
+    int numTotalTriangles = 0;
+    double missesBefore = 0.0, missesAfter = 0.0;
+    double referencedBefore = 0.0, referencedAfter = 0.0;
+    size_t lineIndexBytesAvoided = 0;
+    size_t wireframeBytes = 0;
+    
+    for (const MeshChunkUploadData& data : upload->chunks)
+    {
+        // Only the chunks prepared again count, the others kept their geometry.
+        if (data.reuseGeometry)
+            continue;
+        
+        // Wireframe memory compared to uploading the STMesh line indices.
+        lineIndexBytesAvoided += data.numLines * 2 * d->chunkTable.bufferArena().indexSize();
+        wireframeBytes += data.numWireframeBytes;
+        
+        // Weight the per-chunk ratios back into miss counts for the report.
+        numTotalVertices += data.numVertices;
+        numTotalTriangles += data.numFaces;
+        missesBefore += data.statisticsBefore.acmr * data.numFaces;
+        missesAfter += data.statisticsAfter.acmr * data.numFaces;
+        if (data.statisticsBefore.atvr > 0.f)
         {
-            glBindBuffer(GL_ARRAY_BUFFER, d->colorsVbo[meshIndex]);
-            glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof (GLKVector3), [mesh meshPerVertexColors:meshIndex], GL_STATIC_DRAW);
+            referencedBefore += data.statisticsBefore.acmr * data.numFaces / data.statisticsBefore.atvr;
+            referencedAfter += data.statisticsAfter.acmr * data.numFaces / data.statisticsAfter.atvr;
         }
+    }
+    
+    if (numTotalTriangles > 0 && upload->prepareSeconds > 0.0)
+    {
+        NSLog(@"MeshRenderer: prepared %d vertices (%d bytes each) and %d triangles in %.1f ms, %.1f ms per million triangles.",
+              numTotalVertices, d->chunkTable.geometryFormat().stride + d->chunkTable.surfaceFormat().stride, numTotalTriangles, upload->prepareSeconds * 1e3, upload->prepareSeconds * 1e3 / (numTotalTriangles * 1e-6));
         
-        if (d->hasPerVertexUV)
+        if (upload->optimize && referencedBefore > 0.0)
         {
-            glBindBuffer(GL_ARRAY_BUFFER, d->texcoordsVbo[meshIndex]);
-            glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof (GLKVector2), [mesh meshPerVertexUVTextureCoords:meshIndex], GL_STATIC_DRAW);
+            NSLog(@"MeshRenderer: vertex cache ACMR %.3f -> %.3f, ATVR %.3f -> %.3f.",
+                  missesBefore / numTotalTriangles, missesAfter / numTotalTriangles,
+                  missesBefore / referencedBefore, missesAfter / referencedAfter);
         }
         
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, d->facesVbo[meshIndex]);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, [mesh numberOfMeshFaces:meshIndex] * sizeof(unsigned short) * 3,
-                     [mesh meshFaces:meshIndex], GL_STATIC_DRAW);
+        NSLog(@"MeshRenderer: wireframe uses %.2f MB instead of %.2f MB of line indices, %.2f MB saved per million faces.",
+              wireframeBytes / 1e6, lineIndexBytesAvoided / 1e6,
+              ((double)lineIndexBytesAvoided - (double)wireframeBytes) / numTotalTriangles);
+    }
+    
+    if (numUploads > 0)
+    {
+        const UploadStatistics& statistics = d->uploadStatistics;
+        NSLog(@"MeshRenderer: uploaded %.2f MB for %d chunks, %d of them keeping their geometry, over %d frames in %.1f ms, "
+              "worst frame %.1f ms, worst upload slice %.1f ms.",
+              statistics.numUploadedBytes / 1e6, numUploads, statistics.numReusedGeometryChunks,
+              statistics.numFrames, statistics.totalSeconds * 1e3,
+              statistics.worstFrameSeconds * 1e3, statistics.worstUploadSliceSeconds * 1e3);
         
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, d->linesVbo[meshIndex]);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, [mesh numberOfMeshLines:meshIndex] * sizeof(unsigned short) * 2,
-                     [mesh meshLines:meshIndex], GL_STATIC_DRAW);
+        const MeshBufferArena& arena = d->chunkTable.bufferArena();
+        const MeshBufferArena::Statistics arenaStatistics = arena.statistics();
+        NSLog(@"MeshRenderer: %d chunks in %d buffer objects, %.2f MB used of %.2f MB, %d-bit indices.",
+              numUploads, arenaStatistics.numBufferObjects, arenaStatistics.numUsedBytes / 1e6,
+              arenaStatistics.numAllocatedBytes / 1e6, 8 * arena.indexSize());
         
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        const BufferStatistics buffers = bufferStatistics();
+        NSLog(@"MeshRenderer: the modes draw from %.2f MB (x-ray), %.2f MB (vertex colors), %.2f MB (textured), "
+              "%.2f MB (lighted gray) and %.2f MB (points).",
+              buffers.numModeBytes[RenderingModeXRay] / 1e6, buffers.numModeBytes[RenderingModePerVertexColor] / 1e6,
+              buffers.numModeBytes[RenderingModeTextured] / 1e6, buffers.numModeBytes[RenderingModeLightedGray] / 1e6,
+              buffers.numModeBytes[RenderingModePoints] / 1e6);
+    }
+    
+    // Simplify the chunks in the background, render uploads the levels when they are ready.
+    std::shared_ptr<LevelOfDetailBuild> build = std::make_shared<LevelOfDetailBuild>();
+    build->optimize = upload->optimize;
+    build->chunks.resize (numUploads);
+    for (int meshIndex = 0; meshIndex < numUploads; ++meshIndex)
+    {
+        MeshChunkSimplification& chunk = build->chunks[meshIndex];
+        chunk.rebuilt = !upload->chunks[meshIndex].reuseGeometry;
+        chunk.positions.swap (upload->chunks[meshIndex].simplificationPositions);
+        chunk.indices.swap (upload->chunks[meshIndex].simplificationIndices);
+        chunk.bounds = upload->chunks[meshIndex].bounds;
+    }
+    
+    d->levelOfDetailBuild = build;
+    
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        const double buildStartTime = CACurrentMediaTime();
+        
+        MeshChunkSimplification* chunks = build->chunks.data();
+        const bool optimizeLevels = build->optimize;
+        dispatch_apply(build->chunks.size(), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t meshIndex) {
+            buildChunkLevelsOfDetail(chunks[meshIndex], optimizeLevels);
+        });
         
-        d->numTriangleIndices[meshIndex] = [mesh numberOfMeshFaces:meshIndex] * 3;
-        d->numLinesIndices[meshIndex] = [mesh numberOfMeshLines:meshIndex] * 2;
+        build->seconds = CACurrentMediaTime() - buildStartTime;
+        build->finished = true;
+    });
+}
+
+bool MeshRenderer::isUploadInProgress () const
+{
+    return d->upload != nullptr;
+}
+
+bool MeshRenderer::hasPendingBackgroundWork () const
+{
+    return d->levelOfDetailBuild != nullptr || d->textureProcessing != nullptr;
+}
+
+void MeshRenderer::setUploadBudgetPerFrame (size_t maxBytes, double maxSeconds)
+{
+    d->uploadBudgetBytes = maxBytes;
+    d->uploadBudgetSeconds = maxSeconds;
+}
+
+MeshRenderer::UploadStatistics MeshRenderer::lastUploadStatistics () const
+{
+    return d->uploadStatistics;
+}
+
+void MeshRenderer::uploadLevelsOfDetail ()
+{
+    std::shared_ptr<LevelOfDetailBuild> build;
+    build.swap (d->levelOfDetailBuild);
+    
+    // Level by level, so that the same level of neighbouring chunks can be drawn at once.
+    MeshChunkTable& chunkTable = d->chunkTable;
+    if (!chunkTable.uploadLevelsOfDetail(build->chunks))
+        return;
+    
+    // Levels past the coarsest one of a chunk count as the coarsest, like render draws them.
+    int numTrianglesPerLevel[MaxLevelsOfDetail] = {};
+    for (int meshIndex = 0; meshIndex < chunkTable.numChunks(); ++meshIndex)
+    {
+        const MeshChunk& chunk = chunkTable.chunk(meshIndex);
+        for (int level = 0; level < MaxLevelsOfDetail; ++level)
+            numTrianglesPerLevel[level] += chunk.levelNumIndices[std::min(level, chunk.numLevelsOfDetail - 1)] / 3;
+    }
+    
+    invalidateCommandLists();
+    
+    if (numTrianglesPerLevel[0] > 0)
+    {
+        NSLog(@"MeshRenderer: built the levels of detail in %.1f ms in the background, %d -> %d -> %d -> %d triangles.",
+              build->seconds * 1e3,
+              numTrianglesPerLevel[0], numTrianglesPerLevel[1], numTrianglesPerLevel[2], numTrianglesPerLevel[3]);
     }
 }
 
-void MeshRenderer::uploadTexture (CVImageBufferRef pixelBuffer)
+size_t MeshRenderer::uploadTexture (CVImageBufferRef pixelBuffer)
 {
     int width = (int)CVPixelBufferGetWidth(pixelBuffer);
     int height = (int)CVPixelBufferGetHeight(pixelBuffer);
@@ -258,7 +800,7 @@ void MeshRenderer::uploadTexture (CVImageBufferRef pixelBuffer)
     if (err)
     {
         NSLog(@"Error with CVOpenGLESTextureCacheCreateTextureFromImage: %d", err);
-        return;
+        return 0;
     }
     
     // Set rendering properties for the new texture.
@@ -284,7 +826,7 @@ void MeshRenderer::uploadTexture (CVImageBufferRef pixelBuffer)
     if (err)
     {
         NSLog(@"Error with CVOpenGLESTextureCacheCreateTextureFromImage: %d", err);
-        return;
+        return 0;
     }
     
     glBindTexture(CVOpenGLESTextureGetTarget(d->chromaTexture), CVOpenGLESTextureGetName(d->chromaTexture));
@@ -292,135 +834,290 @@ void MeshRenderer::uploadTexture (CVImageBufferRef pixelBuffer)
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     
     glBindTexture(GL_TEXTURE_2D, 0);
+    
+    d->uploadedTextureBuffer = (CVImageBufferRef)CFRetain(pixelBuffer);
+    
+    // The luma plane and the half resolution chroma one.
+    size_t numBytes = 0;
+    for (size_t plane = 0; plane < CVPixelBufferGetPlaneCount(pixelBuffer); ++plane)
+        numBytes += CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, plane) * CVPixelBufferGetHeightOfPlane(pixelBuffer, plane);
+    
+    d->textureStatistics = TextureStatistics();
+    d->textureStatistics.width = width;
+    d->textureStatistics.height = height;
+    d->textureStatistics.numBytes = numBytes;
+    
+    // The planes are drawn until the processed texture is ready. iOS only decodes ETC2 from OpenGL ES 3,
+    // and OpenGL ES 2 only mipmaps power of two textures.
+    const bool isOpenGLES3 = (context.API >= kEAGLRenderingAPIOpenGLES3);
+    const bool mipmap = d->textureMipmappingEnabled && (isOpenGLES3 || (isPowerOfTwo(width) && isPowerOfTwo(height)));
+    const bool compress = d->textureCompressionEnabled && isOpenGLES3;
+    
+    if (d->textureMipmappingEnabled && !mipmap)
+        NSLog(@"MeshRenderer: the %dx%d texture is not mipmapped, OpenGL ES 2 needs power of two sizes.", width, height);
+    
+    if (mipmap || compress)
+        processTexture (pixelBuffer, mipmap, compress);
+    
+    return numBytes;
 }
 
-void MeshRenderer::enableVertexBuffer (int meshIndex)
-{
-    glBindBuffer(GL_ARRAY_BUFFER, d->vertexVbo[meshIndex]);
-    glEnableVertexAttribArray(CustomShader::ATTRIB_VERTEX);
-    glVertexAttribPointer(CustomShader::ATTRIB_VERTEX, 3, GL_FLOAT, GL_FALSE, 0, 0);
-}
-
-void MeshRenderer::disableVertexBuffer (int meshIndex)
-{
-    glBindBuffer(GL_ARRAY_BUFFER, d->vertexVbo[meshIndex]);
-    glDisableVertexAttribArray(CustomShader::ATTRIB_VERTEX);
-}
-
-void MeshRenderer::enableNormalBuffer (int meshIndex)
-{
-    glBindBuffer(GL_ARRAY_BUFFER, d->normalsVbo[meshIndex]);
-    glEnableVertexAttribArray(CustomShader::ATTRIB_NORMAL);
-    glVertexAttribPointer(CustomShader::ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, 0, 0);
-}
-
-void MeshRenderer::disableNormalBuffer (int meshIndex)
-{
-    glBindBuffer(GL_ARRAY_BUFFER, d->normalsVbo[meshIndex]);
-    glDisableVertexAttribArray(CustomShader::ATTRIB_NORMAL);
-}
-
-void MeshRenderer::enableVertexColorBuffer (int meshIndex)
-{
-    glBindBuffer(GL_ARRAY_BUFFER, d->colorsVbo[meshIndex]);
-    glEnableVertexAttribArray(CustomShader::ATTRIB_COLOR);
-    glVertexAttribPointer(CustomShader::ATTRIB_COLOR, 3, GL_FLOAT, GL_FALSE, 0, 0);
-}
-
-void MeshRenderer::disableVertexColorBuffer (int meshIndex)
-{
-    glBindBuffer(GL_ARRAY_BUFFER, d->colorsVbo[meshIndex]);
-    glDisableVertexAttribArray(CustomShader::ATTRIB_COLOR);
-}
-
-void MeshRenderer::enableVertexTexcoordsBuffer (int meshIndex)
+void MeshRenderer::processTexture (CVImageBufferRef pixelBuffer, bool mipmap, bool compress)
 {
-    glBindBuffer(GL_ARRAY_BUFFER, d->texcoordsVbo[meshIndex]);
-    glEnableVertexAttribArray(CustomShader::ATTRIB_TEXCOORD);
-    glVertexAttribPointer(CustomShader::ATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    std::shared_ptr<TextureProcessing> processing = std::make_shared<TextureProcessing>();
+    processing->pixelBuffer = CVPixelBufferRetain(pixelBuffer);
+    processing->width = (int)CVPixelBufferGetWidth(pixelBuffer);
+    processing->height = (int)CVPixelBufferGetHeight(pixelBuffer);
+    processing->mipmap = mipmap;
+    processing->mipFilter = d->textureMipFilter;
+    processing->compress = compress;
+    
+    d->textureProcessing = processing;
+    
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        TextureProcessing* data = processing.get();
+        CVPixelBufferLockBaseAddress(processing->pixelBuffer, kCVPixelBufferLock_ReadOnly);
+        
+        Nv12Image baseImage;
+        baseImage.luma = (const uint8_t*)CVPixelBufferGetBaseAddressOfPlane(processing->pixelBuffer, 0);
+        baseImage.chroma = (const uint8_t*)CVPixelBufferGetBaseAddressOfPlane(processing->pixelBuffer, 1);
+        baseImage.lumaBytesPerRow = CVPixelBufferGetBytesPerRowOfPlane(processing->pixelBuffer, 0);
+        baseImage.chromaBytesPerRow = CVPixelBufferGetBytesPerRowOfPlane(processing->pixelBuffer, 1);
+        baseImage.width = data->width;
+        baseImage.height = data->height;
+        
+        const int chromaWidth = (int)CVPixelBufferGetWidthOfPlane(processing->pixelBuffer, 1);
+        const int chromaHeight = (int)CVPixelBufferGetHeightOfPlane(processing->pixelBuffer, 1);
+        
+        if (data->mipmap)
+        {
+            const double startTime = CACurrentMediaTime();
+            
+            // The two planes in parallel.
+            dispatch_apply(2, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t plane) {
+                if (plane == 0)
+                    data->lumaLevels = buildMipChain(baseImage.luma, baseImage.width, baseImage.height,
+                                                     baseImage.lumaBytesPerRow, 1, data->mipFilter, &data->cancelled);
+                else
+                    data->chromaLevels = buildMipChain(baseImage.chroma, chromaWidth, chromaHeight,
+                                                       baseImage.chromaBytesPerRow, 2, data->mipFilter, &data->cancelled);
+            });
+            
+            // Uploaded along with the other levels, the buffer is not locked on the GL thread.
+            if (!data->compress && !data->cancelled)
+            {
+                copyPlane(baseImage.luma, baseImage.width, baseImage.height, baseImage.lumaBytesPerRow, 1, data->lumaBase);
+                copyPlane(baseImage.chroma, chromaWidth, chromaHeight, baseImage.chromaBytesPerRow, 2, data->chromaBase);
+            }
+            
+            data->mipmapSeconds = CACurrentMediaTime() - startTime;
+        }
+        
+        if (data->compress && !data->cancelled)
+        {
+            const double startTime = CACurrentMediaTime();
+            
+            data->compressedLevels.resize (1 + data->lumaLevels.size());
+            for (size_t level = 0; level < data->compressedLevels.size() && !data->cancelled; ++level)
+            {
+                // The chroma chain is usually one level shorter, its 1x1 level serves the smallest luma ones.
+                Nv12Image image = baseImage;
+                if (level > 0)
+                {
+                    const MipLevel& luma = data->lumaLevels[level - 1];
+                    image.luma = luma.pixels.data();
+                    image.lumaBytesPerRow = luma.width;
+                    image.width = luma.width;
+                    image.height = luma.height;
+                    
+                    if (!data->chromaLevels.empty())
+                    {
+                        const MipLevel& chroma = data->chromaLevels[std::min(level, data->chromaLevels.size()) - 1];
+                        image.chroma = chroma.pixels.data();
+                        image.chromaBytesPerRow = 2 * chroma.width;
+                    }
+                }
+                
+                // Each job writes its own block rows.
+                std::vector<uint8_t>& blocks = data->compressedLevels[level];
+                blocks.resize (etcEncodedSize(image.width, image.height));
+                uint8_t* encoded = blocks.data();
+                
+                const int numJobs = (etcBlockRowCount(image.height) + kBlockRowsPerCompressionJob - 1) / kBlockRowsPerCompressionJob;
+                dispatch_apply(numJobs, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t job) {
+                    if (!data->cancelled)
+                        encodeNv12ToEtc2(image, (int)job * kBlockRowsPerCompressionJob, kBlockRowsPerCompressionJob, encoded);
+                });
+            }
+            
+            data->compressionSeconds = CACurrentMediaTime() - startTime;
+            
+            if (!data->cancelled)
+                data->psnr = computeEtc2Psnr(baseImage, data->compressedLevels[0].data());
+        }
+        
+        CVPixelBufferUnlockBaseAddress(processing->pixelBuffer, kCVPixelBufferLock_ReadOnly);
+        CVPixelBufferRelease(processing->pixelBuffer);
+        processing->pixelBuffer = NULL;
+        
+        processing->finished = true;
+    });
 }
 
-void MeshRenderer::disableVertexTexcoordBuffer (int meshIndex)
+void MeshRenderer::uploadProcessedTexture ()
 {
-    glBindBuffer(GL_ARRAY_BUFFER, d->texcoordsVbo[meshIndex]);
-    glDisableVertexAttribArray(CustomShader::ATTRIB_TEXCOORD);
+    std::shared_ptr<TextureProcessing> processing;
+    processing.swap (d->textureProcessing);
+    
+    glActiveTexture(d->textureUnit);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    
+    size_t numBytes = 0;
+    if (processing->compress)
+    {
+        glGenTextures(1, &d->compressedTexture);
+        glBindTexture(GL_TEXTURE_2D, d->compressedTexture);
+        
+        int width = processing->width;
+        int height = processing->height;
+        for (size_t level = 0; level < processing->compressedLevels.size(); ++level)
+        {
+            const std::vector<uint8_t>& blocks = processing->compressedLevels[level];
+            glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, GL_COMPRESSED_RGB8_ETC2, width, height, 0,
+                                   (GLsizei)blocks.size(), blocks.data());
+            numBytes += blocks.size();
+            
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+        
+        setTextureSampling(processing->mipmap);
+    }
+    else
+    {
+        d->mipmappedLumaTexture = createMipmappedTexture(d->isOpenGLES3 ? GL_R8 : GL_RED_EXT, GL_RED_EXT,
+                                                         processing->lumaBase, processing->lumaLevels, numBytes);
+        d->mipmappedChromaTexture = createMipmappedTexture(d->isOpenGLES3 ? GL_RG8 : GL_RG_EXT, GL_RG_EXT,
+                                                           processing->chromaBase, processing->chromaLevels, numBytes);
+    }
+    
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    
+    // The planes are not needed anymore, the pixel buffer is kept to recognize the texture.
+    if (d->lumaTexture)
+    {
+        CFRelease(d->lumaTexture);
+        d->lumaTexture = NULL;
+    }
+    
+    if (d->chromaTexture)
+    {
+        CFRelease(d->chromaTexture);
+        d->chromaTexture = NULL;
+    }
+    
+    TextureStatistics& statistics = d->textureStatistics;
+    statistics.numMipLevels = processing->mipmap ? 1 + (int)processing->lumaLevels.size() : 1;
+    statistics.mipmapSeconds = processing->mipmapSeconds;
+    statistics.compressed = processing->compress;
+    statistics.compressionSeconds = processing->compressionSeconds;
+    statistics.compressionPsnr = processing->psnr;
+    statistics.numBytes = numBytes;
+    
+    if (processing->mipmap)
+    {
+        NSLog(@"MeshRenderer: built %d mip levels of the %dx%d texture in %.1f ms in the background, %s filter.",
+              statistics.numMipLevels, processing->width, processing->height, statistics.mipmapSeconds * 1e3,
+              processing->mipFilter == MipFilterBox ? "box" : "Kaiser");
+    }
+    
+    if (processing->compress)
+    {
+        // 1.5 bytes per pixel for the planes, 0.5 for ETC2, a third more with the mip levels.
+        const double numPixels = (double)processing->width * processing->height;
+        NSLog(@"MeshRenderer: compressed the %dx%d texture to ETC2 in %.1f ms in the background (%.1f MP/s), "
+              "PSNR %.1f dB, %.2f MB for %d levels.",
+              processing->width, processing->height, statistics.compressionSeconds * 1e3,
+              numPixels / statistics.compressionSeconds / 1e6, statistics.compressionPsnr,
+              numBytes / 1e6, statistics.numMipLevels);
+    }
 }
 
-void MeshRenderer::enableLinesElementBuffer (int meshIndex)
+void MeshRenderer::invalidateCommandLists ()
 {
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, d->linesVbo[meshIndex]);
-    glLineWidth(1.0);
+    for (RenderCommandList& commands : d->commandLists)
+        commands.clear();
 }
 
-void MeshRenderer::enableTrianglesElementBuffer (int meshIndex)
+MeshRenderer::FrameStatistics MeshRenderer::lastFrameStatistics () const
 {
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, d->facesVbo[meshIndex]);
+    const GLStateCache::Statistics& cacheStatistics = d->stateCache.statistics();
+    
+    FrameStatistics statistics;
+    statistics.numGLCalls = cacheStatistics.numGLCalls;
+    statistics.numSkippedGLCalls = cacheStatistics.numSkippedGLCalls;
+    statistics.numDrawCalls = cacheStatistics.numDrawCalls;
+    statistics.numChunkDraws = d->numChunkDraws;
+    statistics.numDrawnChunks = (int)d->visibleChunks.size();
+    statistics.numCulledChunks = d->numCulledChunks;
+    statistics.numOccludedChunks = d->numOccludedChunks;
+    statistics.numDrawnTriangles = d->numDrawnTriangles;
+    statistics.numDrawnPoints = d->numDrawnPoints;
+    statistics.shaderCompileSeconds = d->shaderCompileSeconds;
+    statistics.renderSeconds = d->renderSeconds;
+    return statistics;
 }
 
-void MeshRenderer::renderPartialMesh(int meshIndex)
+MeshRenderer::BufferStatistics MeshRenderer::bufferStatistics () const
 {
-    if (d->numTriangleIndices[meshIndex] <= 0) // nothing uploaded.
-        return;
+    const MeshChunkTable& chunkTable = d->chunkTable;
+    const MeshBufferArena& arena = chunkTable.bufferArena();
+    const MeshBufferArena::Statistics arenaStatistics = arena.statistics();
     
-    switch (d->currentRenderingMode)
+    BufferStatistics statistics;
+    statistics.numBufferObjects = arenaStatistics.numBufferObjects;
+    statistics.numPages = arenaStatistics.numPages;
+    statistics.numAllocatedBytes = arenaStatistics.numAllocatedBytes;
+    statistics.numUsedBytes = arenaStatistics.numUsedBytes;
+    statistics.numCompactions = arenaStatistics.numCompactions;
+    statistics.indexBits = 8 * arena.indexSize();
+    
+    const size_t indexSize = arena.indexSize();
+    for (int meshIndex = 0; meshIndex < chunkTable.numChunks(); ++meshIndex)
     {
-        case RenderingModeXRay:
-        {
-            enableLinesElementBuffer(meshIndex);
-            enableVertexBuffer(meshIndex);
-            enableNormalBuffer(meshIndex);
-            glDrawElements(GL_LINES, d->numLinesIndices[meshIndex], GL_UNSIGNED_SHORT, 0);
-            disableNormalBuffer(meshIndex);
-            disableVertexBuffer(meshIndex);
-            break;
-        }
-            
-        case RenderingModeLightedGray:
-        {
-            enableTrianglesElementBuffer(meshIndex);
-            enableVertexBuffer(meshIndex);
-            enableNormalBuffer(meshIndex);
-            glDrawElements(GL_TRIANGLES, d->numTriangleIndices[meshIndex], GL_UNSIGNED_SHORT, 0);
-            disableNormalBuffer(meshIndex);
-            disableVertexBuffer(meshIndex);
-            break;
-        }
-            
-        case RenderingModePerVertexColor:
-        {
-            enableTrianglesElementBuffer(meshIndex);
-            enableVertexBuffer(meshIndex);
-            enableNormalBuffer(meshIndex);
-            enableVertexColorBuffer(meshIndex);
-            glDrawElements(GL_TRIANGLES, d->numTriangleIndices[meshIndex], GL_UNSIGNED_SHORT, 0);
-            disableVertexColorBuffer(meshIndex);
-            disableNormalBuffer(meshIndex);
-            disableVertexBuffer(meshIndex);
-            break;
-        }
-
-        case RenderingModeTextured:
-        {
-            enableTrianglesElementBuffer(meshIndex);
-            enableVertexBuffer(meshIndex);
-            enableVertexTexcoordsBuffer(meshIndex);
-            glDrawElements(GL_TRIANGLES, d->numTriangleIndices[meshIndex], GL_UNSIGNED_SHORT, 0);
-            disableVertexTexcoordBuffer(meshIndex);
-            disableVertexBuffer(meshIndex);
-            break;
-        }
-
-        default:
-            NSLog(@"Unknown rendering mode.");
-            break;
+        const MeshChunk& chunk = chunkTable.chunk(meshIndex);
+        if (chunk.vertexAllocation < 0)
+            continue;
+        
+        const size_t numVertices = arena.allocation(chunk.vertexAllocation).count;
+        const size_t geometryBytes = numVertices * arena.vertexStride(MeshBufferArena::GeometryStream);
+        const size_t surfaceBytes = numVertices * arena.vertexStride(MeshBufferArena::SurfaceStream);
+        
+        size_t triangleBytes = 0;
+        for (int level = 0; level < chunk.numLevelsOfDetail; ++level)
+            triangleBytes += chunk.levelNumIndices[level] * indexSize;
+        
+        const size_t wireframeBytes = chunk.hasCornerColors ? numVertices * arena.vertexStride(MeshBufferArena::CornerColorStream) + chunk.levelNumIndices[0] * indexSize
+                                                            : chunk.numLinesIndices * indexSize;
+        
+        statistics.numModeBytes[RenderingModeXRay] += geometryBytes + wireframeBytes;
+        statistics.numModeBytes[RenderingModePerVertexColor] += geometryBytes + surfaceBytes + triangleBytes;
+        statistics.numModeBytes[RenderingModeTextured] += geometryBytes + surfaceBytes + triangleBytes;
+        statistics.numModeBytes[RenderingModeLightedGray] += geometryBytes + triangleBytes;
+        statistics.numModeBytes[RenderingModePoints] += geometryBytes;
     }
     
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (d->hasTexture)
+        statistics.numModeBytes[RenderingModeTextured] += d->textureStatistics.numBytes;
+    
+    return statistics;
 }
 
 void MeshRenderer::render(const GLKMatrix4& projectionMatrix, const GLKMatrix4& modelViewMatrix)
 {
+    const double renderStartTime = CACurrentMediaTime();
+    
     if (d->currentRenderingMode == RenderingModePerVertexColor && !d->hasPerVertexColor && d->hasTexture && d->hasPerVertexUV)
     {
         NSLog(@"Warning: The mesh has no per-vertex colors, but a texture, switching the rendering mode to RenderingModeTextured");
@@ -432,61 +1129,236 @@ void MeshRenderer::render(const GLKMatrix4& projectionMatrix, const GLKMatrix4&
         d->currentRenderingMode = RenderingModePerVertexColor;
     }
     
+    if (d->upload)
+        uploadPendingChunks(true);
+    
+    if (d->levelOfDetailBuild && d->levelOfDetailBuild->finished)
+        uploadLevelsOfDetail();
+    
+    if (d->textureProcessing && d->textureProcessing->finished)
+        uploadProcessedTexture();
+    
+    // Skip the chunks outside of the view, and draw the others front to back for early depth rejection.
+    const GLKMatrix4 viewProjection = GLKMatrix4Multiply(projectionMatrix, modelViewMatrix);
+    const MeshChunkTable& chunkTable = d->chunkTable;
+    d->numCulledChunks = chunkTable.cullChunks(viewProjection, d->visibleChunks);
+    
+    // Then rasterize the occluders on a worker thread, while the GL state is set up here.
+    dispatch_group_t occlusionGroup = dispatch_group_create();
+    d->numOccludedChunks = 0;
+    if (d->occlusionCullingEnabled && (int)d->visibleChunks.size() >= kMinChunksForOcclusionCulling)
+    {
+        PrivateData* data = d;
+        dispatch_group_async(occlusionGroup, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
+            data->numOccludedChunks = data->chunkTable.removeOccludedChunks(data->occlusionCuller, viewProjection, data->visibleChunks);
+        });
+    }
+    
+    GLStateCache& cache = d->stateCache;
+    cache.beginFrame();
+    
+    const bool quantizedPositions = chunkTable.hasQuantizedPositions();
+    MeshShader* shader = NULL;
+    
     switch (d->currentRenderingMode)
     {
         case RenderingModeXRay:
-            d->xRayShader.enable();
-            d->xRayShader.prepareRendering(projectionMatrix.m, modelViewMatrix.m);
-            break;
-            
         case RenderingModeLightedGray:
-            d->lightedGrayShader.enable();
-            d->lightedGrayShader.prepareRendering(projectionMatrix.m, modelViewMatrix.m);
+        case RenderingModePoints:
+            shader = &d->shaders[shaderVariantIndex(d->currentRenderingMode, quantizedPositions)];
             break;
 
         case RenderingModePerVertexColor:
             if (!d->hasPerVertexColor)
             {
                 NSLog(@"Warning: the mesh has no colors, skipping rendering.");
-                return;
+                break;
             }
-            d->perVertexColorShader.enable();
-            d->perVertexColorShader.prepareRendering(projectionMatrix.m, modelViewMatrix.m);
+            shader = &d->shaders[shaderVariantIndex(d->currentRenderingMode, quantizedPositions)];
             break;
             
         case RenderingModeTextured:
+            if (d->hasTexture && d->compressedTexture != 0)
+            {
+                cache.bindTexture(d->textureUnit, GL_TEXTURE_2D, d->compressedTexture);
+                shader = &d->shaders[compressedTextureShaderIndex(quantizedPositions)];
+                break;
+            }
+            
+            if (d->hasTexture && d->mipmappedLumaTexture != 0 && d->mipmappedChromaTexture != 0)
+            {
+                cache.bindTexture(d->textureUnit, GL_TEXTURE_2D, d->mipmappedLumaTexture);
+                cache.bindTexture(d->textureUnit + 1, GL_TEXTURE_2D, d->mipmappedChromaTexture);
+                shader = &d->shaders[shaderVariantIndex(d->currentRenderingMode, quantizedPositions)];
+                break;
+            }
+            
             if (!d->hasTexture || d->lumaTexture == NULL || d->chromaTexture == NULL)
             {
                 NSLog(@"Warning: null textures, skipping rendering.");
-                return;
+                break;
             }
             
-            glActiveTexture(d->textureUnit);
-            glBindTexture(CVOpenGLESTextureGetTarget(d->lumaTexture),
-                          CVOpenGLESTextureGetName(d->lumaTexture));
+            cache.bindTexture(d->textureUnit,
+                              CVOpenGLESTextureGetTarget(d->lumaTexture),
+                              CVOpenGLESTextureGetName(d->lumaTexture));
             
-            glActiveTexture(d->textureUnit + 1);
-            glBindTexture(CVOpenGLESTextureGetTarget(d->chromaTexture),
-                          CVOpenGLESTextureGetName(d->chromaTexture));
+            cache.bindTexture(d->textureUnit + 1,
+                              CVOpenGLESTextureGetTarget(d->chromaTexture),
+                              CVOpenGLESTextureGetName(d->chromaTexture));
             
-            d->yCbCrTextureShader.enable();
-            d->yCbCrTextureShader.prepareRendering(projectionMatrix.m, modelViewMatrix.m, d->textureUnit);
+            shader = &d->shaders[shaderVariantIndex(d->currentRenderingMode, quantizedPositions)];
             break;
 
         default:
             NSLog(@"Unknown rendering mode.");
-            return;
+            break;
+    }
+    
+    d->shaderCompileSeconds = 0.0;
+    
+    if (shader == NULL)
+    {
+        dispatch_group_wait(occlusionGroup, DISPATCH_TIME_FOREVER);
+        d->renderSeconds = CACurrentMediaTime() - renderStartTime;
+        return;
+    }
+    
+    // Compiles the variant if initializeGL did not prewarm it.
+    const bool compilesShader = !shader->isLoaded();
+    const double enableStartTime = CACurrentMediaTime();
+    shader->enable(cache);
+    if (compilesShader)
+    {
+        d->shaderCompileSeconds = CACurrentMediaTime() - enableStartTime;
+        NSLog(@"MeshRenderer: compiled the %s shader on first use in %.1f ms.",
+              describeMeshShaderKey(shader->key()).c_str(), d->shaderCompileSeconds * 1e3);
     }
     
+    shader->prepareRendering(cache, projectionMatrix.m, modelViewMatrix.m, d->textureUnit);
+    
+    // Recorded for the attributes of the mode, the compressed texture variant reads the same ones.
+    RenderCommandList& commands = d->commandLists[d->currentRenderingMode];
+    const MeshShaderKey shaderKey = kRenderingModeShaderKeys[d->currentRenderingMode];
+    if (commands.empty())
+        chunkTable.recordCommandList(shaderKey, commands);
+    
     // Keep previous GL_DEPTH_TEST state
-    BOOL wasDepthTestEnabled = glIsEnabled(GL_DEPTH_TEST);
-    glEnable(GL_DEPTH_TEST);
+    const bool wasDepthTestEnabled = cache.isCapabilityEnabled(GL_DEPTH_TEST);
+    cache.setCapability(GL_DEPTH_TEST, true);
     
-    for (int i = 0; i < d->numUploadedMeshes; ++i)
+    dispatch_group_wait(occlusionGroup, DISPATCH_TIME_FOREVER);
+    
+    d->draws.clear();
+    d->numDrawnTriangles = 0;
+    d->numDrawnPoints = 0;
+    chunkTable.buildDraws(shaderKey, d->visibleChunks, projectionMatrix, modelViewMatrix, d->draws, d->numDrawnTriangles, d->numDrawnPoints);
+    
+    // The point splats of each chunk have their own size, their draws are not merged.
+    const bool points = (d->currentRenderingMode == RenderingModePoints);
+    d->numChunkDraws = (int)d->draws.size();
+    if (d->drawCallMergingEnabled && !points)
+        chunkTable.mergeDraws(d->draws);
+    
+    float pixelsPerUnit = 0.f;
+    if (points)
     {
-        renderPartialMesh (i);
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        pixelsPerUnit = pointSplatPixelsPerUnit(projectionMatrix, modelViewMatrix, viewport[3]);
     }
     
+    chunkTable.draw(cache, *shader, commands, d->draws, pixelsPerUnit);
+    
+    // Leave a clean state to the other users of the GL context.
+    cache.disableAllVertexAttributes();
+    cache.bindElementArrayBuffer(0);
+    cache.bindArrayBuffer(0);
+    
     if (!wasDepthTestEnabled)
-        glDisable(GL_DEPTH_TEST);
+        cache.setCapability(GL_DEPTH_TEST, false);
+    
+    d->renderSeconds = CACurrentMediaTime() - renderStartTime;
+}
+
+MeshRenderer::BenchmarkStatistics MeshRenderer::runBenchmark (STMesh* mesh, const GLKMatrix4& projectionMatrix,
+                                                              const GLKMatrix4& modelViewMatrix, int numFrames)
+{
+    BenchmarkStatistics statistics;
+    const RenderingMode previousRenderingMode = d->currentRenderingMode;
+    
+    // Nothing is reused from the mesh already uploaded.
+    releaseGLBuffers();
+    releaseGLTextures();
+    
+    const double uploadStartTime = CACurrentMediaTime();
+    uploadMesh(mesh);
+    finishUpload();
+    statistics.uploadSeconds = CACurrentMediaTime() - uploadStartTime;
+    statistics.numUploadedBytes = d->uploadStatistics.numUploadedBytes;
+    
+    // The levels of detail and the texture processing are picked up by the next render.
+    const double backgroundStartTime = CACurrentMediaTime();
+    while ((d->levelOfDetailBuild && !d->levelOfDetailBuild->finished) || (d->textureProcessing && !d->textureProcessing->finished))
+        [NSThread sleepForTimeInterval:0.001];
+    statistics.backgroundSeconds = CACurrentMediaTime() - backgroundStartTime;
+    
+    for (int mode = 0; mode < RenderingModeNumModes; ++mode)
+    {
+        BenchmarkStatistics::ModeStatistics& modeStatistics = statistics.modes[mode];
+        if ((mode == RenderingModePerVertexColor && !d->hasPerVertexColor)
+            || (mode == RenderingModeTextured && (!d->hasTexture || !d->hasPerVertexUV)))
+            continue;
+        
+        d->currentRenderingMode = RenderingMode(mode);
+        
+        // A first frame uploads the background work and records the command lists.
+        clear();
+        render(projectionMatrix, modelViewMatrix);
+        glFinish();
+        
+        for (int frame = 0; frame < numFrames; ++frame)
+        {
+            const double frameStartTime = CACurrentMediaTime();
+            clear();
+            render(projectionMatrix, modelViewMatrix);
+            glFinish();
+            const double frameSeconds = CACurrentMediaTime() - frameStartTime;
+            
+            modeStatistics.averageFrameSeconds += frameSeconds;
+            modeStatistics.worstFrameSeconds = std::max(modeStatistics.worstFrameSeconds, frameSeconds);
+            modeStatistics.averageRenderSeconds += d->renderSeconds;
+        }
+        
+        modeStatistics.rendered = true;
+        modeStatistics.numFrames = numFrames;
+        modeStatistics.averageFrameSeconds /= std::max(1, numFrames);
+        modeStatistics.averageRenderSeconds /= std::max(1, numFrames);
+        modeStatistics.lastFrame = lastFrameStatistics();
+    }
+    
+    d->currentRenderingMode = previousRenderingMode;
+    statistics.buffers = bufferStatistics();
+    statistics.texture = d->textureStatistics;
+    
+    NSLog(@"MeshRenderer: benchmark upload %.1f ms (%.2f MB), background work %.1f ms, %.2f MB of buffers, %.2f MB of texture.",
+          statistics.uploadSeconds * 1e3, statistics.numUploadedBytes / 1e6, statistics.backgroundSeconds * 1e3,
+          statistics.buffers.numAllocatedBytes / 1e6, statistics.texture.numBytes / 1e6);
+    
+    static const char* const modeNames[RenderingModeNumModes] = { "x-ray", "vertex colors", "textured", "lighted gray", "points" };
+    for (int mode = 0; mode < RenderingModeNumModes; ++mode)
+    {
+        const BenchmarkStatistics::ModeStatistics& modeStatistics = statistics.modes[mode];
+        if (!modeStatistics.rendered)
+            continue;
+        
+        NSLog(@"MeshRenderer: benchmark %s, %.2f ms per frame (worst %.2f ms, %.2f ms in render), %d GL calls, %d draws, "
+              "%d triangles, %d points, %.2f MB drawn from.",
+              modeNames[mode], modeStatistics.averageFrameSeconds * 1e3, modeStatistics.worstFrameSeconds * 1e3,
+              modeStatistics.averageRenderSeconds * 1e3, modeStatistics.lastFrame.numGLCalls, modeStatistics.lastFrame.numDrawCalls,
+              modeStatistics.lastFrame.numDrawnTriangles, modeStatistics.lastFrame.numDrawnPoints,
+              statistics.buffers.numModeBytes[mode] / 1e6);
+    }
+    
+    return statistics;
 }
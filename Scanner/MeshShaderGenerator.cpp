@@ -0,0 +1,213 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "MeshShaderGenerator.h"
+
+#include <cassert>
+
+// Local functions
+namespace
+{
+
+    const char* const kOctahedralNormalDecoding = R"(
+vec3 decodeOctahedralNormal(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+)";
+
+    const char* const kWireframeDiscard = R"(
+    // The color missing from the triangle stays exactly 0, the others are barycentric coordinates
+    // and reach 0 on the opposite edge. An all-zero color is the lines fallback, drawn entirely.
+    vec4 absentColor = vec4(equal(v_cornerColor, vec4(0.0)));
+
+#ifdef GL_OES_standard_derivatives
+    // Distance to the edges in pixels, for lines of constant width.
+    vec4 edgeDistances = v_cornerColor / max(fwidth(v_cornerColor), vec4(1e-4)) + absentColor * 1e3;
+    float maxEdgeDistance = 0.5;
+#else
+    vec4 edgeDistances = v_cornerColor + absentColor;
+    float maxEdgeDistance = 0.02;
+#endif
+
+    float edgeDistance = min(min(edgeDistances.x, edgeDistances.y), min(edgeDistances.z, edgeDistances.w));
+    if (edgeDistance > maxEdgeDistance && absentColor != vec4(1.0))
+        discard;
+)";
+
+    const char* const kYCbCrConversion = R"(
+    mediump vec3 yuv;
+    yuv.x = texture2D(s_texture_y, v_texCoord).r;
+    yuv.yz = texture2D(s_texture_cbcr, v_texCoord).rg - vec2(0.5, 0.5);
+
+    vec3 color = mat3(      1,       1,      1,
+                            0, -.18732, 1.8556,
+                      1.57481, -.46813,      0) * yuv;
+)";
+
+} // Anonymous
+
+MeshShaderSource generateMeshShaderSource (MeshShaderKey key)
+{
+    assert (isValidMeshShaderKey(key));
+
+    const bool lighting = (key & MeshShaderLightingMask) != 0;
+    const bool vertexColors = (key & MeshShaderVertexColors) != 0;
+    const bool yCbCrTexture = (key & MeshShaderYCbCrTexture) != 0;
+    const bool rgbTexture = (key & MeshShaderRgbTexture) != 0;
+    const bool texture = yCbCrTexture || rgbTexture;
+    const bool wireframe = (key & MeshShaderWireframe) != 0;
+    const bool pointSplats = (key & MeshShaderPointSplats) != 0;
+    const bool quantized = (key & MeshShaderQuantizedPositions) != 0;
+
+    MeshShaderSource source;
+    source.attributes.push_back({ MeshShaderAttributePosition, "a_position" });
+    source.uniforms.push_back("u_perspective_projection");
+    source.uniforms.push_back("u_modelview");
+
+    std::string& vs = source.vertexShader;
+    std::string& fs = source.fragmentShader;
+
+    // Declarations.
+    vs += "attribute vec4 a_position;\n";
+    if (lighting)
+    {
+        vs += "attribute vec2 a_normal; // octahedral encoding\n";
+        source.attributes.push_back({ MeshShaderAttributeNormal, "a_normal" });
+    }
+    if (vertexColors)
+    {
+        vs += "attribute vec3 a_color;\n";
+        source.attributes.push_back({ MeshShaderAttributeColor, "a_color" });
+    }
+    if (texture)
+    {
+        vs += "attribute vec2 a_texCoord;\n";
+        source.attributes.push_back({ MeshShaderAttributeTexcoord, "a_texCoord" });
+    }
+    if (wireframe)
+    {
+        vs += "attribute vec4 a_cornerColor; // one-hot, distinct for the 3 corners of a triangle\n";
+        source.attributes.push_back({ MeshShaderAttributeCornerColor, "a_cornerColor" });
+    }
+
+    vs += "uniform mat4 u_perspective_projection;\n";
+    vs += "uniform mat4 u_modelview;\n";
+    if (quantized)
+    {
+        vs += "uniform vec4 u_dequantization; // cube origin and size\n";
+        source.uniforms.push_back("u_dequantization");
+    }
+    if (pointSplats)
+    {
+        vs += "uniform vec4 u_pointSplat; // diameter at w = 1, min and max diameters, in pixels\n";
+        source.uniforms.push_back("u_pointSplat");
+    }
+
+    if (wireframe)
+        fs += "#extension GL_OES_standard_derivatives : enable\n";
+    fs += "precision mediump float;\n";
+
+    if (yCbCrTexture)
+    {
+        fs += "uniform sampler2D s_texture_y;\n";
+        fs += "uniform sampler2D s_texture_cbcr;\n";
+        source.uniforms.push_back("s_texture_y");
+        source.uniforms.push_back("s_texture_cbcr");
+    }
+    if (rgbTexture)
+    {
+        fs += "uniform sampler2D s_texture;\n";
+        source.uniforms.push_back("s_texture");
+    }
+
+    std::string varyings;
+    if (lighting)
+        varyings += "varying float v_luminance;\n";
+    if (vertexColors)
+        varyings += "varying vec3 v_color;\n";
+    if (texture)
+        varyings += "varying vec2 v_texCoord;\n";
+    if (wireframe)
+        varyings += "varying vec4 v_cornerColor;\n";
+    vs += varyings;
+    fs += varyings;
+
+    if (lighting)
+        vs += kOctahedralNormalDecoding;
+
+    // Vertex shader body.
+    vs += "\nvoid main()\n{\n";
+    if (quantized)
+        vs += "    vec4 position = vec4(u_dequantization.xyz + u_dequantization.w * a_position.xyz, 1.0);\n";
+    else
+        vs += "    vec4 position = a_position;\n";
+    vs += "    gl_Position = u_perspective_projection*u_modelview*position;\n";
+    if (pointSplats)
+        vs += "    gl_PointSize = clamp(u_pointSplat.x / gl_Position.w, u_pointSplat.y, u_pointSplat.z);\n";
+
+    if (lighting)
+    {
+        // The modelview can include a scale, hence the normalization.
+        vs += "    vec3 normal = normalize(mat3(u_modelview)*decodeOctahedralNormal(a_normal));\n";
+        if (key & MeshShaderHeadlight)
+            vs += "    v_luminance = 0.5*abs(normal.z) + 0.5; // slightly reduced lighting\n";
+        else
+            vs += "    v_luminance = 1.0 - abs(normal.z);\n";
+    }
+    if (vertexColors)
+        vs += "    v_color = a_color;\n";
+    if (texture)
+        vs += "    v_texCoord = a_texCoord;\n";
+    if (wireframe)
+        vs += "    v_cornerColor = a_cornerColor;\n";
+    vs += "}\n";
+
+    // Fragment shader body.
+    fs += "\nvoid main()\n{\n";
+    if (wireframe)
+        fs += kWireframeDiscard;
+    if (pointSplats)
+        fs += "    if (length(gl_PointCoord - vec2(0.5)) > 0.5)\n        discard;\n";
+
+    if (yCbCrTexture)
+        fs += kYCbCrConversion;
+    else if (rgbTexture)
+        fs += "    vec3 color = texture2D(s_texture, v_texCoord).rgb;\n";
+    else if (vertexColors)
+        fs += "    vec3 color = v_color;\n";
+    else
+        fs += "    vec3 color = vec3(1.0);\n";
+
+    if (lighting)
+        fs += "    color *= v_luminance;\n";
+
+    fs += "    gl_FragColor = vec4(color, 1.0);\n";
+    fs += "}\n";
+
+    return source;
+}
+
+std::string describeMeshShaderKey (MeshShaderKey key)
+{
+    static const char* const names[] = { "headlight", "x-ray", "vertex colors", "texture", "rgb texture", "wireframe", "point splats", "quantized" };
+
+    std::string description;
+    for (int feature = 0; feature < (int)(sizeof(names) / sizeof(names[0])); ++feature)
+    {
+        if ((key & (1u << feature)) == 0)
+            continue;
+
+        if (!description.empty())
+            description += "+";
+        description += names[feature];
+    }
+
+    return description.empty() ? "unlit" : description;
+}
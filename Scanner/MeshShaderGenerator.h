@@ -0,0 +1,86 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Vertex attribute indices bound by the mesh shaders, and set up by MeshRenderer.
+enum MeshShaderAttribute
+{
+    MeshShaderAttributePosition = 0,
+    MeshShaderAttributeNormal,
+    MeshShaderAttributeColor,
+    MeshShaderAttributeTexcoord,
+    MeshShaderAttributeCornerColor,
+};
+
+// Features of a mesh shader variant, or-ed into a key. At most one lighting model and one color
+// source, the surface is gray without a color source.
+typedef unsigned MeshShaderKey;
+
+enum MeshShaderFeature : MeshShaderKey
+{
+    // Lighting models, both read octahedral normals.
+    MeshShaderHeadlight = 1 << 0,         // directional light moving with the camera
+    MeshShaderXRayLighting = 1 << 1,      // brighter where the surface is seen edge-on
+
+    // Color sources.
+    MeshShaderVertexColors = 1 << 2,      // a_color
+    MeshShaderYCbCrTexture = 1 << 3,      // a_texCoord into the luma and chroma planes
+    MeshShaderRgbTexture = 1 << 4,        // a_texCoord into an RGB texture, e.g. the ETC2 encoding of the planes
+
+    // Keeps only the triangle edges, from the one-hot corner colors, see assignCornerColors.
+    MeshShaderWireframe = 1 << 5,
+
+    // Vertices drawn as GL_POINTS discs facing the screen: u_pointSplat.x is the diameter in pixels at
+    // clip w = 1, clamped to [u_pointSplat.y, u_pointSplat.z].
+    MeshShaderPointSplats = 1 << 6,
+
+    // Positions are unorm16 relative to a cube: position = u_dequantization.xyz + u_dequantization.w * a_position.
+    MeshShaderQuantizedPositions = 1 << 7,
+};
+
+constexpr MeshShaderKey MeshShaderLightingMask = MeshShaderHeadlight | MeshShaderXRayLighting;
+constexpr MeshShaderKey MeshShaderColorMask = MeshShaderVertexColors | MeshShaderYCbCrTexture | MeshShaderRgbTexture;
+constexpr MeshShaderKey MeshShaderAllFeatures = (MeshShaderQuantizedPositions << 1) - 1;
+
+constexpr bool isSingleFeature (MeshShaderKey features)
+{
+    return (features & (features - 1)) == 0;
+}
+
+// Usable with static_assert on the variants a renderer needs.
+constexpr bool isValidMeshShaderKey (MeshShaderKey key)
+{
+    return (key & ~MeshShaderAllFeatures) == 0
+        && isSingleFeature(key & MeshShaderLightingMask)
+        && isSingleFeature(key & MeshShaderColorMask)
+        && isSingleFeature(key & (MeshShaderWireframe | MeshShaderPointSplats));
+}
+
+// GLSL ES 1.00 of a variant, with the attributes and uniforms it actually declares. Only depends on
+// the key, and does not need a GL context.
+struct MeshShaderSource
+{
+    std::string vertexShader;
+    std::string fragmentShader;
+
+    struct Attribute
+    {
+        MeshShaderAttribute index;
+        const char* name;
+    };
+
+    std::vector<Attribute> attributes;
+    std::vector<const char*> uniforms;
+};
+
+MeshShaderSource generateMeshShaderSource (MeshShaderKey key);
+
+// Short description for the logs, e.g. "headlight+quantized".
+std::string describeMeshShaderKey (MeshShaderKey key);
@@ -0,0 +1,305 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+// Local functions
+namespace
+{
+
+    // Clustered triangle with its original winding, and its corners sorted to find duplicates.
+    struct ClusterTriangle
+    {
+        int key[3];
+        int corners[3];
+
+        bool operator< (const ClusterTriangle& other) const
+        {
+            return std::lexicographical_compare(key, key + 3, other.key, other.key + 3);
+        }
+
+        bool sameKey (const ClusterTriangle& other) const
+        {
+            return key[0] == other.key[0] && key[1] == other.key[1] && key[2] == other.key[2];
+        }
+    };
+
+    std::vector<bool> findBorderVertices (const uint16_t* indices, int numIndices, int numVertices)
+    {
+        std::vector<std::pair<int, int> > edges;
+        edges.reserve(numIndices);
+        for (int i = 0; i + 2 < numIndices; i += 3)
+            for (int k = 0; k < 3; ++k)
+            {
+                const int a = indices[i + k];
+                const int b = indices[i + (k + 1) % 3];
+                edges.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+            }
+
+        std::sort(edges.begin(), edges.end());
+
+        // An edge used by a single triangle is on a border.
+        std::vector<bool> isBorderVertex (numVertices, false);
+        for (size_t i = 0; i < edges.size(); )
+        {
+            size_t end = i + 1;
+            while (end < edges.size() && edges[end] == edges[i])
+                ++end;
+
+            if (end - i == 1)
+                isBorderVertex[edges[i].first] = isBorderVertex[edges[i].second] = true;
+            i = end;
+        }
+
+        return isBorderVertex;
+    }
+
+} // Anonymous
+
+void clusterVertices (const uint16_t* indices,
+                      int numIndices,
+                      const float* positions,
+                      int numVertices,
+                      const AxisAlignedBox& bounds,
+                      float cellSize,
+                      VertexClustering& clustering)
+{
+    clustering.vertexClusters.assign(numVertices, -1);
+    clustering.numClusters = 0;
+    clustering.triangles.clear();
+    clustering.maxError = 0.f;
+
+    if (bounds.empty || numIndices < 3 || cellSize <= 0.f)
+        return;
+
+    const std::vector<bool> isBorderVertex = findBorderVertices(indices, numIndices, numVertices);
+
+    std::vector<bool> isReferenced (numVertices, false);
+    for (int i = 0; i < numIndices; ++i)
+        isReferenced[indices[i]] = true;
+
+    int64_t gridSize[3];
+    for (int axis = 0; axis < 3; ++axis)
+        gridSize[axis] = std::max<int64_t>(1, (int64_t)std::ceil((bounds.max[axis] - bounds.min[axis]) / cellSize));
+
+    // Sorted (cell id, vertex) pairs, border vertices get ids past the grid cells.
+    const int64_t numCells = gridSize[0] * gridSize[1] * gridSize[2];
+    const float invCellSize = 1.f / cellSize;
+    std::vector<std::pair<int64_t, int> > cellIdToVertex;
+    cellIdToVertex.reserve(numVertices);
+    for (int v = 0; v < numVertices; ++v)
+    {
+        if (!isReferenced[v])
+            continue;
+
+        if (isBorderVertex[v])
+        {
+            cellIdToVertex.push_back(std::make_pair(numCells + v, v));
+            continue;
+        }
+
+        int64_t cell[3];
+        for (int axis = 0; axis < 3; ++axis)
+            cell[axis] = std::max<int64_t>(0, std::min<int64_t>(gridSize[axis] - 1, (int64_t)((positions[3*v + axis] - bounds.min[axis]) * invCellSize)));
+        cellIdToVertex.push_back(std::make_pair(cell[0] + gridSize[0] * (cell[1] + gridSize[1] * cell[2]), v));
+    }
+
+    std::sort(cellIdToVertex.begin(), cellIdToVertex.end());
+
+    bool mergedVertices = false;
+    for (size_t i = 0; i < cellIdToVertex.size(); )
+    {
+        const int64_t cellId = cellIdToVertex[i].first;
+        const size_t begin = i;
+        for (; i < cellIdToVertex.size() && cellIdToVertex[i].first == cellId; ++i)
+            clustering.vertexClusters[cellIdToVertex[i].second] = clustering.numClusters;
+
+        mergedVertices |= (i - begin > 1);
+        ++clustering.numClusters;
+    }
+
+    // Two vertices of the same cell are at most a cell diagonal apart.
+    if (mergedVertices)
+        clustering.maxError = cellSize * std::sqrt(3.f);
+
+    // Triangles spanning 3 distinct clusters survive, duplicates are dropped regardless of winding.
+    std::vector<ClusterTriangle> clusterTriangles;
+    clusterTriangles.reserve(numIndices / 3);
+    for (int i = 0; i + 2 < numIndices; i += 3)
+    {
+        ClusterTriangle triangle;
+        for (int k = 0; k < 3; ++k)
+            triangle.corners[k] = triangle.key[k] = clustering.vertexClusters[indices[i + k]];
+
+        if (triangle.key[0] == triangle.key[1] || triangle.key[1] == triangle.key[2] || triangle.key[0] == triangle.key[2])
+            continue;
+
+        std::sort(triangle.key, triangle.key + 3);
+        clusterTriangles.push_back(triangle);
+    }
+
+    std::stable_sort(clusterTriangles.begin(), clusterTriangles.end());
+
+    clustering.triangles.reserve(clusterTriangles.size() * 3);
+    for (size_t i = 0; i < clusterTriangles.size(); ++i)
+    {
+        if (i > 0 && clusterTriangles[i].sameKey(clusterTriangles[i - 1]))
+            continue;
+
+        clustering.triangles.insert(clustering.triangles.end(), clusterTriangles[i].corners, clusterTriangles[i].corners + 3);
+    }
+}
+
+float averageEdgeLength (const uint16_t* indices, int numIndices, const float* positions)
+{
+    double sum = 0.0;
+    int numEdges = 0;
+    for (int i = 0; i + 2 < numIndices; i += 3)
+        for (int k = 0; k < 3; ++k)
+        {
+            const float* a = &positions[3*indices[i + k]];
+            const float* b = &positions[3*indices[i + (k + 1) % 3]];
+            const float d[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            sum += std::sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+            ++numEdges;
+        }
+
+    return numEdges > 0 ? float(sum / numEdges) : 0.f;
+}
+
+float simplifyMesh (const uint16_t* indices,
+                    int numIndices,
+                    const float* positions,
+                    int numVertices,
+                    const AxisAlignedBox& bounds,
+                    float cellSize,
+                    std::vector<uint16_t>& simplifiedIndices)
+{
+    VertexClustering clustering;
+    clusterVertices(indices, numIndices, positions, numVertices, bounds, cellSize, clustering);
+
+    std::vector<float> means (clustering.numClusters * 3, 0.f);
+    std::vector<int> counts (clustering.numClusters, 0);
+    for (int v = 0; v < numVertices; ++v)
+    {
+        const int cluster = clustering.vertexClusters[v];
+        if (cluster < 0)
+            continue;
+
+        for (int axis = 0; axis < 3; ++axis)
+            means[3*cluster + axis] += positions[3*v + axis];
+        ++counts[cluster];
+    }
+
+    for (int cluster = 0; cluster < clustering.numClusters; ++cluster)
+        for (int axis = 0; axis < 3; ++axis)
+            means[3*cluster + axis] /= counts[cluster];
+
+    std::vector<int> representatives (clustering.numClusters, -1);
+    std::vector<float> representativeDistances (clustering.numClusters, INFINITY);
+    for (int v = 0; v < numVertices; ++v)
+    {
+        const int cluster = clustering.vertexClusters[v];
+        if (cluster < 0)
+            continue;
+
+        float distance = 0.f;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const float delta = positions[3*v + axis] - means[3*cluster + axis];
+            distance += delta * delta;
+        }
+
+        if (distance < representativeDistances[cluster])
+        {
+            representativeDistances[cluster] = distance;
+            representatives[cluster] = v;
+        }
+    }
+
+    simplifiedIndices.resize(clustering.triangles.size());
+    for (size_t i = 0; i < clustering.triangles.size(); ++i)
+        simplifiedIndices[i] = (uint16_t)representatives[clustering.triangles[i]];
+
+    return clustering.maxError;
+}
+
+void buildLevelsOfDetail (const uint16_t* indices,
+                          int numIndices,
+                          const float* positions,
+                          int numVertices,
+                          const AxisAlignedBox& bounds,
+                          int maxLevels,
+                          std::vector<LevelOfDetail>& levels)
+{
+    levels.clear();
+
+    float cellSize = 2.f * averageEdgeLength(indices, numIndices, positions);
+    if (cellSize <= 0.f)
+        return;
+
+    int previousNumIndices = numIndices;
+    while ((int)levels.size() < maxLevels)
+    {
+        LevelOfDetail level;
+        level.error = simplifyMesh(indices, numIndices, positions, numVertices, bounds, cellSize, level.indices);
+
+        if (level.indices.empty() || (int)level.indices.size() * 4 > previousNumIndices * 3)
+            break;
+
+        previousNumIndices = (int)level.indices.size();
+        levels.push_back(LevelOfDetail());
+        levels.back().indices.swap(level.indices);
+        levels.back().error = level.error;
+
+        cellSize *= 2.f;
+    }
+}
+
+int selectLevelOfDetail (const float* levelErrors,
+                         int numLevels,
+                         const AxisAlignedBox& bounds,
+                         const float projection[16],
+                         const float modelView[16],
+                         float viewportHeight,
+                         float maxPixelError)
+{
+    if (numLevels <= 1 || viewportHeight <= 0.f)
+        return 0;
+
+    // Distance from the eye to the bounding sphere, in eye space.
+    float center[3];
+    float radiusSquared = 0.f;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        center[axis] = 0.5f * (bounds.min[axis] + bounds.max[axis]);
+        const float halfSize = 0.5f * (bounds.max[axis] - bounds.min[axis]);
+        radiusSquared += halfSize * halfSize;
+    }
+
+    float distanceSquared = 0.f;
+    for (int row = 0; row < 3; ++row)
+    {
+        const float eye = modelView[row] * center[0] + modelView[4 + row] * center[1] + modelView[8 + row] * center[2] + modelView[12 + row];
+        distanceSquared += eye * eye;
+    }
+
+    const float distance = std::sqrt(distanceSquared) - std::sqrt(radiusSquared);
+    if (distance <= 0.f)
+        return 0;
+
+    // The projection carries the viewer zoom, and the pixels per unit at this distance follow its y scale.
+    const float pixelsPerUnit = projection[5] * 0.5f * viewportHeight / distance;
+
+    int level = 0;
+    while (level + 1 < numLevels && levelErrors[level + 1] * pixelsPerUnit <= maxPixelError)
+        ++level;
+    return level;
+}
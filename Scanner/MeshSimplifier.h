@@ -0,0 +1,85 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#include "FrustumCulling.h"
+
+#include <cstdint>
+#include <vector>
+
+// Vertex clustering simplification (Rossignac & Borrel 1993) of one mesh chunk, used for the levels
+// of detail and the occluder proxies. Like MeshOptimizer, it works on 16-bit triangle lists and
+// tightly packed xyz float positions, and has no shared state.
+
+struct VertexClustering
+{
+    // Cluster of every vertex, -1 for the vertices not referenced by any triangle.
+    std::vector<int> vertexClusters;
+    int numClusters = 0;
+
+    // Clustered triangles, 3 cluster indices each, without degenerate or duplicate triangles.
+    std::vector<int> triangles;
+
+    // Maximum distance between a vertex and any other vertex of its cluster.
+    float maxError = 0.f;
+};
+
+// Merges the vertices falling in the same cell of a cubic grid of cellSize over bounds. The vertices on
+// the open borders of the chunk are never merged, so that neighbouring chunks simplified separately
+// stay watertight.
+void clusterVertices (const uint16_t* indices,
+                      int numIndices,
+                      const float* positions,
+                      int numVertices,
+                      const AxisAlignedBox& bounds,
+                      float cellSize,
+                      VertexClustering& clustering);
+
+// Average edge length of the triangles, 0 for an empty mesh.
+float averageEdgeLength (const uint16_t* indices, int numIndices, const float* positions);
+
+// Simplified triangles referencing the original vertices: each cluster is represented by its vertex
+// closest to the cluster mean, so the result can share the vertex buffer of the chunk. Returns the
+// distance bound of the simplification, in the units of positions.
+float simplifyMesh (const uint16_t* indices,
+                    int numIndices,
+                    const float* positions,
+                    int numVertices,
+                    const AxisAlignedBox& bounds,
+                    float cellSize,
+                    std::vector<uint16_t>& simplifiedIndices);
+
+struct LevelOfDetail
+{
+    std::vector<uint16_t> indices;
+
+    // Distance bound to the full resolution mesh.
+    float error = 0.f;
+};
+
+// Coarser and coarser simplifications of a chunk, doubling the cell size from twice the average edge
+// length. Stops after maxLevels levels, or when a level would not remove at least a quarter of the
+// triangles of the previous one.
+void buildLevelsOfDetail (const uint16_t* indices,
+                          int numIndices,
+                          const float* positions,
+                          int numVertices,
+                          const AxisAlignedBox& bounds,
+                          int maxLevels,
+                          std::vector<LevelOfDetail>& levels);
+
+// Coarsest level whose error projects to at most maxPixelError pixels, for a chunk of the given bounds
+// drawn with the column-major projection and modelView matrices in a viewport of viewportHeight pixels.
+// levelErrors[0] is the full resolution. The error is projected at the distance of the bounding sphere,
+// and the full resolution is kept when the eye is inside it or the viewport is unknown.
+int selectLevelOfDetail (const float* levelErrors,
+                         int numLevels,
+                         const AxisAlignedBox& bounds,
+                         const float projection[16],
+                         const float modelView[16],
+                         float viewportHeight,
+                         float maxPixelError);
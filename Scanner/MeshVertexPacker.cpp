@@ -0,0 +1,300 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "MeshVertexPacker.h"
+#include "FrustumCulling.h"
+#include "SimdMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Local functions
+namespace
+{
+
+    // Octahedral encoding of 4 normals, ex and ey receive the snorm16 coordinates.
+    void encodeOctahedral4 (SimdFloat4 x, SimdFloat4 y, SimdFloat4 z, int16_t encoded[8])
+    {
+        const SimdFloat4 l1Norm = simdMax(simdAbs(x) + simdAbs(y) + simdAbs(z), simdSplat(1e-20f));
+        const SimdFloat4 invL1Norm = simdReciprocal(l1Norm);
+
+        SimdFloat4 px = x * invL1Norm;
+        SimdFloat4 py = y * invL1Norm;
+
+        // Fold the lower hemisphere over the diagonals.
+        const SimdFloat4 one = simdSplat(1.f);
+        const SimdFloat4 lowerHemisphere = simdLess(z, simdSplat(0.f));
+        const SimdFloat4 foldedX = (one - simdAbs(py)) * simdSignNotZero(px);
+        const SimdFloat4 foldedY = (one - simdAbs(px)) * simdSignNotZero(py);
+        px = simdSelect(lowerHemisphere, foldedX, px);
+        py = simdSelect(lowerHemisphere, foldedY, py);
+
+        const SimdFloat4 scale = simdSplat(32767.f);
+        simdStoreInt16(encoded,
+                       simdRoundToInt(simdClamp(px, -1.f, 1.f) * scale),
+                       simdRoundToInt(simdClamp(py, -1.f, 1.f) * scale));
+    }
+
+    // Packs exactly 4 vertices. Source pointers must have 4 readable vertices.
+    void packBlock (const PackedVertexFormat& format,
+                    const PositionQuantization& quantization,
+                    const float* positions,
+                    const float* normals,
+                    const float* colors,
+                    const float* texcoords,
+                    int numVerticesToWrite,
+                    uint8_t* dst)
+    {
+        if (format.positionType == PackedVertexFormat::PositionFloat32)
+        {
+            for (int i = 0; i < numVerticesToWrite; ++i)
+                memcpy(dst + i*format.stride + format.positionOffset, positions + 3*i, 3*sizeof(float));
+        }
+        else if (format.positionType == PackedVertexFormat::PositionUnorm16)
+        {
+            SimdFloat4 x, y, z;
+            simdLoadDeinterleave3(positions, x, y, z);
+
+            const SimdFloat4 invScale = simdSplat(65535.f / quantization.scale);
+            int32_t qx[4], qy[4], qz[4];
+            simdStoreInt(qx, simdRoundToInt(simdClamp((x - simdSplat(quantization.origin[0])) * invScale, 0.f, 65535.f)));
+            simdStoreInt(qy, simdRoundToInt(simdClamp((y - simdSplat(quantization.origin[1])) * invScale, 0.f, 65535.f)));
+            simdStoreInt(qz, simdRoundToInt(simdClamp((z - simdSplat(quantization.origin[2])) * invScale, 0.f, 65535.f)));
+
+            for (int i = 0; i < numVerticesToWrite; ++i)
+            {
+                const uint16_t q[4] = { (uint16_t)qx[i], (uint16_t)qy[i], (uint16_t)qz[i], 0 };
+                memcpy(dst + i*format.stride + format.positionOffset, q, sizeof(q));
+            }
+        }
+        else if (format.positionType == PackedVertexFormat::PositionFloat16)
+        {
+            SimdFloat4 x, y, z;
+            simdLoadDeinterleave3(positions, x, y, z);
+
+            uint16_t hx[4], hy[4], hz[4];
+            simdStoreHalf(hx, x);
+            simdStoreHalf(hy, y);
+            simdStoreHalf(hz, z);
+
+            const uint16_t hOne = floatToHalf(1.f);
+            for (int i = 0; i < numVerticesToWrite; ++i)
+            {
+                const uint16_t h[4] = { hx[i], hy[i], hz[i], hOne };
+                memcpy(dst + i*format.stride + format.positionOffset, h, sizeof(h));
+            }
+        }
+
+        if (format.hasNormals)
+        {
+            SimdFloat4 x, y, z;
+            simdLoadDeinterleave3(normals, x, y, z);
+
+            int16_t encoded[8];
+            encodeOctahedral4(x, y, z, encoded);
+
+            for (int i = 0; i < numVerticesToWrite; ++i)
+            {
+                const int16_t n[2] = { encoded[i], encoded[4+i] };
+                memcpy(dst + i*format.stride + format.normalOffset, n, sizeof(n));
+            }
+        }
+
+        if (format.hasColors)
+        {
+            SimdFloat4 r, g, b;
+            simdLoadDeinterleave3(colors, r, g, b);
+
+            const SimdFloat4 scale = simdSplat(255.f);
+            int32_t ri[4], gi[4], bi[4];
+            simdStoreInt(ri, simdRoundToInt(simdClamp(r, 0.f, 1.f) * scale));
+            simdStoreInt(gi, simdRoundToInt(simdClamp(g, 0.f, 1.f) * scale));
+            simdStoreInt(bi, simdRoundToInt(simdClamp(b, 0.f, 1.f) * scale));
+
+            for (int i = 0; i < numVerticesToWrite; ++i)
+            {
+                const uint8_t rgba[4] = { (uint8_t)ri[i], (uint8_t)gi[i], (uint8_t)bi[i], 255 };
+                memcpy(dst + i*format.stride + format.colorOffset, rgba, sizeof(rgba));
+            }
+        }
+
+        if (format.hasTexcoords)
+        {
+            SimdFloat4 u, v;
+            simdLoadDeinterleave2(texcoords, u, v);
+
+            uint16_t hu[4], hv[4];
+            simdStoreHalf(hu, u);
+            simdStoreHalf(hv, v);
+
+            for (int i = 0; i < numVerticesToWrite; ++i)
+            {
+                const uint16_t uv[2] = { hu[i], hv[i] };
+                memcpy(dst + i*format.stride + format.texcoordOffset, uv, sizeof(uv));
+            }
+        }
+    }
+
+} // Anonymous
+
+PackedVertexFormat makePackedVertexFormat (PackedVertexFormat::PositionType positionType,
+                                           bool hasNormals,
+                                           bool hasColors,
+                                           bool hasTexcoords)
+{
+    PackedVertexFormat format;
+    format.positionType = positionType;
+    format.hasNormals = hasNormals;
+    format.hasColors = hasColors;
+    format.hasTexcoords = hasTexcoords;
+
+    int offset = 0;
+
+    if (positionType != PackedVertexFormat::PositionNone)
+    {
+        format.positionOffset = offset;
+        offset += (positionType == PackedVertexFormat::PositionFloat32) ? 3*sizeof(float) : 4*sizeof(uint16_t);
+    }
+
+    if (hasNormals)
+    {
+        format.normalOffset = offset;
+        offset += 2*sizeof(int16_t);
+    }
+
+    if (hasColors)
+    {
+        format.colorOffset = offset;
+        offset += 4*sizeof(uint8_t);
+    }
+
+    if (hasTexcoords)
+    {
+        format.texcoordOffset = offset;
+        offset += 2*sizeof(uint16_t);
+    }
+
+    format.stride = offset;
+    return format;
+}
+
+void packVertices (const PackedVertexFormat& format,
+                   int numVertices,
+                   const float* positions,
+                   const float* normals,
+                   const float* colors,
+                   const float* texcoords,
+                   uint8_t* dst,
+                   const PositionQuantization& quantization)
+{
+    const int numFullBlocks = numVertices / 4;
+    const bool hasPositions = (format.positionType != PackedVertexFormat::PositionNone);
+
+    for (int block = 0; block < numFullBlocks; ++block)
+    {
+        const int first = 4*block;
+        packBlock(format,
+                  quantization,
+                  hasPositions ? positions + 3*first : NULL,
+                  format.hasNormals ? normals + 3*first : NULL,
+                  format.hasColors ? colors + 3*first : NULL,
+                  format.hasTexcoords ? texcoords + 2*first : NULL,
+                  4,
+                  dst + first*format.stride);
+    }
+
+    // Copy the last partial block into zero-padded storage so the SIMD loads stay in bounds.
+    const int first = 4*numFullBlocks;
+    const int numRemaining = numVertices - first;
+    if (numRemaining > 0)
+    {
+        float paddedPositions[12] = {};
+        float paddedNormals[12] = {};
+        float paddedColors[12] = {};
+        float paddedTexcoords[8] = {};
+
+        if (hasPositions)
+            memcpy(paddedPositions, positions + 3*first, numRemaining*3*sizeof(float));
+        if (format.hasNormals)
+            memcpy(paddedNormals, normals + 3*first, numRemaining*3*sizeof(float));
+        if (format.hasColors)
+            memcpy(paddedColors, colors + 3*first, numRemaining*3*sizeof(float));
+        if (format.hasTexcoords)
+            memcpy(paddedTexcoords, texcoords + 2*first, numRemaining*2*sizeof(float));
+
+        packBlock(format, quantization, paddedPositions, paddedNormals, paddedColors, paddedTexcoords,
+                  numRemaining, dst + first*format.stride);
+    }
+}
+
+PositionQuantization computePositionQuantization (const float* positions, int numVertices)
+{
+    return computePositionQuantization(computeAxisAlignedBox(positions, numVertices));
+}
+
+PositionQuantization computePositionQuantization (const AxisAlignedBox& box)
+{
+    PositionQuantization quantization;
+    if (box.empty)
+        return quantization;
+
+    float extent = 0.f;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        quantization.origin[axis] = box.min[axis];
+        extent = std::max(extent, box.max[axis] - box.min[axis]);
+    }
+
+    // Degenerate chunks (single vertex) still need an invertible transform.
+    quantization.scale = std::max(extent, 1e-6f);
+    return quantization;
+}
+
+float positionQuantizationErrorBound (const PositionQuantization& quantization)
+{
+    // Rounding is off by at most half a step on each axis.
+    const float halfStep = 0.5f * quantization.scale / 65535.f;
+    return std::sqrt(3.f) * halfStep;
+}
+
+void encodeOctahedralNormal (const float normal[3], int16_t encoded[2])
+{
+    const float l1Norm = std::max(std::abs(normal[0]) + std::abs(normal[1]) + std::abs(normal[2]), 1e-20f);
+    float px = normal[0] / l1Norm;
+    float py = normal[1] / l1Norm;
+
+    if (normal[2] < 0.f)
+    {
+        const float foldedX = (1.f - std::abs(py)) * (px < 0.f ? -1.f : 1.f);
+        const float foldedY = (1.f - std::abs(px)) * (py < 0.f ? -1.f : 1.f);
+        px = foldedX;
+        py = foldedY;
+    }
+
+    encoded[0] = (int16_t)std::lround(std::min(std::max(px, -1.f), 1.f) * 32767.f);
+    encoded[1] = (int16_t)std::lround(std::min(std::max(py, -1.f), 1.f) * 32767.f);
+}
+
+void decodeOctahedralNormal (const int16_t encoded[2], float normal[3])
+{
+    float x = std::max(encoded[0] / 32767.f, -1.f);
+    float y = std::max(encoded[1] / 32767.f, -1.f);
+    const float z = 1.f - std::abs(x) - std::abs(y);
+
+    if (z < 0.f)
+    {
+        const float unfoldedX = (1.f - std::abs(y)) * (x < 0.f ? -1.f : 1.f);
+        const float unfoldedY = (1.f - std::abs(x)) * (y < 0.f ? -1.f : 1.f);
+        x = unfoldedX;
+        y = unfoldedY;
+    }
+
+    const float length = std::sqrt(x*x + y*y + z*z);
+    normal[0] = x / length;
+    normal[1] = y / length;
+    normal[2] = z / length;
+}
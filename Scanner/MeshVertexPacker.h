@@ -0,0 +1,82 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct AxisAlignedBox;
+
+// Interleaved vertex layout uploaded by MeshRenderer. Every attribute starts on a 4-byte boundary:
+//   position:  3 x float32, 4 x float16 (w = 1), 3 x unorm16 + 2 padding bytes, or none
+//   normal:    2 x snorm16, octahedral encoding
+//   color:     4 x unorm8, RGBA with opaque alpha
+//   texcoords: 2 x float16
+struct PackedVertexFormat
+{
+    enum PositionType
+    {
+        PositionFloat32 = 0,
+        PositionFloat16,
+
+        // Relative to a chunk or mesh bounding cube, see PositionQuantization.
+        PositionUnorm16,
+
+        // For a separate stream of the other attributes.
+        PositionNone,
+    };
+
+    PositionType positionType = PositionFloat32;
+
+    bool hasNormals = false;
+    bool hasColors = false;
+    bool hasTexcoords = false;
+
+    // Byte offsets inside a vertex, -1 if the attribute is absent.
+    int positionOffset = -1;
+    int normalOffset = -1;
+    int colorOffset = -1;
+    int texcoordOffset = -1;
+
+    int stride = 0;
+};
+
+// Maps the bounding cube of a chunk to [0,1]^3: position = origin + scale * unorm16.
+// A cube rather than a box keeps the dequantization a uniform scale, so normals can still
+// be transformed by the upper 3x3 of the modelview matrix.
+struct PositionQuantization
+{
+    float origin[3] = { 0.f, 0.f, 0.f };
+    float scale = 1.f;
+};
+
+PositionQuantization computePositionQuantization (const float* positions, int numVertices);
+PositionQuantization computePositionQuantization (const AxisAlignedBox& box);
+
+// Largest distance between an original and a dequantized position, in position units.
+float positionQuantizationErrorBound (const PositionQuantization& quantization);
+
+PackedVertexFormat makePackedVertexFormat (PackedVertexFormat::PositionType positionType,
+                                           bool hasNormals,
+                                           bool hasColors,
+                                           bool hasTexcoords);
+
+// Source arrays are tightly packed xyz (positions, normals, rgb colors in [0,1]) and uv floats,
+// like the STMesh per-chunk arrays. Attributes absent from the format are ignored and may be NULL.
+// quantization is only used by PositionUnorm16. dst must hold numVertices * format.stride bytes.
+void packVertices (const PackedVertexFormat& format,
+                   int numVertices,
+                   const float* positions,
+                   const float* normals,
+                   const float* colors,
+                   const float* texcoords,
+                   uint8_t* dst,
+                   const PositionQuantization& quantization = PositionQuantization());
+
+// Octahedral normal encoding, exposed for the shaders' reference and for debugging.
+void encodeOctahedralNormal (const float normal[3], int16_t encoded[2]);
+void decodeOctahedralNormal (const int16_t encoded[2], float normal[3]);
@@ -25,6 +25,7 @@
 @property (nonatomic) BOOL needsDisplay; // force the view to redraw.
 @property (nonatomic) BOOL colorEnabled;
 @property (nonatomic) STMesh * mesh;
+@property (nonatomic) float voxelSizeInMeters; // used to validate the vertex position quantization.
 
 @property (weak, nonatomic) IBOutlet UISegmentedControl *displayControl;
 @property (weak, nonatomic) IBOutlet UILabel *meshViewerMessageLabel;
@@ -6,54 +6,144 @@
 
 #import "MeshViewController.h"
 #import "MeshRenderer.h"
+#import "MeshBvh.h"
+#import "FramePipeline.h"
+#import "ImageResampler.h"
+#import "JpegEncoder.h"
+#import "OffscreenTargetPool.h"
+#import "TiledImageWriter.h"
+#import "VideoFileWriter.h"
 #import "ViewpointController.h"
 #import "CustomUIKitStyles.h"
 
 #import <UIKit/UIAlertView.h>
-#import <ImageIO/ImageIO.h>
 
+#include <mach/mach.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
 #include <vector>
 
 // Local Helper Functions
 namespace
 {
     
-    void saveJpegFromRGBABuffer(const char* filename, unsigned char* src_buffer, int width, int height)
+    // Meshes with at least this many vertices are drawn as points until all their triangles are uploaded.
+    const int kMinVerticesForPointsPreview = 1000000;
+    
+    // The screenshots of a mesh, from the largest one, which is rendered, the others being downsampled
+    // from it. 4:3 like the screen viewport.
+    struct ScreenShotSize
     {
-        FILE *file = fopen(filename, "w");
-        if(!file)
-            return;
+        int width;
+        int height;
+        const char* filename;
+    };
+    
+    const ScreenShotSize kScreenShotSizes[] = {
+        { 1024, 768, "PreviewLarge.jpg" },
+        { 320, 240, "Preview.jpg" },
+        { 64, 48, "PreviewIcon.jpg" },
+    };
+    
+    const int kNumScreenShotSizes = sizeof(kScreenShotSizes) / sizeof(kScreenShotSizes[0]);
+    
+    // The -MeshHighResolutionExport launch argument renders the mesh at this size for prints, in tiles
+    // of this size: the strips of one tile height are the most of the image kept in memory.
+    const int kHighResolutionWidth = 8192;
+    const int kHighResolutionHeight = 6144;
+    const int kHighResolutionTileWidth = 2048;
+    const int kHighResolutionTileHeight = 256;
+    
+    // Tiles rendered ahead of the one being read back and encoded.
+    const int kMaxExportTilesInFlight = 2;
+    
+    // A tiled export in progress, shared by the rendering steps on the main thread and the encoding queue.
+    struct TiledExport
+    {
+        std::unique_ptr<TiledImageWriter> writer;
+        FILE* file = nullptr;
+        dispatch_queue_t encodingQueue;
+        
+        GLKMatrix4 projectionMatrix;
+        GLKMatrix4 modelViewMatrix;
+        
+        // Main thread.
+        int nextTile = 0;
+        int nextTileToRead = 0;
+        int numTilesInFlight = 0;
+        bool cancelled = false;
+        bool finishing = false;
+        size_t peakTargetBytes = 0;
+        
+        // Encoding queue.
+        size_t numOutputBytes = 0;
+        size_t peakWriterBytes = 0;
+        size_t startFootprint = 0;
+        size_t peakFootprint = 0;
+        
+        CFTimeInterval startTime = 0;
+    };
+    
+    // The -MeshTurntableExport launch argument records one turn of the mesh in this many frames, with
+    // this many frames in flight between the rendering and the encoder.
+    const int kTurntableWidth = 960;
+    const int kTurntableHeight = 720;
+    const int kTurntableNumFrames = 120;
+    const int kTurntableFramesPerSecond = 30;
+    const int kTurntableNumSlots = 3;
+    
+    // A turntable export in progress. The frames are rendered on the main thread, then read back,
+    // converted and encoded by the stages of the pipeline, each on its own thread.
+    struct TurntableExport
+    {
+        // The buffers of a frame in flight.
+        struct Slot
+        {
+            int target = -1;
+            CVPixelBufferRef renderedPixels = NULL;
+            GLsync fence = 0;
+            CVPixelBufferRef videoFrame = NULL;
+        };
         
-        CGColorSpaceRef colorSpace;
-        CGImageAlphaInfo alphaInfo;
-        CGContextRef context;
+        std::unique_ptr<FramePipeline> pipeline;
+        std::vector<Slot> slots;
+        VideoFileWriter writer;
         
-        colorSpace = CGColorSpaceCreateDeviceRGB();
-        alphaInfo = kCGImageAlphaNoneSkipLast;
-        context = CGBitmapContextCreate(src_buffer, width, height, 8, width * 4, colorSpace, alphaInfo);
-        CGImageRef rgbImage = CGBitmapContextCreateImage(context);
+        // Same sharegroup as the context of the viewer, to wait on the fences from the readback stage.
+        EAGLContext* readbackContext;
         
-        CGContextRelease(context);
-        CGColorSpaceRelease(colorSpace);
+        // The orbit from the viewpoint when the export started.
+        GLKMatrix4 projectionMatrix;
+        std::vector<GLKMatrix4> modelViewMatrices;
         
-        CFMutableDataRef jpgData = CFDataCreateMutable(NULL, 0);
+        // Main thread.
+        int nextFrame = 0;
+        bool cancelled = false;
         
-        CGImageDestinationRef imageDest = CGImageDestinationCreateWithData(jpgData, CFSTR("public.jpeg"), 1, NULL);
-        CFDictionaryRef options = CFDictionaryCreate(kCFAllocatorDefault, // Our empty IOSurface properties dictionary
-                                                     NULL,
-                                                     NULL,
-                                                     0,
-                                                     &kCFTypeDictionaryKeyCallBacks,
-                                                     &kCFTypeDictionaryValueCallBacks);
-        CGImageDestinationAddImage(imageDest, rgbImage, (CFDictionaryRef)options);
-        CGImageDestinationFinalize(imageDest);
-        CFRelease(imageDest);
-        CFRelease(options);
-        CGImageRelease(rgbImage);
+        // Encoding stage.
+        bool failed = false;
         
-        fwrite(CFDataGetBytePtr(jpgData), 1, CFDataGetLength(jpgData), file);
-        fclose(file);
-        CFRelease(jpgData);
+        CFTimeInterval startTime = 0;
+    };
+    
+    // The memory iOS counts against the limit of the app.
+    size_t physicalFootprint ()
+    {
+        task_vm_info_data_t info;
+        mach_msg_type_number_t count = TASK_VM_INFO_COUNT;
+        if (task_info(mach_task_self(), TASK_VM_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+            return 0;
+        return (size_t)info.phys_footprint;
+    }
+    
+    // ParallelFor over the global queue.
+    void dispatchApply (int numJobs, const std::function<void (int)>& job)
+    {
+        dispatch_apply(numJobs, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t index) {
+            job((int)index);
+        });
     }
     
 }
@@ -68,6 +158,27 @@ namespace
     
     GLKMatrix4 _modelViewMatrixBeforeUserInteractions;
     GLKMatrix4 _projectionMatrixBeforeUserInteractions;
+    
+    // GL call count of the last logged frame, to report changes only.
+    int _lastLoggedNumGLCalls;
+    
+    // The mesh being uploaded is large enough for the points preview.
+    bool _previewAsPoints;
+    
+    // The display link is paused while there is nothing to draw. Callbacks that found nothing to draw
+    // since the last resume, and when the first one happened.
+    int _numIdleWakeups;
+    CFTimeInterval _idleStartTime;
+    
+    // Ray queries on the current mesh, null until its background build finished.
+    std::shared_ptr<MeshBvh> _meshBvh;
+    
+    // Screenshot targets, read back asynchronously.
+    OffscreenTargetPool _offscreenTargets;
+    
+    // Each mesh upload may ask for an export, only one of each kind runs at a time.
+    bool _highResolutionExportInProgress;
+    bool _turntableExportInProgress;
 }
 
 @property MFMailComposeViewController *mailViewController;
@@ -126,6 +237,13 @@ namespace
     [twoFingersPanGesture setMaximumNumberOfTouches:2];
     [twoFingersPanGesture setMinimumNumberOfTouches:2];
     [self.view addGestureRecognizer:twoFingersPanGesture];
+    
+    // We'll use a tap to orbit around the tapped point.
+    UITapGestureRecognizer *tapGesture = [[UITapGestureRecognizer alloc]
+                                          initWithTarget:self
+                                          action:@selector(tapGesture:)];
+    [tapGesture setDelegate:self];
+    [self.view addGestureRecognizer:tapGesture];
 }
 
 - (void)viewDidLoad
@@ -137,7 +255,9 @@ namespace
     
     [self.meshViewerMessageLabel applyCustomStyleWithBackgroundColor:blackLabelColorWithLightAlpha];
     
-    _renderer = new MeshRenderer();    
+    _renderer = new MeshRenderer();
+    _renderer->setPositionQuantizationEnabled(true);
+    
     _viewpointController = new ViewpointController(self.view.frame.size.width,
                                                    self.view.frame.size.height);
     
@@ -174,6 +294,7 @@ namespace
     
     _displayLink = [CADisplayLink displayLinkWithTarget:self selector:@selector(draw)];
     [_displayLink addToRunLoop:[NSRunLoop mainRunLoop] forMode:NSRunLoopCommonModes];
+    _numIdleWakeups = 0;
     
     _viewpointController->reset();
 
@@ -192,6 +313,7 @@ namespace
 - (void)setupGL
 {
     _renderer->initializeGL();
+    _offscreenTargets.initializeGL();
     
     int framebufferWidth, framebufferHeight;
     glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_WIDTH, &framebufferWidth);
@@ -210,6 +332,8 @@ namespace
     _glViewport[1] = 0;
     _glViewport[2] = framebufferWidth*imageAspectRatio;
     _glViewport[3] = framebufferHeight;
+    
+    _renderer->setLevelOfDetailViewport(_glViewport[3]);
 }
 
 - (void)dismissView
@@ -221,6 +345,9 @@ namespace
     _renderer->releaseGLBuffers();
     _renderer->releaseGLTextures();
     
+    // The readbacks still in flight find their handles stale and give up.
+    _offscreenTargets.deleteTargets();
+    
     [_displayLink invalidate];
     _displayLink = nil;
     
@@ -253,51 +380,546 @@ namespace
 {
     _mesh = meshRef;
     
+    int numVertices = 0;
+    for (int meshIndex = 0; meshIndex < [meshRef numberOfMeshes]; ++meshIndex)
+        numVertices += [meshRef numberOfMeshVertices:meshIndex];
+    _previewAsPoints = (numVertices >= kMinVerticesForPointsPreview);
+    
+    // The chunks are uploaded by the next draws, see meshUploadDidFinish.
     _renderer->uploadMesh(meshRef);
     
+    [self buildMeshBvh:meshRef];
+    
     [self trySwitchToColorRenderingMode];
     
     self.needsDisplay = TRUE;
 }
 
-#pragma mark - Email Mesh OBJ file
+- (void)meshUploadDidFinish
+{
+    MeshRenderer::UploadStatistics uploadStatistics = _renderer->lastUploadStatistics();
+    NSLog(@"Mesh viewer: mesh uploaded in %.1f ms over %d frames, worst frame %.1f ms, %.2f MB sent to the GPU (%d of %d chunks kept their geometry).",
+          uploadStatistics.totalSeconds * 1000.0, uploadStatistics.numFrames, uploadStatistics.worstFrameSeconds * 1000.0,
+          uploadStatistics.numUploadedBytes / 1e6, uploadStatistics.numReusedGeometryChunks, uploadStatistics.numChunks);
+    
+    // The quantization error has to stay well below the reconstruction resolution to be invisible.
+    float quantizationError = _renderer->maxPositionQuantizationError();
+    if (self.voxelSizeInMeters > 0 && quantizationError > 0.5f * self.voxelSizeInMeters)
+    {
+        NSLog(@"Warning: vertex position quantization error (%.3f mm) exceeds half the voxel size (%.3f mm).",
+              quantizationError * 1000.f, self.voxelSizeInMeters * 1000.f);
+    }
+    else
+    {
+        NSLog(@"Vertex position quantization error: %.3f mm (voxel size %.3f mm).",
+              quantizationError * 1000.f, self.voxelSizeInMeters * 1000.f);
+    }
+    
+    // Launched with the -MeshRendererBenchmark YES argument, e.g. from the Xcode scheme.
+    if ([[NSUserDefaults standardUserDefaults] boolForKey:@"MeshRendererBenchmark"])
+    {
+        _renderer->runBenchmark(_mesh, _viewpointController->currentGLProjectionMatrix(),
+                                _viewpointController->currentGLModelViewMatrix());
+        self.needsDisplay = TRUE;
+    }
+    
+    // Launched with the -MeshHighResolutionExport YES argument. Started once the current screenshot or
+    // frame is done, this can be called while they render.
+    if ([[NSUserDefaults standardUserDefaults] boolForKey:@"MeshHighResolutionExport"])
+    {
+        NSString* documentDirectory = [NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES) objectAtIndex:0];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self exportHighResolutionImage:[documentDirectory stringByAppendingPathComponent:@"PreviewPrint.jpg"]];
+        });
+    }
+    
+    // Launched with the -MeshTurntableExport YES argument, the same way.
+    if ([[NSUserDefaults standardUserDefaults] boolForKey:@"MeshTurntableExport"])
+    {
+        NSString* documentDirectory = [NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES) objectAtIndex:0];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self exportTurntableVideo:[documentDirectory stringByAppendingPathComponent:@"Turntable.mp4"]];
+        });
+    }
+}
 
-- (void)mailComposeController:(MFMailComposeViewController *)controller
-          didFinishWithResult:(MFMailComposeResult)result
-                        error:(NSError *)error
+- (void)buildMeshBvh:(STMesh *)meshRef
 {
-    [self.mailViewController dismissViewControllerAnimated:YES completion:nil];
+    _meshBvh.reset();
+    
+    // Gather the chunk arrays here, STMesh is not accessed by the build. The block retains the mesh,
+    // which keeps them alive.
+    std::vector<MeshBvh::MeshChunk> chunks ([meshRef numberOfMeshes]);
+    for (int meshIndex = 0; meshIndex < (int)chunks.size(); ++meshIndex)
+    {
+        MeshBvh::MeshChunk& chunk = chunks[meshIndex];
+        chunk.positions = reinterpret_cast<const float*>([meshRef meshVertices:meshIndex]);
+        chunk.numVertices = [meshRef numberOfMeshVertices:meshIndex];
+        chunk.indices = [meshRef meshFaces:meshIndex];
+        chunk.numIndices = 3 * [meshRef numberOfMeshFaces:meshIndex];
+    }
+    
+    if (chunks.empty())
+        return;
+    
+    // Launched with the -MeshRendererBenchmark YES argument, the rays of a 256x256 grid over the current
+    // view are timed once built.
+    std::vector<GLKVector3> benchmarkRays;
+    if ([[NSUserDefaults standardUserDefaults] boolForKey:@"MeshRendererBenchmark"])
+    {
+        const int gridSize = 256;
+        benchmarkRays.resize (2 * gridSize * gridSize);
+        for (int y = 0; y < gridSize; ++y)
+            for (int x = 0; x < gridSize; ++x)
+            {
+                GLKVector2 point = GLKVector2Make((x + 0.5f) / gridSize, (y + 0.5f) / gridSize);
+                GLKVector3* ray = &benchmarkRays[2 * (y * gridSize + x)];
+                _viewpointController->viewportRay(point, GLKVector2Make(1, 1), ray[0], ray[1]);
+            }
+    }
+    
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        std::shared_ptr<MeshBvh> meshBvh = std::make_shared<MeshBvh>();
+        meshBvh->setParallelFor(dispatchApply);
+        
+        const double buildStartTime = CACurrentMediaTime();
+        meshBvh->build(chunks);
+        
+        const MeshBvh::BuildStatistics& statistics = meshBvh->buildStatistics();
+        NSLog(@"Mesh viewer: ray queries BVH built in %.1f ms, %d triangles, %d nodes, %d leaves, depth %d, %.2f MB.",
+              (CACurrentMediaTime() - buildStartTime) * 1000.0, statistics.numTriangles, statistics.numNodes,
+              statistics.numLeaves, statistics.maxDepth, statistics.numBytes / 1e6);
+        
+        if (!benchmarkRays.empty())
+        {
+            const int numRays = (int)benchmarkRays.size() / 2;
+            int numHits = 0;
+            const double raysStartTime = CACurrentMediaTime();
+            for (int ray = 0; ray < numRays; ++ray)
+            {
+                const GLKVector3 origin = benchmarkRays[2 * ray];
+                const GLKVector3 direction = GLKVector3Subtract(benchmarkRays[2 * ray + 1], origin);
+                MeshBvh::RayHit hit;
+                numHits += meshBvh->intersect(origin.v, direction.v, 1.f, hit);
+            }
+            const double raysSeconds = CACurrentMediaTime() - raysStartTime;
+            NSLog(@"Mesh viewer: %d rays in %.1f ms on one thread, %.2f M rays/s, %.0f%% hit the mesh.",
+                  numRays, raysSeconds * 1000.0, numRays / raysSeconds / 1e6, 100.0 * numHits / numRays);
+        }
+        
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (self.mesh == meshRef)
+                self->_meshBvh = meshBvh;
+        });
+    });
 }
 
-- (void)prepareScreenShot:(NSString*)screenshotPath
+#pragma mark - High resolution export
+
+// Renders the initial viewpoint of the screenshots at print resolution, in tiles with sub-frusta of its
+// projection, each one rendered into a pooled target. The tiles are read back and encoded strip by strip
+// on a serial queue while the next ones render, so that the whole image is never in memory.
+- (void)exportHighResolutionImage:(NSString*)path
 {
-    const int width = 320;
-    const int height = 240;
+    if (_highResolutionExportInProgress)
+    {
+        NSLog(@"Mesh viewer: high resolution export already in progress, %@ skipped.", path);
+        return;
+    }
+    
+    std::shared_ptr<TiledExport> tiledExport = std::make_shared<TiledExport>();
+    
+    tiledExport->file = fopen([path UTF8String], "wb");
+    if (!tiledExport->file)
+    {
+        NSLog(@"Mesh viewer: could not open %@ for the high resolution export.", path);
+        return;
+    }
+    
+    _highResolutionExportInProgress = true;
+    
+    // The tiles have to fit in a renderbuffer.
+    GLint maxRenderbufferSize;
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbufferSize);
+    const int tileWidth = std::min<int>(kHighResolutionTileWidth, maxRenderbufferSize);
+    const int tileHeight = std::min<int>(kHighResolutionTileHeight, maxRenderbufferSize);
+    
+    // The writer outlives its output, both belong to the export.
+    TiledExport* exportData = tiledExport.get();
+    tiledExport->writer.reset(new TiledImageWriter(kHighResolutionWidth, kHighResolutionHeight, tileWidth, tileHeight, true, 95,
+                                                   [exportData](const uint8_t* data, size_t size) {
+        exportData->numOutputBytes += size;
+        return fwrite(data, 1, size, exportData->file) == size;
+    }));
+    
+    tiledExport->encodingQueue = dispatch_queue_create("MeshViewController.highResolutionExport", DISPATCH_QUEUE_SERIAL);
+    tiledExport->projectionMatrix = _projectionMatrixBeforeUserInteractions;
+    tiledExport->modelViewMatrix = _modelViewMatrixBeforeUserInteractions;
+    tiledExport->startFootprint = physicalFootprint();
+    tiledExport->peakFootprint = tiledExport->startFootprint;
+    tiledExport->startTime = CACurrentMediaTime();
+    
+    [self renderNextExportTile:tiledExport];
+}
+
+// Renders the next tile unless enough are already waiting for their readback, and finishes the export
+// once all of them are encoded.
+- (void)renderNextExportTile:(std::shared_ptr<TiledExport>)tiledExport
+{
+    TiledImageWriter& writer = *tiledExport->writer;
+    const int numTiles = (int)writer.tiles().size();
+    
+    // The mesh viewer was dismissed.
+    if (!_mesh)
+        tiledExport->cancelled = true;
+    
+    if (tiledExport->cancelled || tiledExport->nextTile == numTiles)
+    {
+        if (tiledExport->numTilesInFlight == 0 && !tiledExport->finishing)
+        {
+            tiledExport->finishing = true;
+            [self finishTiledExport:tiledExport];
+        }
+        return;
+    }
+    
+    if (tiledExport->numTilesInFlight >= kMaxExportTilesInFlight)
+        return;
+    
+    const int tile = tiledExport->nextTile;
+    const TiledImageWriter::Tile& region = writer.tiles()[tile];
     
     GLint currentFrameBuffer;
     glGetIntegerv(GL_FRAMEBUFFER_BINDING, &currentFrameBuffer);
     
-    // Create temp texture, framebuffer, renderbuffer
-    glViewport(0, 0, width, height);
+    // All the tiles share the targets of the full tile size, the smaller edge tiles use their bottom left corner.
+    const TiledImageWriter::Tile& fullTile = writer.tiles()[0];
+    const int target = _offscreenTargets.acquire(fullTile.width, fullTile.height);
+    if (target < 0)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, currentFrameBuffer);
+        tiledExport->cancelled = true;
+        [self renderNextExportTile:tiledExport];
+        return;
+    }
+    
+    glViewport(0, 0, region.width, region.height);
+    
+    // The levels of detail follow the pixels of the whole image: the tile projection scales by the
+    // ratio of the image and tile heights.
+    float tileProjection[16];
+    writer.tileProjection(tiledExport->projectionMatrix.m, tile, tileProjection);
+    _renderer->setLevelOfDetailViewport(region.height);
+    [self renderScreenShotWithProjection:GLKMatrix4MakeWithArray(tileProjection) modelView:tiledExport->modelViewMatrix];
+    _renderer->setLevelOfDetailViewport(_glViewport[3]);
+    
+    _offscreenTargets.finishRendering(target);
+    
+    // Back to the original frame buffer
+    glBindFramebuffer(GL_FRAMEBUFFER, currentFrameBuffer);
+    glViewport(_glViewport[0], _glViewport[1], _glViewport[2], _glViewport[3]);
+    
+    ++tiledExport->nextTile;
+    ++tiledExport->numTilesInFlight;
+    tiledExport->peakTargetBytes = std::max(tiledExport->peakTargetBytes, _offscreenTargets.statistics().numBytes);
+    
+    [self readExportTile:tile target:target tiledExport:tiledExport];
+    
+    // The next tile renders while this one is read back, the viewer still draws in between.
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [self renderNextExportTile:tiledExport];
+    });
+}
+
+// Waits for the fence of the tile without blocking, then adds it to the image on the encoding queue.
+// The tiles are read in order, the strips are encoded from the top.
+- (void)readExportTile:(int)tile target:(int)target tiledExport:(std::shared_ptr<TiledExport>)tiledExport
+{
+    if (tile != tiledExport->nextTileToRead || !_offscreenTargets.isReadable(target))
+    {
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, 2 * NSEC_PER_MSEC), dispatch_get_main_queue(), ^{
+            [self readExportTile:tile target:target tiledExport:tiledExport];
+        });
+        return;
+    }
+    
+    ++tiledExport->nextTileToRead;
+    
+    // The targets were deleted by dismissView meanwhile.
+    CVPixelBufferRef pixelBuffer = CVPixelBufferRetain(_offscreenTargets.pixelBuffer(target));
+    if (!pixelBuffer)
+    {
+        tiledExport->cancelled = true;
+        --tiledExport->numTilesInFlight;
+        [self renderNextExportTile:tiledExport];
+        return;
+    }
+    
+    dispatch_async(tiledExport->encodingQueue, ^{
+        
+        CVPixelBufferLockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
+        tiledExport->writer->addTile(tile, static_cast<const uint8_t*>(CVPixelBufferGetBaseAddress(pixelBuffer)),
+                                     CVPixelBufferGetBytesPerRow(pixelBuffer), true);
+        CVPixelBufferUnlockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
+        CVPixelBufferRelease(pixelBuffer);
+        
+        tiledExport->peakWriterBytes = std::max(tiledExport->peakWriterBytes, tiledExport->writer->numBufferedBytes());
+        tiledExport->peakFootprint = std::max(tiledExport->peakFootprint, physicalFootprint());
+        
+        dispatch_async(dispatch_get_main_queue(), ^{
+            _offscreenTargets.release(target);
+            --tiledExport->numTilesInFlight;
+            [self renderNextExportTile:tiledExport];
+        });
+    });
+}
+
+- (void)finishTiledExport:(std::shared_ptr<TiledExport>)tiledExport
+{
+    dispatch_async(tiledExport->encodingQueue, ^{
+        
+        bool success = !tiledExport->cancelled && tiledExport->writer->finish();
+        success = (fclose(tiledExport->file) == 0) && success;
+        tiledExport->file = nullptr;
+        
+        const CFTimeInterval seconds = CACurrentMediaTime() - tiledExport->startTime;
+        
+        dispatch_async(dispatch_get_main_queue(), ^{
+            _highResolutionExportInProgress = false;
+            
+            TiledImageWriter& writer = *tiledExport->writer;
+            if (!success)
+            {
+                NSLog(@"Mesh viewer: high resolution export failed after %d of %d tiles.",
+                      writer.numAddedTiles(), (int)writer.tiles().size());
+                return;
+            }
+            
+            NSLog(@"Mesh viewer: %dx%d image exported in %.1f s, %d tiles of %dx%d, %.1f MB of JPEG. Peak memory: %.1f MB of tile targets and %.1f MB of strip and encoder buffers instead of %.1f MB for the whole image, footprint +%.1f MB.",
+                  writer.width(), writer.height(), seconds, (int)writer.tiles().size(), writer.tiles()[0].width, writer.tiles()[0].height,
+                  tiledExport->numOutputBytes / 1e6, tiledExport->peakTargetBytes / 1e6, tiledExport->peakWriterBytes / 1e6,
+                  writer.width() * 4.0 * writer.height() / 1e6, (double(tiledExport->peakFootprint) - tiledExport->startFootprint) / 1e6);
+        });
+    });
+}
+
+#pragma mark - Turntable video export
+
+// Records one turn of the mesh around the vertical axis through the orbit center, from the current
+// viewpoint. The frames go through a FramePipeline: rendered into the pooled target of their slot on the
+// main thread, then read back once their fence passed, converted to NV12 and encoded to H.264 by the
+// stages of the pipeline, so that the GPU renders the next frames while the encoder takes the previous
+// ones.
+- (void)exportTurntableVideo:(NSString*)path
+{
+    if (_turntableExportInProgress)
+    {
+        NSLog(@"Mesh viewer: turntable export already in progress, %@ skipped.", path);
+        return;
+    }
+    
+    std::shared_ptr<TurntableExport> turntable = std::make_shared<TurntableExport>();
+    
+    if (!turntable->writer.open(path, kTurntableWidth, kTurntableHeight, kTurntableFramesPerSecond))
+    {
+        NSLog(@"Mesh viewer: could not open %@ for the turntable export.", path);
+        return;
+    }
+    
+    _turntableExportInProgress = true;
+    
+    EAGLContext* context = [EAGLContext currentContext];
+    turntable->readbackContext = [[EAGLContext alloc] initWithAPI:context.API sharegroup:context.sharegroup];
+    
+    GLint currentFrameBuffer;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &currentFrameBuffer);
+    
+    // Every slot keeps its target for the whole export.
+    turntable->slots.resize(kTurntableNumSlots);
+    for (TurntableExport::Slot& slot : turntable->slots)
+    {
+        slot.target = _offscreenTargets.acquire(kTurntableWidth, kTurntableHeight);
+        if (slot.target < 0)
+            break;
+        slot.renderedPixels = CVPixelBufferRetain(_offscreenTargets.pixelBuffer(slot.target));
+    }
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, currentFrameBuffer);
+    
+    turntable->projectionMatrix = _viewpointController->currentGLProjectionMatrix();
+    for (int frame = 0; frame < kTurntableNumFrames; ++frame)
+    {
+        const float angle = 2.f * M_PI * frame / kTurntableNumFrames;
+        turntable->modelViewMatrices.push_back(_viewpointController->turntableModelViewMatrix(angle));
+    }
+    
+    // The stages belong to the export, which outlives the pipeline.
+    TurntableExport* exportData = turntable.get();
+    turntable->pipeline.reset(new FramePipeline(kTurntableNumSlots, "render"));
+    
+    // Waits for the GPU to finish the frame, the pixels are then readable in place.
+    turntable->pipeline->addStage("readback", [exportData](int slot, int /*frame*/) {
+        TurntableExport::Slot& frameSlot = exportData->slots[slot];
+        if (frameSlot.fence)
+        {
+            [EAGLContext setCurrentContext:exportData->readbackContext];
+            glClientWaitSyncAPPLE(frameSlot.fence, 0, GL_TIMEOUT_IGNORED_APPLE);
+            glDeleteSyncAPPLE(frameSlot.fence);
+            frameSlot.fence = 0;
+            [EAGLContext setCurrentContext:nil];
+        }
+        CVPixelBufferLockBaseAddress(frameSlot.renderedPixels, kCVPixelBufferLock_ReadOnly);
+    });
+    
+    turntable->pipeline->addStage("conversion", [exportData](int slot, int /*frame*/) {
+        TurntableExport::Slot& frameSlot = exportData->slots[slot];
+        frameSlot.videoFrame = exportData->writer.createPixelBuffer();
+        if (frameSlot.videoFrame)
+        {
+            CVPixelBufferLockBaseAddress(frameSlot.videoFrame, 0);
+            convertToNv12(static_cast<const uint8_t*>(CVPixelBufferGetBaseAddress(frameSlot.renderedPixels)),
+                          kTurntableWidth, kTurntableHeight, CVPixelBufferGetBytesPerRow(frameSlot.renderedPixels), true, true,
+                          static_cast<uint8_t*>(CVPixelBufferGetBaseAddressOfPlane(frameSlot.videoFrame, 0)),
+                          CVPixelBufferGetBytesPerRowOfPlane(frameSlot.videoFrame, 0),
+                          static_cast<uint8_t*>(CVPixelBufferGetBaseAddressOfPlane(frameSlot.videoFrame, 1)),
+                          CVPixelBufferGetBytesPerRowOfPlane(frameSlot.videoFrame, 1));
+            CVPixelBufferUnlockBaseAddress(frameSlot.videoFrame, 0);
+        }
+        CVPixelBufferUnlockBaseAddress(frameSlot.renderedPixels, kCVPixelBufferLock_ReadOnly);
+    });
+    
+    // Blocks while the encoder is busy, the slots then fill up and the rendering waits for it.
+    turntable->pipeline->addStage("encoding", [exportData](int slot, int frame) {
+        TurntableExport::Slot& frameSlot = exportData->slots[slot];
+        if (!frameSlot.videoFrame || !exportData->writer.appendFrame(frameSlot.videoFrame, frame))
+            exportData->failed = true;
+        
+        CVPixelBufferRelease(frameSlot.videoFrame);
+        frameSlot.videoFrame = NULL;
+    });
+    
+    // Without all its targets, the export finishes right away.
+    turntable->cancelled = (turntable->slots.back().target < 0);
+    
+    turntable->startTime = CACurrentMediaTime();
+    turntable->pipeline->start();
+    
+    [self renderNextTurntableFrame:turntable];
+}
+
+// Renders the next frame once a slot is free, the viewer still draws in between.
+- (void)renderNextTurntableFrame:(std::shared_ptr<TurntableExport>)turntable
+{
+    // The mesh viewer was dismissed.
+    if (!_mesh)
+        turntable->cancelled = true;
+    
+    if (turntable->cancelled || turntable->nextFrame == kTurntableNumFrames)
+    {
+        [self finishTurntableExport:turntable];
+        return;
+    }
+    
+    const int slot = turntable->pipeline->acquireSlot(false);
+    if (slot < 0)
+    {
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, 2 * NSEC_PER_MSEC), dispatch_get_main_queue(), ^{
+            [self renderNextTurntableFrame:turntable];
+        });
+        return;
+    }
+    
+    const CFTimeInterval startTime = CACurrentMediaTime();
+    const int frame = turntable->nextFrame;
+    TurntableExport::Slot& frameSlot = turntable->slots[slot];
     
-    GLuint outputTexture;
-    glActiveTexture(GL_TEXTURE0);
-    glGenTextures(1, &outputTexture);
-    glBindTexture(GL_TEXTURE_2D, outputTexture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-    
-    GLuint colorFrameBuffer, depthRenderBuffer;
-    glGenFramebuffers(1, &colorFrameBuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, colorFrameBuffer);
-    glGenRenderbuffers(1, &depthRenderBuffer);
-    glBindRenderbuffer(GL_RENDERBUFFER, depthRenderBuffer);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, width, height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderBuffer);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, outputTexture, 0);
+    GLint currentFrameBuffer;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &currentFrameBuffer);
+    
+    _offscreenTargets.bind(frameSlot.target);
+    glViewport(0, 0, kTurntableWidth, kTurntableHeight);
+    
+    _renderer->setLevelOfDetailViewport(kTurntableHeight);
+    [self renderScreenShotWithProjection:turntable->projectionMatrix modelView:turntable->modelViewMatrices[frame]];
+    _renderer->setLevelOfDetailViewport(_glViewport[3]);
+    
+    // The readback stage waits on the fence, not the main thread.
+    _offscreenTargets.finishRendering(frameSlot.target);
+    frameSlot.fence = _offscreenTargets.takeFence(frameSlot.target);
+    
+    // Back to the original frame buffer
+    glBindFramebuffer(GL_FRAMEBUFFER, currentFrameBuffer);
+    glViewport(_glViewport[0], _glViewport[1], _glViewport[2], _glViewport[3]);
+    
+    // The time to issue the commands: the GPU time shows in the readback stage.
+    turntable->pipeline->submit(slot, frame, CACurrentMediaTime() - startTime);
+    ++turntable->nextFrame;
+    
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [self renderNextTurntableFrame:turntable];
+    });
+}
+
+- (void)finishTurntableExport:(std::shared_ptr<TurntableExport>)turntable
+{
+    // The stages drain off the main thread, the encoding one may still wait for the encoder.
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        
+        turntable->pipeline->finish();
+        
+        turntable->writer.finish(^(bool written) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                
+                _turntableExportInProgress = false;
+                
+                for (TurntableExport::Slot& slot : turntable->slots)
+                {
+                    _offscreenTargets.release(slot.target);
+                    CVPixelBufferRelease(slot.renderedPixels);
+                    slot.renderedPixels = NULL;
+                }
+                
+                const bool success = written && !turntable->cancelled && !turntable->failed;
+                if (!success)
+                {
+                    NSLog(@"Mesh viewer: turntable export failed after %d of %d frames.",
+                          turntable->writer.numAppendedFrames(), kTurntableNumFrames);
+                    return;
+                }
+                
+                const FramePipeline& pipeline = *turntable->pipeline;
+                NSLog(@"Mesh viewer: turntable of %d frames at %dx%d exported in %.1f s, %.1f fps with %d frames in flight.",
+                      pipeline.numFinishedFrames(), kTurntableWidth, kTurntableHeight,
+                      CACurrentMediaTime() - turntable->startTime, pipeline.framesPerSecond(), pipeline.numSlots());
+                
+                for (const FramePipeline::StageStatistics& stage : pipeline.statistics())
+                {
+                    NSLog(@"Mesh viewer: turntable %s stage at %.1f fps, %.2f s busy, %.2f s waiting.",
+                          stage.name.c_str(), stage.framesPerSecond(), stage.busySeconds, stage.waitSeconds);
+                }
+            });
+        });
+    });
+}
+
+#pragma mark - Email Mesh OBJ file
+
+- (void)mailComposeController:(MFMailComposeViewController *)controller
+          didFinishWithResult:(MFMailComposeResult)result
+                        error:(NSError *)error
+{
+    [self.mailViewController dismissViewControllerAnimated:YES completion:nil];
+}
+
+// Renders the whole mesh in colors if possible, into the bound framebuffer.
+- (void)renderScreenShotWithProjection:(GLKMatrix4)projectionMatrix modelView:(GLKMatrix4)modelViewMatrix
+{
+    // The screenshot needs the whole mesh.
+    if (_renderer->isUploadInProgress())
+    {
+        _renderer->finishUpload();
+        [self meshUploadDidFinish];
+    }
     
     // Keep the current render mode
     MeshRenderer::RenderingMode previousRenderingMode = _renderer->getRenderingMode();
@@ -318,40 +940,148 @@ namespace
         _renderer->setRenderingMode( MeshRenderer::RenderingModeLightedGray );
     }
     
-    // Render from the initial viewpoint for the screenshot.
     _renderer->clear();
-    _renderer->render(_projectionMatrixBeforeUserInteractions, _modelViewMatrixBeforeUserInteractions);
+    _renderer->render(projectionMatrix, modelViewMatrix);
     
     // Back to current render mode
     _renderer->setRenderingMode( previousRenderingMode );
+}
+
+// Renders the largest screenshot, and saves all of them to the directory. The completion is called on
+// the main thread.
+- (void)prepareScreenShotsInDirectory:(NSString*)directory completion:(void (^)(BOOL success))completion
+{
+    const int width = kScreenShotSizes[0].width;
+    const int height = kScreenShotSizes[0].height;
     
-    struct RgbaPixel { uint8_t rgba[4]; };
-    std::vector<RgbaPixel> screenShotRgbaBuffer (width*height);
-    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, screenShotRgbaBuffer.data());
+    const CFTimeInterval startTime = CACurrentMediaTime();
     
-    // We need to flip the axis, because OpenGL reads out the buffer from the bottom.
-    std::vector<RgbaPixel> rowBuffer (width);
-    for (int h = 0; h < height/2; ++h)
+    GLint currentFrameBuffer;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &currentFrameBuffer);
+    
+    // The target is kept for the next screenshots, and a second one is created if this one is still being read.
+    const int target = _offscreenTargets.acquire(width, height);
+    if (target < 0)
     {
-        RgbaPixel* screenShotDataTopRow    = screenShotRgbaBuffer.data() + h * width;
-        RgbaPixel* screenShotDataBottomRow = screenShotRgbaBuffer.data() + (height - h - 1) * width;
+        glBindFramebuffer(GL_FRAMEBUFFER, currentFrameBuffer);
         
-        // Swap the top and bottom rows, using rowBuffer as a temporary placeholder.
-        memcpy(rowBuffer.data(), screenShotDataTopRow, width * sizeof(RgbaPixel));
-        memcpy(screenShotDataTopRow, screenShotDataBottomRow, width * sizeof (RgbaPixel));
-        memcpy(screenShotDataBottomRow, rowBuffer.data(), width * sizeof (RgbaPixel));
+        // Still after the caller's own work, like a successful screenshot.
+        dispatch_async(dispatch_get_main_queue(), ^{ completion(NO); });
+        return;
     }
     
-    saveJpegFromRGBABuffer([screenshotPath UTF8String], reinterpret_cast<uint8_t*>(screenShotRgbaBuffer.data()), width, height);
+    glViewport(0, 0, width, height);
+    
+    // Render from the initial viewpoint for the screenshot, with the levels of detail of its size.
+    _renderer->setLevelOfDetailViewport(height);
+    [self renderScreenShotWithProjection:_projectionMatrixBeforeUserInteractions modelView:_modelViewMatrixBeforeUserInteractions];
+    _renderer->setLevelOfDetailViewport(_glViewport[3]);
+    
+    // Submit the commands with a fence, the GPU renders while the main thread goes on.
+    _offscreenTargets.finishRendering(target);
     
     // Back to the original frame buffer
     glBindFramebuffer(GL_FRAMEBUFFER, currentFrameBuffer);
     glViewport(_glViewport[0], _glViewport[1], _glViewport[2], _glViewport[3]);
     
-    // Free the data
-    glDeleteTextures(1, &outputTexture);
-    glDeleteFramebuffers(1, &colorFrameBuffer);
-    glDeleteRenderbuffers(1, &depthRenderBuffer);
+    [self encodeScreenShotTarget:target
+                     inDirectory:directory
+                       startTime:startTime
+                     blockedTime:CACurrentMediaTime() - startTime
+                      completion:completion];
+}
+
+// Waits for the fence of the target without blocking, then downsamples and encodes its pixels in the
+// background.
+- (void)encodeScreenShotTarget:(int)target
+                   inDirectory:(NSString*)directory
+                     startTime:(CFTimeInterval)startTime
+                   blockedTime:(CFTimeInterval)blockedTime
+                    completion:(void (^)(BOOL success))completion
+{
+    const CFTimeInterval pollStartTime = CACurrentMediaTime();
+    const bool readable = _offscreenTargets.isReadable(target);
+    blockedTime += CACurrentMediaTime() - pollStartTime;
+    
+    if (!readable)
+    {
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, 2 * NSEC_PER_MSEC), dispatch_get_main_queue(), ^{
+            [self encodeScreenShotTarget:target inDirectory:directory startTime:startTime blockedTime:blockedTime completion:completion];
+        });
+        return;
+    }
+    
+    const CFTimeInterval readableTime = CACurrentMediaTime();
+    
+    // The GPU is done with it, the pool hands it out again only once released below. NULL if the
+    // targets were deleted by dismissView meanwhile.
+    CVPixelBufferRef pixelBuffer = CVPixelBufferRetain(_offscreenTargets.pixelBuffer(target));
+    if (!pixelBuffer)
+    {
+        completion(NO);
+        return;
+    }
+    
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        
+        CVPixelBufferLockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
+        
+        // The render, bottom-up as GL wrote it.
+        JpegSourceImage render;
+        render.pixels = static_cast<const uint8_t*>(CVPixelBufferGetBaseAddress(pixelBuffer));
+        render.width = (int)CVPixelBufferGetWidth(pixelBuffer);
+        render.height = (int)CVPixelBufferGetHeight(pixelBuffer);
+        render.bytesPerRow = CVPixelBufferGetBytesPerRow(pixelBuffer);
+        render.bgra = true;
+        render.bottomUp = true;
+        
+        // The smaller sizes, each from the previous one, flipped upright by the first resampling.
+        std::vector<ImageSize> smallerSizes;
+        for (int index = 1; index < kNumScreenShotSizes; ++index)
+            smallerSizes.push_back({ kScreenShotSizes[index].width, kScreenShotSizes[index].height });
+        
+        const std::vector<ColorImage> smallerImages = buildImagePyramid(render.pixels, render.width, render.height, render.bytesPerRow,
+                                                                        true, smallerSizes, ResampleFilterLanczos3, dispatchApply);
+        const CFTimeInterval resampledTime = CACurrentMediaTime();
+        
+        // All the sizes encoded in parallel, the blocks reading the images through pointers rather than copies.
+        const ColorImage* smallerImageData = smallerImages.data();
+        bool saved[kNumScreenShotSizes] = {};
+        bool* savedData = saved;
+        dispatch_apply(kNumScreenShotSizes, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t index) {
+            JpegSourceImage image = render;
+            if (index > 0)
+            {
+                const ColorImage& smallerImage = smallerImageData[index - 1];
+                image.pixels = smallerImage.pixels.data();
+                image.width = smallerImage.width;
+                image.height = smallerImage.height;
+                image.bytesPerRow = size_t(smallerImage.width) * 4;
+                image.bottomUp = false;
+            }
+            
+            const std::vector<uint8_t> jpeg = encodeJpeg(image);
+            NSString* path = [directory stringByAppendingPathComponent:@(kScreenShotSizes[index].filename)];
+            savedData[index] = !jpeg.empty() && [[NSData dataWithBytes:jpeg.data() length:jpeg.size()] writeToFile:path atomically:YES];
+        });
+        
+        const BOOL success = std::all_of(saved, saved + kNumScreenShotSizes, [](bool imageSaved) { return imageSaved; });
+        
+        CVPixelBufferUnlockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
+        CVPixelBufferRelease(pixelBuffer);
+        
+        const CFTimeInterval encodedTime = CACurrentMediaTime();
+        
+        dispatch_async(dispatch_get_main_queue(), ^{
+            _offscreenTargets.release(target);
+            
+            NSLog(@"Mesh viewer: %d screenshots ready in %.1f ms (GPU %.1f ms, resampling %.1f ms, encoding %.1f ms), main thread blocked %.1f ms.",
+                  kNumScreenShotSizes, (encodedTime - startTime) * 1e3, (readableTime - startTime) * 1e3,
+                  (resampledTime - readableTime) * 1e3, (encodedTime - resampledTime) * 1e3, blockedTime * 1e3);
+            
+            completion(success);
+        });
+    });
 }
 
 - (void)emailMesh
@@ -382,8 +1112,22 @@ namespace
     NSString *zipPath = [cacheDirectory stringByAppendingPathComponent:zipFilename];
     NSString *screenshotPath =[cacheDirectory stringByAppendingPathComponent:screenshotFilename];
     
-    // Take a screenshot and save it to disk.
-    [self prepareScreenShot:screenshotPath];
+    // Take the screenshots and save them to disk, they are encoded in the background while the mesh is exported.
+    [self prepareScreenShotsInDirectory:cacheDirectory completion:^(BOOL screenshotSaved) {
+        
+        // The export failed and was reported.
+        if (!self.mailViewController)
+            return;
+        
+        // Attach the Screenshot.
+        if (screenshotSaved)
+            [self.mailViewController addAttachmentData:[NSData dataWithContentsOfFile:screenshotPath] mimeType:@"image/jpeg" fileName:screenshotFilename];
+        
+        // Attach the zipped mesh.
+        [self.mailViewController addAttachmentData:[NSData dataWithContentsOfFile:zipPath] mimeType:@"application/zip" fileName:zipFilename];
+        
+        [self presentViewController:self.mailViewController animated:YES completion:^(){}];
+    }];
     
     [self.mailViewController setSubject:@"3D Model"];
     
@@ -409,37 +1153,86 @@ namespace
         [alertView show];
         return;
     }
-    
-    // Attach the Screenshot.
-    [self.mailViewController addAttachmentData:[NSData dataWithContentsOfFile:screenshotPath] mimeType:@"image/jpeg" fileName:screenshotFilename];
-    
-    // Attach the zipped mesh.
-    [self.mailViewController addAttachmentData:[NSData dataWithContentsOfFile:zipPath] mimeType:@"application/zip" fileName:zipFilename];
-    
-    [self presentViewController:self.mailViewController animated:YES completion:^(){}];
 }
 
 #pragma mark - Rendering
 
-- (void)draw
+- (void)setNeedsDisplay:(BOOL)needsDisplay
 {
-    [(EAGLView *)self.view setFramebuffer];
+    _needsDisplay = needsDisplay;
     
-    glViewport(_glViewport[0], _glViewport[1], _glViewport[2], _glViewport[3]);
+    if (needsDisplay)
+        [self resumeDisplayLink];
+}
+
+- (void)resumeDisplayLink
+{
+    if (!_displayLink.paused)
+        return;
     
+    const CFTimeInterval idleSeconds = CACurrentMediaTime() - _idleStartTime;
+    NSLog(@"Mesh viewer: display link resumed after %.1f s idle, %d wakeups (%.2f per minute).",
+          idleSeconds, _numIdleWakeups, _numIdleWakeups * 60.0 / std::max(idleSeconds, 1.0));
+    
+    _numIdleWakeups = 0;
+    _displayLink.paused = NO;
+}
+
+- (void)draw
+{
     bool viewpointChanged = _viewpointController->update();
     
-    // If nothing changed, do not waste time and resources rendering.
+    // If nothing changed, do not waste time and resources rendering, nor wake up on every vsync: touches,
+    // gestures and needsDisplay resume the display link.
     if (!_needsDisplay && !viewpointChanged)
+    {
+        if (_numIdleWakeups++ == 0)
+            _idleStartTime = CACurrentMediaTime();
+        
+        if (!_viewpointController->isAnimating())
+            _displayLink.paused = YES;
         return;
+    }
+    
+    [(EAGLView *)self.view setFramebuffer];
+    
+    glViewport(_glViewport[0], _glViewport[1], _glViewport[2], _glViewport[3]);
     
     GLKMatrix4 currentModelView = _viewpointController->currentGLModelViewMatrix();
     GLKMatrix4 currentProjection = _viewpointController->currentGLProjectionMatrix();
     
+    const bool wasUploading = _renderer->isUploadInProgress();
+    
+    // The points only need the vertex streams, and are much cheaper to draw than the triangles.
+    const MeshRenderer::RenderingMode renderingMode = _renderer->getRenderingMode();
+    const bool previewAsPoints = wasUploading && _previewAsPoints;
+    if (previewAsPoints)
+        _renderer->setRenderingMode(MeshRenderer::RenderingModePoints);
+    
     _renderer->clear();
     _renderer->render (currentProjection, currentModelView);
+    
+    if (previewAsPoints)
+        _renderer->setRenderingMode(renderingMode);
+    
+    MeshRenderer::FrameStatistics frameStatistics = _renderer->lastFrameStatistics();
+    if (frameStatistics.numGLCalls != _lastLoggedNumGLCalls)
+    {
+        NSLog(@"Mesh viewer: %d GL calls per frame, %d draws merged from %d, %d redundant calls skipped, %d chunks drawn, %d culled, %d occluded, %d triangles.",
+              frameStatistics.numGLCalls, frameStatistics.numDrawCalls, frameStatistics.numChunkDraws, frameStatistics.numSkippedGLCalls,
+              frameStatistics.numDrawnChunks, frameStatistics.numCulledChunks, frameStatistics.numOccludedChunks,
+              frameStatistics.numDrawnTriangles);
+        _lastLoggedNumGLCalls = frameStatistics.numGLCalls;
+    }
+    
+    if (frameStatistics.shaderCompileSeconds > 0.0)
+        NSLog(@"Mesh viewer: frame stalled %.1f ms compiling a shader.", frameStatistics.shaderCompileSeconds * 1000.0);
 
-    _needsDisplay = FALSE;
+    // Keep drawing while the mesh is uploaded, each render uploads a few more chunks, and until render
+    // picked up the levels of detail and the processed texture built in the background.
+    _needsDisplay = _renderer->isUploadInProgress() || _renderer->hasPendingBackgroundWork();
+    if (wasUploading && !_needsDisplay)
+        [self meshUploadDidFinish];
     
     [(EAGLView *)self.view presentFramebuffer];
 }
@@ -448,6 +1241,8 @@ namespace
 
 - (void)pinchScaleGesture:(UIPinchGestureRecognizer *)gestureRecognizer
 {
+    [self resumeDisplayLink];
+    
     // Forward to the ViewpointController.
     if ([gestureRecognizer state] == UIGestureRecognizerStateBegan)
         _viewpointController->onPinchGestureBegan([gestureRecognizer scale]);
@@ -457,6 +1252,8 @@ namespace
 
 - (void)oneFingerPanGesture:(UIPanGestureRecognizer *)gestureRecognizer
 {
+    [self resumeDisplayLink];
+    
     CGPoint touchPos = [gestureRecognizer locationInView:self.view];
     CGPoint touchVel = [gestureRecognizer velocityInView:self.view];
     GLKVector2 touchPosVec = GLKVector2Make(touchPos.x, touchPos.y);
@@ -472,6 +1269,8 @@ namespace
 
 - (void)twoFingersPanGesture:(UIPanGestureRecognizer *)gestureRecognizer
 {
+    [self resumeDisplayLink];
+    
     if ([gestureRecognizer numberOfTouches] != 2)
         return;
     
@@ -488,9 +1287,28 @@ namespace
         _viewpointController->onTwoFingersPanEnded (touchVelVec);
 }
 
+- (void)tapGesture:(UITapGestureRecognizer *)gestureRecognizer
+{
+    if (!_meshBvh)
+        return;
+    
+    [self resumeDisplayLink];
+    
+    // The gesture is in view points, the viewport in framebuffer pixels with y up.
+    CGFloat contentScale = self.view.contentScaleFactor;
+    CGPoint touchPos = [gestureRecognizer locationInView:self.view];
+    float viewportTop = self.view.bounds.size.height * contentScale - _glViewport[1] - _glViewport[3];
+    GLKVector2 touchInViewport = GLKVector2Make(touchPos.x * contentScale - _glViewport[0],
+                                                touchPos.y * contentScale - viewportTop);
+    
+    if (!_viewpointController->onTapGesture(touchInViewport, GLKVector2Make(_glViewport[2], _glViewport[3]), *_meshBvh))
+        NSLog(@"Mesh viewer: tap missed the mesh, the orbit center did not change.");
+}
+
 - (void)touchesBegan:(NSSet *)touches
            withEvent:(UIEvent *)event
 {
+    [self resumeDisplayLink];
     _viewpointController->onTouchBegan();
 }
 
@@ -0,0 +1,85 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "Nv12Image.h"
+
+#include <algorithm>
+#include <cstring>
+
+void convertToNv12 (const uint8_t* pixels, int width, int height, size_t bytesPerRow, bool bgra, bool bottomUp,
+                    uint8_t* luma, size_t lumaBytesPerRow, uint8_t* chroma, size_t chromaBytesPerRow)
+{
+    const int redOffset = bgra ? 2 : 0;
+    const int blueOffset = bgra ? 0 : 2;
+    const int chromaWidth = (width + 1) / 2;
+    const int chromaHeight = (height + 1) / 2;
+
+    // Blocks of 8 pixels on 2 rows, 4 CbCr pairs.
+    for (int chromaY = 0; chromaY < chromaHeight; ++chromaY)
+    {
+        const int rows[2] = { 2 * chromaY, std::min(2 * chromaY + 1, height - 1) };
+
+        const uint8_t* sourceRows[2];
+        for (int row = 0; row < 2; ++row)
+        {
+            const int sourceRow = bottomUp ? height - 1 - rows[row] : rows[row];
+            sourceRows[row] = pixels + sourceRow * bytesPerRow;
+        }
+
+        uint8_t* chromaRow = chroma + chromaY * chromaBytesPerRow;
+
+        for (int x = 0; x < width; x += 8)
+        {
+            const int numPixels = std::min(8, width - x);
+
+            SimdFloat4 sums[3] = { simdSplat(0.f), simdSplat(0.f), simdSplat(0.f) };
+            for (int row = 0; row < 2; ++row)
+            {
+                float red[8], green[8], blue[8];
+                for (int lane = 0; lane < 8; ++lane)
+                {
+                    const uint8_t* pixel = sourceRows[row] + 4 * (x + std::min(lane, numPixels - 1));
+                    red[lane] = pixel[redOffset];
+                    green[lane] = pixel[1];
+                    blue[lane] = pixel[blueOffset];
+                }
+
+                // The last row of an odd height is written twice, with the same values.
+                uint8_t lumaBytes[8];
+                for (int half = 0; half < 2; ++half)
+                {
+                    SimdFloat4 y, cb, cr;
+                    simdRgbToYCbCr(simdLoad(red + 4 * half), simdLoad(green + 4 * half), simdLoad(blue + 4 * half), y, cb, cr);
+                    simdStoreBytes(lumaBytes + 4 * half, y);
+                }
+                memcpy(luma + rows[row] * lumaBytesPerRow + x, lumaBytes, numPixels);
+
+                // Horizontal pairs of pixels.
+                SimdFloat4 even, odd;
+                simdLoadDeinterleave2(red, even, odd);
+                sums[0] = sums[0] + even + odd;
+                simdLoadDeinterleave2(green, even, odd);
+                sums[1] = sums[1] + even + odd;
+                simdLoadDeinterleave2(blue, even, odd);
+                sums[2] = sums[2] + even + odd;
+            }
+
+            SimdFloat4 y, cb, cr;
+            simdRgbToYCbCr(simdSplat(0.25f) * sums[0], simdSplat(0.25f) * sums[1], simdSplat(0.25f) * sums[2], y, cb, cr);
+
+            uint8_t blueBytes[4], redBytes[4];
+            simdStoreBytes(blueBytes, cb);
+            simdStoreBytes(redBytes, cr);
+
+            const int numPairs = std::min(4, chromaWidth - x / 2);
+            for (int pair = 0; pair < numPairs; ++pair)
+            {
+                chromaRow[x + 2 * pair] = blueBytes[pair];
+                chromaRow[x + 2 * pair + 1] = redBytes[pair];
+            }
+        }
+    }
+}
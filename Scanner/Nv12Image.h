@@ -0,0 +1,51 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#include "SimdMath.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// A bi-planar 4:2:0 image, like the full range kCVPixelFormatType_420YpCbCr8BiPlanarFullRange pixel
+// buffers of the mesh textures: a luma plane and a half resolution plane of interleaved CbCr.
+struct Nv12Image
+{
+    const uint8_t* luma = nullptr;
+    const uint8_t* chroma = nullptr;
+    size_t lumaBytesPerRow = 0;
+    size_t chromaBytesPerRow = 0;
+    int width = 0;
+    int height = 0;
+};
+
+// Full range BT.709 to RGB, like the texture mesh shaders. Inputs and outputs are in [0, 255], the
+// chroma not yet centered, the outputs not clamped.
+inline void simdYCbCrToRgb (SimdFloat4 y, SimdFloat4 cb, SimdFloat4 cr, SimdFloat4& r, SimdFloat4& g, SimdFloat4& b)
+{
+    cb = cb - simdSplat(128.f);
+    cr = cr - simdSplat(128.f);
+
+    r = y + simdSplat(1.57481f) * cr;
+    g = y - simdSplat(0.18732f) * cb - simdSplat(0.46813f) * cr;
+    b = y + simdSplat(1.8556f) * cb;
+}
+
+// RGB to full range BT.709, the inverse of simdYCbCrToRgb. The chroma is centered on 128, the outputs
+// not clamped.
+inline void simdRgbToYCbCr (SimdFloat4 r, SimdFloat4 g, SimdFloat4 b, SimdFloat4& y, SimdFloat4& cb, SimdFloat4& cr)
+{
+    y = simdSplat(0.2126f) * r + simdSplat(0.7152f) * g + simdSplat(0.0722f) * b;
+    cb = simdSplat(1.f / 1.8556f) * (b - y) + simdSplat(128.f);
+    cr = simdSplat(1.f / 1.57481f) * (r - y) + simdSplat(128.f);
+}
+
+// Converts 4-byte pixels with an ignored alpha to the planes of an Nv12Image of the same size, e.g. the
+// rendered frames of a video. Each CbCr pair is the average of its 2x2 pixels, the last row and column
+// repeating for odd sizes. The luma rows need width bytes, the chroma rows 2 * ((width + 1) / 2).
+void convertToNv12 (const uint8_t* pixels, int width, int height, size_t bytesPerRow, bool bgra, bool bottomUp,
+                    uint8_t* luma, size_t lumaBytesPerRow, uint8_t* chroma, size_t chromaBytesPerRow);
@@ -0,0 +1,257 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "OcclusionCuller.h"
+#include "MeshSimplifier.h"
+#include "SimdMath.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Local functions
+namespace
+{
+
+    // Triangles with a vertex closer than this clip-space w are not rasterized: skipping an
+    // occluder is always safe, and it avoids clipping against the near plane.
+    const float kMinOccluderW = 1e-3f;
+
+    // Column-major matrix times (x, y, z, 1).
+    void transformPoint (const float m[16], const float p[3], float clip[4])
+    {
+        for (int row = 0; row < 4; ++row)
+            clip[row] = m[row]*p[0] + m[4 + row]*p[1] + m[8 + row]*p[2] + m[12 + row];
+    }
+
+} // Anonymous
+
+void buildOccluderProxy (const float* positions,
+                         int numVertices,
+                         const uint16_t* indices,
+                         int numIndices,
+                         const AxisAlignedBox& bounds,
+                         int gridResolution,
+                         OccluderProxy& proxy)
+{
+    proxy.triangles.clear();
+    proxy.margin = 0.f;
+
+    if (bounds.empty || numIndices < 3)
+        return;
+
+    float extent = 0.f;
+    for (int axis = 0; axis < 3; ++axis)
+        extent = std::max(extent, bounds.max[axis] - bounds.min[axis]);
+
+    VertexClustering clustering;
+    clusterVertices(indices, numIndices, positions, numVertices, bounds, std::max(extent, 1e-6f) / gridResolution, clustering);
+
+    // Representative of a cluster: the mean of its vertices.
+    std::vector<float> representatives (clustering.numClusters * 3, 0.f);
+    std::vector<int> counts (clustering.numClusters, 0);
+    for (int v = 0; v < numVertices; ++v)
+    {
+        const int cluster = clustering.vertexClusters[v];
+        if (cluster < 0)
+            continue;
+
+        for (int axis = 0; axis < 3; ++axis)
+            representatives[3*cluster + axis] += positions[3*v + axis];
+        ++counts[cluster];
+    }
+
+    for (int cluster = 0; cluster < clustering.numClusters; ++cluster)
+        for (int axis = 0; axis < 3; ++axis)
+            representatives[3*cluster + axis] /= counts[cluster];
+
+    proxy.triangles.reserve(clustering.triangles.size() * 3);
+    for (int cluster : clustering.triangles)
+        proxy.triangles.insert(proxy.triangles.end(), &representatives[3*cluster], &representatives[3*cluster] + 3);
+
+    // A representative stays inside its cell, so the proxy is within the clustering error of the surface.
+    proxy.margin = clustering.maxError;
+}
+
+OcclusionCuller::OcclusionCuller (int width, int height)
+: _width ((width + 3) & ~3)
+, _height (height)
+, _depth (_width * _height, 1.f)
+{
+    std::fill(_viewProjection, _viewProjection + 16, 0.f);
+}
+
+void OcclusionCuller::beginFrame (const float viewProjection[16])
+{
+    std::copy(viewProjection, viewProjection + 16, _viewProjection);
+    std::fill(_depth.begin(), _depth.end(), 1.f);
+}
+
+void OcclusionCuller::renderOccluder (const OccluderProxy& proxy)
+{
+    const int numTriangles = (int)proxy.triangles.size() / 9;
+
+    for (int t = 0; t < numTriangles; ++t)
+    {
+        float window[3][3];
+        bool behindNearPlane = false;
+
+        for (int k = 0; k < 3; ++k)
+        {
+            float clip[4];
+            transformPoint(_viewProjection, &proxy.triangles[9*t + 3*k], clip);
+            if (clip[3] < kMinOccluderW)
+            {
+                behindNearPlane = true;
+                break;
+            }
+
+            const float invW = 1.f / clip[3];
+            window[k][0] = (clip[0] * invW * 0.5f + 0.5f) * _width;
+            window[k][1] = (clip[1] * invW * 0.5f + 0.5f) * _height;
+            window[k][2] = clip[2] * invW * 0.5f + 0.5f;
+        }
+
+        if (!behindNearPlane)
+            rasterizeTriangle(window[0], window[1], window[2]);
+    }
+}
+
+void OcclusionCuller::rasterizeTriangle (const float v0[3], const float v1[3], const float v2[3])
+{
+    // Twice the signed area, both windings are rasterized.
+    const float area = (v1[0] - v0[0]) * (v2[1] - v0[1]) - (v1[1] - v0[1]) * (v2[0] - v0[0]);
+    if (std::abs(area) < 1e-8f)
+        return;
+
+    const float orientation = area > 0.f ? 1.f : -1.f;
+
+    // Edge functions E(x, y) = a x + b y + c, positive inside.
+    const float* vertices[3] = { v0, v1, v2 };
+    float a[3], b[3], c[3];
+    for (int e = 0; e < 3; ++e)
+    {
+        const float* p = vertices[e];
+        const float* q = vertices[(e + 1) % 3];
+        a[e] = orientation * (p[1] - q[1]);
+        b[e] = orientation * (q[0] - p[0]);
+        c[e] = orientation * (p[0] * q[1] - p[1] * q[0]);
+    }
+
+    // Depth plane, evaluated at the farthest point of each pixel.
+    const float invArea = 1.f / area;
+    const float dzdx = ((v1[2] - v0[2]) * (v2[1] - v0[1]) - (v2[2] - v0[2]) * (v1[1] - v0[1])) * invArea;
+    const float dzdy = ((v2[2] - v0[2]) * (v1[0] - v0[0]) - (v1[2] - v0[2]) * (v2[0] - v0[0])) * invArea;
+    const float maxVertexDepth = std::max(v0[2], std::max(v1[2], v2[2]));
+    const float depthOffset = v0[2] - dzdx * v0[0] - dzdy * v0[1] + 0.5f * (std::abs(dzdx) + std::abs(dzdy));
+
+    const float minX = std::min(v0[0], std::min(v1[0], v2[0]));
+    const float maxX = std::max(v0[0], std::max(v1[0], v2[0]));
+    const float minY = std::min(v0[1], std::min(v1[1], v2[1]));
+    const float maxY = std::max(v0[1], std::max(v1[1], v2[1]));
+
+    // Pixels whose center is inside the bounds, the first one aligned to 4.
+    const int beginX = std::max(0, int(std::ceil(minX - 0.5f))) & ~3;
+    const int endX = std::min(_width, int(std::floor(maxX - 0.5f)) + 1);
+    const int beginY = std::max(0, int(std::ceil(minY - 0.5f)));
+    const int endY = std::min(_height, int(std::floor(maxY - 0.5f)) + 1);
+    if (beginX >= endX || beginY >= endY)
+        return;
+
+    const float pixelCenters[4] = { 0.5f, 1.5f, 2.5f, 3.5f };
+    const SimdFloat4 laneOffsets = simdLoad(pixelCenters);
+    const SimdFloat4 maxDepth = simdSplat(std::min(maxVertexDepth, 1.f));
+
+    SimdFloat4 edgeA[3], edgeStep[3];
+    for (int e = 0; e < 3; ++e)
+    {
+        edgeA[e] = simdSplat(a[e]);
+        edgeStep[e] = simdSplat(4.f * a[e]);
+    }
+
+    const SimdFloat4 depthStep = simdSplat(4.f * dzdx);
+    const SimdFloat4 zero = simdSplat(0.f);
+
+    for (int y = beginY; y < endY; ++y)
+    {
+        const float centerY = y + 0.5f;
+        const SimdFloat4 x0 = simdSplat(float(beginX)) + laneOffsets;
+
+        SimdFloat4 edges[3];
+        for (int e = 0; e < 3; ++e)
+            edges[e] = edgeA[e] * x0 + simdSplat(b[e] * centerY + c[e]);
+
+        SimdFloat4 depth = simdSplat(dzdx) * x0 + simdSplat(dzdy * centerY + depthOffset);
+
+        float* row = &_depth[y * _width];
+        for (int x = beginX; x < endX; x += 4)
+        {
+            const SimdFloat4 inside = simdAndMask(simdLess(zero, edges[0]),
+                                                  simdAndMask(simdLess(zero, edges[1]), simdLess(zero, edges[2])));
+
+            const SimdFloat4 current = simdLoad(row + x);
+            const SimdFloat4 occluderDepth = simdMin(depth, maxDepth);
+            simdStore(row + x, simdSelect(inside, simdMin(current, occluderDepth), current));
+
+            for (int e = 0; e < 3; ++e)
+                edges[e] = edges[e] + edgeStep[e];
+            depth = depth + depthStep;
+        }
+    }
+}
+
+bool OcclusionCuller::isBoxVisible (const AxisAlignedBox& box, float margin) const
+{
+    if (box.empty)
+        return false;
+
+    float minWindow[3] = { INFINITY, INFINITY, INFINITY };
+    float maxWindow[2] = { -INFINITY, -INFINITY };
+
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        const float p[3] = { (corner & 1) ? box.max[0] + margin : box.min[0] - margin,
+                             (corner & 2) ? box.max[1] + margin : box.min[1] - margin,
+                             (corner & 4) ? box.max[2] + margin : box.min[2] - margin };
+        float clip[4];
+        transformPoint(_viewProjection, p, clip);
+
+        // Boxes crossing the near plane are too close to be worth testing.
+        if (clip[3] < kMinOccluderW)
+            return true;
+
+        const float invW = 1.f / clip[3];
+        const float window[3] = { (clip[0] * invW * 0.5f + 0.5f) * _width,
+                                  (clip[1] * invW * 0.5f + 0.5f) * _height,
+                                  clip[2] * invW * 0.5f + 0.5f };
+        for (int axis = 0; axis < 3; ++axis)
+            minWindow[axis] = std::min(minWindow[axis], window[axis]);
+        for (int axis = 0; axis < 2; ++axis)
+            maxWindow[axis] = std::max(maxWindow[axis], window[axis]);
+    }
+
+    // Every pixel touched by the projected box, in aligned blocks of 4 which only adds pixels.
+    const int beginX = std::max(0, int(std::floor(minWindow[0]))) & ~3;
+    const int endX = std::min(_width, int(std::ceil(maxWindow[0])));
+    const int beginY = std::max(0, int(std::floor(minWindow[1])));
+    const int endY = std::min(_height, int(std::ceil(maxWindow[1])));
+    if (beginX >= endX || beginY >= endY)
+        return false; // off screen.
+
+    SimdFloat4 farthestOccluder = simdSplat(0.f);
+    for (int y = beginY; y < endY; ++y)
+    {
+        const float* row = &_depth[y * _width];
+        for (int x = beginX; x < endX; x += 4)
+            farthestOccluder = simdMax(farthestOccluder, simdLoad(row + x));
+    }
+
+    float lanes[4];
+    simdStore(lanes, farthestOccluder);
+    const float farthest = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+
+    // Visible if the nearest point of the box is in front of the occluders in at least one pixel.
+    return minWindow[2] <= farthest;
+}
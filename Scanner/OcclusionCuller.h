@@ -0,0 +1,61 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#include "FrustumCulling.h"
+
+#include <cstdint>
+#include <vector>
+
+// Coarse stand-in for a chunk, rasterized as an occluder. The triangles are a vertex-clustering
+// simplification of the chunk, so they can be off the real surface by up to margin.
+struct OccluderProxy
+{
+    std::vector<float> triangles; // 9 floats per triangle.
+    float margin = 0.f;
+};
+
+// Simplifies a chunk on a cubic grid of gridResolution cells along the longest box side.
+void buildOccluderProxy (const float* positions,
+                         int numVertices,
+                         const uint16_t* indices,
+                         int numIndices,
+                         const AxisAlignedBox& bounds,
+                         int gridResolution,
+                         OccluderProxy& proxy);
+
+// Low resolution depth buffer where occluders are rasterized with SIMD, 4 pixels at a time, to test
+// the bounding boxes of the chunks before drawing them. Occluders cover the pixels whose center they
+// contain, like GL, but at their farthest depth inside the pixel. A chunk peeking out by less than a
+// low resolution pixel around the occluder silhouettes can thus be culled.
+class OcclusionCuller
+{
+public:
+    // width is rounded up to a multiple of 4.
+    OcclusionCuller (int width = 128, int height = 96);
+
+    // Depth is the [0,1] window depth of the GL viewport transform, cleared to the far plane.
+    void beginFrame (const float viewProjection[16]);
+
+    void renderOccluder (const OccluderProxy& proxy);
+
+    // False if the box, grown by margin, is entirely behind the occluders rendered so far.
+    bool isBoxVisible (const AxisAlignedBox& box, float margin) const;
+
+    int width () const { return _width; }
+    int height () const { return _height; }
+    const float* depth () const { return _depth.data(); }
+
+private:
+    void rasterizeTriangle (const float v0[3], const float v1[3], const float v2[3]);
+
+private:
+    int _width;
+    int _height;
+    float _viewProjection[16];
+    std::vector<float> _depth;
+};
@@ -0,0 +1,97 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#import <GLKit/GLKit.h>
+#import <CoreVideo/CoreVideo.h>
+#import <OpenGLES/ES2/glext.h>
+
+#include <vector>
+
+// Offscreen color and depth targets for the screenshots, kept from one use to the next. The color
+// buffer is a CVPixelBuffer bound to a texture through a texture cache, so once a GL_APPLE_sync fence
+// passed the CPU reads the rendered pixels in place: there is no glReadPixels stalling the pipeline
+// and copying them, the GLES2 counterpart of a pixel buffer object readback. Several targets of the
+// same size can be in flight, one being read while the next one renders.
+class OffscreenTargetPool
+{
+public:
+    struct Statistics
+    {
+        int numTargets = 0;
+        int numUsedTargets = 0;
+        int numReuses = 0;
+        size_t numBytes = 0;
+    };
+
+public:
+    ~OffscreenTargetPool ();
+
+    // Creates the texture cache and looks for GL_APPLE_sync, the GL context must be current.
+    void initializeGL ();
+
+    // Deletes the targets and their fences, readbacks in flight included. Their handles become stale:
+    // release and bind ignore them, isReadable is true and pixelBuffer NULL, so that the pending
+    // readbacks give up instead of reaching the targets created afterwards.
+    void deleteTargets ();
+
+    // Binds the framebuffer of a free target of this size, creating one if needed. Returns its handle,
+    // or -1 if the target could not be created.
+    int acquire (int width, int height);
+
+    // Binds the framebuffer of an acquired target again, to render a new frame into it.
+    void bind (int target);
+
+    // Call after the rendering commands: flushes them with a fence behind. Without GL_APPLE_sync,
+    // waits for the GPU instead.
+    void finishRendering (int target);
+
+    // Does not block, the pixels can be read once true.
+    bool isReadable (int target);
+
+    // Hands the fence of finishRendering over to the caller, to wait on it instead of isReadable, e.g.
+    // from another thread with a context of the same sharegroup, and to delete it. 0 without
+    // GL_APPLE_sync, the rendering being already finished.
+    GLsync takeFence (int target);
+
+    // BGRA, the first row is the bottom one as GL renders them. Valid until release.
+    CVPixelBufferRef pixelBuffer (int target) const;
+
+    // The target can be acquired again.
+    void release (int target);
+
+    Statistics statistics () const;
+
+private:
+    struct Target
+    {
+        int width = 0;
+        int height = 0;
+        GLuint framebuffer = 0;
+        GLuint depthRenderbuffer = 0;
+        CVPixelBufferRef pixelBuffer = NULL;
+        CVOpenGLESTextureRef texture = NULL;
+        GLsync fence = 0;
+        bool used = false;
+    };
+
+    bool createTarget (Target& target, int width, int height);
+    void deleteTarget (Target& target);
+
+    // The handles hold the index of the target and the generation of the pool, bumped by deleteTargets.
+    int handle (int index) const { return index | (_generation << 16); }
+    Target* findTarget (int handle);
+    const Target* findTarget (int handle) const;
+
+private:
+    CVOpenGLESTextureCacheRef _textureCache = NULL;
+    bool _hasFences = false;
+
+    std::vector<Target> _targets;
+    int _generation = 0;
+    int _numReuses = 0;
+};
@@ -0,0 +1,265 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#import "OffscreenTargetPool.h"
+#import "GLExtensions.h"
+
+OffscreenTargetPool::~OffscreenTargetPool ()
+{
+    deleteTargets();
+
+    if (_textureCache)
+    {
+        CFRelease(_textureCache);
+        _textureCache = NULL;
+    }
+}
+
+void OffscreenTargetPool::initializeGL ()
+{
+    _hasFences = hasGLExtension("GL_APPLE_sync");
+
+    if (!_textureCache)
+    {
+        CVReturn texError = CVOpenGLESTextureCacheCreate(kCFAllocatorDefault, NULL, [EAGLContext currentContext], NULL, &_textureCache);
+        if (texError) { NSLog(@"Error at CVOpenGLESTextureCacheCreate %d", texError); }
+    }
+}
+
+void OffscreenTargetPool::deleteTargets ()
+{
+    for (Target& target : _targets)
+        deleteTarget(target);
+
+    _targets.clear();
+    _generation = (_generation + 1) & 0x7fff;
+
+    if (_textureCache)
+        CVOpenGLESTextureCacheFlush(_textureCache, 0);
+}
+
+int OffscreenTargetPool::acquire (int width, int height)
+{
+    int found = -1;
+    for (int index = 0; index < (int)_targets.size() && found < 0; ++index)
+    {
+        const Target& target = _targets[index];
+        if (!target.used && target.width == width && target.height == height)
+            found = index;
+    }
+
+    if (found >= 0)
+    {
+        ++_numReuses;
+    }
+    else
+    {
+        Target target;
+        if (!createTarget(target, width, height))
+        {
+            deleteTarget(target);
+            return -1;
+        }
+
+        found = (int)_targets.size();
+        _targets.push_back(target);
+    }
+
+    Target& target = _targets[found];
+    target.used = true;
+    glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+    return handle(found);
+}
+
+void OffscreenTargetPool::bind (int handle)
+{
+    if (const Target* target = findTarget(handle))
+        glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+}
+
+void OffscreenTargetPool::finishRendering (int handle)
+{
+    Target* found = findTarget(handle);
+    if (!found)
+        return;
+
+    Target& target = *found;
+
+    if (_hasFences)
+    {
+        // The fence of a previous frame not read yet.
+        if (target.fence)
+            glDeleteSyncAPPLE(target.fence);
+
+        target.fence = glFenceSyncAPPLE(GL_SYNC_GPU_COMMANDS_COMPLETE_APPLE, 0);
+        glFlush();
+    }
+    else
+    {
+        glFinish();
+    }
+}
+
+bool OffscreenTargetPool::isReadable (int handle)
+{
+    Target* found = findTarget(handle);
+    if (!found || !found->fence)
+        return true;
+
+    Target& target = *found;
+
+    // A zero timeout only polls.
+    GLenum status = glClientWaitSyncAPPLE(target.fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED_APPLE && status != GL_CONDITION_SATISFIED_APPLE)
+        return false;
+
+    glDeleteSyncAPPLE(target.fence);
+    target.fence = 0;
+    return true;
+}
+
+GLsync OffscreenTargetPool::takeFence (int handle)
+{
+    Target* target = findTarget(handle);
+    if (!target)
+        return 0;
+
+    GLsync fence = target->fence;
+    target->fence = 0;
+    return fence;
+}
+
+CVPixelBufferRef OffscreenTargetPool::pixelBuffer (int handle) const
+{
+    const Target* target = findTarget(handle);
+    return target ? target->pixelBuffer : NULL;
+}
+
+void OffscreenTargetPool::release (int handle)
+{
+    Target* found = findTarget(handle);
+    if (!found)
+        return;
+
+    Target& target = *found;
+    if (target.fence)
+    {
+        glDeleteSyncAPPLE(target.fence);
+        target.fence = 0;
+    }
+    target.used = false;
+}
+
+OffscreenTargetPool::Statistics OffscreenTargetPool::statistics () const
+{
+    Statistics statistics;
+    statistics.numTargets = (int)_targets.size();
+    statistics.numReuses = _numReuses;
+    for (const Target& target : _targets)
+    {
+        if (target.used)
+            ++statistics.numUsedTargets;
+
+        // BGRA color and 16-bit depth.
+        statistics.numBytes += size_t(target.width) * target.height * (4 + 2);
+    }
+    return statistics;
+}
+
+bool OffscreenTargetPool::createTarget (Target& target, int width, int height)
+{
+    if (!_textureCache)
+        return false;
+
+    target.width = width;
+    target.height = height;
+
+    // IOSurface backing, so that the texture cache can share the memory with the GPU.
+    NSDictionary* attributes = @{ (id)kCVPixelBufferIOSurfacePropertiesKey: @{} };
+    CVReturn err = CVPixelBufferCreate(kCFAllocatorDefault, width, height, kCVPixelFormatType_32BGRA,
+                                       (__bridge CFDictionaryRef)attributes, &target.pixelBuffer);
+    if (err)
+    {
+        NSLog(@"Error with CVPixelBufferCreate: %d", err);
+        return false;
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+    err = CVOpenGLESTextureCacheCreateTextureFromImage(kCFAllocatorDefault,
+                                                       _textureCache,
+                                                       target.pixelBuffer,
+                                                       NULL,
+                                                       GL_TEXTURE_2D,
+                                                       GL_RGBA,
+                                                       width,
+                                                       height,
+                                                       GL_BGRA_EXT,
+                                                       GL_UNSIGNED_BYTE,
+                                                       0,
+                                                       &target.texture);
+    if (err)
+    {
+        NSLog(@"Error with CVOpenGLESTextureCacheCreateTextureFromImage: %d", err);
+        return false;
+    }
+
+    const GLuint texture = CVOpenGLESTextureGetName(target.texture);
+    glBindTexture(CVOpenGLESTextureGetTarget(target.texture), texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &target.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+    glGenRenderbuffers(1, &target.depthRenderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, target.depthRenderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target.depthRenderbuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+    {
+        NSLog(@"Offscreen target %dx%d incomplete: %x", width, height, status);
+        return false;
+    }
+
+    return true;
+}
+
+OffscreenTargetPool::Target* OffscreenTargetPool::findTarget (int handle)
+{
+    return const_cast<Target*>(static_cast<const OffscreenTargetPool*>(this)->findTarget(handle));
+}
+
+const OffscreenTargetPool::Target* OffscreenTargetPool::findTarget (int handle) const
+{
+    // Negative for a failed acquire, or from before the last deleteTargets.
+    const int index = handle & 0xffff;
+    if (handle < 0 || (handle >> 16) != _generation || index >= (int)_targets.size())
+        return nullptr;
+
+    return &_targets[index];
+}
+
+void OffscreenTargetPool::deleteTarget (Target& target)
+{
+    if (target.fence)
+        glDeleteSyncAPPLE(target.fence);
+
+    // Deleting the name 0 is ignored.
+    glDeleteFramebuffers(1, &target.framebuffer);
+    glDeleteRenderbuffers(1, &target.depthRenderbuffer);
+
+    if (target.texture)
+        CFRelease(target.texture);
+    if (target.pixelBuffer)
+        CVPixelBufferRelease(target.pixelBuffer);
+
+    target = Target();
+}
@@ -0,0 +1,37 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Runs job(0) to job(numJobs - 1), possibly in parallel, and returns when they are all done. Lets the
+// portable code spread its work with dispatch_apply on iOS, and std::thread elsewhere.
+typedef std::function<void (int numJobs, const std::function<void (int)>& job)> ParallelFor;
+
+// The default ParallelFor: the calling thread and one std::thread per other core pull the jobs in order.
+inline void runOnThreads (int numJobs, const std::function<void (int)>& job)
+{
+    const int numThreads = std::min(numJobs, (int)std::max(1u, std::thread::hardware_concurrency()));
+
+    std::atomic<int> nextJob (0);
+    auto worker = [&] {
+        for (int index = nextJob++; index < numJobs; index = nextJob++)
+            job(index);
+    };
+
+    std::vector<std::thread> threads;
+    for (int thread = 1; thread < numThreads; ++thread)
+        threads.emplace_back(worker);
+    worker();
+
+    for (std::thread& thread : threads)
+        thread.join();
+}
@@ -0,0 +1,184 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#import <GLKit/GLKit.h>
+
+#include <vector>
+
+// Where a vertex attribute array reads from, as given to glVertexAttribPointer.
+struct VertexAttributeBinding
+{
+    GLuint index = 0;
+    GLuint buffer = 0;
+    GLint size = 0;
+    GLenum type = 0;
+    GLboolean normalized = GL_FALSE;
+    GLsizei stride = 0;
+    GLsizeiptr offset = 0;
+
+    bool operator== (const VertexAttributeBinding& other) const
+    {
+        return index == other.index && buffer == other.buffer && size == other.size && type == other.type
+            && normalized == other.normalized && stride == other.stride && offset == other.offset;
+    }
+};
+
+// Shadows the GL state changed through it to skip redundant calls, and counts the calls issued.
+// The GL context can be shared with other renderers, so beginFrame forgets the context-wide bindings.
+// Uniforms are program state and stay cached across frames.
+class GLStateCache
+{
+public:
+    enum { MaxVertexAttributes = 8 };
+
+    struct Statistics
+    {
+        int numGLCalls = 0;
+        int numSkippedGLCalls = 0;
+        int numDrawCalls = 0;
+    };
+
+public:
+    void beginFrame ();
+    const Statistics& statistics () const { return _statistics; }
+
+    void useProgram (GLuint program);
+
+    // To call after changing the current program without going through the cache.
+    void invalidateProgram ();
+
+    void setCapability (GLenum capability, bool enabled);
+    bool isCapabilityEnabled (GLenum capability);
+
+    void bindArrayBuffer (GLuint buffer);
+    void bindElementArrayBuffer (GLuint buffer);
+    void bindTexture (GLenum textureUnit, GLenum target, GLuint texture);
+
+    void setVertexAttribute (const VertexAttributeBinding& binding);
+    void setConstantVertexAttribute (GLuint index, const GLfloat value[4]);
+    void disableVertexAttribute (GLuint index);
+    void disableAllVertexAttributes ();
+
+    // The program must be current.
+    void setUniformMatrix4 (GLint location, const GLfloat matrix[16]);
+    void setUniform1i (GLint location, GLint value);
+    void setUniform4 (GLint location, const GLfloat value[4]);
+
+    void setLineWidth (GLfloat width);
+
+    void drawElements (GLenum mode, GLsizei count, GLenum type, GLsizeiptr offset);
+    void drawArrays (GLenum mode, GLint first, GLsizei count);
+
+private:
+    void countCall () { ++_statistics.numGLCalls; }
+    void countSkip () { ++_statistics.numSkippedGLCalls; }
+
+    struct CachedUniform
+    {
+        GLuint program;
+        GLint location;
+        int numValues;
+        GLfloat values[16];
+    };
+
+    CachedUniform* findUniform (GLint location);
+
+    enum TriState { Unknown = -1, Off = 0, On = 1 };
+
+    struct CachedAttribute
+    {
+        TriState enabled = Unknown;
+        bool hasBinding = false;
+        VertexAttributeBinding binding;
+        bool hasConstant = false;
+        GLfloat constant[4];
+    };
+
+private:
+    Statistics _statistics;
+
+    GLuint _program = 0;
+    bool _programKnown = false;
+
+    GLuint _arrayBuffer = 0;
+    bool _arrayBufferKnown = false;
+    GLuint _elementArrayBuffer = 0;
+    bool _elementArrayBufferKnown = false;
+
+    GLenum _activeTexture = 0;
+
+    TriState _depthTest = Unknown;
+    TriState _blend = Unknown;
+    TriState _cullFace = Unknown;
+
+    GLfloat _lineWidth = -1.f;
+
+    CachedAttribute _attributes[MaxVertexAttributes];
+    std::vector<CachedUniform> _uniforms;
+};
+
+// The state changes needed to render the mesh in one mode, recorded once per upload and replayed every
+// frame before the draws. Recording already drops the changes that would not modify the recorded state.
+// Commands are grouped in segments, e.g. one per buffer page, which set up all their state so that any
+// subset of them can be replayed in any order.
+class RenderCommandList
+{
+public:
+    void clear ();
+    bool empty () const { return _commands.empty(); }
+
+    void beginSegment ();
+    int numSegments () const { return (int)_segmentStarts.size(); }
+
+    void setVertexAttribute (const VertexAttributeBinding& binding);
+    void setConstantVertexAttribute (GLuint index, const GLfloat value[4]);
+    void bindElementArrayBuffer (GLuint buffer);
+    void setLineWidth (GLfloat width);
+
+    // Assumes all the vertex attribute arrays are disabled when starting, like recording does.
+    void replaySegments (GLStateCache& cache, const int* segments, int numSegments) const;
+
+private:
+    enum CommandType
+    {
+        CommandSetVertexAttribute,
+        CommandSetConstantVertexAttribute,
+        CommandBindElementArrayBuffer,
+        CommandSetLineWidth,
+    };
+
+    struct Command
+    {
+        CommandType type;
+
+        // Index into _bindings or _constants for the commands using them.
+        int dataIndex = -1;
+
+        GLuint buffer = 0;
+        GLuint attributeIndex = 0;
+        GLfloat lineWidth = 0.f;
+    };
+
+    void replayCommands (GLStateCache& cache, int beginCommand, int endCommand) const;
+
+private:
+    std::vector<Command> _commands;
+    std::vector<int> _segmentStarts;
+    std::vector<VertexAttributeBinding> _bindings;
+    std::vector<GLKVector4> _constants;
+
+    // State at the end of the recorded commands, to skip redundant ones.
+    struct RecordedAttribute
+    {
+        enum { Disabled, Array, Constant } kind = Disabled;
+        int dataIndex = -1;
+    };
+    RecordedAttribute _recordedAttributes[GLStateCache::MaxVertexAttributes];
+    GLuint _recordedElementArrayBuffer = 0;
+    GLfloat _recordedLineWidth = -1.f;
+};
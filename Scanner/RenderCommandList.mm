@@ -0,0 +1,446 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#import "RenderCommandList.h"
+
+#include <cassert>
+#include <cstring>
+
+// Local functions
+namespace
+{
+
+    const GLvoid* bufferOffset (GLsizeiptr offset)
+    {
+        return reinterpret_cast<const GLvoid*>(static_cast<intptr_t>(offset));
+    }
+
+} // Anonymous
+
+//------------------------------------------------------------------------------
+#pragma mark - GLStateCache
+
+void GLStateCache::beginFrame ()
+{
+    _statistics = Statistics();
+
+    _programKnown = false;
+    _arrayBufferKnown = false;
+    _elementArrayBufferKnown = false;
+    _activeTexture = 0;
+    _depthTest = Unknown;
+    _blend = Unknown;
+    _cullFace = Unknown;
+    _lineWidth = -1.f;
+
+    for (CachedAttribute& attribute : _attributes)
+        attribute = CachedAttribute();
+}
+
+void GLStateCache::useProgram (GLuint program)
+{
+    if (_programKnown && _program == program)
+    {
+        countSkip();
+        return;
+    }
+
+    glUseProgram(program);
+    countCall();
+
+    _program = program;
+    _programKnown = true;
+}
+
+void GLStateCache::invalidateProgram ()
+{
+    _programKnown = false;
+}
+
+void GLStateCache::setCapability (GLenum capability, bool enabled)
+{
+    TriState* state = NULL;
+    switch (capability)
+    {
+        case GL_DEPTH_TEST: state = &_depthTest; break;
+        case GL_BLEND: state = &_blend; break;
+        case GL_CULL_FACE: state = &_cullFace; break;
+        default: break;
+    }
+
+    const TriState requested = enabled ? On : Off;
+    if (state && *state == requested)
+    {
+        countSkip();
+        return;
+    }
+
+    if (enabled)
+        glEnable(capability);
+    else
+        glDisable(capability);
+    countCall();
+
+    if (state)
+        *state = requested;
+}
+
+bool GLStateCache::isCapabilityEnabled (GLenum capability)
+{
+    TriState* state = NULL;
+    switch (capability)
+    {
+        case GL_DEPTH_TEST: state = &_depthTest; break;
+        case GL_BLEND: state = &_blend; break;
+        case GL_CULL_FACE: state = &_cullFace; break;
+        default: break;
+    }
+
+    if (state && *state != Unknown)
+        return *state == On;
+
+    const bool enabled = glIsEnabled(capability);
+    countCall();
+
+    if (state)
+        *state = enabled ? On : Off;
+    return enabled;
+}
+
+void GLStateCache::bindArrayBuffer (GLuint buffer)
+{
+    if (_arrayBufferKnown && _arrayBuffer == buffer)
+    {
+        countSkip();
+        return;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    countCall();
+
+    _arrayBuffer = buffer;
+    _arrayBufferKnown = true;
+}
+
+void GLStateCache::bindElementArrayBuffer (GLuint buffer)
+{
+    if (_elementArrayBufferKnown && _elementArrayBuffer == buffer)
+    {
+        countSkip();
+        return;
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+    countCall();
+
+    _elementArrayBuffer = buffer;
+    _elementArrayBufferKnown = true;
+}
+
+void GLStateCache::bindTexture (GLenum textureUnit, GLenum target, GLuint texture)
+{
+    // Texture bindings are not cached, CVOpenGLESTextureCache may rebind them behind our back.
+    if (_activeTexture != textureUnit)
+    {
+        glActiveTexture(textureUnit);
+        countCall();
+        _activeTexture = textureUnit;
+    }
+    else
+        countSkip();
+
+    glBindTexture(target, texture);
+    countCall();
+}
+
+void GLStateCache::setVertexAttribute (const VertexAttributeBinding& binding)
+{
+    assert (binding.index < MaxVertexAttributes);
+    CachedAttribute& attribute = _attributes[binding.index];
+
+    if (attribute.enabled != On)
+    {
+        glEnableVertexAttribArray(binding.index);
+        countCall();
+        attribute.enabled = On;
+    }
+    else
+        countSkip();
+
+    if (attribute.hasBinding && attribute.binding == binding)
+    {
+        countSkip();
+        return;
+    }
+
+    bindArrayBuffer(binding.buffer);
+    glVertexAttribPointer(binding.index, binding.size, binding.type, binding.normalized, binding.stride, bufferOffset(binding.offset));
+    countCall();
+
+    attribute.hasBinding = true;
+    attribute.binding = binding;
+}
+
+void GLStateCache::setConstantVertexAttribute (GLuint index, const GLfloat value[4])
+{
+    assert (index < MaxVertexAttributes);
+    disableVertexAttribute(index);
+
+    CachedAttribute& attribute = _attributes[index];
+    if (attribute.hasConstant && memcmp(attribute.constant, value, sizeof(attribute.constant)) == 0)
+    {
+        countSkip();
+        return;
+    }
+
+    glVertexAttrib4fv(index, value);
+    countCall();
+
+    attribute.hasConstant = true;
+    memcpy(attribute.constant, value, sizeof(attribute.constant));
+}
+
+void GLStateCache::disableVertexAttribute (GLuint index)
+{
+    assert (index < MaxVertexAttributes);
+    CachedAttribute& attribute = _attributes[index];
+
+    if (attribute.enabled == Off)
+    {
+        countSkip();
+        return;
+    }
+
+    glDisableVertexAttribArray(index);
+    countCall();
+    attribute.enabled = Off;
+}
+
+void GLStateCache::disableAllVertexAttributes ()
+{
+    for (GLuint index = 0; index < MaxVertexAttributes; ++index)
+    {
+        // Only touch the attributes that may have been enabled through the cache.
+        if (_attributes[index].enabled != Unknown)
+            disableVertexAttribute(index);
+    }
+}
+
+GLStateCache::CachedUniform* GLStateCache::findUniform (GLint location)
+{
+    assert (_programKnown);
+
+    for (CachedUniform& uniform : _uniforms)
+    {
+        if (uniform.program == _program && uniform.location == location)
+            return &uniform;
+    }
+
+    CachedUniform uniform;
+    uniform.program = _program;
+    uniform.location = location;
+    uniform.numValues = -1; // never uploaded.
+    _uniforms.push_back(uniform);
+    return &_uniforms.back();
+}
+
+void GLStateCache::setUniformMatrix4 (GLint location, const GLfloat matrix[16])
+{
+    CachedUniform* uniform = findUniform(location);
+    if (uniform->numValues == 16 && memcmp(uniform->values, matrix, 16 * sizeof(GLfloat)) == 0)
+    {
+        countSkip();
+        return;
+    }
+
+    glUniformMatrix4fv(location, 1, GL_FALSE, matrix);
+    countCall();
+
+    uniform->numValues = 16;
+    memcpy(uniform->values, matrix, 16 * sizeof(GLfloat));
+}
+
+void GLStateCache::setUniform1i (GLint location, GLint value)
+{
+    CachedUniform* uniform = findUniform(location);
+    const GLfloat storedValue = GLfloat(value);
+    if (uniform->numValues == 1 && uniform->values[0] == storedValue)
+    {
+        countSkip();
+        return;
+    }
+
+    glUniform1i(location, value);
+    countCall();
+
+    uniform->numValues = 1;
+    uniform->values[0] = storedValue;
+}
+
+void GLStateCache::setUniform4 (GLint location, const GLfloat value[4])
+{
+    CachedUniform* uniform = findUniform(location);
+    if (uniform->numValues == 4 && memcmp(uniform->values, value, 4 * sizeof(GLfloat)) == 0)
+    {
+        countSkip();
+        return;
+    }
+
+    glUniform4fv(location, 1, value);
+    countCall();
+
+    uniform->numValues = 4;
+    memcpy(uniform->values, value, 4 * sizeof(GLfloat));
+}
+
+void GLStateCache::setLineWidth (GLfloat width)
+{
+    if (_lineWidth == width)
+    {
+        countSkip();
+        return;
+    }
+
+    glLineWidth(width);
+    countCall();
+    _lineWidth = width;
+}
+
+void GLStateCache::drawElements (GLenum mode, GLsizei count, GLenum type, GLsizeiptr offset)
+{
+    glDrawElements(mode, count, type, bufferOffset(offset));
+    countCall();
+    ++_statistics.numDrawCalls;
+}
+
+void GLStateCache::drawArrays (GLenum mode, GLint first, GLsizei count)
+{
+    glDrawArrays(mode, first, count);
+    countCall();
+    ++_statistics.numDrawCalls;
+}
+
+//------------------------------------------------------------------------------
+#pragma mark - RenderCommandList
+
+void RenderCommandList::clear ()
+{
+    *this = RenderCommandList();
+}
+
+void RenderCommandList::beginSegment ()
+{
+    _segmentStarts.push_back((int)_commands.size());
+
+    // Forget the recorded state, the previous segment may not be replayed before this one.
+    for (RecordedAttribute& recorded : _recordedAttributes)
+        recorded = RecordedAttribute();
+    _recordedElementArrayBuffer = 0;
+    _recordedLineWidth = -1.f;
+}
+
+void RenderCommandList::setVertexAttribute (const VertexAttributeBinding& binding)
+{
+    assert (binding.index < GLStateCache::MaxVertexAttributes);
+    RecordedAttribute& recorded = _recordedAttributes[binding.index];
+
+    if (recorded.kind == RecordedAttribute::Array && _bindings[recorded.dataIndex] == binding)
+        return;
+
+    Command command;
+    command.type = CommandSetVertexAttribute;
+    command.dataIndex = (int)_bindings.size();
+    _bindings.push_back(binding);
+    _commands.push_back(command);
+
+    recorded.kind = RecordedAttribute::Array;
+    recorded.dataIndex = command.dataIndex;
+}
+
+void RenderCommandList::setConstantVertexAttribute (GLuint index, const GLfloat value[4])
+{
+    assert (index < GLStateCache::MaxVertexAttributes);
+    RecordedAttribute& recorded = _recordedAttributes[index];
+
+    const GLKVector4 constant = GLKVector4MakeWithArray(const_cast<GLfloat*>(value));
+    if (recorded.kind == RecordedAttribute::Constant && GLKVector4AllEqualToVector4(_constants[recorded.dataIndex], constant))
+        return;
+
+    Command command;
+    command.type = CommandSetConstantVertexAttribute;
+    command.attributeIndex = index;
+    command.dataIndex = (int)_constants.size();
+    _constants.push_back(constant);
+    _commands.push_back(command);
+
+    recorded.kind = RecordedAttribute::Constant;
+    recorded.dataIndex = command.dataIndex;
+}
+
+void RenderCommandList::bindElementArrayBuffer (GLuint buffer)
+{
+    if (_recordedElementArrayBuffer == buffer)
+        return;
+
+    Command command;
+    command.type = CommandBindElementArrayBuffer;
+    command.buffer = buffer;
+    _commands.push_back(command);
+
+    _recordedElementArrayBuffer = buffer;
+}
+
+void RenderCommandList::setLineWidth (GLfloat width)
+{
+    if (_recordedLineWidth == width)
+        return;
+
+    Command command;
+    command.type = CommandSetLineWidth;
+    command.lineWidth = width;
+    _commands.push_back(command);
+
+    _recordedLineWidth = width;
+}
+
+void RenderCommandList::replaySegments (GLStateCache& cache, const int* segments, int numSegments) const
+{
+    for (int i = 0; i < numSegments; ++i)
+    {
+        const int segment = segments[i];
+        assert (segment >= 0 && segment < (int)_segmentStarts.size());
+
+        const int beginCommand = _segmentStarts[segment];
+        const int endCommand = (segment + 1 < (int)_segmentStarts.size()) ? _segmentStarts[segment + 1] : (int)_commands.size();
+        replayCommands(cache, beginCommand, endCommand);
+    }
+}
+
+void RenderCommandList::replayCommands (GLStateCache& cache, int beginCommand, int endCommand) const
+{
+    for (int commandIndex = beginCommand; commandIndex < endCommand; ++commandIndex)
+    {
+        const Command& command = _commands[commandIndex];
+        switch (command.type)
+        {
+            case CommandSetVertexAttribute:
+                cache.setVertexAttribute(_bindings[command.dataIndex]);
+                break;
+
+            case CommandSetConstantVertexAttribute:
+                cache.setConstantVertexAttribute(command.attributeIndex, _constants[command.dataIndex].v);
+                break;
+
+            case CommandBindElementArrayBuffer:
+                cache.bindElementArrayBuffer(command.buffer);
+                break;
+
+            case CommandSetLineWidth:
+                cache.setLineWidth(command.lineWidth);
+                break;
+        }
+    }
+}
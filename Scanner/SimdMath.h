@@ -0,0 +1,327 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+// Minimal 4-wide float/int vector types shared by the CPU-side mesh processing code.
+// Maps to NEON on iOS devices, SSE2 on x86 (simulator, Linux) and plain C++ otherwise.
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#   include <arm_neon.h>
+#   define SIMD_MATH_NEON 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#   include <emmintrin.h>
+#   define SIMD_MATH_SSE2 1
+#   if defined(__F16C__)
+#       include <immintrin.h>
+#   endif
+#endif
+
+#if SIMD_MATH_NEON
+
+struct SimdFloat4 { float32x4_t v; };
+struct SimdInt4 { int32x4_t v; };
+
+inline SimdFloat4 simdSplat (float x) { return { vdupq_n_f32(x) }; }
+inline SimdFloat4 simdLoad (const float* p) { return { vld1q_f32(p) }; }
+inline void simdStore (float* p, SimdFloat4 a) { vst1q_f32(p, a.v); }
+
+inline SimdFloat4 operator+ (SimdFloat4 a, SimdFloat4 b) { return { vaddq_f32(a.v, b.v) }; }
+inline SimdFloat4 operator- (SimdFloat4 a, SimdFloat4 b) { return { vsubq_f32(a.v, b.v) }; }
+inline SimdFloat4 operator* (SimdFloat4 a, SimdFloat4 b) { return { vmulq_f32(a.v, b.v) }; }
+
+inline SimdFloat4 simdReciprocal (SimdFloat4 a)
+{
+#   if defined(__aarch64__)
+    return { vdivq_f32(vdupq_n_f32(1.f), a.v) };
+#   else
+    // Estimate refined by two Newton-Raphson steps, ARMv7 NEON has no division.
+    float32x4_t r = vrecpeq_f32(a.v);
+    r = vmulq_f32(vrecpsq_f32(a.v, r), r);
+    r = vmulq_f32(vrecpsq_f32(a.v, r), r);
+    return { r };
+#   endif
+}
+
+inline SimdFloat4 simdMin (SimdFloat4 a, SimdFloat4 b) { return { vminq_f32(a.v, b.v) }; }
+inline SimdFloat4 simdMax (SimdFloat4 a, SimdFloat4 b) { return { vmaxq_f32(a.v, b.v) }; }
+inline SimdFloat4 simdAbs (SimdFloat4 a) { return { vabsq_f32(a.v) }; }
+
+// Per-lane a < b, as an all-ones/all-zeros mask stored in a float vector.
+inline SimdFloat4 simdLess (SimdFloat4 a, SimdFloat4 b) { return { vreinterpretq_f32_u32(vcltq_f32(a.v, b.v)) }; }
+inline SimdFloat4 simdAndMask (SimdFloat4 a, SimdFloat4 b)
+{
+    return { vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v))) };
+}
+inline SimdFloat4 simdSelect (SimdFloat4 mask, SimdFloat4 ifTrue, SimdFloat4 ifFalse)
+{
+    return { vbslq_f32(vreinterpretq_u32_f32(mask.v), ifTrue.v, ifFalse.v) };
+}
+
+// 1 for positive or zero lanes, -1 for negative lanes.
+inline SimdFloat4 simdSignNotZero (SimdFloat4 a)
+{
+    const uint32x4_t signBit = vandq_u32(vreinterpretq_u32_f32(a.v), vdupq_n_u32(0x80000000u));
+    return { vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(vdupq_n_f32(1.f)), signBit)) };
+}
+
+inline SimdInt4 simdRoundToInt (SimdFloat4 a)
+{
+#   if defined(__aarch64__)
+    return { vcvtnq_s32_f32(a.v) };
+#   else
+    // Round half away from zero, the conversion itself truncates.
+    const float32x4_t half = vreinterpretq_f32_u32(vorrq_u32(vandq_u32(vreinterpretq_u32_f32(a.v), vdupq_n_u32(0x80000000u)),
+                                                             vreinterpretq_u32_f32(vdupq_n_f32(0.5f))));
+    return { vcvtq_s32_f32(vaddq_f32(a.v, half)) };
+#   endif
+}
+
+inline void simdStoreInt (int32_t* p, SimdInt4 a) { vst1q_s32(p, a.v); }
+
+// Saturating narrowing of two int vectors into 8 int16 values.
+inline void simdStoreInt16 (int16_t* p, SimdInt4 lo, SimdInt4 hi)
+{
+    vst1q_s16(p, vcombine_s16(vqmovn_s32(lo.v), vqmovn_s32(hi.v)));
+}
+
+// Transposes 4 packed xyz triplets (12 floats) into x, y and z vectors.
+inline void simdLoadDeinterleave3 (const float* p, SimdFloat4& x, SimdFloat4& y, SimdFloat4& z)
+{
+    float32x4x3_t v = vld3q_f32(p);
+    x.v = v.val[0]; y.v = v.val[1]; z.v = v.val[2];
+}
+
+// Transposes 4 packed uv pairs (8 floats) into u and v vectors.
+inline void simdLoadDeinterleave2 (const float* p, SimdFloat4& u, SimdFloat4& v)
+{
+    float32x4x2_t w = vld2q_f32(p);
+    u.v = w.val[0]; v.v = w.val[1];
+}
+
+#elif SIMD_MATH_SSE2
+
+struct SimdFloat4 { __m128 v; };
+struct SimdInt4 { __m128i v; };
+
+inline SimdFloat4 simdSplat (float x) { return { _mm_set1_ps(x) }; }
+inline SimdFloat4 simdLoad (const float* p) { return { _mm_loadu_ps(p) }; }
+inline void simdStore (float* p, SimdFloat4 a) { _mm_storeu_ps(p, a.v); }
+
+inline SimdFloat4 operator+ (SimdFloat4 a, SimdFloat4 b) { return { _mm_add_ps(a.v, b.v) }; }
+inline SimdFloat4 operator- (SimdFloat4 a, SimdFloat4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+inline SimdFloat4 operator* (SimdFloat4 a, SimdFloat4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+
+inline SimdFloat4 simdReciprocal (SimdFloat4 a) { return { _mm_div_ps(_mm_set1_ps(1.f), a.v) }; }
+
+inline SimdFloat4 simdMin (SimdFloat4 a, SimdFloat4 b) { return { _mm_min_ps(a.v, b.v) }; }
+inline SimdFloat4 simdMax (SimdFloat4 a, SimdFloat4 b) { return { _mm_max_ps(a.v, b.v) }; }
+inline SimdFloat4 simdAbs (SimdFloat4 a) { return { _mm_andnot_ps(_mm_set1_ps(-0.f), a.v) }; }
+
+inline SimdFloat4 simdLess (SimdFloat4 a, SimdFloat4 b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+inline SimdFloat4 simdAndMask (SimdFloat4 a, SimdFloat4 b) { return { _mm_and_ps(a.v, b.v) }; }
+inline SimdFloat4 simdSelect (SimdFloat4 mask, SimdFloat4 ifTrue, SimdFloat4 ifFalse)
+{
+    return { _mm_or_ps(_mm_and_ps(mask.v, ifTrue.v), _mm_andnot_ps(mask.v, ifFalse.v)) };
+}
+
+inline SimdFloat4 simdSignNotZero (SimdFloat4 a)
+{
+    return { _mm_or_ps(_mm_and_ps(a.v, _mm_set1_ps(-0.f)), _mm_set1_ps(1.f)) };
+}
+
+// Uses the default round-to-nearest-even MXCSR mode.
+inline SimdInt4 simdRoundToInt (SimdFloat4 a) { return { _mm_cvtps_epi32(a.v) }; }
+
+inline void simdStoreInt (int32_t* p, SimdInt4 a) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), a.v); }
+
+inline void simdStoreInt16 (int16_t* p, SimdInt4 lo, SimdInt4 hi)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_packs_epi32(lo.v, hi.v));
+}
+
+inline void simdLoadDeinterleave3 (const float* p, SimdFloat4& x, SimdFloat4& y, SimdFloat4& z)
+{
+    // a = x0 y0 z0 x1, b = y1 z1 x2 y2, c = z2 x3 y3 z3
+    const __m128 a = _mm_loadu_ps(p);
+    const __m128 b = _mm_loadu_ps(p + 4);
+    const __m128 c = _mm_loadu_ps(p + 8);
+
+    x.v = _mm_shuffle_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3,3,0,0)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(1,1,2,2)), _MM_SHUFFLE(2,0,2,0));
+    y.v = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0,0,1,1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2,2,3,3)), _MM_SHUFFLE(2,0,2,0));
+    z.v = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1,1,2,2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3,3,0,0)), _MM_SHUFFLE(2,0,2,0));
+}
+
+inline void simdLoadDeinterleave2 (const float* p, SimdFloat4& u, SimdFloat4& v)
+{
+    const __m128 a = _mm_loadu_ps(p);
+    const __m128 b = _mm_loadu_ps(p + 4);
+    u.v = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0));
+    v.v = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1));
+}
+
+#else // Plain C++ fallback.
+
+struct SimdFloat4 { float v[4]; };
+struct SimdInt4 { int32_t v[4]; };
+
+inline SimdFloat4 simdSplat (float x) { return { { x, x, x, x } }; }
+inline SimdFloat4 simdLoad (const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+inline void simdStore (float* p, SimdFloat4 a) { memcpy(p, a.v, sizeof(a.v)); }
+
+inline SimdFloat4 operator+ (SimdFloat4 a, SimdFloat4 b) { return { { a.v[0]+b.v[0], a.v[1]+b.v[1], a.v[2]+b.v[2], a.v[3]+b.v[3] } }; }
+inline SimdFloat4 operator- (SimdFloat4 a, SimdFloat4 b) { return { { a.v[0]-b.v[0], a.v[1]-b.v[1], a.v[2]-b.v[2], a.v[3]-b.v[3] } }; }
+inline SimdFloat4 operator* (SimdFloat4 a, SimdFloat4 b) { return { { a.v[0]*b.v[0], a.v[1]*b.v[1], a.v[2]*b.v[2], a.v[3]*b.v[3] } }; }
+
+inline SimdFloat4 simdReciprocal (SimdFloat4 a) { return { { 1.f/a.v[0], 1.f/a.v[1], 1.f/a.v[2], 1.f/a.v[3] } }; }
+
+inline SimdFloat4 simdMin (SimdFloat4 a, SimdFloat4 b)
+{
+    SimdFloat4 r; for (int i = 0; i < 4; ++i) r.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return r;
+}
+
+inline SimdFloat4 simdMax (SimdFloat4 a, SimdFloat4 b)
+{
+    SimdFloat4 r; for (int i = 0; i < 4; ++i) r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return r;
+}
+
+inline SimdFloat4 simdAbs (SimdFloat4 a)
+{
+    SimdFloat4 r; for (int i = 0; i < 4; ++i) r.v[i] = a.v[i] < 0.f ? -a.v[i] : a.v[i]; return r;
+}
+
+// Masks are stored as 0/1 floats in the fallback path.
+inline SimdFloat4 simdLess (SimdFloat4 a, SimdFloat4 b)
+{
+    SimdFloat4 r; for (int i = 0; i < 4; ++i) r.v[i] = a.v[i] < b.v[i] ? 1.f : 0.f; return r;
+}
+
+inline SimdFloat4 simdAndMask (SimdFloat4 a, SimdFloat4 b) { return a * b; }
+
+inline SimdFloat4 simdSelect (SimdFloat4 mask, SimdFloat4 ifTrue, SimdFloat4 ifFalse)
+{
+    SimdFloat4 r; for (int i = 0; i < 4; ++i) r.v[i] = mask.v[i] != 0.f ? ifTrue.v[i] : ifFalse.v[i]; return r;
+}
+
+inline SimdFloat4 simdSignNotZero (SimdFloat4 a)
+{
+    SimdFloat4 r; for (int i = 0; i < 4; ++i) r.v[i] = a.v[i] < 0.f ? -1.f : 1.f; return r;
+}
+
+inline SimdInt4 simdRoundToInt (SimdFloat4 a)
+{
+    SimdInt4 r;
+    for (int i = 0; i < 4; ++i)
+        r.v[i] = (int32_t)(a.v[i] < 0.f ? a.v[i] - 0.5f : a.v[i] + 0.5f);
+    return r;
+}
+
+inline void simdStoreInt (int32_t* p, SimdInt4 a) { memcpy(p, a.v, sizeof(a.v)); }
+
+inline void simdStoreInt16 (int16_t* p, SimdInt4 lo, SimdInt4 hi)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        int32_t x = i < 4 ? lo.v[i] : hi.v[i-4];
+        p[i] = (int16_t)(x < -32768 ? -32768 : (x > 32767 ? 32767 : x));
+    }
+}
+
+inline void simdLoadDeinterleave3 (const float* p, SimdFloat4& x, SimdFloat4& y, SimdFloat4& z)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        x.v[i] = p[3*i];
+        y.v[i] = p[3*i+1];
+        z.v[i] = p[3*i+2];
+    }
+}
+
+inline void simdLoadDeinterleave2 (const float* p, SimdFloat4& u, SimdFloat4& v)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        u.v[i] = p[2*i];
+        v.v[i] = p[2*i+1];
+    }
+}
+
+#endif
+
+inline SimdFloat4 operator- (SimdFloat4 a) { return simdSplat(0.f) - a; }
+inline SimdFloat4 simdClamp (SimdFloat4 a, float lo, float hi) { return simdMin(simdMax(a, simdSplat(lo)), simdSplat(hi)); }
+
+// 4 bytes of an 8-bit image to floats.
+inline SimdFloat4 simdLoadBytes (const uint8_t* p)
+{
+    const float f[4] = { (float)p[0], (float)p[1], (float)p[2], (float)p[3] };
+    return simdLoad(f);
+}
+
+// Rounds and saturates 4 floats to bytes.
+inline void simdStoreBytes (uint8_t* p, SimdFloat4 a)
+{
+    int32_t i[4];
+    simdStoreInt(i, simdRoundToInt(simdClamp(a, 0.f, 255.f)));
+    for (int k = 0; k < 4; ++k)
+        p[k] = (uint8_t)i[k];
+}
+
+// IEEE 754 binary32 to binary16 conversion, rounding to nearest even.
+inline uint16_t floatToHalf (float f)
+{
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    
+    const uint32_t sign = (x >> 16) & 0x8000u;
+    const uint32_t mag = x & 0x7fffffffu;
+    
+    if (mag >= 0x7f800000u) // Inf or NaN.
+        return (uint16_t)(sign | 0x7c00u | (mag > 0x7f800000u ? 0x200u : 0u));
+    
+    if (mag >= 0x477ff000u) // Rounds to a value larger than the largest half.
+        return (uint16_t)(sign | 0x7c00u);
+    
+    if (mag < 0x38800000u) // Subnormal half, or zero.
+    {
+        if (mag < 0x33000000u)
+            return (uint16_t)sign;
+        
+        const uint32_t mantissa = (mag & 0x7fffffu) | 0x800000u;
+        const uint32_t shift = 126u - (mag >> 23);
+        uint32_t h = mantissa >> shift;
+        const uint32_t remainder = mantissa & ((1u << shift) - 1u);
+        const uint32_t halfway = 1u << (shift - 1u);
+        if (remainder > halfway || (remainder == halfway && (h & 1u)))
+            ++h;
+        return (uint16_t)(sign | h);
+    }
+    
+    // Rebias the exponent from 127 to 15, a carry out of the mantissa correctly bumps the exponent.
+    uint32_t h = (mag - 0x38000000u) >> 13;
+    const uint32_t remainder = mag & 0x1fffu;
+    if (remainder > 0x1000u || (remainder == 0x1000u && (h & 1u)))
+        ++h;
+    return (uint16_t)(sign | h);
+}
+
+// Converts 4 floats to halves, using the hardware conversion when the target has one.
+inline void simdStoreHalf (uint16_t* p, SimdFloat4 a)
+{
+#if SIMD_MATH_NEON && defined(__aarch64__)
+    vst1_u16(p, vreinterpret_u16_f16(vcvt_f16_f32(a.v)));
+#elif SIMD_MATH_SSE2 && defined(__F16C__)
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_cvtps_ph(a.v, _MM_FROUND_TO_NEAREST_INT));
+#else
+    float lanes[4];
+    simdStore(lanes, a);
+    for (int i = 0; i < 4; ++i)
+        p[i] = floatToHalf(lanes[i]);
+#endif
+}
@@ -0,0 +1,553 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "SoftwareMeshRenderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Local functions
+namespace
+{
+
+    // Tiles are rasterized in parallel, their width a multiple of 4.
+    const int kTileWidth = 64;
+    const int kTileHeight = 32;
+
+    // Triangles set up and binned by each job.
+    const int kTrianglesPerBinningJob = 8192;
+
+    // The X-ray wireframe keeps the pixels this close to an edge, like the shader with derivatives.
+    const float kWireframeHalfWidth = 0.5f;
+
+    // Column-major matrices.
+    void multiplyMatrices (const float a[16], const float b[16], float result[16])
+    {
+        for (int column = 0; column < 4; ++column)
+            for (int row = 0; row < 4; ++row)
+                result[4*column + row] = a[row]*b[4*column] + a[4 + row]*b[4*column + 1]
+                                       + a[8 + row]*b[4*column + 2] + a[12 + row]*b[4*column + 3];
+    }
+
+    // Column-major matrix times (x, y, z, 1).
+    void transformPoint (const float m[16], const float p[3], float clip[4])
+    {
+        for (int row = 0; row < 4; ++row)
+            clip[row] = m[row]*p[0] + m[4 + row]*p[1] + m[8 + row]*p[2] + m[12 + row];
+    }
+
+    // Plane f(x, y) = dx x + dy y + offset through the values at the 3 window positions.
+    void computePlane (const float window[3][3], const float values[3], float invArea, float plane[3])
+    {
+        const float dx = ((values[1] - values[0]) * (window[2][1] - window[0][1]) - (values[2] - values[0]) * (window[1][1] - window[0][1])) * invArea;
+        const float dy = ((values[2] - values[0]) * (window[1][0] - window[0][0]) - (values[1] - values[0]) * (window[2][0] - window[0][0])) * invArea;
+        plane[0] = dx;
+        plane[1] = dy;
+        plane[2] = values[0] - dx * window[0][0] - dy * window[0][1];
+    }
+
+    SimdFloat4 evaluatePlane (const float plane[3], SimdFloat4 x, float y)
+    {
+        return simdSplat(plane[0]) * x + simdSplat(plane[1] * y + plane[2]);
+    }
+
+    // Lanes of a mask as 0 or 1, whatever the mask representation of the SIMD backend.
+    void storeMask (float lanes[4], SimdFloat4 mask)
+    {
+        simdStore(lanes, simdSelect(mask, simdSplat(1.f), simdSplat(0.f)));
+    }
+
+    float sampleBilinear (const MipLevel& image, float u, float v, int channel)
+    {
+        const float x = std::min(std::max(u * image.width - 0.5f, -1.f), float(image.width));
+        const float y = std::min(std::max(v * image.height - 0.5f, -1.f), float(image.height));
+        const float floorX = std::floor(x);
+        const float floorY = std::floor(y);
+        const float fractionX = x - floorX;
+        const float fractionY = y - floorY;
+
+        const int x0 = std::min(std::max(int(floorX), 0), image.width - 1);
+        const int x1 = std::min(std::max(int(floorX) + 1, 0), image.width - 1);
+        const int y0 = std::min(std::max(int(floorY), 0), image.height - 1);
+        const int y1 = std::min(std::max(int(floorY) + 1, 0), image.height - 1);
+
+        const uint8_t* row0 = &image.pixels[size_t(y0) * image.width * image.channels + channel];
+        const uint8_t* row1 = &image.pixels[size_t(y1) * image.width * image.channels + channel];
+        const float top = row0[x0 * image.channels] + fractionX * (row0[x1 * image.channels] - row0[x0 * image.channels]);
+        const float bottom = row1[x0 * image.channels] + fractionX * (row1[x1 * image.channels] - row1[x0 * image.channels]);
+        return top + fractionY * (bottom - top);
+    }
+
+    void copyPlane (const uint8_t* pixels, int width, int height, size_t bytesPerRow, int channels, MipLevel& result)
+    {
+        result.width = width;
+        result.height = height;
+        result.channels = channels;
+        result.pixels.resize (size_t(width) * height * channels);
+        for (int y = 0; y < height; ++y)
+            memcpy(&result.pixels[size_t(y) * width * channels], pixels + y * bytesPerRow, size_t(width) * channels);
+    }
+
+} // Anonymous
+
+SoftwareMeshRenderer::SoftwareMeshRenderer (int width, int height)
+: _parallelFor (runOnThreads)
+{
+    resize(width, height);
+}
+
+void SoftwareMeshRenderer::resize (int width, int height)
+{
+    _width = width;
+    _height = height;
+    _stride = (width + 3) & ~3;
+    _numTilesX = (_stride + kTileWidth - 1) / kTileWidth;
+    _numTilesY = (height + kTileHeight - 1) / kTileHeight;
+
+    _color.assign (size_t(_stride) * height * 4, 0);
+    _depth.assign (size_t(_stride) * height, 1.f);
+}
+
+void SoftwareMeshRenderer::setParallelFor (const ParallelFor& parallelFor)
+{
+    _parallelFor = parallelFor;
+}
+
+void SoftwareMeshRenderer::clearMesh ()
+{
+    _chunks.clear();
+    _clipVertices.clear();
+}
+
+void SoftwareMeshRenderer::addMeshChunk (const MeshChunk& chunk)
+{
+    _chunks.push_back(chunk);
+}
+
+void SoftwareMeshRenderer::setTexture (const Nv12Image& texture, MipFilter filter)
+{
+    _lumaLevels.assign (1, MipLevel());
+    _chromaLevels.assign (1, MipLevel());
+    copyPlane(texture.luma, texture.width, texture.height, texture.lumaBytesPerRow, 1, _lumaLevels[0]);
+    copyPlane(texture.chroma, (texture.width + 1) / 2, (texture.height + 1) / 2, texture.chromaBytesPerRow, 2, _chromaLevels[0]);
+
+    const std::vector<MipLevel> lumaChain = buildMipChain(_lumaLevels[0].pixels.data(), _lumaLevels[0].width, _lumaLevels[0].height,
+                                                          _lumaLevels[0].width, 1, filter);
+    const std::vector<MipLevel> chromaChain = buildMipChain(_chromaLevels[0].pixels.data(), _chromaLevels[0].width, _chromaLevels[0].height,
+                                                            2 * _chromaLevels[0].width, 2, filter);
+
+    _lumaLevels.insert(_lumaLevels.end(), lumaChain.begin(), lumaChain.end());
+    _chromaLevels.insert(_chromaLevels.end(), chromaChain.begin(), chromaChain.end());
+}
+
+void SoftwareMeshRenderer::setRenderingMode (RenderingMode mode)
+{
+    _renderingMode = mode;
+}
+
+void SoftwareMeshRenderer::clear ()
+{
+    const bool colorMode = (_renderingMode == RenderingModePerVertexColor || _renderingMode == RenderingModeTextured);
+    const uint8_t gray = colorMode ? 230 : 26;
+
+    for (size_t pixel = 0; pixel < _depth.size(); ++pixel)
+    {
+        uint8_t* rgba = &_color[4 * pixel];
+        rgba[0] = rgba[1] = rgba[2] = gray;
+        rgba[3] = 255;
+    }
+
+    std::fill(_depth.begin(), _depth.end(), 1.f);
+}
+
+void SoftwareMeshRenderer::render (const float projection[16], const float modelView[16])
+{
+    _statistics = FrameStatistics();
+    _statistics.numTiles = _numTilesX * _numTilesY;
+
+    if (_renderingMode == RenderingModeTextured && _lumaLevels.empty())
+        return;
+
+    float modelViewProjection[16];
+    multiplyMatrices(projection, modelView, modelViewProjection);
+
+    _clipVertices.resize (_chunks.size());
+    _parallelFor((int)_chunks.size(), [&] (int chunk) {
+        transformChunk(chunk, modelViewProjection, modelView);
+    });
+
+    // The triangles of all the chunks in order, split into jobs.
+    _chunkFirstTriangles.resize (_chunks.size() + 1);
+    _chunkFirstTriangles[0] = 0;
+    for (size_t chunk = 0; chunk < _chunks.size(); ++chunk)
+        _chunkFirstTriangles[chunk + 1] = _chunkFirstTriangles[chunk] + _chunks[chunk].numIndices / 3;
+
+    const int numTriangles = _chunkFirstTriangles.back();
+    const int numJobs = std::max(1, (numTriangles + kTrianglesPerBinningJob - 1) / kTrianglesPerBinningJob);
+    _binningJobs.resize (numJobs);
+    _parallelFor(numJobs, [&] (int job) {
+        const int firstTriangle = job * kTrianglesPerBinningJob;
+        binTriangles(job, firstTriangle, std::min(kTrianglesPerBinningJob, numTriangles - firstTriangle));
+    });
+
+    // Each tile draws the triangles of the jobs in order, like GL would.
+    _parallelFor(_numTilesX * _numTilesY, [&] (int tile) {
+        rasterizeTile(tile);
+    });
+
+    _statistics.numTriangles = numTriangles;
+    for (const BinningJob& job : _binningJobs)
+    {
+        _statistics.numRasterizedTriangles += job.numRasterizedTriangles;
+        for (const std::vector<int>& triangles : job.tileTriangles)
+            _statistics.numBinnedTriangles += (int)triangles.size();
+    }
+}
+
+void SoftwareMeshRenderer::readPixels (uint8_t* rgba) const
+{
+    for (int y = 0; y < _height; ++y)
+        memcpy(rgba + size_t(y) * _width * 4, &_color[size_t(y) * _stride * 4], size_t(_width) * 4);
+}
+
+void SoftwareMeshRenderer::transformChunk (int chunkIndex, const float modelViewProjection[16], const float modelView[16])
+{
+    const MeshChunk& chunk = _chunks[chunkIndex];
+    std::vector<ClipVertex>& vertices = _clipVertices[chunkIndex];
+    vertices.resize (chunk.numVertices);
+
+    for (int v = 0; v < chunk.numVertices; ++v)
+    {
+        ClipVertex& vertex = vertices[v];
+        transformPoint(modelViewProjection, &chunk.positions[3*v], vertex.position);
+        std::fill(vertex.attributes, vertex.attributes + 3, 0.f);
+
+        switch (_renderingMode)
+        {
+            case RenderingModeXRay:
+            case RenderingModeLightedGray:
+            {
+                // The modelview can include a scale, hence the normalization.
+                float luminance = 1.f;
+                if (chunk.normals)
+                {
+                    const float* n = &chunk.normals[3*v];
+                    float eye[3];
+                    for (int row = 0; row < 3; ++row)
+                        eye[row] = modelView[row]*n[0] + modelView[4 + row]*n[1] + modelView[8 + row]*n[2];
+
+                    const float length = std::sqrt(eye[0]*eye[0] + eye[1]*eye[1] + eye[2]*eye[2]);
+                    const float z = length > 0.f ? std::abs(eye[2]) / length : 0.f;
+                    luminance = (_renderingMode == RenderingModeXRay) ? 1.f - z : 0.5f * z + 0.5f;
+                }
+                vertex.attributes[0] = luminance;
+                break;
+            }
+
+            case RenderingModePerVertexColor:
+                for (int channel = 0; channel < 3; ++channel)
+                    vertex.attributes[channel] = 255.f * chunk.colors[3*v + channel];
+                break;
+
+            case RenderingModeTextured:
+                vertex.attributes[0] = chunk.texcoords[2*v];
+                vertex.attributes[1] = chunk.texcoords[2*v + 1];
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+void SoftwareMeshRenderer::binTriangles (int jobIndex, int firstTriangle, int numTriangles)
+{
+    BinningJob& job = _binningJobs[jobIndex];
+    job.triangles.clear();
+    job.tileTriangles.resize (_numTilesX * _numTilesY);
+    for (std::vector<int>& triangles : job.tileTriangles)
+        triangles.clear();
+    job.numRasterizedTriangles = 0;
+
+    if (numTriangles <= 0)
+        return;
+
+    int chunkIndex = int(std::upper_bound(_chunkFirstTriangles.begin(), _chunkFirstTriangles.end(), firstTriangle) - _chunkFirstTriangles.begin()) - 1;
+    int triangle = firstTriangle - _chunkFirstTriangles[chunkIndex];
+
+    for (int n = 0; n < numTriangles; ++n, ++triangle)
+    {
+        while (triangle >= _chunks[chunkIndex].numIndices / 3)
+        {
+            ++chunkIndex;
+            triangle = 0;
+        }
+
+        // Nothing to draw in the color modes without colors, like MeshRenderer.
+        const MeshChunk& chunk = _chunks[chunkIndex];
+        if ((_renderingMode == RenderingModePerVertexColor && !chunk.colors)
+            || (_renderingMode == RenderingModeTextured && !chunk.texcoords))
+            continue;
+
+        const ClipVertex vertices[3] =
+        {
+            _clipVertices[chunkIndex][chunk.indices[3*triangle]],
+            _clipVertices[chunkIndex][chunk.indices[3*triangle + 1]],
+            _clipVertices[chunkIndex][chunk.indices[3*triangle + 2]],
+        };
+
+        // Entirely outside one of the frustum planes.
+        unsigned outside = ~0u;
+        bool crossesNearPlane = false;
+        for (const ClipVertex& vertex : vertices)
+        {
+            const float* p = vertex.position;
+            const unsigned codes = (p[0] < -p[3]) | (p[0] > p[3]) << 1 | (p[1] < -p[3]) << 2
+                                 | (p[1] > p[3]) << 3 | (p[2] < -p[3]) << 4 | (p[2] > p[3]) << 5;
+            outside &= codes;
+            crossesNearPlane |= (p[2] < -p[3]);
+        }
+
+        if (outside != 0)
+            continue;
+
+        if (!crossesNearPlane)
+        {
+            setupTriangle(vertices, job);
+            continue;
+        }
+
+        // Clipped against z = -w, the attributes interpolated in clip space. The other planes only
+        // limit the pixel bounds.
+        ClipVertex polygon[4];
+        int numPolygonVertices = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            const ClipVertex& a = vertices[k];
+            const ClipVertex& b = vertices[(k + 1) % 3];
+            const float distanceA = a.position[2] + a.position[3];
+            const float distanceB = b.position[2] + b.position[3];
+
+            if (distanceA >= 0.f)
+                polygon[numPolygonVertices++] = a;
+
+            if ((distanceA >= 0.f) != (distanceB >= 0.f))
+            {
+                const float t = distanceA / (distanceA - distanceB);
+                ClipVertex& clipped = polygon[numPolygonVertices++];
+                for (int i = 0; i < 4; ++i)
+                    clipped.position[i] = a.position[i] + t * (b.position[i] - a.position[i]);
+                for (int i = 0; i < 3; ++i)
+                    clipped.attributes[i] = a.attributes[i] + t * (b.attributes[i] - a.attributes[i]);
+            }
+        }
+
+        for (int k = 1; k + 1 < numPolygonVertices; ++k)
+        {
+            const ClipVertex fan[3] = { polygon[0], polygon[k], polygon[k + 1] };
+            setupTriangle(fan, job);
+        }
+    }
+}
+
+void SoftwareMeshRenderer::setupTriangle (const ClipVertex vertices[3], BinningJob& job)
+{
+    // Window coordinates of the GL viewport transform, y flipped so that row 0 is the top one.
+    float window[3][3];
+    float inverseW[3];
+    for (int k = 0; k < 3; ++k)
+    {
+        const float* p = vertices[k].position;
+        inverseW[k] = 1.f / p[3];
+        window[k][0] = (p[0] * inverseW[k] * 0.5f + 0.5f) * _width;
+        window[k][1] = (0.5f - p[1] * inverseW[k] * 0.5f) * _height;
+        window[k][2] = p[2] * inverseW[k] * 0.5f + 0.5f;
+    }
+
+    // Twice the signed area, both windings are rasterized.
+    const float area = (window[1][0] - window[0][0]) * (window[2][1] - window[0][1]) - (window[1][1] - window[0][1]) * (window[2][0] - window[0][0]);
+    if (!(std::abs(area) >= 1e-8f))
+        return;
+
+    // Pixels whose center is inside the bounds.
+    TriangleSetup setup;
+    setup.minX = std::max(0, int(std::ceil(std::min(window[0][0], std::min(window[1][0], window[2][0])) - 0.5f)));
+    setup.maxX = std::min(_width, int(std::floor(std::max(window[0][0], std::max(window[1][0], window[2][0])) - 0.5f)) + 1);
+    setup.minY = std::max(0, int(std::ceil(std::min(window[0][1], std::min(window[1][1], window[2][1])) - 0.5f)));
+    setup.maxY = std::min(_height, int(std::floor(std::max(window[0][1], std::max(window[1][1], window[2][1])) - 0.5f)) + 1);
+    if (setup.minX >= setup.maxX || setup.minY >= setup.maxY)
+        return;
+
+    // Edge functions E(x, y) = a x + b y + c, positive inside.
+    const float orientation = area > 0.f ? 1.f : -1.f;
+    for (int e = 0; e < 3; ++e)
+    {
+        const float* p = window[e];
+        const float* q = window[(e + 1) % 3];
+        setup.edges[e][0] = orientation * (p[1] - q[1]);
+        setup.edges[e][1] = orientation * (q[0] - p[0]);
+        setup.edges[e][2] = orientation * (p[0] * q[1] - p[1] * q[0]);
+
+        // Pixels from the edge as the wireframe shader measures them, with fwidth = |d/dx| + |d/dy|.
+        setup.edgeScales[e] = 1.f / (std::abs(setup.edges[e][0]) + std::abs(setup.edges[e][1]));
+    }
+
+    // Depth is linear in window space, the attributes are perspective-correct.
+    const float invArea = 1.f / area;
+    const float depths[3] = { window[0][2], window[1][2], window[2][2] };
+    computePlane(window, depths, invArea, setup.depth);
+    computePlane(window, inverseW, invArea, setup.inverseW);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        const float values[3] = { vertices[0].attributes[i] * inverseW[0], vertices[1].attributes[i] * inverseW[1], vertices[2].attributes[i] * inverseW[2] };
+        computePlane(window, values, invArea, setup.attributes[i]);
+    }
+
+    // The level whose texels are closest to the pixels, on average over the triangle.
+    setup.mipLevel = 0;
+    if (_renderingMode == RenderingModeTextured && _lumaLevels.size() > 1)
+    {
+        const float* t0 = vertices[0].attributes;
+        const float* t1 = vertices[1].attributes;
+        const float* t2 = vertices[2].attributes;
+        const float textureArea = std::abs((t1[0] - t0[0]) * (t2[1] - t0[1]) - (t2[0] - t0[0]) * (t1[1] - t0[1]))
+                                * _lumaLevels[0].width * _lumaLevels[0].height;
+        if (textureArea > std::abs(area))
+        {
+            const float level = 0.5f * std::log2(textureArea / std::abs(area));
+            setup.mipLevel = std::min(int(level + 0.5f), (int)_lumaLevels.size() - 1);
+        }
+    }
+
+    const int index = (int)job.triangles.size();
+    job.triangles.push_back(setup);
+    ++job.numRasterizedTriangles;
+
+    for (int tileY = setup.minY / kTileHeight; tileY <= (setup.maxY - 1) / kTileHeight; ++tileY)
+        for (int tileX = setup.minX / kTileWidth; tileX <= (setup.maxX - 1) / kTileWidth; ++tileX)
+            job.tileTriangles[tileY * _numTilesX + tileX].push_back(index);
+}
+
+void SoftwareMeshRenderer::rasterizeTile (int tile)
+{
+    const int tileX = (tile % _numTilesX) * kTileWidth;
+    const int tileY = (tile / _numTilesX) * kTileHeight;
+
+    for (const BinningJob& job : _binningJobs)
+        for (int index : job.tileTriangles[tile])
+            rasterizeTriangle(job.triangles[index], tileX, tileY);
+}
+
+void SoftwareMeshRenderer::rasterizeTriangle (const TriangleSetup& triangle, int tileX, int tileY)
+{
+    // The first pixel aligned to 4, the tiles are.
+    const int beginX = std::max(tileX, triangle.minX) & ~3;
+    const int endX = std::min(std::min(tileX + kTileWidth, _stride), triangle.maxX);
+    const int beginY = std::max(tileY, triangle.minY);
+    const int endY = std::min(tileY + kTileHeight, triangle.maxY);
+
+    const float pixelCenters[4] = { 0.5f, 1.5f, 2.5f, 3.5f };
+    const SimdFloat4 laneOffsets = simdLoad(pixelCenters);
+    const SimdFloat4 zero = simdSplat(0.f);
+    const bool wireframe = (_renderingMode == RenderingModeXRay);
+
+    for (int y = beginY; y < endY; ++y)
+    {
+        const float centerY = y + 0.5f;
+
+        for (int x = beginX; x < endX; x += 4)
+        {
+            const SimdFloat4 centerX = simdSplat(float(x)) + laneOffsets;
+
+            SimdFloat4 edges[3];
+            for (int e = 0; e < 3; ++e)
+                edges[e] = evaluatePlane(triangle.edges[e], centerX, centerY);
+
+            SimdFloat4 mask = simdAndMask(simdLess(zero, edges[0]), simdAndMask(simdLess(zero, edges[1]), simdLess(zero, edges[2])));
+
+            float* depthRow = &_depth[size_t(y) * _stride + x];
+            const SimdFloat4 currentDepth = simdLoad(depthRow);
+            const SimdFloat4 depth = evaluatePlane(triangle.depth, centerX, centerY);
+            mask = simdAndMask(mask, simdLess(depth, currentDepth));
+
+            // Only the pixels close to an edge, which do not hide the ones behind.
+            if (wireframe)
+            {
+                const SimdFloat4 edgeDistance = simdMin(edges[0] * simdSplat(triangle.edgeScales[0]),
+                                                        simdMin(edges[1] * simdSplat(triangle.edgeScales[1]),
+                                                                edges[2] * simdSplat(triangle.edgeScales[2])));
+                mask = simdAndMask(mask, simdLess(edgeDistance, simdSplat(kWireframeHalfWidth)));
+            }
+
+            float lanes[4];
+            storeMask(lanes, mask);
+            if (lanes[0] + lanes[1] + lanes[2] + lanes[3] == 0.f)
+                continue;
+
+            simdStore(depthRow, simdSelect(mask, depth, currentDepth));
+
+            const SimdFloat4 w = simdReciprocal(evaluatePlane(triangle.inverseW, centerX, centerY));
+            SimdFloat4 r, g, b;
+            switch (_renderingMode)
+            {
+                case RenderingModePerVertexColor:
+                    r = evaluatePlane(triangle.attributes[0], centerX, centerY) * w;
+                    g = evaluatePlane(triangle.attributes[1], centerX, centerY) * w;
+                    b = evaluatePlane(triangle.attributes[2], centerX, centerY) * w;
+                    break;
+
+                case RenderingModeTextured:
+                {
+                    float u[4], v[4];
+                    simdStore(u, evaluatePlane(triangle.attributes[0], centerX, centerY) * w);
+                    simdStore(v, evaluatePlane(triangle.attributes[1], centerX, centerY) * w);
+                    sampleTexture(triangle.mipLevel, u, v, r, g, b);
+                    break;
+                }
+
+                default:
+                    r = g = b = evaluatePlane(triangle.attributes[0], centerX, centerY) * w * simdSplat(255.f);
+                    break;
+            }
+
+            uint8_t channels[3][4];
+            simdStoreBytes(channels[0], r);
+            simdStoreBytes(channels[1], g);
+            simdStoreBytes(channels[2], b);
+
+            uint8_t* colorRow = &_color[(size_t(y) * _stride + x) * 4];
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                if (lanes[lane] == 0.f)
+                    continue;
+
+                uint8_t* rgba = colorRow + 4 * lane;
+                rgba[0] = channels[0][lane];
+                rgba[1] = channels[1][lane];
+                rgba[2] = channels[2][lane];
+                rgba[3] = 255;
+            }
+        }
+    }
+}
+
+void SoftwareMeshRenderer::sampleTexture (int mipLevel, const float u[4], const float v[4], SimdFloat4& r, SimdFloat4& g, SimdFloat4& b) const
+{
+    const MipLevel& luma = _lumaLevels[std::min(mipLevel, (int)_lumaLevels.size() - 1)];
+    const MipLevel& chroma = _chromaLevels[std::min(mipLevel, (int)_chromaLevels.size() - 1)];
+
+    float y[4], cb[4], cr[4];
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        y[lane] = sampleBilinear(luma, u[lane], v[lane], 0);
+        cb[lane] = sampleBilinear(chroma, u[lane], v[lane], 0);
+        cr[lane] = sampleBilinear(chroma, u[lane], v[lane], 1);
+    }
+
+    simdYCbCrToRgb(simdLoad(y), simdLoad(cb), simdLoad(cr), r, g, b);
+}
@@ -0,0 +1,155 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#include "Nv12Image.h"
+#include "ParallelFor.h"
+#include "TextureMipChain.h"
+
+#include <cstdint>
+#include <vector>
+
+// CPU implementation of the MeshRenderer rendering modes, for rendering without a GL context, e.g. the
+// mesh previews on a server. The triangles are binned into screen tiles, rasterized in parallel with
+// SIMD, 4 pixels at a time, against a float depth buffer. Follows the GL conventions of MeshRenderer:
+// pixels covered when their center is inside, GL_LESS depth test, no face culling, and the lighting,
+// colors and wireframe of the MeshShaderGenerator variants.
+class SoftwareMeshRenderer
+{
+public:
+    // Same values as MeshRenderer::RenderingMode, without its points preview.
+    enum RenderingMode
+    {
+        RenderingModeXRay = 0,
+        RenderingModePerVertexColor,
+        RenderingModeTextured,
+        RenderingModeLightedGray,
+
+        RenderingModeNumModes
+    };
+
+    // A chunk of the mesh, like those of STMesh. The arrays are referenced, they must stay valid
+    // until clearMesh.
+    struct MeshChunk
+    {
+        const float* positions = nullptr;  // xyz
+        const float* normals = nullptr;    // xyz, for the lighting modes
+        const float* colors = nullptr;     // rgb in [0, 1], for RenderingModePerVertexColor
+        const float* texcoords = nullptr;  // uv, for RenderingModeTextured
+        int numVertices = 0;
+
+        const uint16_t* indices = nullptr; // triangles
+        int numIndices = 0;
+    };
+
+    struct FrameStatistics
+    {
+        int numTriangles = 0;
+
+        // After frustum rejection and near plane clipping.
+        int numRasterizedTriangles = 0;
+
+        // Triangle and tile pairs, a triangle is rasterized once per tile it overlaps.
+        int numBinnedTriangles = 0;
+        int numTiles = 0;
+    };
+
+public:
+    // The size of the MeshViewController screenshots by default.
+    SoftwareMeshRenderer (int width = 320, int height = 240);
+
+    void resize (int width, int height);
+    int width () const { return _width; }
+    int height () const { return _height; }
+
+    // Spreads the work over std::thread workers by default, e.g. dispatch_apply on iOS.
+    void setParallelFor (const ParallelFor& parallelFor);
+
+    void clearMesh ();
+    void addMeshChunk (const MeshChunk& chunk);
+
+    // Copies the planes, and builds their mip levels with filter. A level is picked per triangle, from
+    // the ratio of its texture and screen areas.
+    void setTexture (const Nv12Image& texture, MipFilter filter = MipFilterKaiser);
+
+    void setRenderingMode (RenderingMode mode);
+    RenderingMode getRenderingMode () const { return _renderingMode; }
+
+    // The clear colors of MeshRenderer::clear for the current mode, and the far depth.
+    void clear ();
+
+    // Column-major matrices, like GLKMatrix4.m.
+    void render (const float projection[16], const float modelView[16]);
+
+    const FrameStatistics& lastFrameStatistics () const { return _statistics; }
+
+    // RGBA, 4 * width bytes per row, the top row first, as encodeJpeg reads it by default.
+    void readPixels (uint8_t* rgba) const;
+
+private:
+    // Clip-space position and the interpolated values of the mode: a luminance, a color or texture
+    // coordinates.
+    struct ClipVertex
+    {
+        float position[4];
+        float attributes[3];
+    };
+
+    // Edge functions, positive inside, and planes of the window depth, 1/w and attributes/w.
+    struct TriangleSetup
+    {
+        float edges[3][3];
+        float edgeScales[3];   // to the wireframe distance
+        float depth[3];
+        float inverseW[3];
+        float attributes[3][3];
+        int minX, maxX, minY, maxY;
+        int mipLevel;
+    };
+
+    struct BinningJob
+    {
+        std::vector<TriangleSetup> triangles;
+        std::vector<std::vector<int>> tileTriangles;
+        int numRasterizedTriangles = 0;
+    };
+
+    void transformChunk (int chunkIndex, const float modelViewProjection[16], const float modelView[16]);
+    void binTriangles (int job, int firstTriangle, int numTriangles);
+    void setupTriangle (const ClipVertex vertices[3], BinningJob& job);
+    void rasterizeTile (int tile);
+    void rasterizeTriangle (const TriangleSetup& triangle, int tileX, int tileY);
+
+    // Bilinear, clamped to the edges, in [0, 255].
+    void sampleTexture (int mipLevel, const float u[4], const float v[4], SimdFloat4& r, SimdFloat4& g, SimdFloat4& b) const;
+
+private:
+    int _width = 0;
+    int _height = 0;
+
+    // Rounded up to a multiple of 4.
+    int _stride = 0;
+    int _numTilesX = 0;
+    int _numTilesY = 0;
+
+    ParallelFor _parallelFor;
+    RenderingMode _renderingMode = RenderingModeLightedGray;
+
+    std::vector<MeshChunk> _chunks;
+    std::vector<std::vector<ClipVertex>> _clipVertices;
+    std::vector<int> _chunkFirstTriangles;
+
+    // Luma and chroma levels from 0.
+    std::vector<MipLevel> _lumaLevels;
+    std::vector<MipLevel> _chromaLevels;
+
+    std::vector<BinningJob> _binningJobs;
+    std::vector<uint8_t> _color;
+    std::vector<float> _depth;
+
+    FrameStatistics _statistics;
+};
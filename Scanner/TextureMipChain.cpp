@@ -0,0 +1,195 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "TextureMipChain.h"
+#include "SimdMath.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// Local functions
+namespace
+{
+
+    // Separable taps of a 2x downsampling: destination pixel x reads the source pixels 2x + firstOffset
+    // to 2x + firstOffset + numTaps - 1, centered on 2x + 0.5.
+    struct MipKernel
+    {
+        int numTaps;
+        int firstOffset;
+        float weights[8];
+    };
+
+    double besselI0 (double x)
+    {
+        double sum = 1.0;
+        double term = 1.0;
+        for (int k = 1; k < 32; ++k)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    // Lowpass at half the source frequency, windowed to a radius of 4 source pixels.
+    MipKernel makeKaiserKernel ()
+    {
+        const double beta = 4.0;
+        const double radius = 4.0;
+
+        MipKernel kernel;
+        kernel.numTaps = 8;
+        kernel.firstOffset = -3;
+
+        double sum = 0.0;
+        double weights[8];
+        for (int tap = 0; tap < kernel.numTaps; ++tap)
+        {
+            const double t = tap + kernel.firstOffset - 0.5;
+            const double x = M_PI * t / 2.0;
+            const double ratio = t / radius;
+            weights[tap] = (std::sin(x) / x) * besselI0(beta * std::sqrt(1.0 - ratio * ratio)) / besselI0(beta);
+            sum += weights[tap];
+        }
+
+        for (int tap = 0; tap < kernel.numTaps; ++tap)
+            kernel.weights[tap] = float(weights[tap] / sum);
+        return kernel;
+    }
+
+    const MipKernel& mipKernel (MipFilter filter)
+    {
+        static const MipKernel box = { 2, 0, { 0.5f, 0.5f } };
+        static const MipKernel kaiser = makeKaiserKernel();
+        return (filter == MipFilterBox) ? box : kaiser;
+    }
+
+    // Horizontal taps read up to this many pixels on each side of a row.
+    const int kRowPadding = 4;
+
+} // Anonymous
+
+int mipLevelCount (int width, int height)
+{
+    int numLevels = 1;
+    while (width > 1 || height > 1)
+    {
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+        ++numLevels;
+    }
+    return numLevels;
+}
+
+void downsampleMipLevel (const uint8_t* pixels, int width, int height, size_t bytesPerRow, int channels,
+                         MipFilter filter, MipLevel& result)
+{
+    assert (channels == 1 || channels == 2);
+
+    const MipKernel& kernel = mipKernel(filter);
+
+    result.width = std::max(1, width / 2);
+    result.height = std::max(1, height / 2);
+    result.channels = channels;
+    result.pixels.resize (size_t(result.width) * result.height * channels);
+
+    // The destination row is computed 4 pixels at a time.
+    const int alignedWidth = (result.width + 3) & ~3;
+    const int rowSize = width * channels;
+    const int paddedRowSize = 2 * alignedWidth + 4 * kRowPadding;
+
+    std::vector<float> filteredRow (rowSize + 3);
+    std::vector<float> paddedRows (channels * paddedRowSize);
+    std::vector<uint8_t> channelRows (channels * alignedWidth);
+
+    for (int y = 0; y < result.height; ++y)
+    {
+        // Vertical pass over whole rows, interleaved channels included.
+        std::fill (filteredRow.begin(), filteredRow.end(), 0.f);
+        for (int tap = 0; tap < kernel.numTaps; ++tap)
+        {
+            const int sourceY = std::min(height - 1, std::max(0, 2 * y + kernel.firstOffset + tap));
+            const uint8_t* row = pixels + sourceY * bytesPerRow;
+            const SimdFloat4 weight = simdSplat(kernel.weights[tap]);
+
+            int i = 0;
+            for (; i + 4 <= rowSize; i += 4)
+                simdStore(&filteredRow[i], simdLoad(&filteredRow[i]) + weight * simdLoadBytes(row + i));
+            for (; i < rowSize; ++i)
+                filteredRow[i] += kernel.weights[tap] * row[i];
+        }
+
+        // Deinterleaved and padded with the edge pixels.
+        for (int channel = 0; channel < channels; ++channel)
+        {
+            float* padded = &paddedRows[channel * paddedRowSize];
+            for (int i = 0; i < paddedRowSize; ++i)
+                padded[i] = filteredRow[std::min(width - 1, std::max(0, i - kRowPadding)) * channels + channel];
+        }
+
+        // Horizontal pass, the even lanes of the padded row are the taps of 4 consecutive destination pixels.
+        for (int channel = 0; channel < channels; ++channel)
+        {
+            const float* padded = &paddedRows[channel * paddedRowSize];
+            uint8_t* channelRow = &channelRows[channel * alignedWidth];
+            for (int x = 0; x < alignedWidth; x += 4)
+            {
+                SimdFloat4 sum = simdSplat(0.f);
+                for (int tap = 0; tap < kernel.numTaps; ++tap)
+                {
+                    SimdFloat4 even, odd;
+                    simdLoadDeinterleave2(padded + kRowPadding + 2 * x + kernel.firstOffset + tap, even, odd);
+                    sum = sum + simdSplat(kernel.weights[tap]) * even;
+                }
+                simdStoreBytes(channelRow + x, sum);
+            }
+        }
+
+        uint8_t* destination = &result.pixels[size_t(y) * result.width * channels];
+        if (channels == 1)
+        {
+            std::copy (channelRows.begin(), channelRows.begin() + result.width, destination);
+        }
+        else
+        {
+            for (int x = 0; x < result.width; ++x)
+            {
+                destination[2 * x] = channelRows[x];
+                destination[2 * x + 1] = channelRows[alignedWidth + x];
+            }
+        }
+    }
+}
+
+std::vector<MipLevel> buildMipChain (const uint8_t* pixels, int width, int height, size_t bytesPerRow, int channels,
+                                     MipFilter filter, const std::atomic<bool>* cancelled)
+{
+    std::vector<MipLevel> levels (mipLevelCount(width, height) - 1);
+
+    for (size_t level = 0; level < levels.size(); ++level)
+    {
+        if (cancelled && *cancelled)
+        {
+            levels.resize (level);
+            break;
+        }
+
+        if (level == 0)
+        {
+            downsampleMipLevel(pixels, width, height, bytesPerRow, channels, filter, levels[0]);
+        }
+        else
+        {
+            const MipLevel& source = levels[level - 1];
+            downsampleMipLevel(source.pixels.data(), source.width, source.height, size_t(source.width) * channels,
+                               channels, filter, levels[level]);
+        }
+    }
+
+    return levels;
+}
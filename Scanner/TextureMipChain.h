@@ -0,0 +1,40 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum MipFilter
+{
+    MipFilterBox = 0,   // average of 2x2 pixels
+    MipFilterKaiser,    // Kaiser-windowed sinc over 8x8 pixels, sharper but may ring on hard edges
+};
+
+// An 8-bit image with 1 or 2 interleaved channels, e.g. a luma or a CbCr plane, rows tightly packed.
+struct MipLevel
+{
+    int width = 0;
+    int height = 0;
+    int channels = 1;
+    std::vector<uint8_t> pixels;
+};
+
+// Levels of an image down to 1x1, level 0 included.
+int mipLevelCount (int width, int height);
+
+// Halves the image to max(1, width / 2) by max(1, height / 2) like the GL mip levels, the odd last
+// row or column only contributing through the wider filter. Edge pixels repeat past the borders.
+void downsampleMipLevel (const uint8_t* pixels, int width, int height, size_t bytesPerRow, int channels,
+                         MipFilter filter, MipLevel& result);
+
+// Levels 1 to 1x1 of the image, each one downsampled from the previous one. Once cancelled is set, stops
+// before the next level and returns the levels built so far.
+std::vector<MipLevel> buildMipChain (const uint8_t* pixels, int width, int height, size_t bytesPerRow, int channels,
+                                     MipFilter filter, const std::atomic<bool>* cancelled = nullptr);
@@ -0,0 +1,82 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "TiledImageWriter.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+TiledImageWriter::TiledImageWriter (int width, int height, int tileWidth, int tileHeight, bool bgra, int quality,
+                                    const JpegEncoder::Output& output)
+: _width (width)
+, _height (height)
+, _tileHeight (tileHeight)
+, _bgra (bgra)
+, _encoder (width, height, quality, output)
+{
+    assert (tileWidth > 0 && tileHeight > 0);
+
+    for (int y = 0; y < height; y += tileHeight)
+    {
+        for (int x = 0; x < width; x += tileWidth)
+            _tiles.push_back({ x, y, std::min(tileWidth, width - x), std::min(tileHeight, height - y) });
+    }
+
+    _strip.resize(size_t(width) * std::min(tileHeight, height) * 4);
+}
+
+void TiledImageWriter::tileProjection (const float projection[16], int tile, float result[16]) const
+{
+    const Tile& region = _tiles[tile];
+
+    // Maps the normalized device coordinates of the tile to [-1, 1], applied to the clip coordinates.
+    // GL windows count the rows from the bottom.
+    const int bottom = _height - region.y - region.height;
+    const float scaleX = float(_width) / region.width;
+    const float scaleY = float(_height) / region.height;
+    const float offsetX = float(_width - 2 * region.x - region.width) / region.width;
+    const float offsetY = float(_height - 2 * bottom - region.height) / region.height;
+
+    for (int column = 0; column < 4; ++column)
+    {
+        const float* source = projection + 4 * column;
+        float* destination = result + 4 * column;
+        destination[0] = scaleX * source[0] + offsetX * source[3];
+        destination[1] = scaleY * source[1] + offsetY * source[3];
+        destination[2] = source[2];
+        destination[3] = source[3];
+    }
+}
+
+void TiledImageWriter::addTile (int tile, const uint8_t* pixels, size_t bytesPerRow, bool bottomUp)
+{
+    assert (tile == _numAddedTiles);
+
+    const Tile& region = _tiles[tile];
+    const size_t stripBytesPerRow = size_t(_width) * 4;
+    for (int row = 0; row < region.height; ++row)
+    {
+        const uint8_t* source = pixels + size_t(bottomUp ? region.height - 1 - row : row) * bytesPerRow;
+        memcpy(&_strip[row * stripBytesPerRow + size_t(region.x) * 4], source, size_t(region.width) * 4);
+    }
+
+    ++_numAddedTiles;
+
+    // The last tile of its strip.
+    if (region.x + region.width == _width)
+        _encoder.addRows(_strip.data(), region.height, stripBytesPerRow, _bgra);
+}
+
+bool TiledImageWriter::finish ()
+{
+    return _numAddedTiles == int(_tiles.size()) && _encoder.finish();
+}
+
+size_t TiledImageWriter::numBufferedBytes () const
+{
+    return _strip.capacity() + _encoder.numBufferedBytes();
+}
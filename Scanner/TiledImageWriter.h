@@ -0,0 +1,70 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#include "JpegEncoder.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Encodes an image larger than the framebuffers can be, rendered in tiles with sub-frusta of its
+// projection. The tiles are added strip by strip from the top, and each strip is encoded to JPEG as
+// soon as it is complete: only one strip of pixels is ever kept, never the whole image.
+class TiledImageWriter
+{
+public:
+    // In pixels, from the top left corner of the image.
+    struct Tile
+    {
+        int x;
+        int y;
+        int width;
+        int height;
+    };
+
+public:
+    // The pixels have 4 bytes, BGRA or RGBA. The edge tiles are smaller when the image size is not a
+    // multiple of the tile size.
+    TiledImageWriter (int width, int height, int tileWidth, int tileHeight, bool bgra, int quality,
+                      const JpegEncoder::Output& output);
+
+    int width () const { return _width; }
+    int height () const { return _height; }
+
+    // In the order to add them: strips from the top, tiles from the left.
+    const std::vector<Tile>& tiles () const { return _tiles; }
+
+    // The projection restricted to the tile, column-major like GLKMatrix4.m. Rendering every tile with
+    // its own covers exactly the pixels of the image rendered with the whole projection.
+    void tileProjection (const float projection[16], int tile, float result[16]) const;
+
+    // Copies the tile in its strip, and encodes the strip once its last tile is added.
+    void addTile (int tile, const uint8_t* pixels, size_t bytesPerRow, bool bottomUp);
+
+    int numAddedTiles () const { return _numAddedTiles; }
+
+    // Once all the tiles are added. False if the output failed.
+    bool finish ();
+
+    // The strip and the encoder buffers, what the writer holds of the image.
+    size_t numBufferedBytes () const;
+
+private:
+    int _width;
+    int _height;
+    int _tileHeight;
+    bool _bgra;
+
+    std::vector<Tile> _tiles;
+    int _numAddedTiles = 0;
+
+    // The strip of the next tile, top-down.
+    std::vector<uint8_t> _strip;
+
+    JpegEncoder _encoder;
+};
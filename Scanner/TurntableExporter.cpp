@@ -0,0 +1,168 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "TurntableExporter.h"
+#include "JpegEncoder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+// Local functions
+namespace
+{
+
+    // result = a * b, column-major.
+    void multiplyMatrices (const float a[16], const float b[16], float result[16])
+    {
+        for (int column = 0; column < 4; ++column)
+        {
+            for (int row = 0; row < 4; ++row)
+            {
+                float sum = 0.f;
+                for (int k = 0; k < 4; ++k)
+                    sum += a[k * 4 + row] * b[column * 4 + k];
+                result[column * 4 + row] = sum;
+            }
+        }
+    }
+
+} // Anonymous
+
+void turntableModelView (const float modelView[16], const float center[3], float angle, float result[16])
+{
+    const float c = std::cos(angle);
+    const float s = std::sin(angle);
+
+    // The rotation around y, between the translations of the center to the origin and back.
+    const float orbit[16] = {
+        c, 0.f, -s, 0.f,
+        0.f, 1.f, 0.f, 0.f,
+        s, 0.f, c, 0.f,
+        center[0] - c * center[0] - s * center[2], 0.f, center[2] + s * center[0] - c * center[2], 1.f,
+    };
+
+    multiplyMatrices(modelView, orbit, result);
+}
+
+SoftwareTurntableExporter::SoftwareTurntableExporter (const TurntableSettings& settings)
+: _settings (settings)
+, _slots (std::max(1, settings.numSlots))
+{
+    const size_t numPixels = size_t(settings.width) * settings.height;
+    const size_t numChromaBytes = size_t((settings.width + 1) / 2) * ((settings.height + 1) / 2) * 2;
+
+    for (Slot& slot : _slots)
+    {
+        slot.renderer.reset(new SoftwareMeshRenderer(settings.width, settings.height));
+        slot.rgba.resize(numPixels * 4);
+        slot.luma.resize(numPixels);
+        slot.chroma.resize(numChromaBytes);
+    }
+}
+
+void SoftwareTurntableExporter::setParallelFor (const ParallelFor& parallelFor)
+{
+    for (Slot& slot : _slots)
+        slot.renderer->setParallelFor(parallelFor);
+}
+
+void SoftwareTurntableExporter::setMesh (const std::vector<SoftwareMeshRenderer::MeshChunk>& chunks,
+                                         SoftwareMeshRenderer::RenderingMode mode, const Nv12Image* texture)
+{
+    for (Slot& slot : _slots)
+    {
+        SoftwareMeshRenderer& renderer = *slot.renderer;
+        renderer.clearMesh();
+        for (const SoftwareMeshRenderer::MeshChunk& chunk : chunks)
+            renderer.addMeshChunk(chunk);
+
+        if (texture)
+            renderer.setTexture(*texture);
+
+        renderer.setRenderingMode(mode);
+    }
+}
+
+bool SoftwareTurntableExporter::exportFrames (const float projection[16], const float modelView[16], const float center[3],
+                                              const std::string& pathPrefix)
+{
+    const int width = _settings.width;
+    const int height = _settings.height;
+    const size_t chromaBytesPerRow = size_t((width + 1) / 2) * 2;
+
+    // Only the encoding stage writes it, it is read once the pipeline finished.
+    bool failed = false;
+
+    FramePipeline pipeline ((int)_slots.size(), "render");
+
+    pipeline.addStage("readback", [this](int slot, int /*frame*/) {
+        _slots[slot].renderer->readPixels(_slots[slot].rgba.data());
+    });
+
+    pipeline.addStage("conversion", [this, width, height, chromaBytesPerRow](int slot, int /*frame*/) {
+        Slot& target = _slots[slot];
+        convertToNv12(target.rgba.data(), width, height, size_t(width) * 4, false, false,
+                      target.luma.data(), width, target.chroma.data(), chromaBytesPerRow);
+    });
+
+    pipeline.addStage("encoding", [this, &pathPrefix, &failed](int slot, int frame) {
+        char suffix[16];
+        snprintf(suffix, sizeof(suffix), "%04d.jpg", frame);
+        if (!writeFrame(_slots[slot], pathPrefix + suffix))
+            failed = true;
+    });
+
+    pipeline.start();
+
+    for (int frame = 0; frame < _settings.numFrames; ++frame)
+    {
+        const int slot = pipeline.acquireSlot(true);
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        float frameModelView[16];
+        const float angle = 2.f * float(M_PI) * frame / _settings.numFrames;
+        turntableModelView(modelView, center, angle, frameModelView);
+
+        SoftwareMeshRenderer& renderer = *_slots[slot].renderer;
+        renderer.clear();
+        renderer.render(projection, frameModelView);
+
+        pipeline.submit(slot, frame, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    pipeline.finish();
+
+    _statistics = pipeline.statistics();
+    _elapsedSeconds = pipeline.elapsedSeconds();
+    _framesPerSecond = pipeline.framesPerSecond();
+    return !failed;
+}
+
+bool SoftwareTurntableExporter::writeFrame (const Slot& slot, const std::string& path) const
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+
+    Nv12Image image;
+    image.luma = slot.luma.data();
+    image.chroma = slot.chroma.data();
+    image.lumaBytesPerRow = _settings.width;
+    image.chromaBytesPerRow = size_t((_settings.width + 1) / 2) * 2;
+    image.width = _settings.width;
+    image.height = _settings.height;
+
+    JpegEncoder encoder (image.width, image.height, _settings.quality, [file](const uint8_t* data, size_t size) {
+        return fwrite(data, 1, size, file) == size;
+    });
+    encoder.addRows(image, 0, image.height);
+
+    bool success = encoder.finish();
+    success = (fclose(file) == 0) && success;
+    return success;
+}
@@ -0,0 +1,74 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#include "FramePipeline.h"
+#include "SoftwareMeshRenderer.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// The orbit of the turntable exports: modelView turned by angle, in radians, around the y axis of the
+// mesh through center. Column-major matrices like GLKMatrix4.m, the same orbit as
+// ViewpointController::turntableModelViewMatrix.
+void turntableModelView (const float modelView[16], const float center[3], float angle, float result[16]);
+
+// The frames of a full turn, and the frames in flight in the pipeline.
+struct TurntableSettings
+{
+    int width = 640;
+    int height = 480;
+    int numFrames = 120;
+    int numSlots = 3;
+    int quality = 90;
+};
+
+// Renders a turntable of a mesh with the SoftwareMeshRenderer and writes its frames as numbered JPEGs,
+// e.g. on a server. The frames go through the stages of the video export of the mesh viewer in a
+// FramePipeline: rendering, readback, YCbCr conversion and encoding. Every slot has its own renderer, so
+// the next frame renders while the previous ones are read back and encoded.
+class SoftwareTurntableExporter
+{
+public:
+    explicit SoftwareTurntableExporter (const TurntableSettings& settings = TurntableSettings());
+
+    const TurntableSettings& settings () const { return _settings; }
+
+    // The renderers of all the slots, the chunks must stay valid until the next setMesh.
+    void setParallelFor (const ParallelFor& parallelFor);
+    void setMesh (const std::vector<SoftwareMeshRenderer::MeshChunk>& chunks, SoftwareMeshRenderer::RenderingMode mode,
+                  const Nv12Image* texture = nullptr);
+
+    // One full turn from modelView, into pathPrefix0000.jpg and on. False if a file could not be written.
+    bool exportFrames (const float projection[16], const float modelView[16], const float center[3], const std::string& pathPrefix);
+
+    // Of the last export.
+    const std::vector<FramePipeline::StageStatistics>& statistics () const { return _statistics; }
+    double elapsedSeconds () const { return _elapsedSeconds; }
+    double framesPerSecond () const { return _framesPerSecond; }
+
+private:
+    // The buffers of a frame in flight, from one stage to the next.
+    struct Slot
+    {
+        std::unique_ptr<SoftwareMeshRenderer> renderer;
+        std::vector<uint8_t> rgba;
+        std::vector<uint8_t> luma;
+        std::vector<uint8_t> chroma;
+    };
+
+    bool writeFrame (const Slot& slot, const std::string& path) const;
+
+private:
+    TurntableSettings _settings;
+    std::vector<Slot> _slots;
+
+    std::vector<FramePipeline::StageStatistics> _statistics;
+    double _elapsedSeconds = 0.0;
+    double _framesPerSecond = 0.0;
+};
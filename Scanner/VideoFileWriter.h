@@ -0,0 +1,42 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#import <AVFoundation/AVFoundation.h>
+#import <CoreVideo/CoreVideo.h>
+
+// H.264 video in an MPEG-4 file, from full range BT.709 NV12 frames like those of convertToNv12. The
+// frames are converted into pixel buffers of the pool of the writer, then appended once the encoder
+// takes them: only the calling thread waits, e.g. the encoding stage of a FramePipeline.
+class VideoFileWriter
+{
+public:
+    ~VideoFileWriter ();
+
+    // Replaces an existing file. False if the writer could not start.
+    bool open (NSString* path, int width, int height, int framesPerSecond);
+
+    // A full range bi-planar buffer to convert the next frame into, NULL on failure. Released by the
+    // caller.
+    CVPixelBufferRef createPixelBuffer ();
+
+    // Waits until the encoder takes more frames, then appends this one at its time. False if the writer
+    // failed.
+    bool appendFrame (CVPixelBufferRef pixelBuffer, int frame);
+
+    int numAppendedFrames () const { return _numAppendedFrames; }
+
+    // Once all the frames are appended. The completion is called on an arbitrary queue.
+    void finish (void (^completion)(bool success));
+
+private:
+    AVAssetWriter* _writer = nil;
+    AVAssetWriterInput* _input = nil;
+    AVAssetWriterInputPixelBufferAdaptor* _adaptor = nil;
+    int _framesPerSecond = 30;
+    int _numAppendedFrames = 0;
+};
@@ -0,0 +1,115 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#import "VideoFileWriter.h"
+
+VideoFileWriter::~VideoFileWriter ()
+{
+    if (_writer && _writer.status == AVAssetWriterStatusWriting)
+        [_writer cancelWriting];
+}
+
+bool VideoFileWriter::open (NSString* path, int width, int height, int framesPerSecond)
+{
+    NSURL* url = [NSURL fileURLWithPath:path];
+    [[NSFileManager defaultManager] removeItemAtURL:url error:nil];
+    
+    NSError* error = nil;
+    _writer = [[AVAssetWriter alloc] initWithURL:url fileType:AVFileTypeMPEG4 error:&error];
+    if (!_writer)
+    {
+        NSLog(@"Video writer: could not create %@: %@", path, error);
+        return false;
+    }
+    
+    NSDictionary* outputSettings = @{
+        AVVideoCodecKey: AVVideoCodecH264,
+        AVVideoWidthKey: @(width),
+        AVVideoHeightKey: @(height),
+    };
+    
+    _input = [AVAssetWriterInput assetWriterInputWithMediaType:AVMediaTypeVideo outputSettings:outputSettings];
+    _input.expectsMediaDataInRealTime = NO;
+    
+    NSDictionary* bufferAttributes = @{
+        (id)kCVPixelBufferPixelFormatTypeKey: @(kCVPixelFormatType_420YpCbCr8BiPlanarFullRange),
+        (id)kCVPixelBufferWidthKey: @(width),
+        (id)kCVPixelBufferHeightKey: @(height),
+        (id)kCVPixelBufferIOSurfacePropertiesKey: @{},
+    };
+    
+    _adaptor = [AVAssetWriterInputPixelBufferAdaptor assetWriterInputPixelBufferAdaptorWithAssetWriterInput:_input
+                                                                               sourcePixelBufferAttributes:bufferAttributes];
+    
+    if (![_writer canAddInput:_input])
+    {
+        NSLog(@"Video writer: H.264 %dx%d is not supported.", width, height);
+        return false;
+    }
+    [_writer addInput:_input];
+    
+    if (![_writer startWriting])
+    {
+        NSLog(@"Video writer: could not start writing: %@", _writer.error);
+        return false;
+    }
+    [_writer startSessionAtSourceTime:kCMTimeZero];
+    
+    _framesPerSecond = framesPerSecond;
+    _numAppendedFrames = 0;
+    return true;
+}
+
+CVPixelBufferRef VideoFileWriter::createPixelBuffer ()
+{
+    // The pool exists once the writing started.
+    CVPixelBufferRef pixelBuffer = NULL;
+    CVReturn err = CVPixelBufferPoolCreatePixelBuffer(kCFAllocatorDefault, _adaptor.pixelBufferPool, &pixelBuffer);
+    if (err)
+    {
+        NSLog(@"Video writer: error with CVPixelBufferPoolCreatePixelBuffer: %d", err);
+        return NULL;
+    }
+    
+    // The matrix of convertToNv12, the encoder keeps it in the video.
+    CVBufferSetAttachment(pixelBuffer, kCVImageBufferYCbCrMatrixKey, kCVImageBufferYCbCrMatrix_ITU_R_709_2, kCVAttachmentMode_ShouldPropagate);
+    CVBufferSetAttachment(pixelBuffer, kCVImageBufferColorPrimariesKey, kCVImageBufferColorPrimaries_ITU_R_709_2, kCVAttachmentMode_ShouldPropagate);
+    CVBufferSetAttachment(pixelBuffer, kCVImageBufferTransferFunctionKey, kCVImageBufferTransferFunction_ITU_R_709_2, kCVAttachmentMode_ShouldPropagate);
+    return pixelBuffer;
+}
+
+bool VideoFileWriter::appendFrame (CVPixelBufferRef pixelBuffer, int frame)
+{
+    while (!_input.readyForMoreMediaData && _writer.status == AVAssetWriterStatusWriting)
+        [NSThread sleepForTimeInterval:0.002];
+    
+    if (_writer.status != AVAssetWriterStatusWriting)
+        return false;
+    
+    if (![_adaptor appendPixelBuffer:pixelBuffer withPresentationTime:CMTimeMake(frame, _framesPerSecond)])
+    {
+        NSLog(@"Video writer: could not append frame %d: %@", frame, _writer.error);
+        return false;
+    }
+    
+    ++_numAppendedFrames;
+    return true;
+}
+
+void VideoFileWriter::finish (void (^completion)(bool success))
+{
+    AVAssetWriter* writer = _writer;
+    if (!writer || writer.status != AVAssetWriterStatusWriting)
+    {
+        completion(false);
+        return;
+    }
+    
+    [_input markAsFinished];
+    [writer finishWritingWithCompletionHandler:^{
+        completion(writer.status == AVAssetWriterStatusCompleted);
+    }];
+}
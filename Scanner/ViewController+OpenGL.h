@@ -15,6 +15,7 @@
 @interface ViewController (OpenGL)
 
 - (void)setupGL;
+- (void)setupRenderLoop;
 - (void)setupGLViewport;
 - (void)uploadGLColorTexture:(CMSampleBufferRef)sampleBuffer;
 - (void)uploadGLColorTextureFromDepth;
@@ -16,8 +16,11 @@
 
 - (void)setupGL
 {
-    // Create an EAGLContext for our EAGLView.
-    _display.context = [[EAGLContext alloc] initWithAPI:kEAGLRenderingAPIOpenGLES2];
+    // Create an EAGLContext for our EAGLView. OpenGL ES 3 when available, the mesh renderer needs it to
+    // sample ETC2 textures and mipmap those that are not a power of two. The shaders are ES 2 ones.
+    _display.context = [[EAGLContext alloc] initWithAPI:kEAGLRenderingAPIOpenGLES3];
+    if (!_display.context)
+        _display.context = [[EAGLContext alloc] initWithAPI:kEAGLRenderingAPIOpenGLES2];
     if (!_display.context) { NSLog(@"Failed to create ES context"); }
     
     [EAGLContext setCurrentContext:_display.context];
@@ -40,6 +43,45 @@
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 }
 
+- (void)setupRenderLoop
+{
+    // The preview draws the newest camera image and SLAM result on the next vsync, so it keeps up with
+    // the display even when a SLAM frame is slow.
+    _display.displayLink = [CADisplayLink displayLinkWithTarget:self selector:@selector(renderLoopDidFire)];
+    [_display.displayLink addToRunLoop:[NSRunLoop mainRunLoop] forMode:NSRunLoopCommonModes];
+}
+
+- (void)renderLoopDidFire
+{
+    [self logLiveFrameRates];
+    
+    // Drawing the same preview again would only waste power.
+    if (!_display.needsRender)
+        return;
+    
+    _display.needsRender = false;
+    [self renderScene];
+    ++_liveFrameRates.numRenderedFrames;
+}
+
+- (void)logLiveFrameRates
+{
+    const CFTimeInterval now = CACurrentMediaTime();
+    const CFTimeInterval elapsedSeconds = now - _liveFrameRates.startTime;
+    if (elapsedSeconds < 5.0)
+        return;
+    
+    if (_liveFrameRates.numRenderedFrames > 0 || _liveFrameRates.numProcessedFrames > 0)
+    {
+        NSLog(@"Live preview: %.1f fps, SLAM: %.1f fps, %d sensor frames dropped.",
+              _liveFrameRates.numRenderedFrames / elapsedSeconds, _liveFrameRates.numProcessedFrames / elapsedSeconds,
+              _liveFrameRates.numDroppedFrames);
+    }
+    
+    _liveFrameRates = LiveFrameRates();
+    _liveFrameRates.startTime = now;
+}
+
 - (void)setupGLViewport
 {
     const float vgaAspectRatio = 640.0f/480.0f;
@@ -19,6 +19,8 @@
 - (void)setupSLAM:(STStreamInfo *)streamInfo;
 - (void)resetSLAM;
 - (void)clearSLAM;
+- (void)scheduleDepthFrameProcessing:(STDepthFrame *)depthFrame
+                          colorFrame:(CMSampleBufferRef)sampleBuffer;
 - (void)processDepthFrame:(STDepthFrame *)depthFrame
                colorFrame:(CMSampleBufferRef)sampleBuffer;
 
@@ -105,8 +105,22 @@
     _slamState.initialized = true;
 }
 
+- (void)dropPendingDepthFrame
+{
+    // The scheduled processing finds nothing to do, a frame of the SLAM state being replaced is not
+    // processed by the new one.
+    _slamState.pendingDepthFrame = nil;
+    if (_slamState.pendingColorFrame)
+    {
+        CFRelease(_slamState.pendingColorFrame);
+        _slamState.pendingColorFrame = NULL;
+    }
+}
+
 - (void)resetSLAM
 {
+    [self dropPendingDepthFrame];
+    
     [_slamState.mapper reset];
     [_slamState.tracker reset];
     [_slamState.scene clear];
@@ -117,6 +131,8 @@
 
 - (void)clearSLAM
 {
+    [self dropPendingDepthFrame];
+    
     _slamState.initialized = false;
     _slamState.streamInfo = nil;
     _slamState.scene = nil;
@@ -125,6 +141,46 @@
     _slamState.keyFrameManager = nil;
 }
 
+- (void)scheduleDepthFrameProcessing:(STDepthFrame *)depthFrame
+                          colorFrame:(CMSampleBufferRef)sampleBuffer
+{
+    // SLAM did not get to the previous frames, only the newest ones are worth processing.
+    if (_slamState.pendingDepthFrame != nil)
+        ++_liveFrameRates.numDroppedFrames;
+    
+    if (sampleBuffer)
+        CFRetain(sampleBuffer);
+    if (_slamState.pendingColorFrame)
+        CFRelease(_slamState.pendingColorFrame);
+    
+    _slamState.pendingDepthFrame = depthFrame;
+    _slamState.pendingColorFrame = sampleBuffer;
+    
+    if (_slamState.processingScheduled)
+        return;
+    
+    // The SLAM objects share the preview GL context, so they stay on the main thread: the scene is bound
+    // to one context, and the display link renders it between two frames of the mapper. Processing on a
+    // later run loop pass lets the display link present the new camera image first.
+    _slamState.processingScheduled = true;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        STDepthFrame *pendingDepthFrame = _slamState.pendingDepthFrame;
+        CMSampleBufferRef pendingColorFrame = _slamState.pendingColorFrame;
+        _slamState.pendingDepthFrame = nil;
+        _slamState.pendingColorFrame = NULL;
+        _slamState.processingScheduled = false;
+        
+        if (_slamState.initialized && pendingDepthFrame != nil)
+        {
+            [self processDepthFrame:pendingDepthFrame colorFrame:pendingColorFrame];
+            ++_liveFrameRates.numProcessedFrames;
+        }
+        
+        if (pendingColorFrame)
+            CFRelease(pendingColorFrame);
+    });
+}
+
 - (void)processDepthFrame:(STDepthFrame *)depthFrame
                colorFrame:(CMSampleBufferRef)sampleBuffer
 {
@@ -132,12 +188,13 @@
     // Both shift and float values in meters will then be available.
     [_lastFloatDepth updateFromDepthFrame:depthFrame];
     
-    // Upload the new color image for next rendering.
-    if (_useColorCamera && sampleBuffer != nil)
-        [self uploadGLColorTexture:sampleBuffer];
-    else if(!_useColorCamera)
+    // The color image was already uploaded by the sensor callback, as soon as it arrived.
+    if (!_useColorCamera)
         [self uploadGLColorTextureFromDepth];
     
+    // Render the new SLAM result on the next vsync.
+    _display.needsRender = true;
+    
     switch (_slamState.scannerState)
     {
         case ScannerStateCubePlacement:
@@ -246,20 +246,21 @@
 {
     if (_slamState.initialized)
     {
-        [self processDepthFrame:depthFrame colorFrame:sampleBuffer];
-        // Scene rendering is triggered by new frames to avoid rendering the same view several times.
-        [self renderScene];
+        // The preview shows the new camera image on the next vsync, SLAM catches up at its own rate.
+        if (_useColorCamera)
+        {
+            [self uploadGLColorTexture:sampleBuffer];
+            _display.needsRender = true;
+        }
+        
+        [self scheduleDepthFrameProcessing:depthFrame colorFrame:sampleBuffer];
     }
 }
 
 - (void)sensorDidOutputDepthFrame:(STDepthFrame *)depthFrame
 {
     if (_slamState.initialized)
-    {
-        [self processDepthFrame:depthFrame colorFrame:nil];
-        // Scene rendering is triggered by new frames to avoid rendering the same view several times.
-        [self renderScene];
-    }
+        [self scheduleDepthFrameProcessing:depthFrame colorFrame:nil];
 }
 
 @end
@@ -53,6 +53,8 @@ struct SlamData
     SlamData ()
     : initialized (false)
     , scannerState (ScannerStateCubePlacement)
+    , pendingColorFrame (NULL)
+    , processingScheduled (false)
     {}
     
     BOOL initialized;
@@ -64,6 +66,12 @@ struct SlamData
     STCameraPoseInitializer *cameraPoseInitializer;
     STKeyFrameManager *keyFrameManager;
     ScannerState scannerState;
+    
+    // Newest sensor frames not processed yet, the color one retained. Each sensor frame replaces the
+    // previous one, so SLAM drops frames rather than falling behind when it is slower than the sensor.
+    STDepthFrame *pendingDepthFrame;
+    CMSampleBufferRef pendingColorFrame;
+    bool processingScheduled;
 };
 
 // Utility struct to manage a gesture-based scale.
@@ -156,6 +164,21 @@ struct DisplayData
     
     // OpenGL viewport.
     GLfloat viewport[4];
+    
+    // Renders the live preview at the display rate, independently of SLAM.
+    CADisplayLink *displayLink;
+    
+    // A new camera image or SLAM result was published since the last rendered frame.
+    bool needsRender = false;
+};
+
+// Rates of the live preview and of SLAM, logged every few seconds.
+struct LiveFrameRates
+{
+    CFTimeInterval startTime = 0;
+    int numRenderedFrames = 0;
+    int numProcessedFrames = 0;
+    int numDroppedFrames = 0;
 };
 
 @interface ViewController : UIViewController <STBackgroundTaskDelegate, MeshViewDelegate, UIPopoverControllerDelegate, UIGestureRecognizerDelegate>
@@ -176,6 +199,8 @@ struct DisplayData
     
     DisplayData _display;
     
+    LiveFrameRates _liveFrameRates;
+    
     // Most recent gravity vector from IMU.
     GLKVector3 _lastGravity;
     
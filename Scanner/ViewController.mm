@@ -10,6 +10,7 @@
 #import "ViewController+SLAM.h"
 #import "ViewController+OpenGL.h"
 
+#include <algorithm>
 #include <cmath>
 
 @implementation ViewController
@@ -43,6 +44,8 @@
 
     [self setupGL];
     
+    [self setupRenderLoop];
+    
     [self setupUserInterface];
     
     [self setupMeshViewController];
@@ -140,6 +143,10 @@
     [EAGLContext setCurrentContext:_display.context];
     
     _meshViewController.colorEnabled = _useColorCamera;
+    
+    GLKVector3 volumeSize = [_slamState.mapper volumeSizeInMeters];
+    _meshViewController.voxelSizeInMeters = std::min(volumeSize.x, std::min(volumeSize.y, volumeSize.z)) / _options.volumeResolution;
+    
     _meshViewController.mesh = mesh;
     [_meshViewController setCameraProjectionMatrix:[_slamState.scene depthCameraGLProjectionMatrix]];
     
@@ -166,6 +173,8 @@
     
     _slamState.scannerState = ScannerStateCubePlacement;
     
+    _display.displayLink.paused = NO;
+    
     [self updateIdleTimer];
 }
 
@@ -214,6 +223,9 @@
     
     _slamState.scannerState = ScannerStateViewing;
     
+    // The mesh viewer has its own display link.
+    _display.displayLink.paused = YES;
+    
     [self updateIdleTimer];
 }
 
@@ -302,11 +314,12 @@ namespace { // anonymous namespace for utility function.
         _lastGravity = GLKVector3Make (motion.gravity.x, motion.gravity.y, motion.gravity.z);
     }
     
-    if (_slamState.scannerState == ScannerStateCubePlacement || _slamState.scannerState == ScannerStateScanning)
-    {
-        // The tracker is more robust to fast moves if we feed it with motion data.
-        [_slamState.tracker updateCameraPoseWithMotion:motion];
-    }
+    // The tracker is more robust to fast moves if we feed it with motion data. It is only used from
+    // the main thread, like the rest of SLAM.
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (_slamState.scannerState == ScannerStateCubePlacement || _slamState.scannerState == ScannerStateScanning)
+            [_slamState.tracker updateCameraPoseWithMotion:motion];
+    });
 }
 
 #pragma mark - UI Callbacks
@@ -8,6 +8,8 @@
 
 #import <GLKit/GLKit.h>
 
+class MeshBvh;
+
 class ViewpointController
 {
 public:
@@ -20,6 +22,10 @@ public:
     
     void setMeshCenter(GLKVector3 center);
     
+    // Rotations pivot around this point from now on, without moving the current view. Starts at the
+    // mesh center.
+    void setOrbitCenter(GLKVector3 center);
+    
     // Pinch gesture for scale.
     void onPinchGestureBegan(float scale);
     void onPinchGestureChanged(float scale);
@@ -37,16 +43,31 @@ public:
     // Touch without a gesture will stop the current animations.
     void onTouchBegan();
     
+    // Tap to orbit around the tapped point of the mesh. The touch is in the coordinates of the viewport.
+    // Returns false if the mesh was missed.
+    bool onTapGesture(GLKVector2 touch, GLKVector2 viewportSize, const MeshBvh& meshBvh);
+    
+    // Segment from the near to the far plane through a point of the viewport, in mesh coordinates.
+    void viewportRay(GLKVector2 point, GLKVector2 viewportSize, GLKVector3& nearPoint, GLKVector3& farPoint) const;
+    
     // Current modelView matrix in OpenGL space.
     GLKMatrix4 currentGLModelViewMatrix() const;
     
     // Current projection matrix in OpenGL space.
     GLKMatrix4 currentGLProjectionMatrix() const;
+    
+    // The current modelView with the mesh turned by angle, in radians, around its vertical axis through
+    // the orbit center: one full turn from 0 to 2 pi is the orbit of a turntable video.
+    GLKMatrix4 turntableModelViewMatrix(float angle) const;
 
     // Apply one update step. Will apply current velocities and animations.
     // Returns true if the current viewpoint changed.
     bool update();
     
+    // True while update has changes to apply without further input, e.g. the rotation slowing down
+    // after a pan.
+    bool isAnimating() const;
+    
 private:
     GLKMatrix4 currentProjectionCenterTranslation() const;
     
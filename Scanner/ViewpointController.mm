@@ -5,6 +5,7 @@
 */
 
 #include "ViewpointController.h"
+#include "MeshBvh.h"
 
 #import <mach/mach_time.h>
 
@@ -34,6 +35,11 @@ struct ViewpointController::PrivateData
     // Centroid of the mesh.
     GLKVector3 meshCenter;
     
+    // Pivot of the rotations, and the view space translation keeping the view in place when it moved
+    // away from the mesh center.
+    GLKVector3 orbitCenter;
+    GLKVector3 orbitCenterOffset;
+    
     // Scale management
     float scaleWhenPinchGestureBegan;
     float currentScale;
@@ -63,6 +69,7 @@ ViewpointController::ViewpointController (float screenSizeX, float screenSizeY)
 : d (new PrivateData)
 {
     d->screenSize = GLKVector2Make(screenSizeX, screenSizeY);
+    d->meshCenter = GLKVector3Make(0, 0, 0);
     reset();
 }
 
@@ -82,6 +89,8 @@ void ViewpointController::reset()
     d->modelViewRotation = GLKMatrix4Identity;
     d->velocitiesDampingRatio = GLKVector2Make(0.95, 0.95);
     d->modelViewRotationVelocity = GLKVector2Make(0, 0);
+    d->orbitCenter = d->meshCenter;
+    d->orbitCenterOffset = GLKVector3Make(0, 0, 0);
 }
 
 void ViewpointController::setCameraProjection(GLKMatrix4 projRt)
@@ -93,6 +102,17 @@ void ViewpointController::setCameraProjection(GLKMatrix4 projRt)
 void ViewpointController::setMeshCenter(GLKVector3 center)
 {
     d->meshCenter = center;
+    d->orbitCenter = center;
+    d->orbitCenterOffset = GLKVector3Make(0, 0, 0);
+    d->cameraOrProjectionChangedSinceLastUpdate = true;
+}
+
+void ViewpointController::setOrbitCenter(GLKVector3 center)
+{
+    // The rotated displacement of the pivot compensates its move.
+    GLKVector3 displacement = GLKVector3Subtract(center, d->orbitCenter);
+    d->orbitCenterOffset = GLKVector3Add(d->orbitCenterOffset, GLKMatrix4MultiplyVector3(d->modelViewRotation, displacement));
+    d->orbitCenter = center;
     d->cameraOrProjectionChangedSinceLastUpdate = true;
 }
 
@@ -156,17 +176,49 @@ void ViewpointController::onTouchBegan()
     d->modelViewRotationVelocity = GLKVector2Make(0, 0);
 }
 
+bool ViewpointController::onTapGesture(GLKVector2 touch, GLKVector2 viewportSize, const MeshBvh& meshBvh)
+{
+    GLKVector3 nearPoint, farPoint;
+    viewportRay(touch, viewportSize, nearPoint, farPoint);
+    
+    GLKVector3 direction = GLKVector3Subtract(farPoint, nearPoint);
+    MeshBvh::RayHit hit;
+    if (!meshBvh.intersect(nearPoint.v, direction.v, 1.f, hit))
+        return false;
+    
+    setOrbitCenter(GLKVector3MakeWithArray(hit.position));
+    return true;
+}
+
+void ViewpointController::viewportRay(GLKVector2 point, GLKVector2 viewportSize, GLKVector3& nearPoint, GLKVector3& farPoint) const
+{
+    // Touches have y down, normalized device coordinates y up.
+    float x = 2.f * point.x / viewportSize.x - 1.f;
+    float y = 1.f - 2.f * point.y / viewportSize.y;
+    
+    GLKMatrix4 modelViewProjection = GLKMatrix4Multiply(currentGLProjectionMatrix(), currentGLModelViewMatrix());
+    bool isInvertible = false;
+    GLKMatrix4 inverse = GLKMatrix4Invert(modelViewProjection, &isInvertible);
+    
+    GLKVector4 nearClip = GLKMatrix4MultiplyVector4(inverse, GLKVector4Make(x, y, -1.f, 1.f));
+    GLKVector4 farClip = GLKMatrix4MultiplyVector4(inverse, GLKVector4Make(x, y, 1.f, 1.f));
+    nearPoint = GLKVector3DivideScalar(GLKVector3Make(nearClip.x, nearClip.y, nearClip.z), nearClip.w);
+    farPoint = GLKVector3DivideScalar(GLKVector3Make(farClip.x, farClip.y, farClip.z), farClip.w);
+}
+
 // ModelView matrix in OpenGL space.
 GLKMatrix4 ViewpointController::currentGLModelViewMatrix() const
 {
-    GLKMatrix4 meshCenterToOrigin = GLKMatrix4MakeTranslation(-d->meshCenter.x, -d->meshCenter.y, -d->meshCenter.z);
+    GLKMatrix4 orbitCenterToOrigin = GLKMatrix4MakeTranslation(-d->orbitCenter.x, -d->orbitCenter.y, -d->orbitCenter.z);
 
     // We'll put the object at some distance.
-    GLKMatrix4 originToVirtualViewpoint = GLKMatrix4MakeTranslation(0, 0, 4*d->meshCenter.z);
+    GLKMatrix4 originToVirtualViewpoint = GLKMatrix4MakeTranslation(d->orbitCenterOffset.x,
+                                                                    d->orbitCenterOffset.y,
+                                                                    d->orbitCenterOffset.z + 4*d->meshCenter.z);
     
     GLKMatrix4 modelView = originToVirtualViewpoint;
-    modelView = GLKMatrix4Multiply(modelView, d->modelViewRotation); // will apply the rotation around the mesh center.
-    modelView = GLKMatrix4Multiply(modelView, meshCenterToOrigin);
+    modelView = GLKMatrix4Multiply(modelView, d->modelViewRotation); // will apply the rotation around the orbit center.
+    modelView = GLKMatrix4Multiply(modelView, orbitCenterToOrigin);
     return modelView;
 }
 
@@ -181,6 +233,15 @@ GLKMatrix4 ViewpointController::currentGLProjectionMatrix() const
     return GLKMatrix4Multiply(centerTranslation,  GLKMatrix4Multiply(scale, d->referenceProjectionMatrix));
 }
 
+GLKMatrix4 ViewpointController::turntableModelViewMatrix(float angle) const
+{
+    // Applied before the current rotation, so that the mesh spins in place under the current view.
+    GLKMatrix4 turn = GLKMatrix4MakeTranslation(d->orbitCenter.x, d->orbitCenter.y, d->orbitCenter.z);
+    turn = GLKMatrix4RotateY(turn, angle);
+    turn = GLKMatrix4Translate(turn, -d->orbitCenter.x, -d->orbitCenter.y, -d->orbitCenter.z);
+    return GLKMatrix4Multiply(currentGLModelViewMatrix(), turn);
+}
+
 bool ViewpointController::update()
 {
     bool viewpointChanged = d->cameraOrProjectionChangedSinceLastUpdate;
@@ -215,6 +276,11 @@ bool ViewpointController::update()
     return viewpointChanged;
 }
 
+bool ViewpointController::isAnimating() const
+{
+    return d->cameraOrProjectionChangedSinceLastUpdate || GLKVector2Length(d->modelViewRotationVelocity) > 1e-5f;
+}
+
 GLKMatrix4 ViewpointController::currentProjectionCenterTranslation() const
 {
     GLKVector2 deltaFromScreenCenter = GLKVector2Subtract(d->screenCenter, d->meshCenterOnScreen);
@@ -0,0 +1,119 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "BufferSuballocator.h"
+#include "TestChecks.h"
+
+#include <cstring>
+#include <map>
+#include <random>
+
+// Local functions
+namespace
+{
+
+    void testFirstFit ()
+    {
+        BufferSuballocator allocator (100);
+
+        size_t a, b, c;
+        CHECK(allocator.allocate(30, a) && a == 0);
+        CHECK(allocator.allocate(30, b) && b == 30);
+        CHECK(allocator.allocate(30, c) && c == 60);
+        CHECK(allocator.usedSize() == 90);
+
+        size_t none;
+        CHECK(!allocator.allocate(20, none));
+
+        // The freed middle block is reused first, then merged with its free neighbours.
+        allocator.free(b);
+        size_t d;
+        CHECK(allocator.allocate(10, d) && d == 30);
+        allocator.free(d);
+        allocator.free(c);
+        CHECK(allocator.statistics().numFreeBlocks == 1);
+        CHECK(allocator.statistics().largestFreeBlock == 70);
+
+        allocator.free(a);
+        const BufferSuballocator::Statistics statistics = allocator.statistics();
+        CHECK(statistics.numAllocations == 0);
+        CHECK(statistics.numFreeBlocks == 1);
+        CHECK(statistics.largestFreeBlock == 100);
+        CHECK(allocator.freeSize() == 100);
+    }
+
+    // Random allocations over a shadow buffer, compacted and checked with their contents.
+    void testCompaction ()
+    {
+        const size_t capacity = 4096;
+        BufferSuballocator allocator (capacity);
+        std::vector<int> buffer (capacity, -1);
+        std::map<size_t, std::pair<size_t, int>> allocations; // offset to size and tag
+
+        std::mt19937 random (7);
+        for (int step = 0; step < 2000; ++step)
+        {
+            if (allocations.empty() || random() % 3 != 0)
+            {
+                size_t offset;
+                const size_t size = 1 + random() % 64;
+                if (allocator.allocate(size, offset))
+                {
+                    CHECK(offset + size <= capacity);
+                    for (size_t i = offset; i < offset + size; ++i)
+                    {
+                        CHECK(buffer[i] == -1);
+                        buffer[i] = step;
+                    }
+                    allocations[offset] = std::make_pair(size, step);
+                }
+            }
+            else
+            {
+                auto allocation = allocations.begin();
+                std::advance(allocation, random() % allocations.size());
+                std::fill(buffer.begin() + allocation->first, buffer.begin() + allocation->first + allocation->second.first, -1);
+                allocator.free(allocation->first);
+                allocations.erase(allocation);
+            }
+
+            if (step % 500 == 499)
+            {
+                const std::vector<BufferSuballocator::Move> moves = allocator.compact();
+                for (const BufferSuballocator::Move& move : moves)
+                {
+                    CHECK(move.to < move.from);
+                    memmove(&buffer[move.to], &buffer[move.from], move.size * sizeof(int));
+                }
+
+                std::map<size_t, std::pair<size_t, int>> relocated;
+                size_t end = 0;
+                for (const auto& allocation : allocations)
+                {
+                    const size_t offset = relocateOffset(moves, allocation.first);
+                    CHECK(offset == end);
+                    for (size_t i = 0; i < allocation.second.first; ++i)
+                        CHECK(buffer[offset + i] == allocation.second.second);
+                    relocated[offset] = allocation.second;
+                    end = offset + allocation.second.first;
+                }
+                std::fill(buffer.begin() + end, buffer.end(), -1);
+                allocations.swap(relocated);
+
+                CHECK(allocator.usedSize() == end);
+                CHECK(allocator.statistics().largestFreeBlock == capacity - end);
+            }
+        }
+    }
+
+} // Anonymous
+
+int main ()
+{
+    testFirstFit();
+    testCompaction();
+    return testResult("BufferSuballocatorTests");
+}
@@ -0,0 +1,96 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "FrustumCulling.h"
+#include "TestChecks.h"
+
+#include <cmath>
+
+// Local functions
+namespace
+{
+
+    // A perspective projection looking down -z from the origin, like GLKMatrix4MakePerspective.
+    void makePerspective (float fovY, float aspect, float nearZ, float farZ, float matrix[16])
+    {
+        const float f = 1.f / std::tan(fovY / 2.f);
+        for (int i = 0; i < 16; ++i)
+            matrix[i] = 0.f;
+        matrix[0] = f / aspect;
+        matrix[5] = f;
+        matrix[10] = (farZ + nearZ) / (nearZ - farZ);
+        matrix[11] = -1.f;
+        matrix[14] = 2.f * farZ * nearZ / (nearZ - farZ);
+    }
+
+    AxisAlignedBox makeBox (float x, float y, float z, float halfSize)
+    {
+        const float positions[6] = { x - halfSize, y - halfSize, z - halfSize, x + halfSize, y + halfSize, z + halfSize };
+        return computeAxisAlignedBox(positions, 2);
+    }
+
+    void testBoxes ()
+    {
+        const float positions[9] = { 1.f, -2.f, 3.f, -1.f, 5.f, 0.f, 0.5f, 0.f, -4.f };
+        const AxisAlignedBox box = computeAxisAlignedBox(positions, 3);
+        CHECK(!box.empty);
+        CHECK(box.min[0] == -1.f && box.min[1] == -2.f && box.min[2] == -4.f);
+        CHECK(box.max[0] == 1.f && box.max[1] == 5.f && box.max[2] == 3.f);
+
+        CHECK(computeAxisAlignedBox(positions, 0).empty);
+    }
+
+    void testFrustum ()
+    {
+        float projection[16];
+        makePerspective(float(M_PI) / 2.f, 1.f, 0.1f, 10.f, projection);
+
+        // The planes are normalized and point inwards: a point in front of the camera is inside all of them.
+        const Frustum frustum = makeFrustum(projection);
+        for (int plane = 0; plane < 6; ++plane)
+        {
+            const float* p = frustum.planes[plane];
+            CHECK_NEAR(std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]), 1.0, 1e-5);
+            CHECK(p[2] * -5.f + p[3] > 0.f);
+        }
+
+        CHECK(!isBoxOutsideFrustum(frustum, makeBox(0.f, 0.f, -5.f, 0.5f)));
+        CHECK(isBoxOutsideFrustum(frustum, makeBox(0.f, 0.f, 5.f, 0.5f)));     // behind
+        CHECK(isBoxOutsideFrustum(frustum, makeBox(-8.f, 0.f, -5.f, 0.5f)));   // left of the 90 degrees
+        CHECK(isBoxOutsideFrustum(frustum, makeBox(0.f, 0.f, -20.f, 0.5f)));   // past the far plane
+        CHECK(!isBoxOutsideFrustum(frustum, makeBox(0.f, 0.f, -10.f, 0.5f))); // crossing the far plane
+        CHECK(!isBoxOutsideFrustum(frustum, makeBox(-5.5f, 0.f, -5.f, 0.6f))); // crossing a side plane
+        CHECK(isBoxOutsideFrustum(frustum, AxisAlignedBox()));
+    }
+
+    void testCullAndSort ()
+    {
+        float viewProjection[16];
+        makePerspective(float(M_PI) / 2.f, 1.f, 0.1f, 100.f, viewProjection);
+
+        const AxisAlignedBox boxes[5] = {
+            makeBox(0.f, 0.f, -30.f, 1.f),
+            makeBox(0.f, 0.f, 10.f, 1.f),   // behind
+            makeBox(1.f, 1.f, -3.f, 1.f),
+            makeBox(50.f, 0.f, -5.f, 1.f),  // outside
+            makeBox(-2.f, 0.f, -12.f, 1.f),
+        };
+
+        int visible[5];
+        const int numVisible = cullAndSortBoxes(viewProjection, boxes, 5, visible);
+        CHECK(numVisible == 3);
+        CHECK(visible[0] == 2 && visible[1] == 4 && visible[2] == 0);
+    }
+
+} // Anonymous
+
+int main ()
+{
+    testBoxes();
+    testFrustum();
+    testCullAndSort();
+    return testResult("FrustumCullingTests");
+}
@@ -0,0 +1,172 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "MeshOptimizer.h"
+#include "SyntheticMeshes.h"
+#include "TestChecks.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+// Local functions
+namespace
+{
+
+    typedef std::array<uint16_t, 3> Triangle;
+
+    // The triangles rotated to start with their smallest index, which keeps the winding, and sorted.
+    std::vector<Triangle> canonicalTriangles (const uint16_t* indices, int numIndices)
+    {
+        std::vector<Triangle> triangles;
+        for (int i = 0; i + 2 < numIndices; i += 3)
+        {
+            Triangle triangle = {{ indices[i], indices[i + 1], indices[i + 2] }};
+            std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+            triangles.push_back(triangle);
+        }
+        std::sort(triangles.begin(), triangles.end());
+        return triangles;
+    }
+
+    // The triangles with the positions of their corners, to compare meshes whose vertices were renumbered.
+    std::vector<std::array<float, 9>> trianglePositions (const uint16_t* indices, int numIndices, const float* positions)
+    {
+        std::vector<std::array<float, 9>> triangles (numIndices / 3);
+        for (int i = 0; i < numIndices; ++i)
+            memcpy(&triangles[i / 3][3 * (i % 3)], positions + 3 * indices[i], 3 * sizeof(float));
+        return triangles;
+    }
+
+    void testVertexCacheStatistics ()
+    {
+        const uint16_t triangle[3] = { 0, 1, 2 };
+        VertexCacheStatistics statistics = analyzeVertexCache(triangle, 3, 3);
+        CHECK_NEAR(statistics.acmr, 3.0, 1e-6);
+        CHECK_NEAR(statistics.atvr, 1.0, 1e-6);
+
+        // The second triangle reuses two cached vertices.
+        const uint16_t quad[6] = { 0, 1, 2, 2, 1, 3 };
+        statistics = analyzeVertexCache(quad, 6, 4);
+        CHECK_NEAR(statistics.acmr, 2.0, 1e-6);
+        CHECK_NEAR(statistics.atvr, 1.0, 1e-6);
+    }
+
+    void testVertexCacheOptimization ()
+    {
+        SyntheticMesh mesh = makeBumpySphere(60, 80);
+        shuffleTriangles(mesh.indices, 1);
+
+        std::vector<uint16_t> optimized (mesh.indices.size());
+        std::vector<int> clusters;
+        optimizeVertexCache(mesh.indices.data(), mesh.numIndices(), mesh.numVertices(), optimized.data(), clusters);
+
+        CHECK(canonicalTriangles(optimized.data(), mesh.numIndices()) == canonicalTriangles(mesh.indices.data(), mesh.numIndices()));
+
+        const int numTriangles = mesh.numIndices() / 3;
+        CHECK(!clusters.empty() && clusters[0] == 0);
+        CHECK(std::is_sorted(clusters.begin(), clusters.end()));
+        CHECK(clusters.back() < numTriangles);
+
+        const VertexCacheStatistics before = analyzeVertexCache(mesh.indices.data(), mesh.numIndices(), mesh.numVertices());
+        const VertexCacheStatistics after = analyzeVertexCache(optimized.data(), mesh.numIndices(), mesh.numVertices());
+        CHECK(after.acmr < 0.8f);
+        CHECK(after.acmr < 0.5f * before.acmr);
+
+        std::vector<uint16_t> sorted (mesh.indices.size());
+        optimizeOverdraw(optimized.data(), mesh.numIndices(), mesh.positions.data(), mesh.numVertices(), clusters, sorted.data());
+        CHECK(canonicalTriangles(sorted.data(), mesh.numIndices()) == canonicalTriangles(mesh.indices.data(), mesh.numIndices()));
+
+        // Whole clusters move, the cache efficiency stays close.
+        const VertexCacheStatistics overdraw = analyzeVertexCache(sorted.data(), mesh.numIndices(), mesh.numVertices());
+        CHECK(overdraw.acmr < 1.1f * after.acmr);
+    }
+
+    void testVertexFetchOptimization ()
+    {
+        SyntheticMesh mesh = makeBumpySphere(20, 30);
+        shuffleTriangles(mesh.indices, 2);
+
+        // One vertex is not referenced anymore.
+        std::vector<uint16_t> indices = mesh.indices;
+        std::replace(indices.begin(), indices.end(), uint16_t(5), uint16_t(6));
+        const std::vector<std::array<float, 9>> expected = trianglePositions(indices.data(), int(indices.size()), mesh.positions.data());
+
+        std::vector<uint16_t> remap;
+        optimizeVertexFetch(indices.data(), int(indices.size()), mesh.numVertices(), remap);
+
+        // The vertices are numbered in order of first use.
+        int nextVertex = 0;
+        for (uint16_t index : indices)
+        {
+            CHECK(index <= nextVertex);
+            if (index == nextVertex)
+                ++nextVertex;
+        }
+        CHECK(nextVertex == mesh.numVertices() - 1);
+        CHECK(remap[5] == mesh.numVertices() - 1);
+
+        std::vector<uint16_t> sortedRemap = remap;
+        std::sort(sortedRemap.begin(), sortedRemap.end());
+        for (int vertex = 0; vertex < mesh.numVertices(); ++vertex)
+            CHECK(sortedRemap[vertex] == vertex);
+
+        std::vector<float> positions (mesh.positions.size());
+        remapVertices(reinterpret_cast<const uint8_t*>(mesh.positions.data()), mesh.numVertices(), 3 * sizeof(float), remap,
+                      reinterpret_cast<uint8_t*>(positions.data()));
+        CHECK(trianglePositions(indices.data(), int(indices.size()), positions.data()) == expected);
+
+        // Gathering in the new order is the same remapping.
+        std::vector<uint16_t> order (mesh.numVertices());
+        for (int vertex = 0; vertex < mesh.numVertices(); ++vertex)
+            order[remap[vertex]] = uint16_t(vertex);
+        std::vector<float> gathered (mesh.positions.size());
+        gatherVertices(reinterpret_cast<const uint8_t*>(mesh.positions.data()), 3 * sizeof(float), order.data(), mesh.numVertices(),
+                       reinterpret_cast<uint8_t*>(gathered.data()));
+        CHECK(gathered == positions);
+    }
+
+    void testCornerColors ()
+    {
+        SyntheticMesh mesh = makeBumpySphere(40, 50);
+        shuffleTriangles(mesh.indices, 3);
+
+        std::vector<uint16_t> indices = mesh.indices;
+        std::vector<uint8_t> colors;
+        std::vector<uint16_t> duplicateSources;
+        CHECK(assignCornerColors(indices.data(), int(indices.size()), mesh.numVertices(), colors, duplicateSources));
+        CHECK(colors.size() == size_t(mesh.numVertices()) + duplicateSources.size());
+
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            const int a = colors[indices[i]], b = colors[indices[i + 1]], c = colors[indices[i + 2]];
+            CHECK(a < 4 && b < 4 && c < 4);
+            CHECK(a != b && b != c && a != c);
+        }
+
+        // The duplicates only stand for their originals.
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            int original = indices[i];
+            if (original >= mesh.numVertices())
+                original = duplicateSources[original - mesh.numVertices()];
+            CHECK(original == mesh.indices[i]);
+        }
+
+        // A planar mesh rarely needs more than a few duplicates.
+        CHECK(duplicateSources.size() < size_t(mesh.numVertices()) / 20);
+    }
+
+} // Anonymous
+
+int main ()
+{
+    testVertexCacheStatistics();
+    testVertexCacheOptimization();
+    testVertexFetchOptimization();
+    testCornerColors();
+    return testResult("MeshOptimizerTests");
+}
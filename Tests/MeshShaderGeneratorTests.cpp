@@ -0,0 +1,119 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "MeshShaderGenerator.h"
+#include "TestChecks.h"
+
+#include <string>
+
+// The variants of the rendering modes are checked at compile time.
+static_assert(isValidMeshShaderKey(MeshShaderXRayLighting | MeshShaderWireframe | MeshShaderQuantizedPositions), "X-ray");
+static_assert(!isValidMeshShaderKey(MeshShaderHeadlight | MeshShaderXRayLighting), "Two lighting models");
+static_assert(!isValidMeshShaderKey(MeshShaderVertexColors | MeshShaderYCbCrTexture), "Two color sources");
+static_assert(!isValidMeshShaderKey(MeshShaderWireframe | MeshShaderPointSplats), "Wireframe points");
+static_assert(!isValidMeshShaderKey(MeshShaderAllFeatures + 1), "Unknown feature");
+
+// Local functions
+namespace
+{
+
+    int countOccurrences (const std::string& text, const std::string& pattern)
+    {
+        int count = 0;
+        for (size_t found = text.find(pattern); found != std::string::npos; found = text.find(pattern, found + 1))
+            ++count;
+        return count;
+    }
+
+    // A declaration like "attribute vec2 a_normal;", whatever the type.
+    bool declares (const std::string& source, const std::string& qualifier, const std::string& name)
+    {
+        for (size_t found = source.find(qualifier + " "); found != std::string::npos; found = source.find(qualifier + " ", found + 1))
+        {
+            const size_t end = source.find(';', found);
+            const std::string declaration = source.substr(found, end - found);
+            if (declaration.size() > name.size() && declaration.compare(declaration.size() - name.size(), name.size(), name) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    bool hasAttribute (const MeshShaderSource& source, MeshShaderAttribute index)
+    {
+        for (const MeshShaderSource::Attribute& attribute : source.attributes)
+            if (attribute.index == index)
+                return true;
+        return false;
+    }
+
+    void testAllVariants ()
+    {
+        int numValidKeys = 0;
+        for (MeshShaderKey key = 0; key <= MeshShaderAllFeatures; ++key)
+        {
+            if (!isValidMeshShaderKey(key))
+                continue;
+            ++numValidKeys;
+
+            const MeshShaderSource source = generateMeshShaderSource(key);
+            CHECK(countOccurrences(source.vertexShader, "void main") == 1);
+            CHECK(countOccurrences(source.fragmentShader, "void main") == 1);
+            CHECK(source.fragmentShader.find("gl_FragColor") != std::string::npos);
+
+            // Exactly the declared attributes, the unused ones would waste vertex fetches.
+            CHECK(countOccurrences(source.vertexShader, "attribute ") == int(source.attributes.size()));
+            for (const MeshShaderSource::Attribute& attribute : source.attributes)
+                CHECK(declares(source.vertexShader, "attribute", attribute.name));
+
+            for (const char* uniform : source.uniforms)
+                CHECK(declares(source.vertexShader, "uniform", uniform) || declares(source.fragmentShader, "uniform", uniform));
+
+            CHECK(hasAttribute(source, MeshShaderAttributePosition));
+            CHECK(hasAttribute(source, MeshShaderAttributeNormal) == ((key & MeshShaderLightingMask) != 0));
+            CHECK(hasAttribute(source, MeshShaderAttributeColor) == ((key & MeshShaderVertexColors) != 0));
+            CHECK(hasAttribute(source, MeshShaderAttributeTexcoord) == ((key & (MeshShaderYCbCrTexture | MeshShaderRgbTexture)) != 0));
+            CHECK(hasAttribute(source, MeshShaderAttributeCornerColor) == ((key & MeshShaderWireframe) != 0));
+
+            CHECK(declares(source.vertexShader, "uniform", "u_dequantization") == ((key & MeshShaderQuantizedPositions) != 0));
+            CHECK(declares(source.vertexShader, "uniform", "u_pointSplat") == ((key & MeshShaderPointSplats) != 0));
+            CHECK((source.vertexShader.find("gl_PointSize") != std::string::npos) == ((key & MeshShaderPointSplats) != 0));
+
+            // The derivatives of the wireframe need the extension, declared first.
+            if (key & MeshShaderWireframe)
+                CHECK(source.fragmentShader.compare(0, 10, "#extension") == 0);
+            else
+                CHECK(source.fragmentShader.find("#extension") == std::string::npos);
+        }
+
+        // 3 lighting choices, 4 color sources, 3 primitive styles, quantized or not.
+        CHECK(numValidKeys == 3 * 4 * 3 * 2);
+    }
+
+    void testDescriptions ()
+    {
+        CHECK(describeMeshShaderKey(0) == "unlit");
+        CHECK(describeMeshShaderKey(MeshShaderHeadlight | MeshShaderQuantizedPositions) == "headlight+quantized");
+        CHECK(describeMeshShaderKey(MeshShaderXRayLighting | MeshShaderWireframe) == "x-ray+wireframe");
+    }
+
+    void testDeterminism ()
+    {
+        const MeshShaderKey key = MeshShaderHeadlight | MeshShaderYCbCrTexture | MeshShaderQuantizedPositions;
+        const MeshShaderSource first = generateMeshShaderSource(key);
+        const MeshShaderSource second = generateMeshShaderSource(key);
+        CHECK(first.vertexShader == second.vertexShader);
+        CHECK(first.fragmentShader == second.fragmentShader);
+    }
+
+} // Anonymous
+
+int main ()
+{
+    testAllVariants();
+    testDescriptions();
+    testDeterminism();
+    return testResult("MeshShaderGeneratorTests");
+}
@@ -0,0 +1,131 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "MeshSimplifier.h"
+#include "SyntheticMeshes.h"
+#include "TestChecks.h"
+
+#include <cmath>
+
+// Local functions
+namespace
+{
+
+    // Column-major, like GLKMatrix4.
+    void makeTranslation (float x, float y, float z, float matrix[16])
+    {
+        for (int i = 0; i < 16; ++i)
+            matrix[i] = (i % 5 == 0) ? 1.f : 0.f;
+        matrix[12] = x;
+        matrix[13] = y;
+        matrix[14] = z;
+    }
+
+    // Only the y scale of the projection is read.
+    void makeProjection (float yScale, float matrix[16])
+    {
+        for (int i = 0; i < 16; ++i)
+            matrix[i] = 0.f;
+        matrix[0] = yScale;
+        matrix[5] = yScale;
+        matrix[10] = -1.f;
+        matrix[11] = -1.f;
+        matrix[14] = -0.2f;
+    }
+
+    void testLevelsOfDetail ()
+    {
+        const SyntheticMesh mesh = makeBumpySphere(60, 80);
+        const AxisAlignedBox bounds = computeAxisAlignedBox(mesh.positions.data(), mesh.numVertices());
+
+        std::vector<LevelOfDetail> levels;
+        buildLevelsOfDetail(mesh.indices.data(), mesh.numIndices(), mesh.positions.data(), mesh.numVertices(), bounds, 3, levels);
+        CHECK(levels.size() == 3);
+
+        // Each level removes at least a quarter of the triangles of the previous one, and strays further.
+        int previousNumIndices = mesh.numIndices();
+        float previousError = 0.f;
+        for (const LevelOfDetail& level : levels)
+        {
+            CHECK(!level.indices.empty());
+            CHECK(level.indices.size() % 3 == 0);
+            CHECK((int)level.indices.size() * 4 <= previousNumIndices * 3);
+            CHECK(level.error > previousError);
+
+            bool validIndices = true;
+            for (size_t i = 0; i < level.indices.size(); i += 3)
+            {
+                const uint16_t a = level.indices[i], b = level.indices[i + 1], c = level.indices[i + 2];
+                validIndices = validIndices && a < mesh.numVertices() && b < mesh.numVertices() && c < mesh.numVertices();
+                validIndices = validIndices && a != b && b != c && c != a;
+            }
+            CHECK(validIndices);
+
+            previousNumIndices = (int)level.indices.size();
+            previousError = level.error;
+        }
+
+        // A mesh too small to simplify keeps its full resolution only.
+        const uint16_t triangle[3] = { 0, 1, 2 };
+        buildLevelsOfDetail(triangle, 3, mesh.positions.data(), mesh.numVertices(), bounds, 3, levels);
+        CHECK(levels.empty());
+    }
+
+    void testSelectLevelOfDetail ()
+    {
+        // Powers of two, so that the projected errors fall exactly on the pixel threshold.
+        const float levelErrors[4] = { 0.f, 0.0625f, 0.125f, 0.25f };
+
+        // A segment of radius 1 centered 9 units in front of the eye: its nearest point is 8 units away,
+        // where a projection of y scale 2 maps a unit to viewportHeight / 8 pixels.
+        const float segment[6] = { -1.f, 0.f, 0.f, 1.f, 0.f, 0.f };
+        const AxisAlignedBox bounds = computeAxisAlignedBox(segment, 2);
+        float projection[16];
+        float modelView[16];
+        makeProjection(2.f, projection);
+        makeTranslation(0.f, 0.f, -9.f, modelView);
+
+        CHECK(selectLevelOfDetail(levelErrors, 4, bounds, projection, modelView, 256.f, 1.f) == 0);
+        CHECK(selectLevelOfDetail(levelErrors, 4, bounds, projection, modelView, 128.f, 1.f) == 1);
+        CHECK(selectLevelOfDetail(levelErrors, 4, bounds, projection, modelView, 64.f, 1.f) == 2);
+        CHECK(selectLevelOfDetail(levelErrors, 4, bounds, projection, modelView, 32.f, 1.f) == 3);
+        CHECK(selectLevelOfDetail(levelErrors, 4, bounds, projection, modelView, 8.f, 1.f) == 3);
+
+        // A looser threshold, fewer levels, or a zoomed projection.
+        CHECK(selectLevelOfDetail(levelErrors, 4, bounds, projection, modelView, 128.f, 2.f) == 2);
+        CHECK(selectLevelOfDetail(levelErrors, 2, bounds, projection, modelView, 32.f, 1.f) == 1);
+        makeProjection(4.f, projection);
+        CHECK(selectLevelOfDetail(levelErrors, 4, bounds, projection, modelView, 64.f, 1.f) == 1);
+        makeProjection(2.f, projection);
+
+        // Full resolution without a viewport, a single level, or with the eye inside the bounding sphere.
+        CHECK(selectLevelOfDetail(levelErrors, 4, bounds, projection, modelView, 0.f, 1.f) == 0);
+        CHECK(selectLevelOfDetail(levelErrors, 1, bounds, projection, modelView, 32.f, 1.f) == 0);
+        makeTranslation(0.f, 0.f, -0.5f, modelView);
+        CHECK(selectLevelOfDetail(levelErrors, 4, bounds, projection, modelView, 32.f, 1.f) == 0);
+
+        // Moving away never selects a finer level.
+        int previousLevel = 0;
+        bool monotonic = true;
+        for (float distance = 2.f; distance < 200.f; distance += 0.5f)
+        {
+            makeTranslation(0.3f, -0.2f, -distance, modelView);
+            const int level = selectLevelOfDetail(levelErrors, 4, bounds, projection, modelView, 480.f, 1.f);
+            monotonic = monotonic && level >= previousLevel;
+            previousLevel = level;
+        }
+        CHECK(monotonic);
+        CHECK(previousLevel == 3);
+    }
+
+} // Anonymous
+
+int main ()
+{
+    testLevelsOfDetail();
+    testSelectLevelOfDetail();
+    return testResult("MeshSimplifierTests");
+}
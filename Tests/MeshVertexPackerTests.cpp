@@ -0,0 +1,164 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "FrustumCulling.h"
+#include "MeshVertexPacker.h"
+#include "SyntheticMeshes.h"
+#include "TestChecks.h"
+
+#include <cmath>
+#include <cstring>
+
+// Local functions
+namespace
+{
+
+    float halfToFloat (uint16_t half)
+    {
+        const int sign = (half >> 15) ? -1 : 1;
+        const int exponent = (half >> 10) & 0x1f;
+        const int mantissa = half & 0x3ff;
+        if (exponent == 0)
+            return sign * std::ldexp(float(mantissa), -24);
+        if (exponent == 31)
+            return mantissa ? NAN : sign * INFINITY;
+        return sign * std::ldexp(float(mantissa | 0x400), exponent - 25);
+    }
+
+    template <typename T>
+    T readAttribute (const uint8_t* vertex, int offset, int component)
+    {
+        T value;
+        memcpy(&value, vertex + offset + component * sizeof(T), sizeof(T));
+        return value;
+    }
+
+    // Packs the mesh, then checks every attribute read back like the shaders do.
+    void checkRoundTrip (PackedVertexFormat::PositionType positionType, bool normals, bool colors, bool texcoords, int numVertices)
+    {
+        const SyntheticMesh mesh = makeBumpySphere(12, 16, 2.f, 10.f, -3.f, 0.5f);
+        numVertices = std::min(numVertices, mesh.numVertices());
+
+        const PackedVertexFormat format = makePackedVertexFormat(positionType, normals, colors, texcoords);
+        CHECK(format.stride % 4 == 0);
+        CHECK((format.positionOffset >= 0) == (positionType != PackedVertexFormat::PositionNone));
+        CHECK((format.normalOffset >= 0) == normals);
+        CHECK((format.colorOffset >= 0) == colors);
+        CHECK((format.texcoordOffset >= 0) == texcoords);
+
+        const PositionQuantization quantization = computePositionQuantization(mesh.positions.data(), numVertices);
+        const float quantizationError = positionQuantizationErrorBound(quantization);
+
+        // One guard vertex past the end must stay untouched.
+        std::vector<uint8_t> packed ((numVertices + 1) * format.stride, 0xcd);
+        packVertices(format, numVertices, mesh.positions.data(), mesh.normals.data(), mesh.colors.data(), mesh.texcoords.data(),
+                     packed.data(), quantization);
+        for (int i = 0; i < format.stride; ++i)
+            CHECK(packed[numVertices * format.stride + i] == 0xcd);
+
+        for (int v = 0; v < numVertices; ++v)
+        {
+            const uint8_t* vertex = &packed[v * format.stride];
+            const float* position = &mesh.positions[3 * v];
+
+            for (int k = 0; k < 3; ++k)
+            {
+                if (positionType == PackedVertexFormat::PositionFloat32)
+                    CHECK(readAttribute<float>(vertex, format.positionOffset, k) == position[k]);
+                else if (positionType == PackedVertexFormat::PositionFloat16)
+                    CHECK_NEAR(halfToFloat(readAttribute<uint16_t>(vertex, format.positionOffset, k)), position[k], std::fabs(position[k]) / 1024.f);
+                else if (positionType == PackedVertexFormat::PositionUnorm16)
+                {
+                    const float unorm = readAttribute<uint16_t>(vertex, format.positionOffset, k) / 65535.f;
+                    CHECK_NEAR(quantization.origin[k] + quantization.scale * unorm, position[k], quantizationError);
+                }
+            }
+            if (positionType == PackedVertexFormat::PositionFloat16)
+                CHECK_NEAR(halfToFloat(readAttribute<uint16_t>(vertex, format.positionOffset, 3)), 1.0, 0.0);
+
+            if (normals)
+            {
+                const int16_t encoded[2] = { readAttribute<int16_t>(vertex, format.normalOffset, 0),
+                                             readAttribute<int16_t>(vertex, format.normalOffset, 1) };
+                float normal[3];
+                decodeOctahedralNormal(encoded, normal);
+                const float* expected = &mesh.normals[3 * v];
+                CHECK(normal[0] * expected[0] + normal[1] * expected[1] + normal[2] * expected[2] > 0.99999f);
+            }
+
+            if (colors)
+            {
+                for (int k = 0; k < 3; ++k)
+                    CHECK_NEAR(vertex[format.colorOffset + k] / 255.f, mesh.colors[3 * v + k], 0.5f / 255.f + 1e-6f);
+                CHECK(vertex[format.colorOffset + 3] == 255);
+            }
+
+            if (texcoords)
+            {
+                for (int k = 0; k < 2; ++k)
+                    CHECK_NEAR(halfToFloat(readAttribute<uint16_t>(vertex, format.texcoordOffset, k)), mesh.texcoords[2 * v + k], 1.f / 2048.f);
+            }
+        }
+    }
+
+    void testFormats ()
+    {
+        const PackedVertexFormat::PositionType positionTypes[4] = {
+            PackedVertexFormat::PositionFloat32, PackedVertexFormat::PositionFloat16,
+            PackedVertexFormat::PositionUnorm16, PackedVertexFormat::PositionNone,
+        };
+
+        // Every combination, with partial blocks of the SIMD packing at the end.
+        for (PackedVertexFormat::PositionType positionType : positionTypes)
+            for (int attributes = 0; attributes < 8; ++attributes)
+                for (int numVertices : { 1, 3, 4, 7, 221 })
+                    checkRoundTrip(positionType, attributes & 1, attributes & 2, attributes & 4, numVertices);
+    }
+
+    void testOctahedralNormals ()
+    {
+        // The axes and the octants folded over the z = 0 plane.
+        const float directions[8][3] = {
+            { 1.f, 0.f, 0.f }, { 0.f, -1.f, 0.f }, { 0.f, 0.f, 1.f }, { 0.f, 0.f, -1.f },
+            { 0.577f, 0.577f, -0.577f }, { -0.577f, 0.577f, -0.577f }, { -0.6f, -0.8f, 0.f }, { 0.1f, -0.2f, -0.97f },
+        };
+
+        for (const float* direction : directions)
+        {
+            const float length = std::sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+            const float normal[3] = { direction[0] / length, direction[1] / length, direction[2] / length };
+
+            int16_t encoded[2];
+            encodeOctahedralNormal(normal, encoded);
+            float decoded[3];
+            decodeOctahedralNormal(encoded, decoded);
+            CHECK(normal[0] * decoded[0] + normal[1] * decoded[1] + normal[2] * decoded[2] > 0.99999f);
+        }
+    }
+
+    void testQuantization ()
+    {
+        AxisAlignedBox box;
+        box.empty = false;
+        box.min[0] = -1.f; box.min[1] = 2.f; box.min[2] = 0.f;
+        box.max[0] = 1.f; box.max[1] = 2.5f; box.max[2] = 0.25f;
+
+        // A cube over the longest side.
+        const PositionQuantization quantization = computePositionQuantization(box);
+        CHECK(quantization.scale >= 2.f);
+        CHECK(quantization.origin[0] <= -1.f && quantization.origin[1] <= 2.f && quantization.origin[2] <= 0.f);
+        CHECK(positionQuantizationErrorBound(quantization) < 1e-4f);
+    }
+
+} // Anonymous
+
+int main ()
+{
+    testFormats();
+    testOctahedralNormals();
+    testQuantization();
+    return testResult("MeshVertexPackerTests");
+}
@@ -0,0 +1,88 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Meshes shaped like the STMesh chunks for the tests and benchmarks: tightly packed xyz positions,
+// unit normals, rgb colors in [0, 1], uv texture coordinates and 16-bit triangles.
+struct SyntheticMesh
+{
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<float> colors;
+    std::vector<float> texcoords;
+    std::vector<uint16_t> indices;
+
+    int numVertices () const { return int(positions.size() / 3); }
+    int numIndices () const { return int(indices.size()); }
+};
+
+// A sphere with bumps like a scanned surface, of (rings + 1) * (segments + 1) vertices, so at most
+// 254 x 254 for 16-bit indices. The triangles go ring by ring, as a mapper emits them.
+inline SyntheticMesh makeBumpySphere (int rings, int segments, float radius = 1.f, float centerX = 0.f,
+                                      float centerY = 0.f, float centerZ = 0.f)
+{
+    SyntheticMesh mesh;
+
+    for (int ring = 0; ring <= rings; ++ring)
+    {
+        for (int segment = 0; segment <= segments; ++segment)
+        {
+            const float theta = float(M_PI) * ring / rings;
+            const float phi = 2.f * float(M_PI) * segment / segments;
+            const float bump = 1.f + 0.05f * std::sin(7.f * theta) * std::cos(5.f * phi);
+
+            const float direction[3] = { std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi) };
+            mesh.positions.push_back(centerX + radius * bump * direction[0]);
+            mesh.positions.push_back(centerY + radius * bump * direction[1]);
+            mesh.positions.push_back(centerZ + radius * bump * direction[2]);
+            mesh.normals.insert(mesh.normals.end(), direction, direction + 3);
+
+            mesh.colors.push_back(0.5f + 0.5f * std::sin(3.f * phi));
+            mesh.colors.push_back(0.5f + 0.4f * std::cos(2.f * theta));
+            mesh.colors.push_back(0.3f);
+
+            mesh.texcoords.push_back(float(segment) / segments);
+            mesh.texcoords.push_back(float(ring) / rings);
+        }
+    }
+
+    for (int ring = 0; ring < rings; ++ring)
+    {
+        for (int segment = 0; segment < segments; ++segment)
+        {
+            const uint16_t a = uint16_t(ring * (segments + 1) + segment);
+            const uint16_t b = uint16_t(a + segments + 1);
+            const uint16_t triangles[6] = { a, b, uint16_t(a + 1), uint16_t(a + 1), b, uint16_t(b + 1) };
+            mesh.indices.insert(mesh.indices.end(), triangles, triangles + 6);
+        }
+    }
+
+    return mesh;
+}
+
+// Triangles in a random order, each one keeping its winding.
+inline void shuffleTriangles (std::vector<uint16_t>& indices, unsigned seed)
+{
+    const int numTriangles = int(indices.size() / 3);
+    std::vector<int> order (numTriangles);
+    for (int triangle = 0; triangle < numTriangles; ++triangle)
+        order[triangle] = triangle;
+
+    std::mt19937 random (seed);
+    std::shuffle(order.begin(), order.end(), random);
+
+    std::vector<uint16_t> shuffled (indices.size());
+    for (int triangle = 0; triangle < numTriangles; ++triangle)
+        std::copy(&indices[3 * order[triangle]], &indices[3 * order[triangle]] + 3, &shuffled[3 * triangle]);
+    indices.swap(shuffled);
+}
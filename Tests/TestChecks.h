@@ -0,0 +1,52 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+
+// Checks of the test executables: a failed check is reported and counted, and main returns
+// testResult() so that ctest sees the failure.
+
+inline int& numFailedChecks ()
+{
+    static int numFailed = 0;
+    return numFailed;
+}
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) \
+        { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            ++numFailedChecks(); \
+        } \
+    } while (0)
+
+#define CHECK_NEAR(value, expected, tolerance) \
+    do { \
+        const double checkedValue = (value); \
+        const double checkedExpected = (expected); \
+        if (!(std::fabs(checkedValue - checkedExpected) <= (tolerance))) \
+        { \
+            fprintf(stderr, "%s:%d: check failed: %s is %g, expected %g within %g\n", __FILE__, __LINE__, \
+                    #value, checkedValue, checkedExpected, double(tolerance)); \
+            ++numFailedChecks(); \
+        } \
+    } while (0)
+
+inline int testResult (const char* name)
+{
+    if (numFailedChecks() > 0)
+    {
+        fprintf(stderr, "%s: %d checks failed\n", name, numFailedChecks());
+        return 1;
+    }
+
+    printf("%s: all checks passed\n", name);
+    return 0;
+}
@@ -0,0 +1,151 @@
+/*
+  This file is part of the Structure SDK.
+  Copyright © 2015 Occipital, Inc. All rights reserved.
+  http://structure.io
+*/
+
+#include "TextureMipChain.h"
+#include "TestChecks.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+
+// Local functions
+namespace
+{
+
+    // Same kernels as TextureMipChain.cpp, in double precision.
+    std::vector<double> referenceWeights (MipFilter filter, int& firstOffset)
+    {
+        if (filter == MipFilterBox)
+        {
+            firstOffset = 0;
+            return std::vector<double> { 0.5, 0.5 };
+        }
+
+        const auto besselI0 = [](double x) {
+            double sum = 1.0, term = 1.0;
+            for (int k = 1; k < 32; ++k)
+            {
+                term *= (x / (2.0 * k)) * (x / (2.0 * k));
+                sum += term;
+            }
+            return sum;
+        };
+
+        firstOffset = -3;
+        std::vector<double> weights (8);
+        double sum = 0.0;
+        for (int tap = 0; tap < 8; ++tap)
+        {
+            const double t = tap - 3 - 0.5;
+            const double x = M_PI * t / 2.0;
+            weights[tap] = (std::sin(x) / x) * besselI0(4.0 * std::sqrt(1.0 - (t / 4.0) * (t / 4.0))) / besselI0(4.0);
+            sum += weights[tap];
+        }
+        for (double& weight : weights)
+            weight /= sum;
+        return weights;
+    }
+
+    // Direct 2D convolution with clamped edges.
+    MipLevel referenceDownsample (const std::vector<uint8_t>& pixels, int width, int height, int channels, MipFilter filter)
+    {
+        int firstOffset;
+        const std::vector<double> weights = referenceWeights(filter, firstOffset);
+
+        MipLevel result;
+        result.width = std::max(1, width / 2);
+        result.height = std::max(1, height / 2);
+        result.channels = channels;
+        result.pixels.resize(size_t(result.width) * result.height * channels);
+
+        for (int y = 0; y < result.height; ++y)
+            for (int x = 0; x < result.width; ++x)
+                for (int channel = 0; channel < channels; ++channel)
+                {
+                    double sum = 0.0;
+                    for (size_t j = 0; j < weights.size(); ++j)
+                        for (size_t i = 0; i < weights.size(); ++i)
+                        {
+                            const int sourceX = std::min(width - 1, std::max(0, 2 * x + firstOffset + int(i)));
+                            const int sourceY = std::min(height - 1, std::max(0, 2 * y + firstOffset + int(j)));
+                            sum += weights[i] * weights[j] * pixels[(sourceY * width + sourceX) * channels + channel];
+                        }
+                    result.pixels[(y * result.width + x) * channels + channel] = uint8_t(std::min(255.0, std::max(0.0, std::round(sum))));
+                }
+        return result;
+    }
+
+    void checkAgainstReference (int width, int height, int channels, MipFilter filter, unsigned seed)
+    {
+        std::mt19937 random (seed);
+        std::vector<uint8_t> pixels (size_t(width) * height * channels);
+        for (uint8_t& pixel : pixels)
+            pixel = uint8_t(random());
+
+        // Rows padded like a CVPixelBuffer plane.
+        const size_t bytesPerRow = width * channels + 16;
+        std::vector<uint8_t> padded (bytesPerRow * height, 0xff);
+        for (int y = 0; y < height; ++y)
+            std::copy(&pixels[y * width * channels], &pixels[(y + 1) * width * channels], &padded[y * bytesPerRow]);
+
+        MipLevel level;
+        downsampleMipLevel(padded.data(), width, height, bytesPerRow, channels, filter, level);
+        const MipLevel expected = referenceDownsample(pixels, width, height, channels, filter);
+
+        CHECK(level.width == expected.width && level.height == expected.height && level.channels == channels);
+        CHECK(level.pixels.size() == expected.pixels.size());
+
+        int maxError = 0;
+        for (size_t i = 0; i < std::min(level.pixels.size(), expected.pixels.size()); ++i)
+            maxError = std::max(maxError, std::abs(int(level.pixels[i]) - int(expected.pixels[i])));
+        CHECK(maxError <= 1);
+    }
+
+    void testDownsampling ()
+    {
+        const int sizes[][2] = { { 1, 1 }, { 2, 1 }, { 1, 7 }, { 5, 3 }, { 16, 16 }, { 37, 23 }, { 64, 9 } };
+        unsigned seed = 1;
+        for (const int* size : sizes)
+            for (int channels = 1; channels <= 2; ++channels)
+            {
+                checkAgainstReference(size[0], size[1], channels, MipFilterBox, seed++);
+                checkAgainstReference(size[0], size[1], channels, MipFilterKaiser, seed++);
+            }
+    }
+
+    void testChain ()
+    {
+        CHECK(mipLevelCount(1, 1) == 1);
+        CHECK(mipLevelCount(8, 2) == 4);
+        CHECK(mipLevelCount(640, 480) == 10);
+
+        // A constant image stays constant with both kernels, down to 1x1.
+        const int width = 80, height = 60;
+        const std::vector<uint8_t> pixels (width * height * 2, 173);
+        for (MipFilter filter : { MipFilterBox, MipFilterKaiser })
+        {
+            const std::vector<MipLevel> levels = buildMipChain(pixels.data(), width, height, width * 2, 2, filter);
+            CHECK(int(levels.size()) == mipLevelCount(width, height) - 1);
+            CHECK(levels.back().width == 1 && levels.back().height == 1);
+            for (const MipLevel& level : levels)
+                for (uint8_t pixel : level.pixels)
+                    CHECK(std::abs(int(pixel) - 173) <= 1);
+        }
+
+        // A cancelled chain stops before its first level.
+        const std::atomic<bool> cancelled { true };
+        CHECK(buildMipChain(pixels.data(), width, height, width * 2, 2, MipFilterBox, &cancelled).empty());
+    }
+
+} // Anonymous
+
+int main ()
+{
+    testDownsampling();
+    testChain();
+    return testResult("TextureMipChainTests");
+}